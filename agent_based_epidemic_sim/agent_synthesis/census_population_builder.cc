@@ -0,0 +1,294 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/census_population_builder.h"
+
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/random/bit_gen_ref.h"
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/core/uuid_generator.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/util/records.h"
+
+namespace abesim {
+namespace {
+
+bool InRegions(const Household& household, const UsCensusLocator& regions) {
+  if (regions.geoid().empty()) return true;
+  return std::any_of(regions.geoid().begin(), regions.geoid().end(),
+                     [&household](const std::string& geoid) {
+                       return absl::StartsWith(household.census_geoid(),
+                                               geoid);
+                     });
+}
+
+bool IsStudent(const Person& person, const CensusPopulationOptions& options) {
+  if (person.age() > options.max_school_age) return false;
+  // SCH is 2 or 3 for people enrolled in public or private school.
+  if (!person.pums_sch().empty()) {
+    return person.pums_sch() == "2" || person.pums_sch() == "3";
+  }
+  return person.age() >= options.min_school_age;
+}
+
+bool IsWorker(const Person& person, const CensusPopulationOptions& options) {
+  // WKHP is the usual hours worked per week.
+  int hours;
+  if (absl::SimpleAtoi(person.pums_wkhp(), &hours)) return hours > 0;
+  return person.age() >= options.min_work_age &&
+         person.age() <= options.max_work_age;
+}
+
+// The households of one run of a geoid in a household file, and the records
+// built from them.  Runs are built in parallel and written in the order they
+// were read.
+struct GeoidRun {
+  int file;
+  std::vector<Household> households;
+  std::vector<AgentProto> agents;
+  std::vector<LocationProto> locations;
+  // Marks the end of file instead of a run of households.
+  bool end_of_file = false;
+  // Guarded by the mutex of BuildCensusPopulation.
+  bool built = false;
+};
+
+// Builds the agents and locations of the people of one geoid.
+class GeoidBuilder {
+ public:
+  GeoidBuilder(const CensusPopulationOptions& options,
+               const UuidGenerator& uuid_generator, GeoidRun* run)
+      : options_(options), uuid_generator_(uuid_generator), run_(*run) {}
+
+  // Builds the homes of the households of the run, and then their people once
+  // they are assigned to schools and workplaces.
+  void Build() {
+    for (const Household& household : run_.households) {
+      const int64 home_uuid = uuid_generator_.GenerateUuid();
+      AddLocation(home_uuid, LocationReference::HOUSEHOLD,
+                  household.person_size());
+      for (const Person& person : household.person()) {
+        AgentProto& agent = run_.agents.emplace_back();
+        agent.set_uuid(uuid_generator_.GenerateUuid());
+        agent.set_population_profile_id(options_.population_profile_id);
+        agent.set_initial_health_state(HealthState::SUSCEPTIBLE);
+        LocationReference* home = agent.add_locations();
+        home->set_uuid(home_uuid);
+        home->set_type(LocationReference::HOUSEHOLD);
+        if (IsStudent(person, options_)) {
+          students_.push_back(run_.agents.size() - 1);
+        } else if (IsWorker(person, options_)) {
+          workers_.push_back(run_.agents.size() - 1);
+        }
+      }
+    }
+    absl::BitGenRef gen = GetBitGen();
+    std::shuffle(students_.begin(), students_.end(), gen);
+    std::shuffle(workers_.begin(), workers_.end(), gen);
+    const int num_schools =
+        (students_.size() + options_.school_size - 1) / options_.school_size;
+    for (int school = 0, assigned = 0; school < num_schools; ++school) {
+      // Schools are as even in size as possible.
+      const int size =
+          (students_.size() - assigned) / (num_schools - school);
+      Assign(absl::MakeConstSpan(students_).subspan(assigned, size));
+      assigned += size;
+    }
+    for (int assigned = 0; assigned < workers_.size();) {
+      const int size = std::min<int>(
+          1 + absl::Poisson<int>(gen, options_.mean_workplace_size - 1),
+          workers_.size() - assigned);
+      Assign(absl::MakeConstSpan(workers_).subspan(assigned, size));
+      assigned += size;
+    }
+  }
+
+ private:
+  void AddLocation(const int64 uuid, const LocationReference::Type type,
+                   const int size) {
+    LocationProto& location = run_.locations.emplace_back();
+    location.mutable_reference()->set_uuid(uuid);
+    location.mutable_reference()->set_type(type);
+    location.mutable_dense()->set_size(size);
+  }
+
+  // Assigns the given agents to a new BUSINESS location.
+  void Assign(absl::Span<const int> members) {
+    const int64 uuid = uuid_generator_.GenerateUuid();
+    for (const int member : members) {
+      LocationReference* location = run_.agents[member].add_locations();
+      location->set_uuid(uuid);
+      location->set_type(LocationReference::BUSINESS);
+    }
+    AddLocation(uuid, LocationReference::BUSINESS, members.size());
+  }
+
+  const CensusPopulationOptions& options_;
+  const UuidGenerator& uuid_generator_;
+  GeoidRun& run_;
+  // Indices into run_.agents.
+  std::vector<int> students_;
+  std::vector<int> workers_;
+};
+
+// The shards of one household file, open while its runs are written.
+struct FileShards {
+  riegeli::RecordWriter<RiegeliBytesSink> agent_writer;
+  riegeli::RecordWriter<RiegeliBytesSink> location_writer;
+  int64 num_agents = 0;
+};
+
+absl::Status ValidateOptions(const CensusPopulationOptions& options) {
+  if (options.assignment_geoid_length <= 0) {
+    return absl::InvalidArgumentError("assignment_geoid_length must be > 0.");
+  }
+  if (options.school_size <= 0 || options.mean_workplace_size <= 0) {
+    return absl::InvalidArgumentError(
+        "School and workplace sizes must be > 0.");
+  }
+  if (options.num_workers <= 0) {
+    return absl::InvalidArgumentError("num_workers must be > 0.");
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+absl::StatusOr<CensusPopulation> BuildCensusPopulation(
+    const absl::Span<const std::string> household_files,
+    const absl::string_view output_prefix,
+    const CensusPopulationOptions& options) {
+  if (absl::Status status = ValidateOptions(options); !status.ok()) {
+    return status;
+  }
+  CensusPopulation population;
+  for (int i = 0; i < household_files.size(); ++i) {
+    population.agent_files.push_back(absl::StrFormat(
+        "%s-agents-%05d-of-%05d", output_prefix, i, household_files.size()));
+    population.location_files.push_back(absl::StrFormat(
+        "%s-locations-%05d-of-%05d", output_prefix, i, household_files.size()));
+  }
+
+  // Runs are read and written by this thread and built by the executor.  At
+  // most max_pending runs are held at a time, which bounds memory however
+  // large the household files are.
+  const int max_pending = 2 * options.num_workers;
+  const ShardedGlobalIdUuidGenerator uuid_generator(options.uuid_shard);
+  absl::Mutex mu;
+  std::deque<std::unique_ptr<GeoidRun>> pending;
+  std::vector<std::unique_ptr<FileShards>> shards(household_files.size());
+  absl::Status status;
+  // Writes the built runs at the front of pending, waiting for runs to be
+  // built until at most max_runs are left.
+  auto write_runs = [&](const int max_runs) {
+    while (!pending.empty()) {
+      GeoidRun& run = *pending.front();
+      {
+        absl::MutexLock l(&mu);
+        if (!run.built && pending.size() <= max_runs) return;
+        mu.Await(absl::Condition(&run.built));
+      }
+      FileShards& file = *shards[run.file];
+      if (run.end_of_file) {
+        file.agent_writer.Close();
+        file.location_writer.Close();
+        if (status.ok()) status = file.agent_writer.status();
+        if (status.ok()) status = file.location_writer.status();
+        LOG(INFO) << "Built " << file.num_agents << " agents from "
+                  << household_files[run.file];
+        shards[run.file] = nullptr;
+      } else {
+        // A writer that fails keeps failing, which Close reports.
+        for (const AgentProto& agent : run.agents) {
+          file.agent_writer.WriteRecord(agent);
+        }
+        for (const LocationProto& location : run.locations) {
+          file.location_writer.WriteRecord(location);
+        }
+        file.num_agents += run.agents.size();
+        population.num_agents += run.agents.size();
+        population.num_locations += run.locations.size();
+      }
+      pending.pop_front();
+    }
+  };
+  auto executor = NewExecutor(options.num_workers);
+  auto exec = executor->NewExecution();
+  // Queues the households read so far to be built as one run.
+  auto add_run = [&](const int file, std::vector<Household>* households) {
+    write_runs(max_pending - 1);
+    pending.push_back(absl::WrapUnique(
+        new GeoidRun{.file = file, .households = std::move(*households)}));
+    GeoidRun* const run = pending.back().get();
+    households->clear();
+    exec->Add([run, &options, &uuid_generator, &mu]() {
+      GeoidBuilder(options, uuid_generator, run).Build();
+      run->households = {};
+      absl::MutexLock l(&mu);
+      run->built = true;
+    });
+  };
+  for (int i = 0; i < household_files.size(); ++i) {
+    shards[i] = absl::WrapUnique(new FileShards{
+        .agent_writer = MakeRecordWriter(population.agent_files[i],
+                                         /*parallelism=*/0),
+        .location_writer = MakeRecordWriter(population.location_files[i],
+                                            /*parallelism=*/0)});
+    auto reader = MakeRecordReader(household_files[i]);
+    // The households of the geoid being read.
+    std::vector<Household> households;
+    Household household;
+    while (reader.ReadRecord(household)) {
+      if (!InRegions(household, options.regions)) continue;
+      if (!households.empty() &&
+          absl::string_view(households[0].census_geoid())
+                  .substr(0, options.assignment_geoid_length) !=
+              absl::string_view(household.census_geoid())
+                  .substr(0, options.assignment_geoid_length)) {
+        add_run(i, &households);
+      }
+      households.push_back(std::move(household));
+    }
+    if (!households.empty()) add_run(i, &households);
+    reader.Close();
+    if (status.ok()) status = reader.status();
+    write_runs(max_pending - 1);
+    pending.push_back(absl::WrapUnique(
+        new GeoidRun{.file = i, .end_of_file = true, .built = true}));
+  }
+  write_runs(0);
+  exec->Wait();
+  if (!status.ok()) return status;
+  return population;
+}
+
+}  // namespace abesim
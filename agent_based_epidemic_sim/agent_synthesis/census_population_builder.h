@@ -0,0 +1,84 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_CENSUS_POPULATION_BUILDER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_CENSUS_POPULATION_BUILDER_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population.pb.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+struct CensusPopulationOptions {
+  // Only households in these regions are kept.  All households are kept if
+  // there are none.
+  UsCensusLocator regions;
+  // Workplaces and schools are formed from the people of each geoid at this
+  // level of the census geography, 11 being tracts.
+  int assignment_geoid_length = 11;
+  int64 population_profile_id = 0;
+  // The high bits of every uuid, as for ShardedGlobalIdUuidGenerator.
+  int16 uuid_shard = 0;
+  // People whose PUMS school enrollment is unknown attend school at these
+  // ages, and people whose hours worked are unknown work at these ages.
+  int min_school_age = 5;
+  int max_school_age = 18;
+  int min_work_age = 19;
+  int max_work_age = 64;
+  // Schools are of equal size, workplace sizes are drawn from a Poisson
+  // distribution with this mean.
+  int school_size = 500;
+  int mean_workplace_size = 20;
+  int num_workers = 1;
+};
+
+// The shards written by BuildCensusPopulation, in the order of the household
+// files they were built from.
+struct CensusPopulation {
+  std::vector<std::string> agent_files;
+  std::vector<std::string> location_files;
+  int64 num_agents = 0;
+  int64 num_locations = 0;
+};
+
+// Builds the AgentProto and LocationProto records of the people in the
+// Household records of household_files.  Every household becomes a
+// HOUSEHOLD location, while students and workers are assigned to schools and
+// workplaces, both BUSINESS locations, formed among the people of their
+// geoid.  Students are people enrolled in school according to PUMS, or of
+// school age when that is unknown, and workers are those that usually work
+// some hours a week according to PUMS, or are of working age when that is
+// unknown.
+//
+// Each household file is built into its own agent and location shard, named
+// after output_prefix.  Households should be grouped by geoid within a file:
+// the people of a geoid that appears in several runs of a file are assigned
+// separately within each run.  Runs are built in parallel on num_workers
+// threads, even within a single file, and written in the order they were read.
+// At most 2 * num_workers runs are held in memory at a time.
+absl::StatusOr<CensusPopulation> BuildCensusPopulation(
+    absl::Span<const std::string> household_files,
+    absl::string_view output_prefix, const CensusPopulationOptions& options);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_CENSUS_POPULATION_BUILDER_H_
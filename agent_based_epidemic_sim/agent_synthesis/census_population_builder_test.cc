@@ -0,0 +1,174 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/census_population_builder.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population.pb.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/util/records.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+// Writes runs of households, each of a geoid and a number of households.
+std::string WriteHouseholds(
+    const std::string& name,
+    const std::vector<std::pair<std::string, int>>& runs) {
+  const std::string filename = absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+  auto writer = MakeRecordWriter(filename, /*parallelism=*/0);
+  for (const auto& [geoid, num_households] : runs) {
+    // Each household has a worker, a student, and a retiree.
+    const Household household = ParseTextProtoOrDie<Household>(
+        absl::StrCat(R"(census_geoid: ")", geoid, R"(")", R"(
+          person { age: 40 pums_wkhp: "40" }
+          person { age: 10 pums_sch: "2" }
+          person { age: 70 pums_wkhp: "0" }
+        )"));
+    for (int i = 0; i < num_households; ++i) {
+      writer.WriteRecord(household);
+    }
+  }
+  EXPECT_TRUE(writer.Close()) << writer.status();
+  return filename;
+}
+
+std::string WriteHouseholds(const std::string& name, const std::string& geoid,
+                            const int num_households) {
+  return WriteHouseholds(name, {{geoid, num_households}});
+}
+
+std::vector<AgentProto> ReadAgents(const std::vector<std::string>& files) {
+  std::vector<AgentProto> agents;
+  for (const std::string& file : files) {
+    auto reader = MakeRecordReader(file);
+    AgentProto agent;
+    while (reader.ReadRecord(agent)) agents.push_back(agent);
+    reader.Close();
+  }
+  return agents;
+}
+
+TEST(CensusPopulationBuilderTest, BuildsPopulation) {
+  const std::vector<std::string> household_files = {
+      WriteHouseholds("households-a", "110010001001", 300),
+      WriteHouseholds("households-b", "240310001001", 200),
+      WriteHouseholds("households-c", "360610001001", 100)};
+  CensusPopulationOptions options;
+  options.regions = ParseTextProtoOrDie<UsCensusLocator>(R"(
+    geoid: "11001" geoid: "24031"
+  )");
+  options.school_size = 120;
+  options.num_workers = 2;
+  auto population = BuildCensusPopulation(
+      household_files, absl::StrCat(getenv("TEST_TMPDIR"), "/", "population"),
+      options);
+  PANDEMIC_ASSERT_OK(population);
+  EXPECT_EQ(population->agent_files.size(), 3);
+  EXPECT_EQ(population->location_files.size(), 3);
+  EXPECT_EQ(population->num_agents, 1500);
+
+  const std::vector<AgentProto> agents = ReadAgents(population->agent_files);
+  ASSERT_EQ(agents.size(), 1500);
+  absl::flat_hash_set<int64> uuids;
+  int num_with_business = 0;
+  for (const AgentProto& agent : agents) {
+    EXPECT_TRUE(uuids.insert(agent.uuid()).second);
+    ASSERT_GE(agent.locations_size(), 1);
+    EXPECT_EQ(agent.locations(0).type(), LocationReference::HOUSEHOLD);
+    if (agent.locations_size() > 1) {
+      EXPECT_EQ(agent.locations(1).type(), LocationReference::BUSINESS);
+      ++num_with_business;
+    }
+  }
+  // Everyone but the retirees goes to school or work.
+  EXPECT_EQ(num_with_business, 1000);
+
+  absl::flat_hash_map<LocationReference::Type, int> num_locations;
+  int64 total_size = 0;
+  for (const std::string& file : population->location_files) {
+    auto reader = MakeRecordReader(file);
+    LocationProto location;
+    while (reader.ReadRecord(location)) {
+      EXPECT_TRUE(uuids.insert(location.reference().uuid()).second);
+      ++num_locations[location.reference().type()];
+      total_size += location.dense().size();
+    }
+    reader.Close();
+  }
+  EXPECT_EQ(num_locations[LocationReference::HOUSEHOLD], 500);
+  // 300 and 200 students fill 3 and 2 schools.
+  EXPECT_GT(num_locations[LocationReference::BUSINESS], 5);
+  EXPECT_EQ(population->num_locations,
+            num_locations[LocationReference::HOUSEHOLD] +
+                num_locations[LocationReference::BUSINESS]);
+  EXPECT_EQ(total_size, 2500);
+}
+
+TEST(CensusPopulationBuilderTest, WritesGeoidsOfAFileInOrder) {
+  const std::vector<std::string> household_files = {WriteHouseholds(
+      "households-geoids", {{"110010001001", 30},
+                            {"110010002001", 20},
+                            {"110010003001", 10},
+                            {"110010004001", 40}})};
+  CensusPopulationOptions options;
+  options.num_workers = 4;
+  auto population = BuildCensusPopulation(
+      household_files,
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "population-geoids"), options);
+  PANDEMIC_ASSERT_OK(population);
+  EXPECT_EQ(population->num_agents, 300);
+
+  // The homes of the agents come in the order of the households, however the
+  // geoids were scheduled.
+  std::vector<int64> homes;
+  for (const AgentProto& agent : ReadAgents(population->agent_files)) {
+    if (homes.empty() || homes.back() != agent.locations(0).uuid()) {
+      homes.push_back(agent.locations(0).uuid());
+    }
+  }
+  std::vector<int64> households;
+  auto reader = MakeRecordReader(population->location_files[0]);
+  LocationProto location;
+  while (reader.ReadRecord(location)) {
+    if (location.reference().type() == LocationReference::HOUSEHOLD) {
+      households.push_back(location.reference().uuid());
+    }
+  }
+  reader.Close();
+  EXPECT_EQ(households.size(), 100);
+  EXPECT_EQ(homes, households);
+}
+
+TEST(CensusPopulationBuilderTest, RejectsInvalidOptions) {
+  CensusPopulationOptions options;
+  options.school_size = 0;
+  EXPECT_FALSE(BuildCensusPopulation({}, "population", options).ok());
+  options = CensusPopulationOptions();
+  options.num_workers = 0;
+  EXPECT_FALSE(BuildCensusPopulation({}, "population", options).ok());
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,129 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/location_decoder.h"
+
+#include <string>
+
+#include "google/protobuf/io/coded_stream.h"
+#include "google/protobuf/wire_format_lite.h"
+
+namespace abesim {
+namespace {
+
+using google::protobuf::io::CodedInputStream;
+using google::protobuf::internal::WireFormatLite;
+
+constexpr uint32 Tag(const int field, const WireFormatLite::WireType type) {
+  return (static_cast<uint32>(field) << 3) | type;
+}
+
+constexpr uint32 kGraphTag = Tag(LocationProto::kGraphFieldNumber,
+                                 WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+constexpr uint32 kEdgesTag = Tag(GraphLocation::kEdgesFieldNumber,
+                                 WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+constexpr uint32 kTypeTag =
+    Tag(GraphLocation::kTypeFieldNumber, WireFormatLite::WIRETYPE_VARINT);
+constexpr uint32 kUuidATag = Tag(GraphLocation::Edge::kUuidAFieldNumber,
+                                 WireFormatLite::WIRETYPE_VARINT);
+constexpr uint32 kUuidBTag = Tag(GraphLocation::Edge::kUuidBFieldNumber,
+                                 WireFormatLite::WIRETYPE_VARINT);
+
+// Calls decode_field(tag) for each field of the length delimited message at
+// the current position of input.
+template <typename DecodeField>
+bool DecodeSubmessage(CodedInputStream* const input, DecodeField decode_field) {
+  uint32 length;
+  if (!input->ReadVarint32(&length)) return false;
+  const CodedInputStream::Limit limit = input->PushLimit(length);
+  while (const uint32 tag = input->ReadTag()) {
+    if (!decode_field(tag)) return false;
+  }
+  if (!input->ConsumedEntireMessage()) return false;
+  input->PopLimit(limit);
+  return true;
+}
+
+bool DecodeEdge(CodedInputStream* const input,
+                std::pair<int64, int64>* const edge) {
+  return DecodeSubmessage(input, [input, edge](const uint32 tag) {
+    uint64 value;
+    switch (tag) {
+      case kUuidATag:
+        if (!input->ReadVarint64(&value)) return false;
+        edge->first = static_cast<int64>(value);
+        return true;
+      case kUuidBTag:
+        if (!input->ReadVarint64(&value)) return false;
+        edge->second = static_cast<int64>(value);
+        return true;
+      default:
+        return WireFormatLite::SkipField(input, tag);
+    }
+  });
+}
+
+bool DecodeGraph(CodedInputStream* const input, GraphLocation* const graph,
+                 EdgeList* const edges) {
+  return DecodeSubmessage(input, [input, graph, edges](const uint32 tag) {
+    switch (tag) {
+      case kEdgesTag:
+        edges->emplace_back(0, 0);
+        return DecodeEdge(input, &edges->back());
+      case kTypeTag: {
+        uint32 type;
+        if (!input->ReadVarint32(&type)) return false;
+        graph->set_type(static_cast<GraphLocation::Type>(type));
+        return true;
+      }
+      default:
+        return WireFormatLite::SkipField(input, tag);
+    }
+  });
+}
+
+}  // namespace
+
+bool DecodeLocationProto(const absl::string_view serialized,
+                         LocationProto* const proto,
+                         EdgeList* const edges) {
+  proto->Clear();
+  edges->clear();
+  CodedInputStream input(reinterpret_cast<const uint8*>(serialized.data()),
+                         serialized.size());
+  // Everything other than the graph is small, so it is collected and parsed
+  // normally.
+  thread_local std::string rest;
+  rest.clear();
+  bool has_graph = false;
+  GraphLocation graph;
+  while (true) {
+    const int start = input.CurrentPosition();
+    const uint32 tag = input.ReadTag();
+    if (tag == 0) break;
+    if (tag == kGraphTag) {
+      if (!DecodeGraph(&input, &graph, edges)) return false;
+      has_graph = true;
+      continue;
+    }
+    if (!WireFormatLite::SkipField(&input, tag)) return false;
+    rest.append(serialized.data() + start, input.CurrentPosition() - start);
+  }
+  if (!input.ConsumedEntireMessage()) return false;
+  if (!proto->ParseFromString(rest)) return false;
+  if (has_graph) *proto->mutable_graph() = graph;
+  return true;
+}
+
+}  // namespace abesim
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_LOCATION_DECODER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_LOCATION_DECODER_H_
+
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/core/graph_location.h"
+
+namespace abesim {
+
+// Decodes a serialized LocationProto into proto, reusing its storage.  The
+// edges of a graph location are decoded straight from the wire into edges as
+// (uuid_a, uuid_b) pairs instead of being materialized as GraphLocation::Edge
+// messages, so proto->graph() only carries the graph type.  Graph locations
+// can have millions of edges, so this avoids allocating a message per edge
+// and then copying them out again, and edges can be moved straight into
+// NewGraphLocation.
+//
+// Returns false if serialized is not a valid LocationProto.
+bool DecodeLocationProto(absl::string_view serialized, LocationProto* proto,
+                         EdgeList* edges);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_LOCATION_DECODER_H_
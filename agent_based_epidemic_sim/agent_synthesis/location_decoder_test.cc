@@ -0,0 +1,87 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/location_decoder.h"
+
+#include <string>
+
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+using testing::IsEmpty;
+using testing::Pair;
+
+TEST(LocationDecoderTest, DecodesGraphEdgesDirectly) {
+  const std::string serialized =
+      ParseTextProtoOrDie<LocationProto>(R"(
+        reference { uuid: 7 type: BUSINESS }
+        graph {
+          edges { uuid_a: 1 uuid_b: 2 }
+          edges { uuid_a: -3 }
+          type: OCCUPATION_WORK
+          edges { uuid_b: 1000000000000 uuid_a: 4 }
+        }
+      )")
+          .SerializeAsString();
+  LocationProto proto;
+  EdgeList edges = {{9, 9}};
+  ASSERT_TRUE(DecodeLocationProto(serialized, &proto, &edges));
+  EXPECT_EQ(proto.reference().uuid(), 7);
+  EXPECT_EQ(proto.reference().type(), LocationReference::BUSINESS);
+  ASSERT_EQ(proto.location_case(), LocationProto::kGraph);
+  EXPECT_EQ(proto.graph().type(), GraphLocation::OCCUPATION_WORK);
+  EXPECT_EQ(proto.graph().edges_size(), 0);
+  EXPECT_THAT(edges, ElementsAre(Pair(1, 2), Pair(-3, 0),
+                                 Pair(4, 1000000000000)));
+}
+
+TEST(LocationDecoderTest, DecodesOtherLocations) {
+  const LocationProto expected = ParseTextProtoOrDie<LocationProto>(R"(
+    reference { uuid: 8 type: RANDOM }
+    random {}
+  )");
+  // Reuse the output from a graph location to check that it is reset.
+  LocationProto proto = ParseTextProtoOrDie<LocationProto>(R"(
+    reference { uuid: 7 type: BUSINESS }
+    graph { type: OCCUPATION_WORK }
+  )");
+  EdgeList edges = {{1, 2}};
+  ASSERT_TRUE(
+      DecodeLocationProto(expected.SerializeAsString(), &proto, &edges));
+  EXPECT_EQ(proto.SerializeAsString(), expected.SerializeAsString());
+  EXPECT_THAT(edges, IsEmpty());
+}
+
+TEST(LocationDecoderTest, RejectsTruncatedRecords) {
+  const std::string serialized =
+      ParseTextProtoOrDie<LocationProto>(R"(
+        reference { uuid: 7 type: BUSINESS }
+        graph { edges { uuid_a: 1 uuid_b: 2 } }
+      )")
+          .SerializeAsString();
+  LocationProto proto;
+  EdgeList edges;
+  EXPECT_FALSE(DecodeLocationProto(
+      absl::string_view(serialized).substr(0, serialized.size() - 1), &proto,
+      &edges));
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,187 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/occupation_network_builder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <utility>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/random/distributions.h"
+#include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+float MeanWorkInteractions(const NetworkProperties& properties,
+                           const GraphLocation::Type type) {
+  switch (type) {
+    case GraphLocation::OCCUPATION_PRIMARY:
+    case GraphLocation::OCCUPATION_SECONDARY:
+      return properties.mean_work_interactions_child();
+    case GraphLocation::OCCUPATION_RETIRED:
+    case GraphLocation::OCCUPATION_ELDERLY:
+      return properties.mean_work_interactions_elderly();
+    default:
+      return properties.mean_work_interactions_adult();
+  }
+}
+
+// Returns the fraction of an adult per agent in networks of the given type.
+float NetworkAdultsPerAgent(const NetworkProperties& properties,
+                            const GraphLocation::Type type) {
+  switch (type) {
+    case GraphLocation::OCCUPATION_PRIMARY:
+    case GraphLocation::OCCUPATION_SECONDARY:
+      return properties.child_network_adults();
+    case GraphLocation::OCCUPATION_RETIRED:
+    case GraphLocation::OCCUPATION_ELDERLY:
+      return properties.elderly_network_adults();
+    default:
+      return 0;
+  }
+}
+
+// Appends the edges of a Watts-Strogatz graph of degree k over agents, whose
+// edges are rewired with probability p, to the empty edges.  This is the
+// graph of SmallWorldGraph::GenerateWattsStrogatzGraph, built in place: the
+// ring lattice edge of node u to its d-th neighbour on the right stays at
+// index u * k / 2 + d - 1 of edges, where rewiring replaces it, so only the
+// rewired edges are kept aside to look up which nodes are connected.
+void AddWattsStrogatzEdges(const absl::Span<const int64> agents, const int k,
+                           const float p,
+                           std::vector<std::pair<int64, int64>>* const edges) {
+  DCHECK(edges->empty());
+  const int n = agents.size();
+  const int half = k / 2;
+  edges->reserve(int64{n} * half);
+  for (int u = 0; u < n; ++u) {
+    for (int d = 1; d <= half; ++d) {
+      edges->emplace_back(agents[u], agents[(u + d) % n]);
+    }
+  }
+  std::vector<bool> rewired(edges->size());
+  // The rewired edges as (smaller, larger) node pairs.
+  absl::flat_hash_set<std::pair<int, int>> rewired_edges;
+  std::vector<int> degrees(n, k);
+  auto has_edge = [n, half, &rewired, &rewired_edges](const int u,
+                                                       const int w) {
+    const int d = (w - u + n) % n;
+    if (d <= half && !rewired[int64{u} * half + d - 1]) return true;
+    if (n - d <= half && !rewired[int64{w} * half + n - d - 1]) return true;
+    return rewired_edges.contains(std::minmax(u, w));
+  };
+  absl::BitGenRef gen = GetBitGen();
+  for (int u = 0; u < n; ++u) {
+    if (degrees[u] >= n - 1) continue;
+    for (int d = 1; d <= half; ++d) {
+      if (!absl::Bernoulli(gen, p)) continue;
+      int w = u;
+      while (w == u || has_edge(u, w)) {
+        w = absl::Uniform<int>(absl::IntervalClosedClosed, gen, 0, n - 1);
+      }
+      const int64 e = int64{u} * half + d - 1;
+      rewired[e] = true;
+      rewired_edges.insert(std::minmax(u, w));
+      --degrees[(u + d) % n];
+      ++degrees[w];
+      (*edges)[e] = {agents[u], agents[w]};
+    }
+  }
+}
+
+void BuildNetwork(const NetworkProperties& properties,
+                  const OccupationWorkplace& workplace,
+                  OccupationNetwork* network) {
+  network->uuid = workplace.uuid;
+  network->type = workplace.type;
+  const std::vector<int64>& members = workplace.agent_uuids;
+  const int num_adults = OccupationNetworkAdults(properties, workplace);
+  // Adult a is placed before member a * members / num_adults, so that adults
+  // are evenly spaced around the ring lattice.
+  std::vector<int64> agents;
+  agents.reserve(members.size() + num_adults);
+  int a = 0;
+  for (int i = 0; i < members.size(); ++i) {
+    while (a < num_adults &&
+           int64{a} * members.size() <= int64{i} * num_adults) {
+      agents.push_back(workplace.adult_uuids[a++]);
+    }
+    agents.push_back(members[i]);
+  }
+  while (a < num_adults) agents.push_back(workplace.adult_uuids[a++]);
+  const int n = agents.size();
+  const int k = OccupationNetworkDegree(properties, workplace.type, n);
+  if (k <= 0) return;
+  if (k >= n - 1) {
+    network->edges.reserve(n * (n - 1) / 2);
+    for (int i = 0; i < n; ++i) {
+      for (int j = i + 1; j < n; ++j) {
+        network->edges.emplace_back(agents[i], agents[j]);
+      }
+    }
+    return;
+  }
+  AddWattsStrogatzEdges(agents, k, properties.work_network_rewire(),
+                        &network->edges);
+}
+
+}  // namespace
+
+int OccupationNetworkDegree(const NetworkProperties& properties,
+                            const GraphLocation::Type type, const int size) {
+  float degree = MeanWorkInteractions(properties, type);
+  if (properties.daily_fraction_work() > 0) {
+    degree /= properties.daily_fraction_work();
+  }
+  const int even_degree = 2 * std::lround(degree / 2);
+  return std::min(even_degree, std::max(size - 1, 0));
+}
+
+int OccupationNetworkAdults(const NetworkProperties& properties,
+                            const OccupationWorkplace& workplace) {
+  const float per_agent = NetworkAdultsPerAgent(properties, workplace.type);
+  if (per_agent <= 0) return 0;
+  const int64 wanted = std::lround(per_agent * workplace.agent_uuids.size());
+  return std::min<int64>(wanted, workplace.adult_uuids.size());
+}
+
+std::vector<OccupationNetwork> BuildOccupationNetworks(
+    const NetworkProperties& properties,
+    const absl::Span<const OccupationWorkplace> workplaces,
+    const int num_workers) {
+  CHECK_GT(num_workers, 0);
+  std::vector<OccupationNetwork> networks(workplaces.size());
+  // Workers take the next workplace as they finish one, as network sizes
+  // vary widely.
+  std::atomic<int64> next = 0;
+  auto executor = NewExecutor(num_workers);
+  auto exec = executor->NewExecution();
+  for (int i = 0; i < num_workers; ++i) {
+    exec->Add([&properties, workplaces, &networks, &next]() {
+      for (int64 w = next++; w < workplaces.size(); w = next++) {
+        BuildNetwork(properties, workplaces[w], &networks[w]);
+      }
+    });
+  }
+  exec->Wait();
+  return networks;
+}
+
+}  // namespace abesim
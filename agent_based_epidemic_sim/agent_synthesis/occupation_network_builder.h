@@ -0,0 +1,76 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_OCCUPATION_NETWORK_BUILDER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_OCCUPATION_NETWORK_BUILDER_H_
+
+#include <utility>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// A workplace, school, or community center whose contact network is built.
+struct OccupationWorkplace {
+  int64 uuid;
+  GraphLocation::Type type;
+  std::vector<int64> agent_uuids;
+  // Adults, such as teachers or carers, that may join the network of a
+  // workplace of children or the elderly.  Networks take the first of them,
+  // child_network_adults (elderly_network_adults) per agent of agent_uuids,
+  // and ignore the rest.
+  std::vector<int64> adult_uuids;
+};
+
+// The contact network of a workplace.  Edges are (uuid_a, uuid_b) pairs of
+// agents, as taken by NewGraphLocation.
+struct OccupationNetwork {
+  int64 uuid;
+  GraphLocation::Type type;
+  std::vector<std::pair<int64, int64>> edges;
+};
+
+// Returns the degree of the Watts-Strogatz network of a workplace of the
+// given type and size.  An agent interacts daily with a daily_fraction_work
+// of its network, so the degree is chosen for that to give the mean daily
+// interactions of the age group working there: children for
+// OCCUPATION_PRIMARY and OCCUPATION_SECONDARY, the elderly for
+// OCCUPATION_RETIRED and OCCUPATION_ELDERLY, and adults otherwise.  The degree
+// is even, as only even degrees are realized, and at most size - 1, in which
+// case the network is complete.
+int OccupationNetworkDegree(const NetworkProperties& properties,
+                            GraphLocation::Type type, int size);
+
+// Returns the number of adult_uuids that join the network of workplace.
+int OccupationNetworkAdults(const NetworkProperties& properties,
+                            const OccupationWorkplace& workplace);
+
+// Builds the contact network of each workplace, in the same order, as a
+// Watts-Strogatz graph with OccupationNetworkDegree and a rewire probability
+// of work_network_rewire.  The graph is built over agent_uuids and the
+// OccupationNetworkAdults, which are spread evenly among them so that each
+// adult is connected mostly to the children or elderly it looks after.
+// Networks are built in parallel on num_workers threads.
+std::vector<OccupationNetwork> BuildOccupationNetworks(
+    const NetworkProperties& properties,
+    absl::Span<const OccupationWorkplace> workplaces, int num_workers);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_AGENT_SYNTHESIS_OCCUPATION_NETWORK_BUILDER_H_
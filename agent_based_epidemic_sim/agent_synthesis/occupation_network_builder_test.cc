@@ -0,0 +1,189 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/agent_synthesis/occupation_network_builder.h"
+
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::Pair;
+using testing::UnorderedElementsAre;
+
+NetworkProperties TestProperties() {
+  return ParseTextProtoOrDie<NetworkProperties>(R"(
+    mean_work_interactions_child: 2
+    mean_work_interactions_adult: 1
+    mean_work_interactions_elderly: 0.5
+    work_network_rewire: 0.1
+    daily_fraction_work: 0.25
+  )");
+}
+
+TEST(OccupationNetworkBuilderTest, ChoosesDegree) {
+  const NetworkProperties properties = TestProperties();
+  EXPECT_EQ(
+      OccupationNetworkDegree(properties, GraphLocation::OCCUPATION_WORK, 100),
+      4);
+  EXPECT_EQ(OccupationNetworkDegree(properties,
+                                    GraphLocation::OCCUPATION_PRIMARY, 100),
+            8);
+  EXPECT_EQ(OccupationNetworkDegree(properties,
+                                    GraphLocation::OCCUPATION_ELDERLY, 100),
+            2);
+  // Small workplaces are complete networks.
+  EXPECT_EQ(
+      OccupationNetworkDegree(properties, GraphLocation::OCCUPATION_WORK, 3),
+      2);
+  EXPECT_EQ(
+      OccupationNetworkDegree(properties, GraphLocation::OCCUPATION_WORK, 1),
+      0);
+}
+
+TEST(OccupationNetworkBuilderTest, BuildsNetworks) {
+  std::vector<OccupationWorkplace> workplaces;
+  int64 next_uuid = 1000;
+  for (int i = 0; i < 200; ++i) {
+    OccupationWorkplace& workplace = workplaces.emplace_back();
+    workplace.uuid = i;
+    workplace.type = i % 2 == 0 ? GraphLocation::OCCUPATION_WORK
+                                : GraphLocation::OCCUPATION_PRIMARY;
+    for (int j = 0; j < 1 + i % 50; ++j) {
+      workplace.agent_uuids.push_back(next_uuid++);
+    }
+  }
+  const NetworkProperties properties = TestProperties();
+  const std::vector<OccupationNetwork> networks =
+      BuildOccupationNetworks(properties, workplaces, /*num_workers=*/4);
+  ASSERT_EQ(networks.size(), workplaces.size());
+  for (int i = 0; i < networks.size(); ++i) {
+    const OccupationWorkplace& workplace = workplaces[i];
+    const OccupationNetwork& network = networks[i];
+    EXPECT_EQ(network.uuid, workplace.uuid);
+    EXPECT_EQ(network.type, workplace.type);
+    const int n = workplace.agent_uuids.size();
+    const int k = OccupationNetworkDegree(properties, workplace.type, n);
+    EXPECT_EQ(network.edges.size(), n * k / 2) << "workplace " << i;
+    const absl::flat_hash_set<int64> members(workplace.agent_uuids.begin(),
+                                             workplace.agent_uuids.end());
+    absl::flat_hash_set<std::pair<int64, int64>> edges;
+    for (auto [a, b] : network.edges) {
+      EXPECT_TRUE(members.contains(a));
+      EXPECT_TRUE(members.contains(b));
+      EXPECT_NE(a, b);
+      if (a > b) std::swap(a, b);
+      EXPECT_TRUE(edges.emplace(a, b).second);
+    }
+  }
+}
+
+TEST(OccupationNetworkBuilderTest, MixesAdultsIntoChildAndElderlyNetworks) {
+  NetworkProperties properties = TestProperties();
+  properties.set_child_network_adults(0.1);
+  properties.set_elderly_network_adults(0.25);
+  std::vector<OccupationWorkplace> workplaces;
+  for (const GraphLocation::Type type :
+       {GraphLocation::OCCUPATION_PRIMARY, GraphLocation::OCCUPATION_ELDERLY,
+        GraphLocation::OCCUPATION_WORK}) {
+    OccupationWorkplace& workplace = workplaces.emplace_back();
+    workplace.uuid = workplaces.size();
+    workplace.type = type;
+    for (int i = 0; i < 40; ++i) workplace.agent_uuids.push_back(1000 + i);
+    workplace.adult_uuids = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  }
+  EXPECT_EQ(OccupationNetworkAdults(properties, workplaces[0]), 4);
+  EXPECT_EQ(OccupationNetworkAdults(properties, workplaces[1]), 10);
+  EXPECT_EQ(OccupationNetworkAdults(properties, workplaces[2]), 0);
+  // There are only so many adults to go around.
+  properties.set_elderly_network_adults(1);
+  EXPECT_EQ(OccupationNetworkAdults(properties, workplaces[1]), 12);
+  properties.set_elderly_network_adults(0.25);
+
+  const std::vector<OccupationNetwork> networks =
+      BuildOccupationNetworks(properties, workplaces, /*num_workers=*/2);
+  ASSERT_EQ(networks.size(), workplaces.size());
+  for (int i = 0; i < networks.size(); ++i) {
+    const int adults = OccupationNetworkAdults(properties, workplaces[i]);
+    const int n = workplaces[i].agent_uuids.size() + adults;
+    const int k = OccupationNetworkDegree(properties, workplaces[i].type, n);
+    EXPECT_EQ(networks[i].edges.size(), n * k / 2) << "workplace " << i;
+    absl::flat_hash_set<int64> connected_adults;
+    for (const auto& [a, b] : networks[i].edges) {
+      if (a < 1000) connected_adults.insert(a);
+      if (b < 1000) connected_adults.insert(b);
+    }
+    // Only the first adults join, and every one of them has contacts.
+    EXPECT_EQ(connected_adults.size(), adults) << "workplace " << i;
+    for (const int64 adult : connected_adults) EXPECT_LE(adult, adults);
+  }
+}
+
+TEST(OccupationNetworkBuilderTest, BuildsCompleteNetworksOfSmallWorkplaces) {
+  const std::vector<OccupationWorkplace> workplaces = {
+      {.uuid = 1,
+       .type = GraphLocation::OCCUPATION_WORK,
+       .agent_uuids = {10, 11, 12}},
+      {.uuid = 2, .type = GraphLocation::OCCUPATION_WORK, .agent_uuids = {20}}};
+  const std::vector<OccupationNetwork> networks =
+      BuildOccupationNetworks(TestProperties(), workplaces, /*num_workers=*/2);
+  ASSERT_EQ(networks.size(), 2);
+  EXPECT_THAT(networks[0].edges,
+              UnorderedElementsAre(Pair(10, 11), Pair(10, 12), Pair(11, 12)));
+  EXPECT_TRUE(networks[1].edges.empty());
+}
+
+TEST(OccupationNetworkBuilderTest, RewiresRingLattice) {
+  NetworkProperties properties = TestProperties();
+  // Workplaces of adults get a degree of 4.
+  std::vector<OccupationWorkplace> workplaces(
+      1, {.uuid = 1, .type = GraphLocation::OCCUPATION_WORK});
+  for (int i = 0; i < 10; ++i) workplaces[0].agent_uuids.push_back(i);
+
+  properties.set_work_network_rewire(0);
+  std::vector<std::pair<int64, int64>> lattice;
+  for (int i = 0; i < 10; ++i) {
+    lattice.emplace_back(i, (i + 1) % 10);
+    lattice.emplace_back(i, (i + 2) % 10);
+  }
+  EXPECT_THAT(
+      BuildOccupationNetworks(properties, workplaces, /*num_workers=*/1)[0]
+          .edges,
+      testing::ElementsAreArray(lattice));
+
+  // Rewired edges keep their place and first node, and add neither self loops
+  // nor duplicates.
+  properties.set_work_network_rewire(1);
+  const std::vector<OccupationNetwork> networks =
+      BuildOccupationNetworks(properties, workplaces, /*num_workers=*/1);
+  ASSERT_EQ(networks[0].edges.size(), lattice.size());
+  absl::flat_hash_set<std::pair<int64, int64>> edges;
+  for (int e = 0; e < lattice.size(); ++e) {
+    auto [a, b] = networks[0].edges[e];
+    EXPECT_EQ(a, lattice[e].first);
+    EXPECT_NE(a, b);
+    if (a > b) std::swap(a, b);
+    EXPECT_TRUE(edges.emplace(a, b).second);
+  }
+}
+
+}  // namespace
+}  // namespace abesim
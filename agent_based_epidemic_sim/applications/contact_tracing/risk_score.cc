@@ -15,6 +15,8 @@
 #include "agent_based_epidemic_sim/core/risk_score.h"
 
 #include <algorithm>
+#include <limits>
+#include <memory>
 
 #include "absl/memory/memory.h"
 #include "absl/status/statusor.h"
@@ -24,6 +26,7 @@
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/location_type.h"
+#include "agent_based_epidemic_sim/core/paged_arena.h"
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
 #include "agent_based_epidemic_sim/port/time_proto_util.h"
 
@@ -36,15 +39,25 @@ struct TracingRiskScoreConfig {
   absl::Duration contact_retention_duration;
   absl::Duration quarantine_duration;
   absl::Duration test_latency;
+  int max_hops;
+  int max_forwarded_reports_per_step;
+  LocationTypeFn location_type;
 };
 
 // A policy that implements testing, tracing, and isolation guidelines.
 class TracingRiskScore : public RiskScore {
  public:
-  TracingRiskScore(LocationTypeFn location_type,
-                   const TracingRiskScoreConfig& tracing_policy)
-      : tracing_policy_(tracing_policy),
-        location_type_(std::move(location_type)),
+  // Creates a risk score that uses a config shared with other risk scores.
+  // tracing_policy must outlive the risk score.
+  explicit TracingRiskScore(const TracingRiskScoreConfig* tracing_policy)
+      : tracing_policy_(*tracing_policy),
+        infection_onset_time_(absl::InfiniteFuture()),
+        latest_contact_time_(absl::InfinitePast()) {}
+  // Creates a risk score that owns its config.
+  explicit TracingRiskScore(
+      std::unique_ptr<const TracingRiskScoreConfig> tracing_policy)
+      : owned_tracing_policy_(std::move(tracing_policy)),
+        tracing_policy_(*owned_tracing_policy_),
         infection_onset_time_(absl::InfiniteFuture()),
         latest_contact_time_(absl::InfinitePast()) {}
 
@@ -80,7 +93,8 @@ class TracingRiskScore : public RiskScore {
   VisitAdjustment GetVisitAdjustment(const Timestep& timestep,
                                      const int64 location_uuid) const override {
     const bool skip_visit =
-        location_type_(location_uuid) != LocationReference::HOUSEHOLD &&
+        tracing_policy_.location_type(location_uuid) !=
+            LocationReference::HOUSEHOLD &&
         (ShouldQuarantineFromContacts(timestep));
     return {
         .frequency_adjustment = skip_visit ? 0.0f : 1.0f,
@@ -106,7 +120,11 @@ class TracingRiskScore : public RiskScore {
         result.time_requested + tracing_policy_.contact_retention_duration >=
             timestep.start_time();
 
-    return {.report_recursively = false, .send_report = should_report};
+    return {.report_recursively = tracing_policy_.max_hops > 1,
+            .send_report = should_report,
+            .max_hops = tracing_policy_.max_hops,
+            .max_forwarded_reports_per_step =
+                tracing_policy_.max_forwarded_reports_per_step};
   }
 
   absl::Duration ContactRetentionDuration() const override {
@@ -143,16 +161,30 @@ class TracingRiskScore : public RiskScore {
             timestep.end_time() > earliest_quarantine_time);
   }
 
-  const TracingRiskScoreConfig tracing_policy_;
-  const LocationTypeFn location_type_;
+  // Null when the config is shared with other risk scores.
+  const std::unique_ptr<const TracingRiskScoreConfig> owned_tracing_policy_;
+  const TracingRiskScoreConfig& tracing_policy_;
   absl::Time infection_onset_time_;
-  std::vector<TestResult> test_results_;
+  // Grows over the run, so it is paged with the rest of the agent's state.
+  std::vector<TestResult, PagedAllocator<TestResult>> test_results_;
   absl::Time latest_contact_time_;
 };
 
-}  // namespace
+// Creates TracingRiskScores sharing a single config.
+class TracingRiskScoreGenerator : public RiskScoreGenerator {
+ public:
+  explicit TracingRiskScoreGenerator(TracingRiskScoreConfig config)
+      : config_(std::move(config)) {}
 
-absl::StatusOr<std::unique_ptr<RiskScore>> CreateTracingRiskScore(
+  std::unique_ptr<RiskScore> NextRiskScore() override {
+    return absl::make_unique<TracingRiskScore>(&config_);
+  }
+
+ private:
+  const TracingRiskScoreConfig config_;
+};
+
+absl::StatusOr<TracingRiskScoreConfig> ParseTracingRiskScoreConfig(
     const TracingPolicyProto& proto, LocationTypeFn location_type) {
   TracingRiskScoreConfig config;
   auto test_validity_duration_or =
@@ -178,7 +210,31 @@ absl::StatusOr<std::unique_ptr<RiskScore>> CreateTracingRiskScore(
     return test_latency_or.status();
   }
   config.test_latency = *test_latency_or;
-  return absl::make_unique<TracingRiskScore>(location_type, config);
+  config.max_hops = std::max(proto.max_tracing_hops(), 1);
+  config.max_forwarded_reports_per_step =
+      proto.max_forwarded_reports_per_step() > 0
+          ? proto.max_forwarded_reports_per_step()
+          : std::numeric_limits<int>::max();
+  config.location_type = std::move(location_type);
+  return config;
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<RiskScore>> CreateTracingRiskScore(
+    const TracingPolicyProto& proto, LocationTypeFn location_type) {
+  auto config_or = ParseTracingRiskScoreConfig(proto, std::move(location_type));
+  if (!config_or.ok()) return config_or.status();
+  return absl::make_unique<TracingRiskScore>(
+      absl::make_unique<const TracingRiskScoreConfig>(*std::move(config_or)));
+}
+
+absl::StatusOr<std::unique_ptr<RiskScoreGenerator>>
+NewTracingRiskScoreGenerator(const TracingPolicyProto& proto,
+                             LocationTypeFn location_type) {
+  auto config_or = ParseTracingRiskScoreConfig(proto, std::move(location_type));
+  if (!config_or.ok()) return config_or.status();
+  return absl::make_unique<TracingRiskScoreGenerator>(*std::move(config_or));
 }
 
 }  // namespace abesim
@@ -27,6 +27,12 @@ namespace abesim {
 absl::StatusOr<std::unique_ptr<RiskScore>> CreateTracingRiskScore(
     const TracingPolicyProto& proto, LocationTypeFn location_type);
 
+// Returns a generator of risk scores that all share a single parsed copy of
+// proto and location_type, rather than each holding their own.
+absl::StatusOr<std::unique_ptr<RiskScoreGenerator>>
+NewTracingRiskScoreGenerator(const TracingPolicyProto& proto,
+                             LocationTypeFn location_type);
+
 }  // namespace abesim
 
 #endif  // AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_CONTACT_TRACING_RISK_SCORE_H_
@@ -68,6 +68,14 @@ class RiskScoreTest : public testing::Test {
         });
     return std::move(risk_score_or.value());
   }
+  std::unique_ptr<RiskScoreGenerator> GetRiskScoreGenerator() {
+    auto generator_or = NewTracingRiskScoreGenerator(
+        GetTracingPolicyProto(), [](const int64 location_uuid) {
+          return location_uuid == 0 ? LocationReference::BUSINESS
+                                    : LocationReference::HOUSEHOLD;
+        });
+    return std::move(generator_or.value());
+  }
 
  private:
   TracingPolicyProto GetTracingPolicyProto() {
@@ -267,10 +275,44 @@ TEST_F(RiskScoreTest, GetsContactTracingPolicy) {
                                                  .send_report = false}));
 }
 
+TEST(TracingRiskScoreTest, ReportsRecursivelyWithMultipleHops) {
+  auto risk_score = CreateTracingRiskScore(
+      ParseTextProtoOrDie<TracingPolicyProto>(R"pb(
+        contact_retention_duration { seconds: 1209600 }
+        max_tracing_hops: 3
+        max_forwarded_reports_per_step: 100
+      )pb"),
+      [](const int64 location_uuid) { return LocationReference::BUSINESS; });
+  PANDEMIC_ASSERT_OK(risk_score);
+  EXPECT_THAT((*risk_score)
+                  ->GetContactTracingPolicy(
+                      Timestep(TimeFromDay(5), absl::Hours(24))),
+              Eq(RiskScore::ContactTracingPolicy{
+                  .report_recursively = true,
+                  .send_report = false,
+                  .max_hops = 3,
+                  .max_forwarded_reports_per_step = 100}));
+}
+
 TEST_F(RiskScoreTest, GetsContactRetentionDuration) {
   auto risk_score = GetRiskScore();
   EXPECT_EQ(risk_score->ContactRetentionDuration(), absl::Hours(24 * 14));
 }
 
+TEST_F(RiskScoreTest, GeneratedRiskScoresKeepSeparateState) {
+  auto generator = GetRiskScoreGenerator();
+  auto exposed = generator->NextRiskScore();
+  auto unexposed = generator->NextRiskScore();
+  const std::vector<Exposure> exposures = {
+      {.start_time = TimeFromDay(4), .duration = absl::Hours(1)}};
+  EXPECT_THAT(
+      FrequencyAdjustments(*exposed, exposures, LocationReference::BUSINESS),
+      testing::ElementsAre(1.0, 1.0, 0.0, 0.0, 0.0, 1.0, 1.0));
+  EXPECT_THAT(
+      FrequencyAdjustments(*unexposed, {}, LocationReference::BUSINESS),
+      testing::ElementsAre(1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0));
+  EXPECT_EQ(unexposed->ContactRetentionDuration(), absl::Hours(24 * 14));
+}
+
 }  // namespace
 }  // namespace abesim
@@ -24,31 +24,14 @@
 #include "agent_based_epidemic_sim/core/risk_score.h"
 
 namespace abesim {
-namespace {
-
-class TracingRiskScoreGenerator : public RiskScoreGenerator {
- public:
-  TracingRiskScoreGenerator(const TracingPolicyProto& policy,
-                            LocationTypeFn location)
-      : policy_(policy), location_(std::move(location)) {}
-  std::unique_ptr<RiskScore> NextRiskScore() override {
-    return *CreateTracingRiskScore(policy_, location_);
-  }
-
- private:
-  const TracingPolicyProto policy_;
-  const LocationTypeFn location_;
-};
-
-}  // namespace
 
 void RunSimulation(absl::string_view output_file_path,
                    absl::string_view learning_output_base,
                    const ContactTracingHomeWorkSimulationConfig& config,
                    int num_workers) {
   auto get_risk_score_generator = [&config](LocationTypeFn location_type) {
-    return absl::make_unique<TracingRiskScoreGenerator>(
-        config.tracing_policy(), std::move(location_type));
+    return *NewTracingRiskScoreGenerator(config.tracing_policy(),
+                                         std::move(location_type));
   };
   auto context = GetSimulationContext(config.home_work_config());
   RunSimulation(output_file_path, learning_output_base,
@@ -0,0 +1,302 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/home_work/ensemble.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/random/discrete_distribution.h"
+#include "absl/random/distributions.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "agent_based_epidemic_sim/applications/home_work/risk_score.h"
+#include "agent_based_epidemic_sim/applications/home_work/simulation.h"
+#include "agent_based_epidemic_sim/core/huge_page_allocator.h"
+#include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+absl::StatusOr<float> SampleContinuousPrior(const ContinuousPrior& prior,
+                                            absl::BitGenRef gen) {
+  switch (prior.prior_case()) {
+    case ContinuousPrior::kUniformPrior:
+      return absl::Uniform<float>(gen, prior.uniform_prior().min(),
+                                  prior.uniform_prior().max());
+    case ContinuousPrior::kGaussianPrior:
+      return absl::Gaussian<float>(gen, prior.gaussian_prior().mean(),
+                                   prior.gaussian_prior().stddev());
+    case ContinuousPrior::kGammaPrior:
+      return std::gamma_distribution<float>(prior.gamma_prior().alpha(),
+                                            prior.gamma_prior().beta())(gen);
+    default:
+      return absl::InvalidArgumentError(
+          absl::StrCat("Unset prior: ", prior.DebugString()));
+  }
+}
+
+// Returns draws from each of the priors of prior, normalized to sum to 1.
+absl::StatusOr<std::vector<float>> SampleDiscretePrior(
+    const DiscretePrior& prior, const int expected_size, absl::BitGenRef gen) {
+  if (prior.prior_size() != expected_size) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Discrete prior has ", prior.prior_size(),
+                     " priors for a distribution of ", expected_size));
+  }
+  std::vector<float> probabilities;
+  float total = 0;
+  for (const ContinuousPrior& bucket : prior.prior()) {
+    auto probability = SampleContinuousPrior(bucket, gen);
+    if (!probability.ok()) return probability.status();
+    probabilities.push_back(*probability);
+    total += probabilities.back();
+  }
+  if (!(total > 0)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Discrete prior draws sum to ", total));
+  }
+  for (float& probability : probabilities) probability /= total;
+  return probabilities;
+}
+
+absl::Status SampleDiscreteDistribution(const DiscretePrior& prior,
+                                        absl::BitGenRef gen,
+                                        DiscreteDistribution* distribution) {
+  auto probabilities =
+      SampleDiscretePrior(prior, distribution->buckets_size(), gen);
+  if (!probabilities.ok()) return probabilities.status();
+  for (int i = 0; i < probabilities->size(); ++i) {
+    distribution->mutable_buckets(i)->set_count((*probabilities)[i]);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status SampleTransitionModel(const PTTSTransitionPrior& prior,
+                                   absl::BitGenRef gen,
+                                   PTTSTransitionModelProto* model) {
+  for (const auto& state_prior : prior.state_transition_diagram_prior()) {
+    auto state = std::find_if(
+        model->mutable_state_transition_diagram()->begin(),
+        model->mutable_state_transition_diagram()->end(),
+        [&state_prior](const auto& transitions) {
+          return transitions.health_state() == state_prior.health_state();
+        });
+    if (state == model->mutable_state_transition_diagram()->end()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "No transitions from state with prior: ",
+          HealthState::State_Name(state_prior.health_state())));
+    }
+    if (state_prior.transition_probability_prior().prior_size() > 0) {
+      auto probabilities =
+          SampleDiscretePrior(state_prior.transition_probability_prior(),
+                              state->transition_probability_size(), gen);
+      if (!probabilities.ok()) return probabilities.status();
+      for (int i = 0; i < probabilities->size(); ++i) {
+        state->mutable_transition_probability(i)->set_transition_probability(
+            (*probabilities)[i]);
+      }
+    }
+    if (state_prior.has_rate_prior()) {
+      auto rate = SampleContinuousPrior(state_prior.rate_prior(), gen);
+      if (!rate.ok()) return rate.status();
+      if (!(*rate > 0)) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("Sampled non-positive transition rate: ", *rate));
+      }
+      for (auto& transition : *state->mutable_transition_probability()) {
+        transition.set_mean_days_to_transition(1 / *rate);
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Holds the SimulationContext of each PopulationKey while realizations with
+// that key remain to be run.
+class ContextCache {
+ public:
+  explicit ContextCache(absl::Span<const std::string> keys) {
+    for (const std::string& key : keys) ++entries_[key].remaining;
+  }
+
+  // Returns the context for config, building it unless another realization
+  // has built or is building it.
+  std::shared_ptr<const SimulationContext> Acquire(
+      const std::string& key, const HomeWorkSimulationConfig& config) {
+    absl::MutexLock l(&mu_);
+    Entry& entry = entries_[key];
+    mu_.Await(absl::Condition(
+        +[](Entry* entry) { return !entry->building; }, &entry));
+    if (entry.context == nullptr) {
+      entry.building = true;
+      mu_.Unlock();
+      auto context = std::make_shared<const SimulationContext>(
+          GetSimulationContext(config));
+      mu_.Lock();
+      entry.context = std::move(context);
+      entry.building = false;
+    }
+    return entry.context;
+  }
+
+  // Releases the context of key once the last realization with it is done.
+  void Release(const std::string& key) {
+    absl::MutexLock l(&mu_);
+    Entry& entry = entries_[key];
+    if (--entry.remaining == 0) entry.context = nullptr;
+  }
+
+ private:
+  struct Entry {
+    int remaining = 0;
+    bool building = false;
+    std::shared_ptr<const SimulationContext> context;
+  };
+
+  absl::Mutex mu_;
+  // Entries are not added after construction, so references are stable.
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace
+
+absl::StatusOr<HomeWorkSimulationConfig> SampleRealization(
+    const HomeWorkSimulationMetaConfig& meta_config, absl::BitGenRef gen) {
+  HomeWorkSimulationConfig config = meta_config.config_template();
+  if (meta_config.has_population_size_prior()) {
+    auto population_size =
+        SampleContinuousPrior(meta_config.population_size_prior(), gen);
+    if (!population_size.ok()) return population_size.status();
+    config.set_population_size(
+        std::max<int>(1, std::lround(*population_size)));
+  }
+  const LocationPriors& location_priors = meta_config.location_priors();
+  LocationDistributions& locations = *config.mutable_location_distributions();
+  if (location_priors.business_size_prior().has_alpha_prior()) {
+    auto alpha = SampleContinuousPrior(
+        location_priors.business_size_prior().alpha_prior(), gen);
+    if (!alpha.ok()) return alpha.status();
+    locations.mutable_business_distribution()->set_alpha(*alpha);
+  }
+  if (location_priors.business_size_prior().has_beta_prior()) {
+    auto beta = SampleContinuousPrior(
+        location_priors.business_size_prior().beta_prior(), gen);
+    if (!beta.ok()) return beta.status();
+    locations.mutable_business_distribution()->set_beta(*beta);
+  }
+  if (location_priors.household_size_prior().prior_size() > 0) {
+    absl::Status status = SampleDiscreteDistribution(
+        location_priors.household_size_prior(), gen,
+        locations.mutable_household_size_distribution());
+    if (!status.ok()) return status;
+  }
+  const AgentPriors& agent_priors = meta_config.agent_priors();
+  AgentProperties& agents = *config.mutable_agent_properties();
+  if (agent_priors.health_state_prior().prior_size() > 0) {
+    absl::Status status = SampleDiscreteDistribution(
+        agent_priors.health_state_prior(), gen,
+        agents.mutable_initial_health_state_distribution());
+    if (!status.ok()) return status;
+  }
+  if (agent_priors.has_ptts_transition_prior()) {
+    absl::Status status =
+        SampleTransitionModel(agent_priors.ptts_transition_prior(), gen,
+                              agents.mutable_ptts_transition_model());
+    if (!status.ok()) return status;
+  }
+  const auto& policies =
+      meta_config.distancing_priors().distancing_probability();
+  if (!policies.empty()) {
+    std::vector<float> weights;
+    for (const auto& policy : policies) weights.push_back(policy.probability());
+    const int policy = absl::discrete_distribution<int>(weights.begin(),
+                                                        weights.end())(gen);
+    *config.mutable_distancing_policy() = policies[policy].policy();
+  }
+  return config;
+}
+
+std::string PopulationKey(const HomeWorkSimulationConfig& config) {
+  HomeWorkSimulationConfig population;
+  population.set_population_size(config.population_size());
+  *population.mutable_agent_properties() = config.agent_properties();
+  // RunSimulation builds the transition model from each realization's config.
+  population.mutable_agent_properties()->clear_ptts_transition_model();
+  *population.mutable_location_distributions() =
+      config.location_distributions();
+  return population.SerializeAsString();
+}
+
+absl::Status RunEnsemble(const absl::string_view output_file_base,
+                         const absl::string_view learning_output_base,
+                         const HomeWorkSimulationMetaConfig& meta_config,
+                         const int num_workers) {
+  const int num_realizations = meta_config.num_realizations();
+  std::vector<HomeWorkSimulationConfig> configs;
+  std::vector<std::string> keys;
+  configs.reserve(num_realizations);
+  keys.reserve(num_realizations);
+  absl::BitGenRef gen = GetBitGen();
+  for (int i = 0; i < num_realizations; ++i) {
+    auto config = SampleRealization(meta_config, gen);
+    if (!config.ok()) return config.status();
+    keys.push_back(PopulationKey(*config));
+    configs.push_back(*std::move(config));
+  }
+  // Realizations sharing a context run next to each other, so that it need
+  // only be held while they run.
+  std::vector<int> order(num_realizations);
+  for (int i = 0; i < num_realizations; ++i) order[i] = i;
+  std::stable_sort(
+      order.begin(), order.end(),
+      [&keys](const int a, const int b) { return keys[a] < keys[b]; });
+
+  ContextCache contexts(keys);
+  auto executor = NewExecutor(num_workers);
+  auto execution = executor->NewExecution();
+  for (const int i : order) {
+    execution->Add([&, i]() {
+      const HomeWorkSimulationConfig& config = configs[i];
+      std::shared_ptr<const SimulationContext> context =
+          contexts.Acquire(keys[i], config);
+      auto get_risk_score_generator = [&config](LocationTypeFn location_type) {
+        return *NewRiskScoreGenerator(config.distancing_policy(),
+                                      location_type);
+      };
+      RunSimulation(absl::StrCat(output_file_base, "-", i),
+                    learning_output_base.empty()
+                        ? ""
+                        : absl::StrCat(learning_output_base, "-", i),
+                    config, get_risk_score_generator, /*num_workers=*/1,
+                    *context);
+      context = nullptr;
+      contexts.Release(keys[i]);
+      LOG(INFO) << "Finished realization " << i;
+    });
+  }
+  execution->Wait();
+  ReleaseFreeHugePages();
+  return absl::OkStatus();
+}
+
+}  // namespace abesim
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_ENSEMBLE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_ENSEMBLE_H_
+
+#include <string>
+
+#include "absl/random/bit_gen_ref.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+
+namespace abesim {
+
+// Samples the config of one realization from the priors of meta_config.  Only
+// the parts of config_template that have a prior are replaced:
+//   - population_size_prior is rounded to the population size.
+//   - business_size_prior gives the business size distribution.
+//   - household_size_prior and agent_priors.health_state_prior give the
+//     probabilities of the buckets of the household size and initial health
+//     state distributions, in order.  Draws are normalized, so that gamma
+//     priors with unit scale give a Dirichlet distribution.
+//   - agent_priors.ptts_transition_prior gives the transition probabilities
+//     out of each of its states likewise, and rate_prior the rate of leaving
+//     that state, whose inverse is the mean days of each transition.
+//   - distancing_priors picks one of its policies.
+// Returns an error if a discrete prior does not match its distribution.
+absl::StatusOr<HomeWorkSimulationConfig> SampleRealization(
+    const HomeWorkSimulationMetaConfig& meta_config, absl::BitGenRef gen);
+
+// Returns a key that is equal for configs that share a SimulationContext,
+// that is, the same agents, locations, and visit schedules.  Configs that only
+// differ in e.g. distancing policy, transmissibility, or transition model
+// share one.
+std::string PopulationKey(const HomeWorkSimulationConfig& config);
+
+// Runs meta_config.num_realizations realizations sampled from meta_config in
+// this process, writing the output of realization i to
+// "<output_file_base>-<i>" and likewise for learning_output_base if it is not
+// empty.  Realizations run concurrently on num_workers threads, each on a
+// single thread.  Realizations with the same PopulationKey are run together
+// and share their SimulationContext, which is built only once.
+absl::Status RunEnsemble(absl::string_view output_file_base,
+                         absl::string_view learning_output_base,
+                         const HomeWorkSimulationMetaConfig& meta_config,
+                         int num_workers);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_ENSEMBLE_H_
@@ -0,0 +1,179 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/home_work/ensemble.h"
+
+#include <string>
+
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+constexpr char kConfigPath[] =
+    "agent_based_epidemic_sim/applications/home_work/"
+    "config.pbtxt";
+
+HomeWorkSimulationMetaConfig GetMetaConfig() {
+  std::string contents;
+  CHECK_EQ(absl::OkStatus(), file::GetContents(kConfigPath, &contents));
+  HomeWorkSimulationMetaConfig meta_config =
+      ParseTextProtoOrDie<HomeWorkSimulationMetaConfig>(R"(
+        num_realizations: 4
+        population_size_prior { uniform_prior { min: 100 max: 200 } }
+        location_priors {
+          household_size_prior {
+            prior { gamma_prior { alpha: 1 beta: 1 } }
+            prior { gamma_prior { alpha: 1 beta: 1 } }
+            prior { gamma_prior { alpha: 1 beta: 1 } }
+            prior { gamma_prior { alpha: 1 beta: 1 } }
+            prior { gamma_prior { alpha: 1 beta: 1 } }
+          }
+        }
+        agent_priors {
+          ptts_transition_prior {
+            state_transition_diagram_prior {
+              health_state: EXPOSED
+              transition_probability_prior {
+                prior { uniform_prior { min: 1 max: 2 } }
+                prior { uniform_prior { min: 1 max: 2 } }
+              }
+              rate_prior { uniform_prior { min: 0.25 max: 0.5 } }
+            }
+          }
+        }
+        distancing_priors {
+          distancing_probability {
+            policy { stages { essential_worker_fraction: 0.5 } }
+            probability: 1
+          }
+        }
+      )");
+  *meta_config.mutable_config_template() =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  meta_config.mutable_config_template()->set_num_steps(1);
+  return meta_config;
+}
+
+TEST(EnsembleTest, SamplesRealizationFromPriors) {
+  const HomeWorkSimulationMetaConfig meta_config = GetMetaConfig();
+  absl::BitGen gen;
+  const auto config = SampleRealization(meta_config, gen);
+  PANDEMIC_ASSERT_OK(config);
+  EXPECT_GE(config->population_size(), 100);
+  EXPECT_LE(config->population_size(), 200);
+  float total = 0;
+  for (const auto& bucket : config->location_distributions()
+                                 .household_size_distribution()
+                                 .buckets()) {
+    total += bucket.count();
+  }
+  EXPECT_NEAR(total, 1, 1e-5);
+  const auto& exposed = config->agent_properties()
+                            .ptts_transition_model()
+                            .state_transition_diagram(0);
+  EXPECT_NEAR(exposed.transition_probability(0).transition_probability() +
+                  exposed.transition_probability(1).transition_probability(),
+              1, 1e-5);
+  EXPECT_GE(exposed.transition_probability(0).mean_days_to_transition(), 2);
+  EXPECT_LE(exposed.transition_probability(0).mean_days_to_transition(), 4);
+  EXPECT_EQ(config->distancing_policy().stages(0).essential_worker_fraction(),
+            0.5);
+  // Parts without a prior are kept from the template.
+  EXPECT_EQ(config->location_distributions().business_distribution().alpha(),
+            meta_config.config_template()
+                .location_distributions()
+                .business_distribution()
+                .alpha());
+}
+
+TEST(EnsembleTest, RejectsMismatchedDiscretePrior) {
+  HomeWorkSimulationMetaConfig meta_config = GetMetaConfig();
+  meta_config.mutable_location_priors()
+      ->mutable_household_size_prior()
+      ->mutable_prior()
+      ->RemoveLast();
+  absl::BitGen gen;
+  EXPECT_FALSE(SampleRealization(meta_config, gen).ok());
+}
+
+TEST(EnsembleTest, RejectsUnsetPrior) {
+  HomeWorkSimulationMetaConfig meta_config = GetMetaConfig();
+  meta_config.mutable_location_priors()
+      ->mutable_household_size_prior()
+      ->mutable_prior(0)
+      ->Clear();
+  absl::BitGen gen;
+  EXPECT_EQ(SampleRealization(meta_config, gen).status().code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(EnsembleTest, PopulationKeyIgnoresNonPopulationParameters) {
+  const HomeWorkSimulationConfig config = GetMetaConfig().config_template();
+  HomeWorkSimulationConfig other = config;
+  other.set_transmissibility(config.transmissibility() + 1);
+  other.mutable_distancing_policy()->add_stages();
+  EXPECT_EQ(PopulationKey(config), PopulationKey(other));
+  other.set_population_size(config.population_size() + 1);
+  EXPECT_NE(PopulationKey(config), PopulationKey(other));
+}
+
+TEST(EnsembleTest, PopulationKeyIgnoresTransitionModel) {
+  const HomeWorkSimulationMetaConfig meta_config = GetMetaConfig();
+  ASSERT_TRUE(meta_config.agent_priors().has_ptts_transition_prior());
+  HomeWorkSimulationMetaConfig transition_only;
+  *transition_only.mutable_config_template() = meta_config.config_template();
+  *transition_only.mutable_agent_priors()->mutable_ptts_transition_prior() =
+      meta_config.agent_priors().ptts_transition_prior();
+  absl::BitGen gen;
+  auto config = SampleRealization(transition_only, gen);
+  auto other = SampleRealization(transition_only, gen);
+  ASSERT_TRUE(config.ok());
+  ASSERT_TRUE(other.ok());
+  EXPECT_NE(config->agent_properties().ptts_transition_model().DebugString(),
+            other->agent_properties().ptts_transition_model().DebugString());
+  EXPECT_EQ(PopulationKey(*config), PopulationKey(*other));
+}
+
+TEST(EnsembleTest, RunsRealizations) {
+  HomeWorkSimulationMetaConfig meta_config = GetMetaConfig();
+  // The realizations share at most two populations.
+  meta_config.clear_location_priors();
+  meta_config.clear_agent_priors();
+  meta_config.mutable_population_size_prior()
+      ->mutable_uniform_prior()
+      ->set_max(101);
+  const std::string output_file_base =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "ensemble");
+  PANDEMIC_ASSERT_OK(RunEnsemble(output_file_base, "", meta_config,
+                                 /*num_workers=*/2));
+  for (int i = 0; i < meta_config.num_realizations(); ++i) {
+    std::string output;
+    PANDEMIC_ASSERT_OK(
+        file::GetContents(absl::StrCat(output_file_base, "-", i), &output));
+    EXPECT_FALSE(output.empty());
+  }
+}
+
+}  // namespace
+}  // namespace abesim
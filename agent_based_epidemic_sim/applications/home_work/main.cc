@@ -15,6 +15,7 @@
 #include "absl/flags/flag.h"
 #include "absl/flags/parse.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+#include "agent_based_epidemic_sim/applications/home_work/ensemble.h"
 #include "agent_based_epidemic_sim/applications/home_work/simulation.h"
 #include "agent_based_epidemic_sim/core/parse_text_proto.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
@@ -22,6 +23,11 @@
 
 ABSL_FLAG(std::string, simulation_config_pbtxt_path, "",
           "Path to SimulationConfig pbtxt file.");
+ABSL_FLAG(std::string, simulation_meta_config_pbtxt_path, "",
+          "Path to a HomeWorkSimulationMetaConfig pbtxt file.  If set, its "
+          "realizations are run instead of simulation_config_pbtxt_path, with "
+          "output_file_path and learning_output_base as the base paths of "
+          "their outputs.");
 ABSL_FLAG(int, num_workers, 1, "The number of thread workers to use.");
 ABSL_FLAG(std::string, output_file_path, "", "The output file path.");
 ABSL_FLAG(std::string, learning_output_base, "",
@@ -32,6 +38,18 @@ namespace abesim {
 
 int Main(int argc, char** argv) {
   std::string contents;
+  const std::string meta_config_path =
+      absl::GetFlag(FLAGS_simulation_meta_config_pbtxt_path);
+  if (!meta_config_path.empty()) {
+    CHECK_EQ(absl::OkStatus(), file::GetContents(meta_config_path, &contents));
+    CHECK_EQ(absl::OkStatus(),
+             RunEnsemble(absl::GetFlag(FLAGS_output_file_path),
+                         absl::GetFlag(FLAGS_learning_output_base),
+                         ParseTextProtoOrDie<HomeWorkSimulationMetaConfig>(
+                             contents),
+                         absl::GetFlag(FLAGS_num_workers)));
+    return 0;
+  }
   CHECK_EQ(absl::OkStatus(),
            file::GetContents(absl::GetFlag(FLAGS_simulation_config_pbtxt_path),
                              &contents));
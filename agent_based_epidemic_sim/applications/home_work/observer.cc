@@ -21,6 +21,7 @@
 #include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/enum_indexed_array.h"
+#include "agent_based_epidemic_sim/core/visit.h"
 #include "agent_based_epidemic_sim/port/proto_enum_utils.h"
 #include "agent_based_epidemic_sim/util/histogram.h"
 
@@ -41,7 +42,7 @@ HomeWorkSimulationObserver::HomeWorkSimulationObserver(
 
 void HomeWorkSimulationObserver::Observe(
     const Agent& agent, absl::Span<const InfectionOutcome> outcomes) {
-  health_state_counts_[agent.CurrentHealthState()]++;
+  health_state_counts_[agent.CurrentHealthState()] += agent.weight();
   auto& visitor_contacts = contacts_[agent.uuid()];
   for (const InfectionOutcome& outcome : outcomes) {
     if (outcome.exposure_type == InfectionOutcomeProto::CONTACT) {
@@ -52,9 +53,14 @@ void HomeWorkSimulationObserver::Observe(
 void HomeWorkSimulationObserver::Observe(const Location& location,
                                          const absl::Span<const Visit> visits) {
   for (const Visit& visit : visits) {
+    absl::Duration duration;
+    for (int i = 0; i < NumVisitStays(visit); ++i) {
+      const Visit stay = GetVisitStay(visit, i);
+      duration += stay.end_time - stay.start_time;
+    }
     agent_location_type_durations_[visit.agent_uuid]
                                   [location_type_(visit.location_uuid)] +=
-        visit.end_time - visit.start_time;
+        duration;
   }
 }
 
@@ -150,6 +156,10 @@ void HomeWorkSimulationObserverFactory::Aggregate(
   status_.Update(output_->WriteString(line));
 }
 
+void HomeWorkSimulationObserverFactory::Flush() {
+  status_.Update(output_->Flush());
+}
+
 std::unique_ptr<HomeWorkSimulationObserver>
 HomeWorkSimulationObserverFactory::MakeObserver(
     const Timestep& timestep) const {
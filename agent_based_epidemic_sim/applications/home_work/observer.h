@@ -73,6 +73,7 @@ class HomeWorkSimulationObserverFactory
   void Aggregate(const Timestep& timestep,
                  absl::Span<std::unique_ptr<HomeWorkSimulationObserver> const>
                      observers) override;
+  void Flush() override;
   std::unique_ptr<HomeWorkSimulationObserver> MakeObserver(
       const Timestep& timestep) const override;
 
@@ -38,6 +38,7 @@ class MemFileWriterImpl : public file::FileWriter {
     return absl::OkStatus();
   }
 
+  absl::Status Flush() override { return absl::OkStatus(); }
   absl::Status Close() override { return absl::OkStatus(); }
 
  private:
@@ -15,6 +15,8 @@
 #include "agent_based_epidemic_sim/core/risk_score.h"
 
 #include <algorithm>
+#include <memory>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/random/distributions.h"
@@ -110,23 +112,52 @@ std::unique_ptr<RiskScore> ToggleRiskScoreGenerator::NextRiskScore() {
   return GetRiskScore(absl::Uniform(GetBitGen(), 0.0, 1.0));
 }
 
-std::unique_ptr<RiskScore> ToggleRiskScoreGenerator::GetRiskScore(
-    const float essentialness) const {
+RiskScore* ToggleRiskScoreGenerator::NextSharedRiskScore() {
+  return GetSharedRiskScore(absl::Uniform(GetBitGen(), 0.0, 1.0));
+}
+
+std::vector<ToggleRiskScoreGenerator::Tier>::const_iterator
+ToggleRiskScoreGenerator::FindTier(const float essentialness) const {
   auto iter =
       std::lower_bound(tiers_.begin(), tiers_.end(), essentialness,
                        [](const Tier& tier, float essentialness) {
                          return tier.essential_worker_fraction < essentialness;
                        });
   if (iter == tiers_.begin()) {
+    return tiers_.end();
+  }
+  return --iter;
+}
+
+std::unique_ptr<RiskScore> ToggleRiskScoreGenerator::GetRiskScore(
+    const float essentialness) const {
+  auto iter = FindTier(essentialness);
+  if (iter == tiers_.end()) {
     return NewNullRiskScore();
   }
-  iter--;
   return absl::make_unique<TogglingRiskScore>(location_type_, iter->toggles);
 }
 
+RiskScore* ToggleRiskScoreGenerator::GetSharedRiskScore(
+    const float essentialness) const {
+  auto iter = FindTier(essentialness);
+  if (iter == tiers_.end()) {
+    return null_risk_score_.get();
+  }
+  return tier_risk_scores_[iter - tiers_.begin()].get();
+}
+
 ToggleRiskScoreGenerator::ToggleRiskScoreGenerator(LocationTypeFn location_type,
                                                    std::vector<Tier> tiers)
-    : tiers_(std::move(tiers)), location_type_(std::move(location_type)) {}
+    : tiers_(std::move(tiers)),
+      location_type_(std::move(location_type)),
+      null_risk_score_(NewNullRiskScore()) {
+  tier_risk_scores_.reserve(tiers_.size());
+  for (const Tier& tier : tiers_) {
+    tier_risk_scores_.push_back(
+        absl::make_unique<TogglingRiskScore>(location_type_, tier.toggles));
+  }
+}
 
 absl::StatusOr<std::unique_ptr<ToggleRiskScoreGenerator>> NewRiskScoreGenerator(
     const DistancingPolicy& config, LocationTypeFn location_type) {
@@ -17,6 +17,9 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_RISK_SCORE_H_
 #define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_HOME_WORK_RISK_SCORE_H_
 
+#include <memory>
+#include <vector>
+
 #include "absl/random/random.h"
 #include "absl/status/statusor.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
@@ -28,6 +31,7 @@ namespace abesim {
 class ToggleRiskScoreGenerator : public RiskScoreGenerator {
  public:
   std::unique_ptr<RiskScore> NextRiskScore() override;
+  RiskScore* NextSharedRiskScore() override;
 
   // Get a policy for a worker with a given 'essentialness'.  Essentialness
   // measures the fraction of the population more essential than the given
@@ -36,6 +40,10 @@ class ToggleRiskScoreGenerator : public RiskScoreGenerator {
   // current poublic policy has an essential_worker_fraction >= E.
   std::unique_ptr<RiskScore> GetRiskScore(float essentialness) const;
 
+  // As GetRiskScore, but returns the policy shared by every worker in the same
+  // tier.  The policy is owned by the generator.
+  RiskScore* GetSharedRiskScore(float essentialness) const;
+
  private:
   friend absl::StatusOr<std::unique_ptr<ToggleRiskScoreGenerator>>
   NewRiskScoreGenerator(const DistancingPolicy& config,
@@ -52,8 +60,16 @@ class ToggleRiskScoreGenerator : public RiskScoreGenerator {
   ToggleRiskScoreGenerator(LocationTypeFn location_type,
                            std::vector<Tier> tiers);
 
+  // Returns the tier for the given essentialness, or tiers_.end() if the
+  // worker is more essential than every tier and so always works.
+  std::vector<Tier>::const_iterator FindTier(float essentialness) const;
+
   const std::vector<Tier> tiers_;
   const LocationTypeFn location_type_;
+  // Policies shared by all workers in each of tiers_, and by workers that
+  // always work.
+  std::vector<std::unique_ptr<RiskScore>> tier_risk_scores_;
+  const std::unique_ptr<RiskScore> null_risk_score_;
 };
 
 absl::StatusOr<std::unique_ptr<ToggleRiskScoreGenerator>> NewRiskScoreGenerator(
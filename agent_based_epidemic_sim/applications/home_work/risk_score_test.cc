@@ -109,6 +109,32 @@ TEST(PublicPolicyTest, AppropriateFrequencyAdjustments) {
   }
 }
 
+TEST(PublicPolicyTest, SharesRiskScoresWithinTier) {
+  DistancingPolicy config = BuildPolicy({{10, .6}, {3, .2}});
+  auto generator_or =
+      NewRiskScoreGenerator(config, [](const int64 location_uuid) {
+        return location_uuid == 0 ? LocationReference::BUSINESS
+                                  : LocationReference::HOUSEHOLD;
+      });
+  PANDEMIC_ASSERT_OK(generator_or);
+  ToggleRiskScoreGenerator* gen = generator_or->get();
+
+  EXPECT_EQ(gen->GetSharedRiskScore(0.0), gen->GetSharedRiskScore(0.2));
+  EXPECT_EQ(gen->GetSharedRiskScore(0.3), gen->GetSharedRiskScore(0.6));
+  EXPECT_NE(gen->GetSharedRiskScore(0.2), gen->GetSharedRiskScore(0.3));
+  EXPECT_NE(gen->GetSharedRiskScore(0.6), gen->GetSharedRiskScore(0.7));
+  for (const float essentialness : {0.1f, 0.3f, 0.7f}) {
+    RiskScore* shared = gen->GetSharedRiskScore(essentialness);
+    auto owned = gen->GetRiskScore(essentialness);
+    for (const int day : {1, 3, 5, 10, 15}) {
+      Timestep timestep(TestDay(day), absl::Hours(24));
+      EXPECT_EQ(shared->GetVisitAdjustment(timestep, 0).frequency_adjustment,
+                owned->GetVisitAdjustment(timestep, 0).frequency_adjustment)
+          << essentialness << " " << day;
+    }
+  }
+}
+
 TEST(PublicPolicyTest, ZeroStagePolicy) {
   DistancingPolicy config;
   auto generator_or =
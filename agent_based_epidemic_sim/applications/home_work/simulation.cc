@@ -14,11 +14,16 @@
 
 #include "agent_based_epidemic_sim/applications/home_work/simulation.h"
 
+#include <algorithm>
 #include <queue>
 #include <string>
+#include <vector>
 
+#include "absl/container/inlined_vector.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "agent_based_epidemic_sim/agent_synthesis/agent_sampler.h"
 #include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "agent_based_epidemic_sim/agent_synthesis/shuffled_sampler.h"
@@ -29,6 +34,7 @@
 #include "agent_based_epidemic_sim/applications/home_work/risk_score.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
 #include "agent_based_epidemic_sim/core/location.h"
 #include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
@@ -41,6 +47,7 @@
 #include "agent_based_epidemic_sim/core/uuid_generator.h"
 #include "agent_based_epidemic_sim/core/visit_generator.h"
 #include "agent_based_epidemic_sim/core/wrapped_transition_model.h"
+#include "agent_based_epidemic_sim/port/executor.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 #include "agent_based_epidemic_sim/port/time_proto_util.h"
@@ -57,6 +64,9 @@ constexpr char kDistancingStageFraction[] =
 constexpr int64 kPopulationProfileId = 0;
 constexpr char kTopBusiness[] = "top_business_size";
 constexpr int kNumTopBusinesses = 5;
+// Number of agents or locations constructed by each task when building the
+// population.
+constexpr int kAgentChunkSize = 4096;
 }  // namespace
 
 namespace {
@@ -71,24 +81,100 @@ int64 GetLocationUuidForTypeOrDie(const AgentProto& agent,
   LOG(FATAL) << "Location not found for type: " << type;
 }
 
-std::vector<LocationDuration> GetLocationDurations(
-    const AgentProto& agent, const PopulationProfile& population_profile) {
-  std::vector<LocationDuration> durations;
-  durations.reserve(population_profile.visit_durations_size());
+// The visit schedule shared by all agents with a given population profile.
+struct ProfileSchedule {
+  std::vector<ScheduledVisit> visits;
+  // The type of the location at each location_index used by visits.
+  std::vector<LocationReference::Type> location_types;
+};
+
+ProfileSchedule GetProfileSchedule(
+    const PopulationProfile& population_profile) {
+  ProfileSchedule schedule;
+  schedule.visits.reserve(population_profile.visit_durations_size());
   for (const VisitDuration& visit_duration :
        population_profile.visit_durations()) {
-    durations.push_back(
-        {.location_uuid =
-             GetLocationUuidForTypeOrDie(agent, visit_duration.location_type()),
+    const auto type = visit_duration.location_type();
+    const int location_index =
+        std::find(schedule.location_types.begin(),
+                  schedule.location_types.end(), type) -
+        schedule.location_types.begin();
+    if (location_index == schedule.location_types.size()) {
+      schedule.location_types.push_back(type);
+    }
+    schedule.visits.push_back(
+        {.location_index = location_index,
          .sample_duration =
              [mean = visit_duration.gaussian_distribution().mean(),
               stddev = visit_duration.gaussian_distribution().stddev()](
                  float adjustment) {
-               absl::BitGenRef gen = GetBitGen();
-               return absl::Gaussian<float>(gen, mean * adjustment, stddev);
+               return mean * adjustment + stddev * GetBulkRandom().Normal();
              }});
   }
-  return durations;
+  return schedule;
+}
+
+ScheduledVisitGenerator GetVisitGenerator(const AgentProto& agent,
+                                          const ProfileSchedule& schedule) {
+  absl::InlinedVector<int64, 4> location_uuids;
+  for (const LocationReference::Type type : schedule.location_types) {
+    location_uuids.push_back(GetLocationUuidForTypeOrDie(agent, type));
+  }
+  return ScheduledVisitGenerator(&schedule.visits, location_uuids);
+}
+
+// Returns whether the uuids of a's locations sort lexicographically before
+// those of b.
+bool LocationsBefore(const AgentProto& a, const AgentProto& b) {
+  return std::lexicographical_compare(
+      a.locations().begin(), a.locations().end(), b.locations().begin(),
+      b.locations().end(),
+      [](const LocationReference& x, const LocationReference& y) {
+        return x.uuid() < y.uuid();
+      });
+}
+
+// Returns the number of people each agent stands for.  Runs of up to
+// cohort_size SUSCEPTIBLE agents with consecutive uuids that visit the same
+// locations are merged into a cohort, whose first agent stands for the whole
+// run and the others for no one.
+std::vector<int> GetCohortWeights(absl::Span<const AgentProto> agents,
+                                  const int cohort_size) {
+  std::vector<int> weights(agents.size(), 1);
+  if (cohort_size < 2) return weights;
+  for (int i = 0; i < agents.size();) {
+    int j = i + 1;
+    if (agents[i].initial_health_state() == HealthState::SUSCEPTIBLE) {
+      while (j < agents.size() && j - i < cohort_size &&
+             agents[j].uuid() == agents[i].uuid() + (j - i) &&
+             agents[j].initial_health_state() == HealthState::SUSCEPTIBLE &&
+             agents[j].population_profile_id() ==
+                 agents[i].population_profile_id() &&
+             !LocationsBefore(agents[i], agents[j]) &&
+             !LocationsBefore(agents[j], agents[i])) {
+        weights[j++] = 0;
+      }
+      weights[i] = j - i;
+    }
+    i = j;
+  }
+  return weights;
+}
+
+// Dies unless the uuids [uuid, uuid + weight) that each cohort reserves for
+// its people are used by no other agent.
+void CheckCohortUuids(absl::Span<const AgentProto> agents,
+                      absl::Span<const int> weights) {
+  std::vector<std::pair<int64, int>> ranges;
+  for (int i = 0; i < agents.size(); ++i) {
+    if (weights[i] > 0) ranges.push_back({agents[i].uuid(), weights[i]});
+  }
+  std::sort(ranges.begin(), ranges.end());
+  for (int i = 1; i < ranges.size(); ++i) {
+    CHECK_GE(ranges[i].first, ranges[i - 1].first + ranges[i - 1].second)
+        << "Agent " << ranges[i].first << " uses a uuid reserved by agent "
+        << ranges[i - 1].first;
+  }
 }
 
 std::vector<std::pair<std::string, std::string>> GetHomeWorkPassthrough(
@@ -217,6 +303,20 @@ SimulationContext GetSimulationContext(const HomeWorkSimulationConfig& config) {
   for (int i = 0; i < config.population_size(); ++i) {
     context.agents.push_back(sampler.Next());
   }
+  if (config.cohort_size() > 1) {
+    // Cohorts are merged from agents with consecutive uuids, so hand the
+    // uuids out again in the order of the locations agents visit.
+    std::vector<int64> uuids;
+    uuids.reserve(context.agents.size());
+    for (const AgentProto& agent : context.agents) {
+      uuids.push_back(agent.uuid());
+    }
+    std::stable_sort(context.agents.begin(), context.agents.end(),
+                     LocationsBefore);
+    for (int i = 0; i < context.agents.size(); ++i) {
+      context.agents[i].set_uuid(uuids[i]);
+    }
+  }
   absl::flat_hash_set<int64> business_uuids;
   std::for_each(
       context.locations.begin(), context.locations.end(),
@@ -252,36 +352,127 @@ void RunSimulation(
       absl::make_unique<AggregatedTransmissionModel>(config.transmissibility());
   absl::FixedArray<std::unique_ptr<TransitionModel>> transition_models(
       context.population_profiles.population_profiles_size());
+  // The transition model comes from config rather than the context, so that
+  // realizations that share a context may differ in their transition priors.
   for (int i = 0; i < transition_models.size(); ++i) {
     transition_models[i] = PTTSTransitionModel::CreateFromProto(
-        context.population_profiles.population_profiles(i).transition_model());
+        config.agent_properties().ptts_transition_model());
+  }
+  std::vector<ProfileSchedule> schedules;
+  schedules.reserve(context.population_profiles.population_profiles_size());
+  for (const PopulationProfile& profile :
+       context.population_profiles.population_profiles()) {
+    schedules.push_back(GetProfileSchedule(profile));
   }
+  const int num_agents = context.agents.size();
+  const std::vector<int> cohort_weights =
+      GetCohortWeights(context.agents, config.cohort_size());
+  CheckCohortUuids(context.agents, cohort_weights);
+  // Risk scores are drawn up front as generators need not be thread-safe.
   auto policy_generator = get_risk_score_generator(context.location_type);
-  std::vector<std::unique_ptr<Agent>> seir_agents;
-  std::vector<std::unique_ptr<VisitGenerator>> visit_generators;
-  seir_agents.reserve(context.agents.size());
-  visit_generators.reserve(context.agents.size());
-  for (const auto& agent : context.agents) {
-    visit_generators.push_back(
-        absl::make_unique<DurationSpecifiedVisitGenerator>(GetLocationDurations(
-            agent, context.population_profiles.population_profiles(
-                       agent.population_profile_id()))));
-    seir_agents.push_back(SEIRAgent::Create(
-        agent.uuid(),
-        {.time = init_time, .health_state = agent.initial_health_state()},
-        transmission_model.get(), SEIRAgent::default_infectivity_model(),
-        absl::make_unique<WrappedTransitionModel>(
-            transition_models[agent.population_profile_id()].get()),
-        *visit_generators.back(), policy_generator->NextRiskScore()));
+  std::vector<RiskScore*> shared_risk_scores(num_agents);
+  std::vector<std::unique_ptr<RiskScore>> risk_scores(num_agents);
+  for (int i = 0; i < num_agents; ++i) {
+    shared_risk_scores[i] = policy_generator->NextSharedRiskScore();
+    if (shared_risk_scores[i] == nullptr) {
+      risk_scores[i] = policy_generator->NextRiskScore();
+    }
   }
+  // Agents hold references to their visit generators, so each chunk's must
+  // not be resized once its agents are created.
+  std::vector<std::vector<ScheduledVisitGenerator>> visit_generators(
+      (num_agents + kAgentChunkSize - 1) / kAgentChunkSize);
+  // People that split off cohorts draw their risk scores when infected, from
+  // several threads at once.
+  absl::Mutex policy_generator_mu;
+  auto next_risk_score = [&policy_generator, &policy_generator_mu]() {
+    absl::MutexLock l(&policy_generator_mu);
+    return policy_generator->NextRiskScore();
+  };
+  std::vector<std::unique_ptr<Agent>> seir_agents(num_agents);
   MicroExposureGeneratorBuilder meg_builder(kNonParametricTraceDistribution);
-  std::vector<std::unique_ptr<Location>> location_des;
-  location_des.reserve(context.locations.size());
-  for (const auto& location : context.locations) {
-    // TODO: Load a ProximityTrace Distribution from file.
-    location_des.push_back(absl::make_unique<LocationDiscreteEventSimulator>(
-        location.reference().uuid(), meg_builder.Build()));
+  std::vector<std::unique_ptr<Location>> location_des(
+      context.locations.size());
+  {
+    auto executor = NewExecutor(num_workers);
+    auto execution = executor->NewExecution();
+    for (int begin = 0; begin < num_agents; begin += kAgentChunkSize) {
+      execution->Add([&, begin]() {
+        const int end = std::min(num_agents, begin + kAgentChunkSize);
+        std::vector<ScheduledVisitGenerator>& chunk_visit_generators =
+            visit_generators[begin / kAgentChunkSize];
+        chunk_visit_generators.reserve(end - begin);
+        for (int i = begin; i < end; ++i) {
+          // The agent is part of an earlier cohort.
+          if (cohort_weights[i] == 0) continue;
+          const AgentProto& agent = context.agents[i];
+          chunk_visit_generators.push_back(GetVisitGenerator(
+              agent, schedules[agent.population_profile_id()]));
+          TransitionModel* const profile_transition_model =
+              transition_models[agent.population_profile_id()].get();
+          auto transition_model = absl::make_unique<WrappedTransitionModel>(
+              profile_transition_model);
+          if (cohort_weights[i] > 1) {
+            SEIRAgent::Cohort cohort = {
+                .weight = cohort_weights[i],
+                .transition_model_factory =
+                    [profile_transition_model]() {
+                      return absl::make_unique<WrappedTransitionModel>(
+                          profile_transition_model);
+                    },
+                .risk_score_factory = next_risk_score,
+            };
+            seir_agents[i] =
+                shared_risk_scores[i] != nullptr
+                    ? SEIRAgent::CreateCohortWithSharedRiskScore(
+                          agent.uuid(), transmission_model.get(),
+                          SEIRAgent::default_infectivity_model(),
+                          std::move(transition_model),
+                          chunk_visit_generators.back(), shared_risk_scores[i],
+                          std::move(cohort))
+                    : SEIRAgent::CreateCohort(
+                          agent.uuid(), transmission_model.get(),
+                          SEIRAgent::default_infectivity_model(),
+                          std::move(transition_model),
+                          chunk_visit_generators.back(),
+                          std::move(risk_scores[i]), std::move(cohort));
+            continue;
+          }
+          const HealthTransition initial_transition = {
+              .time = init_time, .health_state = agent.initial_health_state()};
+          seir_agents[i] =
+              shared_risk_scores[i] != nullptr
+                  ? SEIRAgent::CreateWithSharedRiskScore(
+                        agent.uuid(), initial_transition,
+                        transmission_model.get(),
+                        SEIRAgent::default_infectivity_model(),
+                        std::move(transition_model),
+                        chunk_visit_generators.back(), shared_risk_scores[i])
+                  : SEIRAgent::Create(agent.uuid(), initial_transition,
+                                      transmission_model.get(),
+                                      SEIRAgent::default_infectivity_model(),
+                                      std::move(transition_model),
+                                      chunk_visit_generators.back(),
+                                      std::move(risk_scores[i]));
+        }
+      });
+    }
+    const int num_locations = location_des.size();
+    for (int begin = 0; begin < num_locations; begin += kAgentChunkSize) {
+      execution->Add([&, begin]() {
+        const int end = std::min(num_locations, begin + kAgentChunkSize);
+        for (int i = begin; i < end; ++i) {
+          // TODO: Load a ProximityTrace Distribution from file.
+          location_des[i] = absl::make_unique<LocationDiscreteEventSimulator>(
+              context.locations[i].reference().uuid(), meg_builder.Build());
+        }
+      });
+    }
+    execution->Wait();
   }
+  seir_agents.erase(
+      std::remove(seir_agents.begin(), seir_agents.end(), nullptr),
+      seir_agents.end());
   // Initializes Simulation.
   auto sim = num_workers > 1
                  ? ParallelSimulation(init_time, std::move(seir_agents),
@@ -14,10 +14,14 @@
 
 #include "agent_based_epidemic_sim/applications/home_work/simulation.h"
 
+#include "absl/algorithm/container.h"
 #include "absl/flags/flag.h"
+#include "absl/strings/numbers.h"
 #include "absl/strings/str_split.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/applications/home_work/config.pb.h"
+#include "agent_based_epidemic_sim/applications/home_work/risk_score.h"
 #include "agent_based_epidemic_sim/core/parse_text_proto.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
 #include "agent_based_epidemic_sim/port/file_utils.h"
@@ -72,5 +76,114 @@ TEST(SimulationTest, RunsSimulation) {
   EXPECT_EQ(kExpectedContentsLength, first_row.size());
 }
 
+TEST(SimulationTest, WritesFullHistoryOfRecoveredAgents) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_population_size(500);
+  config.set_num_steps(20);
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "history_output.csv");
+  const std::string learning_output_base =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "learning");
+  RunSimulation(output_file_path, learning_output_base, config,
+                /*num_workers=*/1);
+
+  // Each line is an agent uuid followed by the health states it entered, and
+  // when.
+  std::string history;
+  PANDEMIC_ASSERT_OK(file::GetContents(
+      absl::StrCat(learning_output_base, "_history.csv"), &history));
+  const std::string kExposed = absl::StrCat(HealthState::EXPOSED);
+  const std::string kInfectious = absl::StrCat(HealthState::INFECTIOUS);
+  const std::string kRecovered = absl::StrCat(HealthState::RECOVERED);
+  int recovered = 0;
+  int recovered_after_infection = 0;
+  for (absl::string_view line :
+       absl::StrSplit(history, '\n', absl::SkipEmpty())) {
+    const std::vector<std::string> fields = absl::StrSplit(line, ',');
+    std::vector<std::string> states;
+    for (int i = 1; i < fields.size(); i += 2) states.push_back(fields[i]);
+    if (states.empty() || states.back() != kRecovered) continue;
+    ++recovered;
+    // Agents start SUSCEPTIBLE or INFECTIOUS, so every recovered agent was
+    // EXPOSED or INFECTIOUS first, however long ago it recovered.
+    EXPECT_GT(states.size(), 1) << line;
+    if (absl::c_linear_search(states, kExposed) &&
+        absl::c_linear_search(states, kInfectious)) {
+      ++recovered_after_infection;
+    }
+  }
+  EXPECT_GT(recovered, 0);
+  EXPECT_GT(recovered_after_infection, 0);
+}
+
+TEST(SimulationTest, SimulatesCohortsOfIdenticalPeople) {
+  const std::string config_path = absl::StrCat("./", "/", kConfigPath);
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(config_path, &contents));
+  HomeWorkSimulationConfig config =
+      ParseTextProtoOrDie<HomeWorkSimulationConfig>(contents);
+  config.set_population_size(500);
+  config.set_num_steps(20);
+  config.set_cohort_size(4);
+  SimulationContext context = GetSimulationContext(config);
+  // With everyone working at the same business, the SUSCEPTIBLE people of a
+  // household visit the same locations and are given consecutive uuids.
+  int64 business_uuid = -1;
+  for (AgentProto& agent : context.agents) {
+    for (LocationReference& location : *agent.mutable_locations()) {
+      if (location.type() != LocationReference::BUSINESS) continue;
+      if (business_uuid < 0) business_uuid = location.uuid();
+      location.set_uuid(business_uuid);
+    }
+  }
+  const std::string output_file_path =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "cohort_output.csv");
+  const std::string learning_output_base =
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "cohort_learning");
+  RunSimulation(
+      output_file_path, learning_output_base, config,
+      [&config](LocationTypeFn location_type) {
+        return *NewRiskScoreGenerator(config.distancing_policy(),
+                                      location_type);
+      },
+      /*num_workers=*/1, context);
+
+  // Every person is counted once, whether it is part of a cohort or not.
+  std::string output;
+  PANDEMIC_ASSERT_OK(file::GetContents(output_file_path, &output));
+  const std::vector<std::string> lines =
+      absl::StrSplit(output, '\n', absl::SkipEmpty());
+  const std::vector<std::string> header = absl::StrSplit(lines[0], ',');
+  const int agents_column = absl::c_find(header, "agents") - header.begin();
+  const int susceptible_column =
+      absl::c_find(header, "SUSCEPTIBLE") - header.begin();
+  ASSERT_LT(susceptible_column, header.size());
+  ASSERT_GT(lines.size(), 2);
+  for (int i = 1; i < lines.size(); ++i) {
+    const std::vector<std::string> row = absl::StrSplit(lines[i], ',');
+    EXPECT_EQ(row[agents_column], "500") << lines[i];
+  }
+  const std::vector<std::string> first_row = absl::StrSplit(lines[1], ',');
+  const std::vector<std::string> last_row = absl::StrSplit(lines.back(), ',');
+  int first_susceptible, last_susceptible;
+  ASSERT_TRUE(absl::SimpleAtoi(first_row[susceptible_column],
+                               &first_susceptible));
+  ASSERT_TRUE(
+      absl::SimpleAtoi(last_row[susceptible_column], &last_susceptible));
+  EXPECT_LT(last_susceptible, first_susceptible);
+
+  // Cohorts write one history between their people.
+  std::string history;
+  PANDEMIC_ASSERT_OK(file::GetContents(
+      absl::StrCat(learning_output_base, "_history.csv"), &history));
+  const std::vector<absl::string_view> histories =
+      absl::StrSplit(history, '\n', absl::SkipEmpty());
+  EXPECT_LT(histories.size(), 500);
+}
+
 }  // namespace
 }  // namespace abesim
@@ -1,16 +1,18 @@
 #include "agent_based_epidemic_sim/applications/risk_learning/hazard_transmission_model.h"
 
+#include <algorithm>
 #include <array>
 #include <iterator>
 #include <numeric>
+#include <random>
 #include <vector>
 
-#include "absl/random/distributions.h"
+#include "absl/memory/memory.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
-#include "agent_based_epidemic_sim/core/random.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
@@ -34,35 +36,143 @@ float HazardTransmissionModel::ComputeDose(const float distance,
   return h;
 }
 
-HealthTransition HazardTransmissionModel::GetInfectionOutcome(
-    absl::Span<const Exposure* const> exposures) {
+void HazardTransmissionModel::AccumulateDose(
+    const Exposure& exposure, float* sum_dose,
+    absl::Time* latest_exposure_time) const {
+  if (exposure.infectivity == 0 || exposure.symptom_factor == 0 ||
+      exposure.location_transmissibility == 0 || exposure.susceptibility == 0) {
+    return;
+  }
+  *latest_exposure_time =
+      std::max(*latest_exposure_time, exposure.start_time + exposure.duration);
+
+  // TODO: Remove proximity_trace.
+  if (exposure.distance >= 0) {
+    *sum_dose += ComputeDose(exposure.distance, exposure.duration, &exposure);
+  } else {
+    for (const float& proximity : exposure.proximity_trace.values) {
+      *sum_dose += ComputeDose(proximity, kProximityTraceInterval, &exposure);
+    }
+  }
+}
+
+bool HazardTransmissionModel::AggregateExposures(
+    const absl::Span<const Exposure* const> exposures,
+    Exposure* const aggregate) const {
+  if (exposures.empty()) return false;
   absl::Time latest_exposure_time = absl::InfinitePast();
   float sum_dose = 0;
   for (const Exposure* exposure : exposures) {
-    if (exposure->infectivity == 0 || exposure->symptom_factor == 0 ||
-        exposure->location_transmissibility == 0 ||
-        exposure->susceptibility == 0) {
-      continue;
-    }
-    latest_exposure_time = std::max(latest_exposure_time,
-                                    exposure->start_time + exposure->duration);
-
-    // TODO: Remove proximity_trace.
-    if (exposure->distance >= 0) {
-      sum_dose += ComputeDose(exposure->distance, exposure->duration, exposure);
-    } else {
-      for (const float& proximity : exposure->proximity_trace.values) {
-        sum_dose += ComputeDose(proximity, kProximityTraceInterval, exposure);
-      }
-    }
+    AccumulateDose(*exposure, &sum_dose, &latest_exposure_time);
+  }
+  *aggregate = *exposures.front();
+  aggregate->proximity_trace = ProximityTrace();
+  aggregate->distance = 0;
+  aggregate->duration = absl::Hours(24);
+  aggregate->symptom_factor = 1;
+  aggregate->location_transmissibility = 1;
+  aggregate->susceptibility = 1;
+  aggregate->infectivity = 1;
+  const float unit_dose =
+      ComputeDose(aggregate->distance, aggregate->duration, aggregate);
+  if (unit_dose <= 0) return false;
+  if (sum_dose <= 0) {
+    // AccumulateDose ignores exposures without infectivity.
+    aggregate->infectivity = 0;
+    return true;
+  }
+  aggregate->start_time = latest_exposure_time - aggregate->duration;
+  aggregate->infectivity = sum_dose / unit_dose;
+  return true;
+}
+
+float HazardTransmissionModel::ProbabilityOfInfection(
+    const int slot, const absl::Span<const Exposure* const> exposures,
+    absl::Time* const latest_exposure_time) const {
+  *latest_exposure_time = absl::InfinitePast();
+  float sum_dose = 0;
+  for (const Exposure* exposure : exposures) {
+    AccumulateDose(*exposure, &sum_dose, latest_exposure_time);
   }
   const float prob_infection = 1 - std::exp(-lambda_ * sum_dose);
-  hazard_callback_(prob_infection, latest_exposure_time);
+  hazard_callback_(slot, prob_infection, *latest_exposure_time);
+  return prob_infection;
+}
+
+HealthTransition HazardTransmissionModel::GetInfectionOutcome(
+    absl::Span<const Exposure* const> exposures) {
+  return GetHostInfectionOutcome(kNoTransmissionSlot, exposures);
+}
+
+HealthTransition HazardTransmissionModel::GetHostInfectionOutcome(
+    const int slot, absl::Span<const Exposure* const> exposures) {
   HealthTransition health_transition;
-  health_transition.time = latest_exposure_time;
-  health_transition.health_state = absl::Bernoulli(GetBitGen(), prob_infection)
-                                       ? HealthState::EXPOSED
-                                       : HealthState::SUSCEPTIBLE;
+  const float prob_infection =
+      ProbabilityOfInfection(slot, exposures, &health_transition.time);
+  health_transition.health_state =
+      GetBulkRandom().Uniform() < prob_infection ? HealthState::EXPOSED
+                                                 : HealthState::SUSCEPTIBLE;
   return health_transition;
 }
+
+int HazardTransmissionModel::GetWeightedInfectionOutcome(
+    const int slot, const absl::Span<const Exposure* const> exposures,
+    const int weight, HealthTransition* const infection) {
+  absl::Time latest_exposure_time;
+  const float prob_infection =
+      ProbabilityOfInfection(slot, exposures, &latest_exposure_time);
+  const int infected = std::binomial_distribution<int>(
+      weight, std::clamp(prob_infection, 0.0f, 1.0f))(GetBulkRandom());
+  if (infected > 0) {
+    *infection = {.time = latest_exposure_time,
+                  .health_state = HealthState::EXPOSED};
+  }
+  return infected;
+}
+
+void HazardTransmissionModel::GetInfectionOutcomes(
+    const absl::Span<const InfectionOutcome> infection_outcomes,
+    const absl::Span<const ExposureRange> hosts,
+    const absl::Span<HealthTransition> health_transitions) {
+  DCHECK_EQ(hosts.size(), health_transitions.size());
+  thread_local std::vector<float> draws;
+  draws.resize(hosts.size());
+  GetBulkRandom().FillUniform(absl::MakeSpan(draws));
+  for (int i = 0; i < hosts.size(); ++i) {
+    absl::Time latest_exposure_time = absl::InfinitePast();
+    float sum_dose = 0;
+    for (int j = hosts[i].begin; j < hosts[i].end; ++j) {
+      AccumulateDose(infection_outcomes[j].exposure, &sum_dose,
+                     &latest_exposure_time);
+    }
+    const float prob_infection = 1 - std::exp(-lambda_ * sum_dose);
+    hazard_callback_(hosts[i].slot, prob_infection, latest_exposure_time);
+    health_transitions[i] = {.time = latest_exposure_time,
+                             .health_state = draws[i] < prob_infection
+                                                 ? HealthState::EXPOSED
+                                                 : HealthState::SUSCEPTIBLE};
+  }
+}
+
+HazardTable::HazardTable(HazardTransmissionOptions options)
+    : transmission_model_(absl::make_unique<HazardTransmissionModel>(
+          std::move(options),
+          [this](const int slot, const float hazard, const absl::Time time) {
+            SetHazard(slot, hazard, time);
+          })) {}
+
+int HazardTable::AddAgent() {
+  hazards_.push_back(0.0f);
+  times_.push_back(absl::InfinitePast());
+  return hazards_.size() - 1;
+}
+
+void HazardTable::SetHazard(const int slot, const float hazard,
+                            const absl::Time time) {
+  if (slot == kNoTransmissionSlot) return;
+  DCHECK_LT(slot, hazards_.size()) << "Hazard computed for unknown slot.";
+  hazards_[slot] = hazard;
+  times_[slot] = time;
+}
+
 }  // namespace abesim
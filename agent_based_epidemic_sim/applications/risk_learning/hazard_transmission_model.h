@@ -18,12 +18,16 @@
 #define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_RISK_LEARNING_HAZARD_TRANSMISSION_MODEL_H_
 
 #include <cmath>
+#include <functional>
 #include <memory>
 #include <type_traits>
+#include <vector>
 
 #include "absl/memory/memory.h"
+#include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
 #include "agent_based_epidemic_sim/core/transmission_model.h"
 
@@ -41,6 +45,12 @@ struct HazardTransmissionOptions {
   };
 };
 
+// Receives the probability of infection computed for the host in the given
+// slot, or kNoTransmissionSlot, along with the time of the host's latest
+// exposure.
+using HazardCallback =
+    std::function<void(int slot, float hazard, absl::Time time)>;
+
 // Models transmission between hosts as a sum of doses where each dose computes
 // a hazard as a function of (duration, distance, infectivity, symptom_factor,
 // location_transmissibility, susceptibility).
@@ -54,23 +64,60 @@ class HazardTransmissionModel : public TransmissionModel {
  public:
   HazardTransmissionModel(
       HazardTransmissionOptions options = HazardTransmissionOptions(),
-      std::function<void(const float, const absl::Time)> hazard_callback =
-          [](const float, const absl::Time) { return; })
+      HazardCallback hazard_callback = [](const int, const float,
+                                          const absl::Time) { return; })
       : lambda_(options.lambda),
         hazard_callback_(std::move(hazard_callback)),
         risk_at_distance_function_(
             std::move(options.risk_at_distance_function)) {}
 
-  // Computes the infection outcome given exposures.
+  // Computes the infection outcome given exposures.  The hazard callback is
+  // invoked with kNoTransmissionSlot.
   HealthTransition GetInfectionOutcome(
       absl::Span<const Exposure* const> exposures) override;
 
+  // Computes the infection outcome of the host in the given slot and invokes
+  // the hazard callback for it.
+  HealthTransition GetHostInfectionOutcome(
+      int slot, absl::Span<const Exposure* const> exposures) override;
+
+  // Computes the infection outcomes of a batch of hosts. Equivalent to calling
+  // GetInfectionOutcome for each host, with the random draws for the batch
+  // made together.  The hazard callback is invoked once per host.
+  void GetInfectionOutcomes(
+      absl::Span<const InfectionOutcome> infection_outcomes,
+      absl::Span<const ExposureRange> hosts,
+      absl::Span<HealthTransition> health_transitions) override;
+
+  // Samples the number of weight identical hosts infected from the binomial
+  // distribution of their common probability of infection.  The hazard
+  // callback is invoked once for the slot the hosts share.
+  int GetWeightedInfectionOutcome(int slot,
+                                  absl::Span<const Exposure* const> exposures,
+                                  int weight,
+                                  HealthTransition* infection) override;
+
+  // Combines exposures into a day-long one at distance 0 whose dose is the sum
+  // of theirs, ending with the last infectious exposure.
+  bool AggregateExposures(absl::Span<const Exposure* const> exposures,
+                          Exposure* aggregate) const override;
+
   // Computes a "viral dose" which is used directly in computing the probability
   // of infection for a given Exposure.
   float ComputeDose(float distance, absl::Duration duration,
                     const Exposure* exposure) const;
 
  private:
+  // Adds the dose of a single exposure to sum_dose and advances
+  // latest_exposure_time. Exposures with a zero factor are ignored.
+  void AccumulateDose(const Exposure& exposure, float* sum_dose,
+                      absl::Time* latest_exposure_time) const;
+  // Returns the probability that a host with the given exposures is infected,
+  // reports it to the hazard callback, and sets latest_exposure_time.
+  float ProbabilityOfInfection(int slot,
+                               absl::Span<const Exposure* const> exposures,
+                               absl::Time* latest_exposure_time) const;
+
   // TODO: Link out to actual papers or some other authoritative
   // source.
   // Typical values of lambda_ come from:
@@ -78,40 +125,48 @@ class HazardTransmissionModel : public TransmissionModel {
   //  (https://www.medrxiv.org/content/10.1101/2020.07.17.20156539v1): 2.2x10e-3
   //  Mark Briers paper (https://arxiv.org/abs/2005.11057): 0.6 / 15
   float lambda_;
-  std::function<void(float, absl::Time)> hazard_callback_;
+  HazardCallback hazard_callback_;
   // Generates a risk dosage for a given distance.
   std::function<float(float)> risk_at_distance_function_;
 };
 
-class Hazard {
+// Records the latest hazard of every registered agent.  All registered agents
+// share a single HazardTransmissionModel, which writes each host's hazard into
+// the slot assigned when the agent was added.  Agents pass their slot on
+// through Agent::TransmissionSlot, so hazards are stored in plain arrays
+// indexed by slot.  Hosts without a slot are not recorded.
+//
+// AddAgent must not be called concurrently with anything else.  Once all
+// agents are added, the transmission model may be used from several threads
+// at once as long as each host is resolved by only one of them.
+class HazardTable {
  public:
-  explicit Hazard(
-      HazardTransmissionOptions options = HazardTransmissionOptions()) {
-    auto hazard_callback = [this](const float prob_infection,
-                                  const absl::Time time) {
-      hazard_ = prob_infection;
-      time_ = time;
-    };
-    transmission_model_ = absl::make_unique<HazardTransmissionModel>(
-        options, std::move(hazard_callback));
-  }
+  explicit HazardTable(
+      HazardTransmissionOptions options = HazardTransmissionOptions());
+
+  // Registers an agent and returns its slot.
+  int AddAgent();
 
   TransmissionModel* GetTransmissionModel() {
     return transmission_model_.get();
   }
 
-  float GetHazard(const Timestep& timestep) const {
-    if (timestep.start_time() - timestep.duration() > time_) {
+  // Returns the hazard of the agent in the given slot, or 0 if it was not
+  // exposed during the previous timestep.
+  float GetHazard(int slot, const Timestep& timestep) const {
+    if (timestep.start_time() - timestep.duration() > times_[slot]) {
       // Hazard is stale.
       return 0.0f;
     }
-    return hazard_;
+    return hazards_[slot];
   }
 
  private:
-  float hazard_ = 0;
-  absl::Time time_ = absl::InfinitePast();
-  std::unique_ptr<TransmissionModel> transmission_model_;
+  void SetHazard(int slot, float hazard, absl::Time time);
+
+  std::vector<float> hazards_;
+  std::vector<absl::Time> times_;
+  std::unique_ptr<HazardTransmissionModel> transmission_model_;
 };
 
 }  // namespace abesim
@@ -129,25 +129,162 @@ TEST(HazardTransmissionModelTest,
                                   .health_state = HealthState::SUSCEPTIBLE}));
 }
 
-TEST(HazardTransmissionModelTest, GetsHazard) {
-  Hazard hazard;
-  std::vector<Exposure> exposures{{
-      .start_time = absl::UnixEpoch(),
+TEST(HazardTransmissionModelTest, GetsBatchedInfectionOutcomes) {
+  std::vector<float> hazards;
+  HazardTransmissionModel transmission_model(
+      {.risk_at_distance_function =
+           [](float distance) { return (distance <= 1) ? 10 : 0; }},
+      [&hazards](const int slot, const float hazard, const absl::Time) {
+        hazards.push_back(hazard);
+      });
+
+  const Exposure close_exposure{
       .duration = kLongDuration,
       .distance = kCloseDistance,
       .infectivity = 1,
       .symptom_factor = 1,
       .susceptibility = 1,
       .location_transmissibility = 1,
+  };
+  const Exposure far_exposure{
+      .duration = kShortDuration,
+      .distance = kFarDistance,
+      .infectivity = 1,
+      .symptom_factor = 1,
+      .susceptibility = 1,
+      .location_transmissibility = 1,
+  };
+  std::vector<InfectionOutcome> outcomes{
+      {.agent_uuid = 1, .exposure = far_exposure},
+      {.agent_uuid = 1, .exposure = close_exposure},
+      {.agent_uuid = 2, .exposure = far_exposure}};
+  std::vector<ExposureRange> hosts{{.agent_uuid = 1, .begin = 0, .end = 2},
+                                   {.agent_uuid = 2, .begin = 2, .end = 3}};
+  std::vector<HealthTransition> transitions(hosts.size());
+  transmission_model.GetInfectionOutcomes(outcomes, hosts,
+                                          absl::MakeSpan(transitions));
+
+  EXPECT_THAT(
+      transitions,
+      testing::ElementsAre(
+          HealthTransition{.time = absl::UnixEpoch() + kLongDuration,
+                           .health_state = HealthState::EXPOSED},
+          HealthTransition{.time = absl::UnixEpoch() + kShortDuration,
+                           .health_state = HealthState::SUSCEPTIBLE}));
+  EXPECT_THAT(hazards, testing::ElementsAre(1.0f, 0.0f));
+}
+
+TEST(HazardTransmissionModelTest, AggregatesExposures) {
+  std::vector<float> hazards;
+  HazardTransmissionModel transmission_model(
+      {.lambda = 0.01}, [&hazards](const int slot, const float hazard,
+                                   const absl::Time) {
+        hazards.push_back(hazard);
+      });
+  const Exposure close_exposure{
+      .duration = kLongDuration,
+      .distance = kCloseDistance,
+      .infectivity = 0.5,
+      .symptom_factor = 1,
+      .susceptibility = 0.8,
+      .location_transmissibility = 1,
+  };
+  const Exposure far_exposure{
+      .start_time = absl::UnixEpoch() + absl::Hours(3),
+      .duration = kShortDuration,
+      .distance = kFarDistance,
+      .infectivity = 1,
+      .symptom_factor = 0.5,
+      .susceptibility = 1,
+      .location_transmissibility = 1,
+  };
+  const Exposure uninfectious_exposure{
+      .start_time = absl::UnixEpoch() + absl::Hours(5),
+      .duration = kLongDuration,
+      .distance = kCloseDistance,
+      .infectivity = 0,
+  };
+  const std::vector<Exposure> exposures{close_exposure, far_exposure,
+                                        uninfectious_exposure};
+  InfectionOutcome aggregate{.agent_uuid = 1};
+  ASSERT_TRUE(transmission_model.AggregateExposures(MakePointers(exposures),
+                                                    &aggregate.exposure));
+  // The aggregate carries the hazard of all the exposures together, and ends
+  // with the last infectious one.
+  EXPECT_EQ(aggregate.exposure.start_time + aggregate.exposure.duration,
+            absl::UnixEpoch() + absl::Hours(3) + kShortDuration);
+  std::vector<InfectionOutcome> outcomes{
+      {.agent_uuid = 1, .exposure = close_exposure},
+      {.agent_uuid = 1, .exposure = far_exposure},
+      {.agent_uuid = 1, .exposure = uninfectious_exposure}};
+  std::vector<HealthTransition> transitions(1);
+  transmission_model.GetInfectionOutcomes(
+      outcomes, {{.agent_uuid = 1, .begin = 0, .end = 3}},
+      absl::MakeSpan(transitions));
+  transmission_model.GetInfectionOutcomes(
+      {aggregate}, {{.agent_uuid = 1, .begin = 0, .end = 1}},
+      absl::MakeSpan(transitions));
+  ASSERT_EQ(hazards.size(), 2);
+  EXPECT_GT(hazards[0], 0);
+  EXPECT_NEAR(hazards[1], hazards[0], 1e-6);
+
+  const std::vector<Exposure> uninfectious_exposures{uninfectious_exposure};
+  ASSERT_TRUE(transmission_model.AggregateExposures(
+      MakePointers(uninfectious_exposures), &aggregate.exposure));
+  EXPECT_EQ(aggregate.exposure.infectivity, 0);
+}
+
+TEST(HazardTableTest, GetsHazard) {
+  HazardTable hazards;
+  const int slot = hazards.AddAgent();
+  const int other_slot = hazards.AddAgent();
+  std::vector<InfectionOutcome> outcomes{{
+      .agent_uuid = 1,
+      .exposure = {.start_time = absl::UnixEpoch(),
+                   .duration = kLongDuration,
+                   .distance = kCloseDistance,
+                   .infectivity = 1,
+                   .symptom_factor = 1,
+                   .susceptibility = 1,
+                   .location_transmissibility = 1},
   }};
-  EXPECT_EQ(0.0,
-            hazard.GetHazard(Timestep(absl::UnixEpoch(), absl::Hours(24))));
-  hazard.GetTransmissionModel()->GetInfectionOutcome(MakePointers(exposures));
-  EXPECT_GT(hazard.GetHazard(
-                Timestep(absl::UnixEpoch() + absl::Hours(24), absl::Hours(24))),
-            0);
-  EXPECT_EQ(0.0, hazard.GetHazard(Timestep(absl::UnixEpoch() + absl::Hours(26),
-                                           absl::Hours(24))));
+  std::vector<ExposureRange> hosts{
+      {.agent_uuid = 1, .slot = slot, .begin = 0, .end = 1}};
+  std::vector<HealthTransition> transitions(hosts.size());
+  const Timestep first_day(absl::UnixEpoch(), absl::Hours(24));
+  EXPECT_EQ(0.0, hazards.GetHazard(slot, first_day));
+  hazards.GetTransmissionModel()->GetInfectionOutcomes(
+      outcomes, hosts, absl::MakeSpan(transitions));
+  const Timestep next_day(absl::UnixEpoch() + absl::Hours(24), absl::Hours(24));
+  EXPECT_GT(hazards.GetHazard(slot, next_day), 0);
+  EXPECT_EQ(0.0, hazards.GetHazard(other_slot, next_day));
+  const Timestep later_day(absl::UnixEpoch() + absl::Hours(26),
+                           absl::Hours(24));
+  EXPECT_EQ(0.0, hazards.GetHazard(slot, later_day));
+}
+
+TEST(HazardTableTest, GetsHazardOfSingleAndWeightedHosts) {
+  HazardTable hazards;
+  const int slot = hazards.AddAgent();
+  const int cohort_slot = hazards.AddAgent();
+  const std::vector<Exposure> exposures{
+      {.start_time = absl::UnixEpoch(),
+       .duration = kLongDuration,
+       .distance = kCloseDistance,
+       .infectivity = 1,
+       .symptom_factor = 1,
+       .susceptibility = 1,
+       .location_transmissibility = 1}};
+  const Timestep next_day(absl::UnixEpoch() + absl::Hours(24), absl::Hours(24));
+  TransmissionModel* transmission_model = hazards.GetTransmissionModel();
+  transmission_model->GetHostInfectionOutcome(slot, MakePointers(exposures));
+  EXPECT_GT(hazards.GetHazard(slot, next_day), 0);
+  EXPECT_EQ(0.0, hazards.GetHazard(cohort_slot, next_day));
+  HealthTransition infection;
+  transmission_model->GetWeightedInfectionOutcome(
+      cohort_slot, MakePointers(exposures), 3, &infection);
+  EXPECT_EQ(hazards.GetHazard(cohort_slot, next_day),
+            hazards.GetHazard(slot, next_day));
 }
 
 }  // namespace
@@ -101,6 +101,11 @@ void SummaryObserverFactory::Aggregate(
   if (!status.ok()) LOG(ERROR) << status;
 }
 
+void SummaryObserverFactory::Flush() {
+  absl::Status status = writer_->Flush();
+  if (!status.ok()) LOG(ERROR) << status;
+}
+
 LearningObserver::LearningObserver(
     Timestep timestep, const absl::Duration& reporting_delay,
     const HazardTransmissionModel* hazard_transmission_model)
@@ -282,4 +287,9 @@ void HazardHistogramObserverFactory::Aggregate(
   if (!status.ok()) LOG(ERROR) << status;
 }
 
+void HazardHistogramObserverFactory::Flush() {
+  absl::Status status = writer_->Flush();
+  if (!status.ok()) LOG(ERROR) << status;
+}
+
 }  // namespace abesim
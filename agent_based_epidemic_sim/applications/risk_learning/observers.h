@@ -29,6 +29,7 @@ class SummaryObserver : public AgentInfectionObserver {
   explicit SummaryObserver(Timestep timestep);
   void Observe(const Agent& agent,
                absl::Span<const InfectionOutcome> outcomes) override;
+  bool ObservesOutcomes() const override { return false; }
 
  private:
   friend class SummaryObserverFactory;
@@ -52,6 +53,7 @@ class SummaryObserverFactory : public ObserverFactory<SummaryObserver> {
   void Aggregate(
       const Timestep& timestep,
       absl::Span<std::unique_ptr<SummaryObserver> const> observers) override;
+  void Flush() override;
 
   static constexpr std::array kOutputStates = {
       HealthState::SUSCEPTIBLE,
@@ -125,6 +127,7 @@ class HazardHistogramObserver : public AgentInfectionObserver {
   explicit HazardHistogramObserver(Timestep timestep);
   void Observe(const Agent& agent,
                absl::Span<const InfectionOutcome> outcomes) override;
+  bool ObservesOutcomes() const override { return false; }
 
  private:
   friend class HazardHistogramObserverFactory;
@@ -142,6 +145,7 @@ class HazardHistogramObserverFactory
   void Aggregate(const Timestep& timestep,
                  absl::Span<std::unique_ptr<HazardHistogramObserver> const>
                      observers) override;
+  void Flush() override;
 
  private:
   LinearHistogram<float, internal::kHazardHistogramBuckets>
@@ -31,10 +31,12 @@
 #include "absl/types/optional.h"
 #include "agent_based_epidemic_sim/applications/risk_learning/config.pb.h"
 #include "agent_based_epidemic_sim/applications/risk_learning/risk_score.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/location_type.h"
+#include "agent_based_epidemic_sim/core/paged_arena.h"
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
 #include "agent_based_epidemic_sim/core/random.h"
 #include "agent_based_epidemic_sim/core/risk_score_model.h"
@@ -138,7 +140,8 @@ class LearningRiskScore : public RiskScore {
     const size_t current = size();
     if (current + 1 >= risk_score_per_timestep_.size()) {
       // Reallocate buffer.
-      std::vector<float> tmp(risk_score_per_timestep_.size() * 2);
+      decltype(risk_score_per_timestep_) tmp(
+          risk_score_per_timestep_.size() * 2);
       size_t id = head_id_;
       for (int i = 0; i < current; ++i) {
         tmp[i] = std::move(GetRiskScorePerTimestepById(id++));
@@ -160,19 +163,19 @@ class LearningRiskScore : public RiskScore {
   TestOutcome::Outcome GetOutcome(const absl::Time request_time) {
     if (request_time >= infection_onset_time_) {
       // Actual positive.
-      return absl::Bernoulli(GetBitGen(), tracing_policy_.test_sensitivity)
+      return absl::Bernoulli(GetBulkRandom(), tracing_policy_.test_sensitivity)
                  ? TestOutcome::POSITIVE
                  : TestOutcome::NEGATIVE;
     }
     // Actual negative.
-    return absl::Bernoulli(GetBitGen(), tracing_policy_.test_specificity)
+    return absl::Bernoulli(GetBulkRandom(), tracing_policy_.test_specificity)
                ? TestOutcome::NEGATIVE
                : TestOutcome::POSITIVE;
   }
 
   void AddExposureNotification(const Exposure& exposure,
                                const ContactReport& notification) override {
-    if (!absl::Bernoulli(GetBitGen(),
+    if (!absl::Bernoulli(GetBulkRandom(),
                          tracing_policy_.traceable_interaction_fraction)) {
       return;
     }
@@ -373,25 +376,32 @@ class LearningRiskScore : public RiskScore {
   const LearningRiskScorePolicy& risk_score_policy_;
   const LocationTypeFn location_type_;
   absl::Time infection_onset_time_;
-  std::vector<TestResult> test_results_;
+  // The histories below grow over the run, so they are paged with the rest of
+  // the agent's state.
+  std::vector<TestResult, PagedAllocator<TestResult>> test_results_;
   absl::Time latest_symptom_time_;
   absl::Time latest_contact_time_;
-  std::vector<float> risk_score_per_timestep_;
+  std::vector<float, PagedAllocator<float>> risk_score_per_timestep_;
   size_t head_ = 0;
   size_t tail_ = 0;
   size_t head_id_ = 1;
   // A mapping of observed timesteps to the indices of risk_score_per_timestep_.
   // Used for garbage collection and accounting with (potentially
   // variable-length) timesteps.
-  std::map<Timestep, size_t, TimestepComparator> timestep_to_id_;
+  std::map<Timestep, size_t, TimestepComparator,
+           PagedAllocator<std::pair<const Timestep, size_t>>>
+      timestep_to_id_;
   absl::optional<Timestep> latest_timestep_;
 };
 
 class AppEnabledRiskScore : public RiskScore {
  public:
-  explicit AppEnabledRiskScore(const bool is_app_enabled,
-                               std::unique_ptr<RiskScore> risk_score)
-      : is_app_enabled_(is_app_enabled), risk_score_(std::move(risk_score)) {}
+  AppEnabledRiskScore(const bool is_app_enabled,
+                      std::unique_ptr<RiskScore> risk_score,
+                      const bool retain_exposures_without_app)
+      : is_app_enabled_(is_app_enabled),
+        retain_exposures_without_app_(retain_exposures_without_app),
+        risk_score_(std::move(risk_score)) {}
 
   void AddHealthStateTransistion(HealthTransition transition) override {
     risk_score_->AddHealthStateTransistion(transition);
@@ -422,6 +432,11 @@ class AppEnabledRiskScore : public RiskScore {
   absl::Duration ContactRetentionDuration() const override {
     return risk_score_->ContactRetentionDuration();
   }
+  bool RetainsExposures() const override {
+    // Without the app, exposures are neither reported nor notified.
+    return (is_app_enabled_ || retain_exposures_without_app_) &&
+           risk_score_->RetainsExposures();
+  }
   float GetRiskScore() const override { return risk_score_->GetRiskScore(); }
   void RequestTest(const absl::Time time) override {
     risk_score_->RequestTest(time);
@@ -429,14 +444,15 @@ class AppEnabledRiskScore : public RiskScore {
 
  private:
   const bool is_app_enabled_;
+  const bool retain_exposures_without_app_;
   std::unique_ptr<RiskScore> risk_score_;
 };
 
 class HazardQueryingRiskScore : public RiskScore {
  public:
-  explicit HazardQueryingRiskScore(std::unique_ptr<Hazard> hazard,
-                                   std::unique_ptr<RiskScore> risk_score)
-      : hazard_(std::move(hazard)), risk_score_(std::move(risk_score)) {}
+  HazardQueryingRiskScore(const HazardTable* hazards, const int slot,
+                          std::unique_ptr<RiskScore> risk_score)
+      : hazards_(hazards), slot_(slot), risk_score_(std::move(risk_score)) {}
 
   void AddHealthStateTransistion(HealthTransition transition) override {
     risk_score_->AddHealthStateTransistion(transition);
@@ -453,13 +469,13 @@ class HazardQueryingRiskScore : public RiskScore {
     return risk_score_->GetVisitAdjustment(timestep, location_uuid);
   }
   TestResult GetTestResult(const Timestep& timestep) const override {
-    const float hazard = hazard_->GetHazard(timestep);
+    const float hazard = hazards_->GetHazard(slot_, timestep);
     // Get a test depending on the current hazard. Not realistic
     // but useful for understanding learning dynamics.
     if (absl::GetFlag(FLAGS_request_test_using_hazard) &&
         risk_score_->GetTestResult(timestep).time_requested ==
             absl::InfiniteFuture() &&
-        absl::Bernoulli(GetBitGen(), hazard)) {
+        absl::Bernoulli(GetBulkRandom(), hazard)) {
       risk_score_->RequestTest(timestep.start_time());
     }
     TestResult result = risk_score_->GetTestResult(timestep);
@@ -473,13 +489,17 @@ class HazardQueryingRiskScore : public RiskScore {
   absl::Duration ContactRetentionDuration() const override {
     return risk_score_->ContactRetentionDuration();
   }
+  bool RetainsExposures() const override {
+    return risk_score_->RetainsExposures();
+  }
   float GetRiskScore() const override { return risk_score_->GetRiskScore(); }
   void RequestTest(const absl::Time time) override {
     risk_score_->RequestTest(time);
   }
 
  private:
-  std::unique_ptr<Hazard> hazard_;
+  const HazardTable* hazards_;
+  const int slot_;
   std::unique_ptr<RiskScore> risk_score_;
 };
 
@@ -785,14 +805,16 @@ absl::StatusOr<std::unique_ptr<RiskScore>> CreateLearningRiskScore(
 }
 
 std::unique_ptr<RiskScore> CreateAppEnabledRiskScore(
-    const bool is_app_enabled, std::unique_ptr<RiskScore> risk_score) {
-  return absl::make_unique<AppEnabledRiskScore>(is_app_enabled,
-                                                std::move(risk_score));
+    const bool is_app_enabled, std::unique_ptr<RiskScore> risk_score,
+    const bool retain_exposures_without_app) {
+  return absl::make_unique<AppEnabledRiskScore>(
+      is_app_enabled, std::move(risk_score), retain_exposures_without_app);
 }
 
 std::unique_ptr<RiskScore> CreateHazardQueryingRiskScore(
-    std::unique_ptr<Hazard> hazard, std::unique_ptr<RiskScore> risk_score) {
-  return absl::make_unique<HazardQueryingRiskScore>(std::move(hazard),
+    const HazardTable* hazards, const int slot,
+    std::unique_ptr<RiskScore> risk_score) {
+  return absl::make_unique<HazardQueryingRiskScore>(hazards, slot,
                                                     std::move(risk_score));
 }
 
@@ -63,12 +63,17 @@ absl::StatusOr<std::unique_ptr<RiskScore>> CreateLearningRiskScore(
     const RiskScoreModel* risk_score_model, LocationTypeFn location_type);
 
 // Returns a risk score that toggles contact tracing behavior on the basis of
-// whether it is enabled.
+// whether it is enabled.  Agents without the app only retain their exposures
+// if retain_exposures_without_app, e.g. when an observer outputs them.
 std::unique_ptr<RiskScore> CreateAppEnabledRiskScore(
-    bool is_app_enabled, std::unique_ptr<RiskScore> risk_score);
+    bool is_app_enabled, std::unique_ptr<RiskScore> risk_score,
+    bool retain_exposures_without_app = false);
 
+// Returns a risk score that appends the hazard recorded in the given slot of
+// hazards to test results.  hazards must outlive the returned risk score.
 std::unique_ptr<RiskScore> CreateHazardQueryingRiskScore(
-    std::unique_ptr<Hazard> hazard, std::unique_ptr<RiskScore> risk_score);
+    const HazardTable* hazards, int slot,
+    std::unique_ptr<RiskScore> risk_score);
 
 }  // namespace abesim
 
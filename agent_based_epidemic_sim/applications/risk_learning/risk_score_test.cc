@@ -384,6 +384,7 @@ TEST_F(RiskScoreTest, AppEnabledRiskScoreTogglesBehaviorOn) {
                   Timestep(TimeFromDay(21), absl::Hours(24))),
               Eq(RiskScore::ContactTracingPolicy{.report_recursively = false,
                                                  .send_report = true}));
+  EXPECT_TRUE(app_enabled_risk_score->RetainsExposures());
 }
 
 TEST_F(RiskScoreTest, AppEnabledRiskScoreTogglesBehaviorOff) {
@@ -397,6 +398,11 @@ TEST_F(RiskScoreTest, AppEnabledRiskScoreTogglesBehaviorOff) {
                   Timestep(TimeFromDay(21), absl::Hours(24))),
               Eq(RiskScore::ContactTracingPolicy{.report_recursively = false,
                                                  .send_report = false}));
+  EXPECT_FALSE(app_enabled_risk_score->RetainsExposures());
+  EXPECT_TRUE(CreateAppEnabledRiskScore(/*is_app_enabled=*/false,
+                                        absl::make_unique<MockRiskScore>(),
+                                        /*retain_exposures_without_app=*/true)
+                  ->RetainsExposures());
 }
 
 TEST_F(RiskScoreTest, HazardQueryingRiskScoreAppendsHazard) {
@@ -405,19 +411,25 @@ TEST_F(RiskScoreTest, HazardQueryingRiskScoreAppendsHazard) {
   auto mock_risk_score = risk_score.get();
   auto request_time = absl::UnixEpoch() + absl::Hours(24);
   Timestep timestep(request_time, absl::Hours(24));
-  auto hazard = absl::make_unique<Hazard>();
-  std::vector<Exposure> exposures{{
-      .start_time = absl::UnixEpoch(),
-      .duration = absl::Hours(48),
-      .distance = 0,
-      .infectivity = 1,
-      .symptom_factor = 1,
-      .susceptibility = 1,
-      .location_transmissibility = 1,
+  HazardTable hazards;
+  const int slot = hazards.AddAgent();
+  std::vector<InfectionOutcome> outcomes{{
+      .agent_uuid = 1,
+      .exposure = {.start_time = absl::UnixEpoch(),
+                   .duration = absl::Hours(48),
+                   .distance = 0,
+                   .infectivity = 1,
+                   .symptom_factor = 1,
+                   .susceptibility = 1,
+                   .location_transmissibility = 1},
   }};
-  hazard->GetTransmissionModel()->GetInfectionOutcome(MakePointers(exposures));
+  std::vector<ExposureRange> hosts{
+      {.agent_uuid = 1, .slot = slot, .begin = 0, .end = 1}};
+  std::vector<HealthTransition> transitions(hosts.size());
+  hazards.GetTransmissionModel()->GetInfectionOutcomes(
+      outcomes, hosts, absl::MakeSpan(transitions));
   auto hazard_risk_score =
-      CreateHazardQueryingRiskScore(std::move(hazard), std::move(risk_score));
+      CreateHazardQueryingRiskScore(&hazards, slot, std::move(risk_score));
   {
     testing::InSequence seq;
     EXPECT_CALL(*mock_risk_score, GetTestResult(Eq(timestep)))
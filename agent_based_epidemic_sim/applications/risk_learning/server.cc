@@ -0,0 +1,511 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/risk_learning/server.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/huge_page_allocator.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+#include "google/protobuf/io/zero_copy_stream_impl.h"
+#include "google/protobuf/io/zero_copy_stream_impl_lite.h"
+#include "google/protobuf/message.h"
+#include "google/protobuf/util/delimited_message_util.h"
+
+namespace abesim {
+namespace {
+
+using google::protobuf::io::FileInputStream;
+using google::protobuf::io::StringOutputStream;
+using google::protobuf::util::ParseDelimitedFromZeroCopyStream;
+using google::protobuf::util::SerializeDelimitedToZeroCopyStream;
+
+// Clients that connect but do not send a request within this time are
+// dropped so that they do not hold on to a job slot.
+constexpr absl::Duration kRequestTimeout = absl::Minutes(1);
+
+absl::Status ErrnoStatus(absl::string_view what) {
+  return absl::InternalError(absl::StrCat(what, ": ", std::strerror(errno)));
+}
+
+absl::StatusOr<sockaddr_un> SocketAddress(absl::string_view socket_path) {
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid socket path: ", socket_path));
+  }
+  socket_path.copy(addr.sun_path, socket_path.size());
+  return addr;
+}
+
+// Identifies the population of a config by the files it is read from.
+std::string PopulationKey(const RiskLearningSimulationConfig& config) {
+  return absl::StrCat(absl::StrJoin(config.agent_file(), ","), ";",
+                      absl::StrJoin(config.location_file(), ","));
+}
+
+// Returns the size of the files that the population of config is read from.
+int64 PopulationFileBytes(const RiskLearningSimulationConfig& config) {
+  int64 bytes = 0;
+  for (const auto* files : {&config.agent_file(), &config.location_file()}) {
+    for (const std::string& file : *files) {
+      // Files that cannot be read fail to load later on.
+      struct stat st;
+      if (stat(file.c_str(), &st) == 0) bytes += st.st_size;
+    }
+  }
+  return bytes;
+}
+
+// Writes message to the socket fd, length delimited.  Writing to a peer that
+// has gone away fails with EPIPE rather than raising SIGPIPE, which would kill
+// the server along with all of its resident populations.
+absl::Status SendDelimited(const int fd,
+                           const google::protobuf::Message& message) {
+  std::string buffer;
+  {
+    StringOutputStream output(&buffer);
+    if (!SerializeDelimitedToZeroCopyStream(message, &output)) {
+      return absl::InternalError("Failed to serialize message.");
+    }
+  }
+  size_t sent = 0;
+  while (sent < buffer.size()) {
+    const ssize_t n =
+        send(fd, buffer.data() + sent, buffer.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return ErrnoStatus("send");
+    sent += n;
+  }
+  return absl::OkStatus();
+}
+
+// Returns the RunOptions of a job, whose files and port are set by the job
+// rather than by the flags.
+RunOptions JobRunOptions(const SimulationJobRequest& request) {
+  RunOptions options = RunOptionsFromFlags();
+  options.agent_state_file = request.agent_state_file();
+  options.progress_prometheus_path = request.progress_prometheus_path();
+  options.progress_json_path = request.progress_json_path();
+  options.progress_http_port = request.progress_http_port();
+  return options;
+}
+
+SimulationJobResponse ErrorResponse(const absl::Status& status) {
+  SimulationJobResponse response;
+  response.set_code(static_cast<int>(status.code()));
+  response.set_error_message(std::string(status.message()));
+  return response;
+}
+
+}  // namespace
+
+struct SimulationServer::PopulationEntry {
+  explicit PopulationEntry(std::string key) : key(std::move(key)) {}
+
+  const std::string key;
+  absl::Notification loaded;
+  absl::Status status;
+  std::unique_ptr<const Population> population;
+  int64 bytes = 0;
+  // The fields below are guarded by SimulationServer::mu_.
+  // Whether population is loaded and its bytes are reserved.  Evicting the
+  // population clears this.
+  bool resident = false;
+  // The number of admitted jobs that use population.
+  int users = 0;
+  // When population was last used, in ticks of use_clock_.
+  int64 last_used = 0;
+};
+
+SimulationServer::SimulationServer(Options options)
+    : options_(std::move(options)),
+      executor_(NewExecutor(options_.max_concurrent_jobs)) {
+  CHECK_GT(options_.max_concurrent_jobs, 0);
+  CHECK_GT(options_.max_workers_per_job, 0);
+}
+
+SimulationServer::~SimulationServer() { Shutdown(); }
+
+int SimulationServer::num_populations() const {
+  absl::MutexLock l(&mu_);
+  return populations_.size();
+}
+
+int64 SimulationServer::reserved_bytes() const {
+  absl::MutexLock l(&mu_);
+  return reserved_bytes_;
+}
+
+bool SimulationServer::HasEvictable(const PopulationEntry* keep) const {
+  for (const auto& [key, entry] : populations_) {
+    if (entry.get() != keep && entry->resident && entry->users == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SimulationServer::EvictUntilFits(
+    const int64 bytes, const PopulationEntry* keep,
+    std::vector<std::unique_ptr<const Population>>* evicted) {
+  while (reserved_bytes_ + bytes > options_.memory_budget_bytes) {
+    auto lru = populations_.end();
+    for (auto it = populations_.begin(); it != populations_.end(); ++it) {
+      const PopulationEntry& entry = *it->second;
+      if (&entry != keep && entry.resident && entry.users == 0 &&
+          (lru == populations_.end() ||
+           entry.last_used < lru->second->last_used)) {
+        lru = it;
+      }
+    }
+    if (lru == populations_.end()) return false;
+    PopulationEntry& entry = *lru->second;
+    LOG(INFO) << "Evicting population " << entry.key << " using "
+              << entry.bytes << " bytes.";
+    entry.resident = false;
+    reserved_bytes_ -= entry.bytes;
+    evicted->push_back(std::move(entry.population));
+    populations_.erase(lru);
+  }
+  return true;
+}
+
+absl::Status SimulationServer::ReservePopulation(const int64 bytes) {
+  if (bytes > options_.memory_budget_bytes) {
+    return absl::ResourceExhaustedError(
+        absl::StrCat("Population is estimated to need ", bytes,
+                     " bytes but the memory budget is only ",
+                     options_.memory_budget_bytes, " bytes."));
+  }
+  // Destroyed once mu_ is released.
+  std::vector<std::unique_ptr<const Population>> evicted;
+  absl::MutexLock l(&mu_);
+  auto may_fit = [this, bytes]() {
+    mu_.AssertHeld();
+    return reserved_bytes_ + bytes <= options_.memory_budget_bytes ||
+           HasEvictable(nullptr);
+  };
+  while (!EvictUntilFits(bytes, nullptr, &evicted)) {
+    mu_.Await(absl::Condition(&may_fit));
+  }
+  reserved_bytes_ += bytes;
+  return absl::OkStatus();
+}
+
+absl::Status SimulationServer::ReconcilePopulation(PopulationEntry* entry,
+                                                   const int64 estimate) {
+  std::vector<std::unique_ptr<const Population>> evicted;
+  absl::MutexLock l(&mu_);
+  if (entry->bytes > options_.memory_budget_bytes) {
+    reserved_bytes_ -= estimate;
+    return absl::ResourceExhaustedError(
+        absl::StrCat("Population needs ", entry->bytes,
+                     " bytes but the memory budget is only ",
+                     options_.memory_budget_bytes, " bytes."));
+  }
+  reserved_bytes_ += entry->bytes - estimate;
+  entry->resident = true;
+  entry->last_used = ++use_clock_;
+  EvictUntilFits(0, entry, &evicted);
+  return absl::OkStatus();
+}
+
+absl::StatusOr<bool> SimulationServer::AdmitJob(PopulationEntry* entry,
+                                                const int64 bytes) {
+  if (entry->bytes + bytes > options_.memory_budget_bytes) {
+    return absl::ResourceExhaustedError(absl::StrCat(
+        "Job needs ", bytes, " bytes but only ",
+        options_.memory_budget_bytes - entry->bytes,
+        " bytes of the memory budget are not used by its population."));
+  }
+  std::vector<std::unique_ptr<const Population>> evicted;
+  absl::MutexLock l(&mu_);
+  auto ready = [this, entry, bytes]() {
+    mu_.AssertHeld();
+    return !entry->resident ||
+           (running_jobs_ < options_.max_concurrent_jobs &&
+            (reserved_bytes_ + bytes <= options_.memory_budget_bytes ||
+             HasEvictable(entry)));
+  };
+  do {
+    mu_.Await(absl::Condition(&ready));
+    if (!entry->resident) return false;
+  } while (!EvictUntilFits(bytes, entry, &evicted));
+  reserved_bytes_ += bytes;
+  ++running_jobs_;
+  ++entry->users;
+  entry->last_used = ++use_clock_;
+  return true;
+}
+
+void SimulationServer::ReleaseJob(PopulationEntry* entry, const int64 bytes) {
+  bool idle;
+  {
+    absl::MutexLock l(&mu_);
+    reserved_bytes_ -= bytes;
+    --running_jobs_;
+    --entry->users;
+    entry->last_used = ++use_clock_;
+    idle = running_jobs_ == 0;
+  }
+  // Jobs that overlap reuse each other's freed queue pages, so they are only
+  // returned to the system once no job is running.
+  if (idle) ReleaseFreeHugePages();
+}
+
+absl::StatusOr<std::shared_ptr<SimulationServer::PopulationEntry>>
+SimulationServer::GetPopulation(const RiskLearningSimulationConfig& config) {
+  const std::string key = PopulationKey(config);
+  std::shared_ptr<PopulationEntry> entry;
+  bool load = false;
+  {
+    absl::MutexLock l(&mu_);
+    std::shared_ptr<PopulationEntry>& slot = populations_[key];
+    if (slot == nullptr) {
+      slot = std::make_shared<PopulationEntry>(key);
+      load = true;
+    }
+    entry = slot;
+  }
+  if (!load) {
+    entry->loaded.WaitForNotification();
+    if (!entry->status.ok()) return entry->status;
+    return entry;
+  }
+
+  // Reserve memory for the population before loading it, so that loading
+  // does not overrun the budget by the size of a whole population.
+  const int64 estimate =
+      PopulationFileBytes(config) * options_.population_memory_factor;
+  entry->status = ReservePopulation(estimate);
+  if (entry->status.ok()) {
+    const absl::Time start = absl::Now();
+    auto population = LoadPopulation(config);
+    if (population.ok()) {
+      entry->bytes = (*population)->SpaceUsed();
+      LOG(INFO) << "Loaded population " << key << " with "
+                << (*population)->agents.size() << " agents and "
+                << (*population)->locations.size() << " locations using "
+                << entry->bytes << " bytes (estimated " << estimate
+                << ") in " << absl::Now() - start;
+      entry->population = std::move(*population);
+      entry->status = ReconcilePopulation(entry.get(), estimate);
+    } else {
+      entry->status = population.status();
+      absl::MutexLock l(&mu_);
+      reserved_bytes_ -= estimate;
+    }
+  }
+  if (!entry->status.ok()) {
+    // Drop the entry so that a later job can try again.
+    entry->population.reset();
+    absl::MutexLock l(&mu_);
+    populations_.erase(key);
+  }
+  entry->loaded.Notify();
+  if (!entry->status.ok()) return entry->status;
+  return entry;
+}
+
+SimulationJobResponse SimulationServer::RunJob(
+    const SimulationJobRequest& request) {
+  const absl::Time queued = absl::Now();
+  std::shared_ptr<PopulationEntry> entry;
+  int64 job_bytes = 0;
+  while (entry == nullptr) {
+    auto population = GetPopulation(request.config());
+    if (!population.ok()) return ErrorResponse(population.status());
+    job_bytes = (*population)->bytes * options_.job_memory_factor;
+    auto admitted = AdmitJob(population->get(), job_bytes);
+    if (!admitted.ok()) return ErrorResponse(admitted.status());
+    // Otherwise the population was evicted while the job waited.
+    if (*admitted) entry = *std::move(population);
+  }
+  const absl::Time start = absl::Now();
+
+  RiskLearningSimulationConfig config = request.config();
+  std::string inline_summary_file;
+  if (request.inline_summary() && config.summary_filename().empty()) {
+    int64 job_id;
+    {
+      absl::MutexLock l(&mu_);
+      job_id = next_job_id_++;
+    }
+    inline_summary_file = absl::StrCat(options_.scratch_dir, "/simulation_",
+                                       getpid(), "_", job_id, ".summary");
+    config.set_summary_filename(inline_summary_file);
+  }
+  absl::Status status = RunSimulation(
+      config, *entry->population,
+      std::clamp(request.num_workers(), 1, options_.max_workers_per_job),
+      JobRunOptions(request));
+  ReleaseJob(entry.get(), job_bytes);
+
+  SimulationJobResponse response = ErrorResponse(status);
+  if (status.ok()) {
+    for (const std::string& filename :
+         {config.summary_filename(), config.learning_filename(),
+          config.hazard_histogram_filename()}) {
+      if (!filename.empty() && filename != inline_summary_file) {
+        response.add_output_files(filename);
+      }
+    }
+    if (request.inline_summary()) {
+      status = file::GetContents(config.summary_filename(),
+                                 response.mutable_summary());
+      if (!status.ok()) response = ErrorResponse(status);
+    }
+  }
+  if (!inline_summary_file.empty()) std::remove(inline_summary_file.c_str());
+  response.set_queued_seconds(absl::ToDoubleSeconds(start - queued));
+  response.set_run_seconds(absl::ToDoubleSeconds(absl::Now() - start));
+  return response;
+}
+
+void SimulationServer::HandleConnection(const int fd) {
+  const timeval timeout = absl::ToTimeval(kRequestTimeout);
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  SimulationJobRequest request;
+  bool parsed;
+  {
+    FileInputStream input(fd);
+    parsed = ParseDelimitedFromZeroCopyStream(&request, &input, nullptr);
+  }
+  if (!parsed) {
+    LOG(WARNING) << "Dropping connection without a valid job request.";
+  } else if (absl::Status status = SendDelimited(fd, RunJob(request));
+             !status.ok()) {
+    LOG(WARNING) << "Failed to send job response: " << status;
+  }
+  close(fd);
+}
+
+int SimulationServer::NextConnection() {
+  absl::MutexLock l(&mu_);
+  CHECK(!connections_.empty());
+  const int fd = connections_.front();
+  connections_.pop_front();
+  return fd;
+}
+
+absl::Status SimulationServer::Serve() {
+  const RunOptions flags = RunOptionsFromFlags();
+  if (!flags.agent_state_file.empty() ||
+      !flags.progress_prometheus_path.empty() ||
+      !flags.progress_json_path.empty() || flags.progress_http_port != 0) {
+    return absl::InvalidArgumentError(
+        "Every job would use the same --agent_state_file and --progress_ "
+        "files and port.  Set them in each SimulationJobRequest instead.");
+  }
+  auto addr = SocketAddress(options_.socket_path);
+  if (!addr.ok()) return addr.status();
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return ErrnoStatus("socket");
+  // Remove the socket of a previous server that did not shut down cleanly.
+  unlink(options_.socket_path.c_str());
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&*addr), sizeof(*addr)) ||
+      listen(fd, SOMAXCONN)) {
+    absl::Status status = ErrnoStatus(options_.socket_path);
+    close(fd);
+    return status;
+  }
+  {
+    absl::MutexLock l(&mu_);
+    if (shutdown_) {
+      close(fd);
+      return absl::OkStatus();
+    }
+    listen_fd_ = fd;
+  }
+  LOG(INFO) << "Serving simulation jobs on " << options_.socket_path;
+
+  absl::Status status;
+  auto execution = executor_->NewExecution();
+  while (true) {
+    const int connection = accept(fd, nullptr, nullptr);
+    if (connection >= 0) {
+      // The executor does not run work in the order it is added, so each
+      // task takes the oldest waiting connection instead of its own.
+      {
+        absl::MutexLock l(&mu_);
+        connections_.push_back(connection);
+      }
+      execution->Add([this]() { HandleConnection(NextConnection()); });
+      continue;
+    }
+    if (errno == EINTR || errno == ECONNABORTED) continue;
+    absl::MutexLock l(&mu_);
+    if (!shutdown_) status = ErrnoStatus("accept");
+    break;
+  }
+  execution->Wait();
+  {
+    absl::MutexLock l(&mu_);
+    listen_fd_ = -1;
+  }
+  close(fd);
+  unlink(options_.socket_path.c_str());
+  return status;
+}
+
+void SimulationServer::Shutdown() {
+  absl::MutexLock l(&mu_);
+  shutdown_ = true;
+  // Wakes up the accept in Serve.
+  if (listen_fd_ >= 0) shutdown(listen_fd_, SHUT_RDWR);
+}
+
+absl::StatusOr<SimulationJobResponse> SubmitSimulationJob(
+    const absl::string_view socket_path, const SimulationJobRequest& request) {
+  auto addr = SocketAddress(socket_path);
+  if (!addr.ok()) return addr.status();
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) return ErrnoStatus("socket");
+  SimulationJobResponse response;
+  absl::Status status;
+  if (connect(fd, reinterpret_cast<const sockaddr*>(&*addr), sizeof(*addr))) {
+    status = ErrnoStatus(socket_path);
+  } else if (absl::Status sent = SendDelimited(fd, request); !sent.ok()) {
+    status = sent;
+  } else {
+    FileInputStream input(fd);
+    if (!ParseDelimitedFromZeroCopyStream(&response, &input, nullptr)) {
+      status = absl::UnavailableError("No job response from server.");
+    }
+  }
+  close(fd);
+  if (!status.ok()) return status;
+  return response;
+}
+
+}  // namespace abesim
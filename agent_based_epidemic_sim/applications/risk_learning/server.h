@@ -0,0 +1,148 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_RISK_LEARNING_SERVER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_RISK_LEARNING_SERVER_H_
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "agent_based_epidemic_sim/applications/risk_learning/server.pb.h"
+#include "agent_based_epidemic_sim/applications/risk_learning/simulation.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+
+namespace abesim {
+
+// SimulationServer runs simulation jobs against populations that it keeps in
+// memory, so that only the first job using a given set of agent and location
+// files pays for reading them.  Each job builds its own agents and locations
+// from the shared population, so concurrent jobs do not share any dynamic
+// state.
+//
+// Jobs are admitted when a job slot is free and the memory they are expected
+// to need fits in the server's budget alongside the resident populations and
+// the jobs already running.  Populations that no admitted job uses are
+// evicted, least recently used first, when a population or job would not fit
+// otherwise.  Jobs that could never fit are rejected.  Jobs received over the
+// socket take free job slots in the order they connected.
+class SimulationServer {
+ public:
+  struct Options {
+    // Unix domain socket to listen on.
+    std::string socket_path;
+    // Maximum number of jobs to run at once.
+    int max_concurrent_jobs = 4;
+    // Jobs asking for more worker threads than this get this many.
+    int max_workers_per_job = 16;
+    // Memory available to resident populations and running jobs.
+    int64 memory_budget_bytes = int64{16} << 30;
+    // The memory a job needs is estimated as this multiple of the size of the
+    // population it simulates.
+    double job_memory_factor = 2.0;
+    // The memory a population needs is estimated, before it is loaded, as
+    // this multiple of the size of its files.  The estimate is replaced by
+    // the population's actual size once it has been loaded.
+    double population_memory_factor = 4.0;
+    // Directory for summaries that are returned inline.
+    std::string scratch_dir = "/tmp";
+  };
+
+  explicit SimulationServer(Options options);
+  ~SimulationServer();
+
+  SimulationServer(const SimulationServer&) = delete;
+  SimulationServer& operator=(const SimulationServer&) = delete;
+
+  // Accepts jobs on options.socket_path until Shutdown is called, then waits
+  // for the jobs in progress to finish.
+  absl::Status Serve();
+  // Stops Serve from accepting new jobs.  May be called from any thread.
+  void Shutdown();
+
+  // Runs a single job, blocking until it has been admitted and has finished.
+  // The job's files and port are those of the request, whatever the flags.
+  SimulationJobResponse RunJob(const SimulationJobRequest& request);
+
+  int num_populations() const;
+  // Bytes of the memory budget currently in use.
+  int64 reserved_bytes() const;
+
+ private:
+  struct PopulationEntry;
+
+  // Returns the population named by config, loading it if necessary.
+  absl::StatusOr<std::shared_ptr<PopulationEntry>> GetPopulation(
+      const RiskLearningSimulationConfig& config);
+  // Blocks until the estimated bytes of a population that is about to be
+  // loaded fit in the memory budget.  Fails if they can never fit.
+  absl::Status ReservePopulation(int64 bytes);
+  // Replaces the estimate reserved for entry by the size of its loaded
+  // population.  A population larger than its estimate may overrun the budget
+  // until enough of the memory in use is released.
+  absl::Status ReconcilePopulation(PopulationEntry* entry, int64 estimate);
+  // Blocks until a job slot is free and bytes fit in the memory budget
+  // alongside the job's population, then admits the job.  Returns false if the
+  // population was evicted in the meantime, in which case it must be loaded
+  // again.  Fails if bytes can never fit.
+  absl::StatusOr<bool> AdmitJob(PopulationEntry* entry, int64 bytes);
+  void ReleaseJob(PopulationEntry* entry, int64 bytes);
+  // Evicts unused populations other than keep, least recently used first,
+  // until bytes fit in the memory budget.  Returns whether they fit.  The
+  // evicted populations are moved to evicted so that they can be destroyed
+  // once mu_ is released.
+  bool EvictUntilFits(int64 bytes, const PopulationEntry* keep,
+                      std::vector<std::unique_ptr<const Population>>* evicted)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Whether a population other than keep could be evicted.
+  bool HasEvictable(const PopulationEntry* keep) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void HandleConnection(int fd);
+  // Removes and returns the connection that has waited longest.
+  int NextConnection();
+
+  const Options options_;
+  std::unique_ptr<Executor> executor_;
+
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::string, std::shared_ptr<PopulationEntry>>
+      populations_ ABSL_GUARDED_BY(mu_);
+  int64 reserved_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+  int running_jobs_ ABSL_GUARDED_BY(mu_) = 0;
+  // Orders the uses of populations, for eviction.
+  int64 use_clock_ ABSL_GUARDED_BY(mu_) = 0;
+  int64 next_job_id_ ABSL_GUARDED_BY(mu_) = 0;
+  // Accepted connections waiting for a job slot, oldest first.
+  std::deque<int> connections_ ABSL_GUARDED_BY(mu_);
+  int listen_fd_ ABSL_GUARDED_BY(mu_) = -1;
+  bool shutdown_ ABSL_GUARDED_BY(mu_) = false;
+};
+
+// Sends request to the SimulationServer listening on socket_path and waits for
+// its response.
+absl::StatusOr<SimulationJobResponse> SubmitSimulationJob(
+    absl::string_view socket_path, const SimulationJobRequest& request);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_RISK_LEARNING_SERVER_H_
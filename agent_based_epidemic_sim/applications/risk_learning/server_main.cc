@@ -0,0 +1,99 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <iostream>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "agent_based_epidemic_sim/applications/risk_learning/config.pb.h"
+#include "agent_based_epidemic_sim/applications/risk_learning/server.h"
+#include "agent_based_epidemic_sim/applications/risk_learning/server.pb.h"
+#include "agent_based_epidemic_sim/applications/risk_learning/simulation.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+ABSL_FLAG(std::string, socket_path, "", "Unix domain socket of the server.");
+ABSL_FLAG(int, max_concurrent_jobs, 4,
+          "Maximum number of jobs to run at once.");
+ABSL_FLAG(int, max_workers_per_job, 16,
+          "Maximum number of worker threads of a single job.");
+ABSL_FLAG(int, memory_budget_gb, 16,
+          "Memory available to resident populations and running jobs.");
+ABSL_FLAG(double, job_memory_factor, 2.0,
+          "Estimated memory use of a job as a multiple of the size of the "
+          "population it simulates.");
+ABSL_FLAG(double, population_memory_factor, 4.0,
+          "Estimated memory use of a population, before it is loaded, as a "
+          "multiple of the size of its files.");
+ABSL_FLAG(std::string, scratch_dir, "/tmp",
+          "Directory for summaries that are returned inline.");
+ABSL_FLAG(std::string, job_config_pbtxt_path, "",
+          "If set, submit this SimulationConfig to the server at "
+          "--socket_path and print the response instead of serving.");
+ABSL_FLAG(int, num_workers, 1,
+          "The number of thread workers to use for a submitted job.");
+
+namespace abesim {
+
+int Submit() {
+  std::string contents;
+  CHECK_EQ(absl::OkStatus(),
+           file::GetContents(absl::GetFlag(FLAGS_job_config_pbtxt_path),
+                             &contents));
+  SimulationJobRequest request;
+  *request.mutable_config() =
+      ParseTextProtoOrDie<RiskLearningSimulationConfig>(contents);
+  request.set_num_workers(absl::GetFlag(FLAGS_num_workers));
+  // The run flags of the client apply to its job.
+  const RunOptions options = RunOptionsFromFlags();
+  request.set_agent_state_file(options.agent_state_file);
+  request.set_progress_prometheus_path(options.progress_prometheus_path);
+  request.set_progress_json_path(options.progress_json_path);
+  request.set_progress_http_port(options.progress_http_port);
+  request.set_inline_summary(request.config().summary_filename().empty());
+  auto response =
+      SubmitSimulationJob(absl::GetFlag(FLAGS_socket_path), request);
+  if (!response.ok()) LOG(FATAL) << response.status();
+  std::cout << response->DebugString();
+  return response->code() == 0 ? 0 : 1;
+}
+
+int Main(int argc, char** argv) {
+  if (!absl::GetFlag(FLAGS_job_config_pbtxt_path).empty()) return Submit();
+  SimulationServer server({
+      .socket_path = absl::GetFlag(FLAGS_socket_path),
+      .max_concurrent_jobs = absl::GetFlag(FLAGS_max_concurrent_jobs),
+      .max_workers_per_job = absl::GetFlag(FLAGS_max_workers_per_job),
+      .memory_budget_bytes =
+          static_cast<int64>(absl::GetFlag(FLAGS_memory_budget_gb)) << 30,
+      .job_memory_factor = absl::GetFlag(FLAGS_job_memory_factor),
+      .population_memory_factor =
+          absl::GetFlag(FLAGS_population_memory_factor),
+      .scratch_dir = absl::GetFlag(FLAGS_scratch_dir),
+  });
+  absl::Status status = server.Serve();
+  if (!status.ok()) {
+    LOG(FATAL) << status;
+  }
+  return 0;
+}
+
+}  // namespace abesim
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+  return abesim::Main(argc, argv);
+}
@@ -0,0 +1,295 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/applications/risk_learning/server.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <thread>  // NOLINT: Open source only.
+#include <vector>
+
+#include "absl/flags/declare.h"
+#include "absl/flags/flag.h"
+#include "absl/flags/reflection.h"
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
+#include "agent_based_epidemic_sim/applications/risk_learning/config.pb.h"
+#include "agent_based_epidemic_sim/applications/risk_learning/server.pb.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/util/records.h"
+#include "gmock/gmock.h"
+#include "google/protobuf/util/delimited_message_util.h"
+#include "gtest/gtest.h"
+
+ABSL_DECLARE_FLAG(std::string, agent_state_file);
+
+namespace abesim {
+namespace {
+
+constexpr char kConfigPath[] =
+    "agent_based_epidemic_sim/applications/risk_learning/"
+    "testdata/config.pbtxt";
+
+std::string TestPath(absl::string_view name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+// Writes a population to files whose names start with name and prepares a
+// request to simulate it.
+void PrepareRequest(SimulationJobRequest* request,
+                    absl::string_view name = "server") {
+  std::string contents;
+  PANDEMIC_ASSERT_OK(file::GetContents(kConfigPath, &contents));
+  RiskLearningSimulationConfig& config = *request->mutable_config();
+  config = ParseTextProtoOrDie<RiskLearningSimulationConfig>(contents);
+  config.add_location_file(TestPath(absl::StrCat(name, "_locations")));
+  config.add_agent_file(TestPath(absl::StrCat(name, "_agents")));
+  std::vector<LocationProto> locations(2);
+  for (int i = 0; i < locations.size(); ++i) {
+    locations[i].mutable_reference()->set_uuid(1000 + i);
+    locations[i].mutable_reference()->set_type(
+        i == 0 ? LocationReference::HOUSEHOLD : LocationReference::BUSINESS);
+    GraphLocation* graph = locations[i].mutable_graph();
+    for (int j = 1; j < 50; ++j) {
+      GraphLocation::Edge* edge = graph->add_edges();
+      edge->set_uuid_a(j);
+      edge->set_uuid_b(j + 1);
+    }
+  }
+  auto location_writer = MakeRecordWriter(config.location_file(0), 0);
+  for (const LocationProto& location : locations) {
+    location_writer.WriteRecord(location);
+  }
+  if (!location_writer.Close()) PANDEMIC_ASSERT_OK(location_writer.status());
+  auto agent_writer = MakeRecordWriter(config.agent_file(0), 0);
+  for (int i = 1; i <= 50; ++i) {
+    AgentProto agent;
+    agent.set_uuid(i);
+    agent.set_population_profile_id(1);
+    for (const LocationProto& location : locations) {
+      *agent.add_locations() = location.reference();
+    }
+    agent_writer.WriteRecord(agent);
+  }
+  if (!agent_writer.Close()) PANDEMIC_ASSERT_OK(agent_writer.status());
+  request->set_num_workers(1);
+  request->set_inline_summary(true);
+}
+
+void ExpectSummary(const SimulationJobResponse& response) {
+  EXPECT_EQ(response.code(), 0) << response.error_message();
+  EXPECT_TRUE(absl::StartsWith(response.summary(), "DATE"))
+      << response.summary();
+  EXPECT_GE(response.queued_seconds(), 0);
+}
+
+TEST(SimulationServerTest, KeepsPopulationsResident) {
+  SimulationServer server({.max_concurrent_jobs = 2,
+                           .scratch_dir = getenv("TEST_TMPDIR")});
+  SimulationJobRequest request;
+  PrepareRequest(&request);
+  const SimulationJobResponse first = server.RunJob(request);
+  ExpectSummary(first);
+  EXPECT_EQ(server.num_populations(), 1);
+  const int64 resident_bytes = server.reserved_bytes();
+  EXPECT_GT(resident_bytes, 0);
+
+  // The same population is reused even once its files are gone.
+  std::remove(request.config().agent_file(0).c_str());
+  request.set_num_workers(2);
+  const SimulationJobResponse second = server.RunJob(request);
+  ExpectSummary(second);
+  EXPECT_EQ(server.num_populations(), 1);
+  EXPECT_EQ(server.reserved_bytes(), resident_bytes);
+}
+
+TEST(SimulationServerTest, ReportsOutputFiles) {
+  SimulationServer server({});
+  SimulationJobRequest request;
+  PrepareRequest(&request);
+  request.set_inline_summary(false);
+  request.mutable_config()->set_summary_filename(TestPath("server_summary"));
+  // More workers than the server allows are clamped.
+  request.set_num_workers(1 << 20);
+  const SimulationJobResponse response = server.RunJob(request);
+  EXPECT_EQ(response.code(), 0) << response.error_message();
+  EXPECT_THAT(response.output_files(),
+              testing::ElementsAre(TestPath("server_summary")));
+  EXPECT_TRUE(response.summary().empty());
+}
+
+TEST(SimulationServerTest, RejectsJobsThatCannotFit) {
+  SimulationJobRequest request;
+  PrepareRequest(&request);
+  {
+    // The population itself does not fit.
+    SimulationServer server({.memory_budget_bytes = 1});
+    const SimulationJobResponse response = server.RunJob(request);
+    EXPECT_EQ(response.code(),
+              static_cast<int>(absl::StatusCode::kResourceExhausted));
+    EXPECT_EQ(server.num_populations(), 0);
+    EXPECT_EQ(server.reserved_bytes(), 0);
+  }
+  {
+    // The population fits, but there is no room to simulate it.
+    SimulationServer server({.memory_budget_bytes = int64{1} << 30,
+                             .job_memory_factor = 1e6});
+    const SimulationJobResponse response = server.RunJob(request);
+    EXPECT_EQ(response.code(),
+              static_cast<int>(absl::StatusCode::kResourceExhausted))
+        << response.error_message();
+    EXPECT_EQ(server.num_populations(), 1);
+  }
+}
+
+TEST(SimulationServerTest, EvictsUnusedPopulations) {
+  SimulationJobRequest first;
+  PrepareRequest(&first, "evict_first");
+  SimulationJobRequest second;
+  PrepareRequest(&second, "evict_second");
+  int64 population_bytes;
+  {
+    SimulationServer server({.scratch_dir = getenv("TEST_TMPDIR")});
+    ExpectSummary(server.RunJob(first));
+    population_bytes = server.reserved_bytes();
+  }
+
+  // There is room for a population and its job, but not for two populations
+  // and a job.
+  SimulationServer server({.memory_budget_bytes = 3 * population_bytes - 1,
+                           .job_memory_factor = 1.0,
+                           .scratch_dir = getenv("TEST_TMPDIR")});
+  ExpectSummary(server.RunJob(first));
+  ExpectSummary(server.RunJob(second));
+  EXPECT_EQ(server.num_populations(), 1);
+  EXPECT_EQ(server.reserved_bytes(), population_bytes);
+  // The first population is loaded again, evicting the second.
+  ExpectSummary(server.RunJob(first));
+  EXPECT_EQ(server.num_populations(), 1);
+  EXPECT_EQ(server.reserved_bytes(), population_bytes);
+}
+
+TEST(SimulationServerTest, RunsConcurrentJobsWithTheirOwnFiles) {
+  SimulationServer server({.max_concurrent_jobs = 2,
+                           .scratch_dir = getenv("TEST_TMPDIR")});
+  SimulationJobRequest request;
+  PrepareRequest(&request);
+  std::vector<SimulationJobResponse> responses(2);
+  std::vector<std::thread> jobs;
+  for (int i = 0; i < responses.size(); ++i) {
+    jobs.emplace_back([&server, &request, &responses, i]() {
+      SimulationJobRequest job = request;
+      job.set_agent_state_file(TestPath(absl::StrCat("job_state_", i)));
+      job.set_progress_json_path(TestPath(absl::StrCat("job_progress_", i)));
+      responses[i] = server.RunJob(job);
+    });
+  }
+  for (std::thread& job : jobs) job.join();
+  for (int i = 0; i < responses.size(); ++i) {
+    ExpectSummary(responses[i]);
+    std::string progress;
+    PANDEMIC_EXPECT_OK(file::GetContents(
+        TestPath(absl::StrCat("job_progress_", i)), &progress));
+  }
+}
+
+TEST(SimulationServerTest, RejectsRunFlagsSharedByJobs) {
+  absl::FlagSaver flag_saver;
+  absl::SetFlag(&FLAGS_agent_state_file, TestPath("shared_state"));
+  SimulationServer server({.socket_path = TestPath("server_flags_socket"),
+                           .scratch_dir = getenv("TEST_TMPDIR")});
+  EXPECT_EQ(server.Serve().code(), absl::StatusCode::kInvalidArgument);
+}
+
+TEST(SimulationServerTest, ServesJobsOverSocket) {
+  const std::string socket_path = TestPath("server_socket");
+  SimulationServer server({.socket_path = socket_path,
+                           .max_concurrent_jobs = 2,
+                           .scratch_dir = getenv("TEST_TMPDIR")});
+  absl::Status serve_status;
+  std::thread serve([&server, &serve_status]() {
+    serve_status = server.Serve();
+  });
+
+  SimulationJobRequest request;
+  PrepareRequest(&request);
+  std::vector<std::thread> clients;
+  std::vector<absl::StatusOr<SimulationJobResponse>> responses(
+      3, absl::UnknownError(""));
+  for (int i = 0; i < responses.size(); ++i) {
+    clients.emplace_back([&socket_path, &request, &responses, i]() {
+      // Wait for the server to start listening.
+      for (int attempt = 0; attempt < 100; ++attempt) {
+        responses[i] = SubmitSimulationJob(socket_path, request);
+        if (responses[i].ok()) return;
+        absl::SleepFor(absl::Milliseconds(20));
+      }
+    });
+  }
+  for (std::thread& client : clients) client.join();
+  server.Shutdown();
+  serve.join();
+  PANDEMIC_EXPECT_OK(serve_status);
+  for (const auto& response : responses) {
+    PANDEMIC_ASSERT_OK(response.status());
+    ExpectSummary(*response);
+  }
+  EXPECT_EQ(server.num_populations(), 1);
+}
+
+TEST(SimulationServerTest, SurvivesClientsThatDisconnect) {
+  const std::string socket_path = TestPath("server_disconnect_socket");
+  SimulationServer server({.socket_path = socket_path,
+                           .max_concurrent_jobs = 1,
+                           .scratch_dir = getenv("TEST_TMPDIR")});
+  std::thread serve([&server]() { PANDEMIC_EXPECT_OK(server.Serve()); });
+
+  SimulationJobRequest request;
+  PrepareRequest(&request);
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  socket_path.copy(addr.sun_path, socket_path.size());
+  // Send a request and hang up without waiting for its response.
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_GE(fd, 0);
+  for (int attempt = 0; attempt < 100; ++attempt) {
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+                sizeof(addr)) == 0) {
+      break;
+    }
+    absl::SleepFor(absl::Milliseconds(20));
+  }
+  ASSERT_TRUE(
+      google::protobuf::util::SerializeDelimitedToFileDescriptor(request, fd));
+  close(fd);
+
+  // The server is still there for the next client.
+  const auto response = SubmitSimulationJob(socket_path, request);
+  server.Shutdown();
+  serve.join();
+  PANDEMIC_ASSERT_OK(response.status());
+  ExpectSummary(*response);
+}
+
+}  // namespace
+}  // namespace abesim
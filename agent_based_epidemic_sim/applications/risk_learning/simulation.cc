@@ -16,10 +16,13 @@
 
 #include <fcntl.h>
 
+#include <algorithm>
+#include <iterator>
 #include <memory>
 #include <random>
 #include <string>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "absl/container/fixed_array.h"
@@ -33,6 +36,8 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/agent_synthesis/location_decoder.h"
 #include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "agent_based_epidemic_sim/applications/risk_learning/config.pb.h"
 #include "agent_based_epidemic_sim/applications/risk_learning/hazard_transmission_model.h"
@@ -42,15 +47,18 @@
 #include "agent_based_epidemic_sim/applications/risk_learning/triple_exposure_generator.h"
 #include "agent_based_epidemic_sim/applications/risk_learning/triple_exposure_generator_builder.h"
 #include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
 #include "agent_based_epidemic_sim/core/enum_indexed_array.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
 #include "agent_based_epidemic_sim/core/graph_location.h"
 #include "agent_based_epidemic_sim/core/micro_exposure_generator.h"
+#include "agent_based_epidemic_sim/core/paged_arena.h"
 #include "agent_based_epidemic_sim/core/parameter_distribution.pb.h"
 #include "agent_based_epidemic_sim/core/ptts_transition_model.h"
 #include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/core/progress_exporter.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
 #include "agent_based_epidemic_sim/core/seir_agent.h"
 #include "agent_based_epidemic_sim/core/simulation.h"
@@ -67,6 +75,21 @@ ABSL_FLAG(int, num_reader_threads, 16,
 ABSL_FLAG(bool, disable_learning_observer, false,
           "If true, disable writing learning outputs.");
 ABSL_FLAG(int, max_population, -1, "If nonnegative, the max number of agents.");
+ABSL_FLAG(std::string, agent_state_file, "",
+          "If set, run out of core, keeping agent state in a temporary file "
+          "at this path rather than in memory.");
+ABSL_FLAG(int, agent_state_file_gb, 64,
+          "Maximum size of --agent_state_file in gigabytes.");
+ABSL_FLAG(std::string, progress_prometheus_path, "",
+          "If set, periodically write the progress of the run to this file in "
+          "the Prometheus text format.");
+ABSL_FLAG(std::string, progress_json_path, "",
+          "If set, periodically write the progress of the run to this file as "
+          "JSON.");
+ABSL_FLAG(int, progress_http_port, 0,
+          "If nonzero, serve the progress of the run on this localhost port.");
+ABSL_FLAG(absl::Duration, progress_interval, absl::Seconds(30),
+          "How often to write the progress of the run.");
 
 namespace abesim {
 namespace {
@@ -76,6 +99,15 @@ struct PopulationProfileData {
   std::negative_binomial_distribution<int> random_edges_distribution;
 };
 
+// Samples the random location edges of a visit.  Profiles whose mean does not
+// fit in a visit are rejected when the simulation is built, so only rare draws
+// from the tail are clamped.
+template <typename URBG>
+int16 SampleRandomLocationEdges(PopulationProfileData& profile, URBG&& gen) {
+  return std::min(profile.random_edges_distribution(gen),
+                  kMaxRandomLocationEdges);
+}
+
 // Generates visits to an agent's configured locations lasting a
 // profile-dependent duration, and having a profile-dependent susceptibility.
 class RiskLearningVisitGenerator : public VisitGenerator {
@@ -111,8 +143,7 @@ class RiskLearningVisitGenerator : public VisitGenerator {
                [mean = visit_duration.gaussian_distribution().mean(),
                 stddev = visit_duration.gaussian_distribution().stddev()](
                    float adjustment) {
-                 return absl::Gaussian<float>(GetBitGen(), mean * adjustment,
-                                              stddev);
+                 return mean * adjustment + stddev * GetBulkRandom().Normal();
                }});
     }
     return durations;
@@ -130,9 +161,9 @@ class RiskLearningVisitGenerator : public VisitGenerator {
 
   static VisitLocationDynamics GenerateVisitDynamics(
       PopulationProfileData& profile) {
-    absl::BitGenRef gen = GetBitGen();
     return {
-        .random_location_edges = profile.random_edges_distribution(gen),
+        .random_location_edges =
+            SampleRandomLocationEdges(profile, GetBulkRandom()),
     };
   }
 
@@ -174,6 +205,23 @@ const ProximityConfigProto* DefaultProximityConfig(
   return nullptr;
 }
 
+// Adds tasks to exec that call fn on each of items, splitting items into one
+// chunk per reader thread.  Each task stops at the first item for which fn
+// returns false.
+template <typename T, typename Fn>
+void AddChunks(Execution& exec, const std::vector<T>& items, Fn fn) {
+  const int num_chunks = absl::GetFlag(FLAGS_num_reader_threads);
+  const size_t chunk_size = (items.size() + num_chunks - 1) / num_chunks;
+  for (size_t begin = 0; begin < items.size(); begin += chunk_size) {
+    const size_t end = std::min(items.size(), begin + chunk_size);
+    exec.Add([&items, fn, begin, end]() {
+      for (size_t i = begin; i < end; ++i) {
+        if (!fn(items[i])) return;
+      }
+    });
+  }
+}
+
 bool ValidSpecificProximityConfig(const RiskLearningSimulationConfig& config) {
   // Returns false if an invalid specific proximity config is provided.
   if (!config.has_specific_proximity_config()) return true;
@@ -229,8 +277,16 @@ class RiskLearningSimulation : public Simulation {
   void RemoveObserverFactory(ObserverFactoryBase* factory) override {
     sim_->RemoveObserverFactory(factory);
   }
+  void SetExposureAggregation(const TransmissionModel* model) override {
+    sim_->SetExposureAggregation(model);
+  }
+  SimulationStats GetStats() const override { return sim_->GetStats(); }
+  // Builds a simulation of population, or of the agent and location files
+  // named in config if population is null.
   static absl::StatusOr<std::unique_ptr<Simulation>> Build(
-      const RiskLearningSimulationConfig& config, int num_workers) {
+      const RiskLearningSimulationConfig& config,
+      const Population* const population, int num_workers,
+      const RunOptions& options) {
     std::vector<StepwiseParams> stepwise_params;
     stepwise_params.reserve(config.seeding_date_delta_days() +
                             config.stepwise_params_size());
@@ -324,92 +380,106 @@ class RiskLearningSimulation : public Simulation {
     auto exec = executor->NewExecution();
     absl::Mutex status_mu;
     absl::Mutex location_mu;
-    // Read in locations.
-    std::vector<std::unique_ptr<Location>> locations;
-    int i = 0;
     std::vector<absl::Status> statuses;
-    for (const std::string& location_file : config.location_file()) {
-      exec->Add([&location_file, &locations, &home_transmissibility,
-                 &work_transmissibility, &random_transmissibility,
-                 &work_interaction_drop_prob, &non_work_drop_prob, &result,
-                 &random_interaction_multiplier, &i, &location_mu, &status_mu,
-                 &statuses]() {
-        auto reader = MakeRecordReader(location_file);
-        LocationProto proto;
-        while (reader.ReadRecord(proto)) {
-          {
-            absl::MutexLock l(&location_mu);
-            result->location_types_[proto.reference().uuid()] =
-                proto.reference().type();
-          }
-          std::function<float()> transmissibility;
-          if (proto.reference().type() == LocationReference::HOUSEHOLD) {
-            transmissibility = home_transmissibility;
-          } else if (proto.reference().type() == LocationReference::BUSINESS) {
-            transmissibility = work_transmissibility;
-          } else if (proto.reference().type() == LocationReference::RANDOM) {
-            transmissibility = random_transmissibility;
-          } else {
-            absl::MutexLock l(&status_mu);
-            statuses.push_back(absl::InvalidArgumentError(absl::StrCat(
-                "Invalid type ", i, ": ", proto.reference().DebugString())));
-            return;
-          }
-          switch (proto.location_case()) {
-            case LocationProto::kGraph: {
-              std::vector<std::pair<int64, int64>> edges;
-              edges.reserve(proto.graph().edges_size());
-              for (const GraphLocation::Edge& edge : proto.graph().edges()) {
-                edges.push_back({edge.uuid_a(), edge.uuid_b()});
-              }
-              std::function<float()> drop_prob =
-                  proto.reference().type() == LocationReference::BUSINESS
-                      ? absl::bind_front(work_interaction_drop_prob,
-                                         proto.graph().type())
-                      : non_work_drop_prob;
-              {
-                const int64 uuid = proto.reference().uuid();
-                absl::MutexLock l(&location_mu);
-                locations.push_back(NewGraphLocation(
-                    uuid, transmissibility, drop_prob, std::move(edges),
-                    *result->exposure_generators_[result->get_location_type_(
-                        uuid)]));
-              }
-              break;
-            }
-            case LocationProto::kRandom: {
-              const int64 uuid = proto.reference().uuid();
-              absl::MutexLock l(&location_mu);
-              locations.push_back(NewRandomGraphLocation(
-                  uuid, transmissibility, random_interaction_multiplier,
-                  *result->exposure_generators_[result->get_location_type_(
-                      uuid)]));
-            } break;
-            default: {
-              absl::MutexLock l(&status_mu);
-              statuses.push_back(absl::InvalidArgumentError(absl::StrCat(
-                  "Invalid location ", i, ": ", proto.DebugString())));
-            }
+    auto add_status = [&status_mu, &statuses](absl::Status status) {
+      absl::MutexLock l(&status_mu);
+      statuses.push_back(std::move(status));
+    };
+    // Creates locations from their records.  Returns false on error.
+    std::vector<std::unique_ptr<Location>> locations;
+    auto add_location = [&locations, &home_transmissibility,
+                         &work_transmissibility, &random_transmissibility,
+                         &work_interaction_drop_prob, &non_work_drop_prob,
+                         &result, &random_interaction_multiplier, &location_mu,
+                         &add_status](
+                            const LocationProto& proto, EdgeList edges) {
+      const int64 uuid = proto.reference().uuid();
+      {
+        absl::MutexLock l(&location_mu);
+        result->location_types_[uuid] = proto.reference().type();
+      }
+      std::function<float()> transmissibility;
+      if (proto.reference().type() == LocationReference::HOUSEHOLD) {
+        transmissibility = home_transmissibility;
+      } else if (proto.reference().type() == LocationReference::BUSINESS) {
+        transmissibility = work_transmissibility;
+      } else if (proto.reference().type() == LocationReference::RANDOM) {
+        transmissibility = random_transmissibility;
+      } else {
+        add_status(absl::InvalidArgumentError(
+            absl::StrCat("Invalid type for location (uuid ", uuid,
+                         "): ", proto.reference().type())));
+        return false;
+      }
+      switch (proto.location_case()) {
+        case LocationProto::kGraph: {
+          std::function<float()> drop_prob =
+              proto.reference().type() == LocationReference::BUSINESS
+                  ? absl::bind_front(work_interaction_drop_prob,
+                                     proto.graph().type())
+                  : non_work_drop_prob;
+          // Locations are built outside of the lock so that readers only
+          // contend on adding them.
+          auto location = NewGraphLocation(
+              uuid, transmissibility, drop_prob, std::move(edges),
+              *result->exposure_generators_[proto.reference().type()]);
+          absl::MutexLock l(&location_mu);
+          locations.push_back(std::move(location));
+          return true;
+        }
+        case LocationProto::kRandom: {
+          auto location = NewRandomGraphLocation(
+              uuid, transmissibility, random_interaction_multiplier,
+              *result->exposure_generators_[proto.reference().type()]);
+          absl::MutexLock l(&location_mu);
+          locations.push_back(std::move(location));
+          return true;
+        }
+        default:
+          add_status(absl::InvalidArgumentError(
+              absl::StrCat("Invalid location (uuid ", uuid, "): case ",
+                           proto.location_case())));
+          return false;
+      }
+    };
+    if (population != nullptr) {
+      // The population outlives the simulation, so each location copies its
+      // edges.  Edges decoded from files below are moved in instead.
+      AddChunks(*exec, population->locations,
+                [&add_location](const Population::Location& location) {
+                  return add_location(location.proto, location.edges);
+                });
+    } else {
+      for (const std::string& location_file : config.location_file()) {
+        exec->Add([&location_file, &add_location, &add_status]() {
+          auto reader = MakeRecordReader(location_file);
+          LocationProto proto;
+          EdgeList edges;
+          absl::string_view record;
+          while (reader.ReadRecord(record)) {
+            if (!DecodeLocationProto(record, &proto, &edges)) {
+              add_status(absl::InvalidArgumentError(
+                  absl::StrCat("Invalid location record in ", location_file)));
               return;
+            }
+            if (!add_location(proto, std::move(edges))) return;
           }
-          {
-            absl::MutexLock l(&location_mu);
-            i++;
+          absl::Status status = reader.status();
+          if (!status.ok()) {
+            add_status(status);
+            return;
           }
-        }
-        absl::Status status = reader.status();
-        if (!status.ok()) {
-          absl::MutexLock l(&status_mu);
-          statuses.push_back(status);
-          return;
-        }
-        reader.Close();
-        LOG(INFO) << "Finished reading location_file: " << location_file;
-      });
+          reader.Close();
+          LOG(INFO) << "Finished reading location_file: " << location_file;
+        });
+      }
     }
 
     // TODO: Specify parameters explicitly here.
     result->transmission_model_ = absl::make_unique<HazardTransmissionModel>();
+    if (config.append_hazard_to_test_results()) {
+      result->hazards_ = absl::make_unique<HazardTable>();
+    }
 
     result->infectivity_model_ =
         absl::make_unique<RiskLearningInfectivityModel>(
@@ -433,6 +503,12 @@ class RiskLearningSimulation : public Simulation {
     for (const PopulationProfile& profile : config.profiles()) {
       float mean = profile.random_visit_params().mean();
       float sd = profile.random_visit_params().stddev();
+      if (mean > kMaxRandomLocationEdges) {
+        return absl::InvalidArgumentError(absl::StrCat(
+            "Mean random location edges of profile ", profile.id(), " is ",
+            mean, ", more than the ", kMaxRandomLocationEdges,
+            " a visit can ask for."));
+      }
       float p = mean / sd / sd;
       int k = static_cast<int>((mean * mean / (sd * sd - mean)) + 0.5);
       profile_data[profile.id()] = {
@@ -492,75 +568,94 @@ class RiskLearningSimulation : public Simulation {
       result->risk_score_policy_ = *risk_score_policy_or;
     }
 
-    // Read in agents.
+    // Create agents from their records.  Returns false on error or once
+    // there are max_population agents.
     absl::Mutex agent_mu;
     std::vector<std::unique_ptr<Agent>> agents;
     const int max_population = absl::GetFlag(FLAGS_max_population);
-    for (const std::string& agent_file : config.agent_file()) {
-      exec->Add([&agent_file, &config, &result, &profile_data, &agents,
-                 &agent_mu, &status_mu, &statuses, &max_population]() {
-        auto reader = MakeRecordReader(agent_file);
-        AgentProto proto;
-        while (reader.ReadRecord(proto)) {
-          auto profile_iter = profile_data.find(proto.population_profile_id());
-          if (profile_iter == profile_data.end()) {
-            absl::MutexLock l(&status_mu);
-            statuses.push_back(absl::InvalidArgumentError(
-                absl::StrCat("Invalid population profile id for agent: ",
-                             proto.DebugString())));
-            return;
-          }
-          PopulationProfileData& agent_profile = profile_iter->second;
-          // TODO: Use a Builder factory instead. It is wasteful to
-          // create a TracingPolicy every time.
-          auto risk_score_or = CreateLearningRiskScore(
-              config.tracing_policy(), result->risk_score_policy_,
-              result->risk_score_model_.get(), result->get_location_type_);
-          if (!risk_score_or.ok()) {
-            absl::MutexLock l(&status_mu);
-            statuses.push_back(risk_score_or.status());
-            return;
-          }
-          auto risk_score = CreateAppEnabledRiskScore(
-              absl::Bernoulli(GetBitGen(),
-                              agent_profile.profile->app_users_fraction()),
-              std::move(*risk_score_or));
-          TransmissionModel* transmission_model;
-          if (config.append_hazard_to_test_results()) {
-            auto hazard = absl::make_unique<Hazard>();
-            transmission_model = hazard->GetTransmissionModel();
-            risk_score = CreateHazardQueryingRiskScore(std::move(hazard),
-                                                       std::move(risk_score));
-          } else {
-            transmission_model = result->transmission_model_.get();
-          }
-          {
-            absl::MutexLock l(&agent_mu);
-            if (max_population > 0 && agents.size() == max_population) {
-              break;
-            }
-            // TODO: It is wasteful that we are making a new transition
-            // model for each agent.  To fix this we need to make
-            // GetNextHealthTransition thread safe.  This is complicated by the
-            // fact that absl::discrete_distribution::operator() is non-const.
-            agents.push_back(SEIRAgent::CreateSusceptible(
-                proto.uuid(), transmission_model,
-                result->infectivity_model_.get(),
-                PTTSTransitionModel::CreateFromProto(
-                    agent_profile.profile->transition_model()),
-                GetVisitGenerator(proto, agent_profile,
-                                  result->visit_gen_cache_),
-                std::move(risk_score)));
-          }
+    // The learning observer outputs the exposures of all agents.
+    const bool retain_exposures_without_app =
+        result->learning_observer_ != nullptr &&
+        !absl::GetFlag(FLAGS_disable_learning_observer);
+    int num_agents = 0;
+    auto add_agent = [&config, &result, &profile_data, &agents, &agent_mu,
+                      &num_agents, &add_status, max_population,
+                      retain_exposures_without_app](const AgentProto& proto) {
+      auto profile_iter = profile_data.find(proto.population_profile_id());
+      if (profile_iter == profile_data.end()) {
+        add_status(absl::InvalidArgumentError(absl::StrCat(
+            "Invalid population profile id for agent ", proto.uuid(), ": ",
+            proto.population_profile_id())));
+        return false;
+      }
+      PopulationProfileData& agent_profile = profile_iter->second;
+      // TODO: Use a Builder factory instead. It is wasteful to
+      // create a TracingPolicy every time.
+      auto risk_score_or = CreateLearningRiskScore(
+          config.tracing_policy(), result->risk_score_policy_,
+          result->risk_score_model_.get(), result->get_location_type_);
+      if (!risk_score_or.ok()) {
+        add_status(risk_score_or.status());
+        return false;
+      }
+      auto risk_score = CreateAppEnabledRiskScore(
+          absl::Bernoulli(GetBitGen(),
+                          agent_profile.profile->app_users_fraction()),
+          std::move(*risk_score_or), retain_exposures_without_app);
+      // Only the shared visit generators and hazard slots are taken under
+      // the lock, so that readers do not contend on building agents.
+      const VisitGenerator* visit_generator;
+      int hazard_slot = kNoTransmissionSlot;
+      {
+        absl::MutexLock l(&agent_mu);
+        if (max_population > 0 && num_agents == max_population) {
+          return false;
         }
-        absl::Status status = reader.status();
-        if (!status.ok()) {
-          absl::MutexLock l(&status_mu);
-          statuses.push_back(status);
+        ++num_agents;
+        visit_generator =
+            &GetVisitGenerator(proto, agent_profile, result->visit_gen_cache_);
+        if (result->hazards_ != nullptr) {
+          hazard_slot = result->hazards_->AddAgent();
         }
-        reader.Close();
-        LOG(INFO) << "Finished reading agent_file: " << agent_file;
-      });
+      }
+      TransmissionModel* transmission_model;
+      if (result->hazards_ != nullptr) {
+        transmission_model = result->hazards_->GetTransmissionModel();
+        risk_score = CreateHazardQueryingRiskScore(
+            result->hazards_.get(), hazard_slot, std::move(risk_score));
+      } else {
+        transmission_model = result->transmission_model_.get();
+      }
+      // TODO: It is wasteful that we are making a new transition
+      // model for each agent.  To fix this we need to make
+      // GetNextHealthTransition thread safe.  This is complicated by the
+      // fact that absl::discrete_distribution::operator() is non-const.
+      auto agent = SEIRAgent::CreateSusceptible(
+          proto.uuid(), transmission_model, result->infectivity_model_.get(),
+          PTTSTransitionModel::CreateFromProto(
+              agent_profile.profile->transition_model()),
+          *visit_generator, std::move(risk_score));
+      agent->SetTransmissionSlot(hazard_slot);
+      absl::MutexLock l(&agent_mu);
+      agents.push_back(std::move(agent));
+      return true;
+    };
+    if (population != nullptr) {
+      AddChunks(*exec, population->agents, add_agent);
+    } else {
+      for (const std::string& agent_file : config.agent_file()) {
+        exec->Add([&agent_file, &add_agent, &add_status]() {
+          auto reader = MakeRecordReader(agent_file);
+          AgentProto proto;
+          while (reader.ReadRecord(proto)) {
+            if (!add_agent(proto)) break;
+          }
+          absl::Status status = reader.status();
+          if (!status.ok()) add_status(status);
+          reader.Close();
+          LOG(INFO) << "Finished reading agent_file: " << agent_file;
+        });
+      }
     }
     exec->Wait();
     if (!statuses.empty()) {
@@ -586,12 +681,20 @@ class RiskLearningSimulation : public Simulation {
       agent->SeedInfection(result->init_time_);
     }
 
+    if (!options.agent_state_file.empty()) {
+      auto arena = PagedArena::Create(options.agent_state_file,
+                                      options.agent_state_file_bytes);
+      if (!arena.ok()) return arena.status();
+      result->agent_state_arena_ = std::move(*arena);
+    }
     result->sim_ =
         num_workers > 1
             ? ParallelSimulation(result->init_time_, std::move(agents),
-                                 std::move(locations), num_workers)
+                                 std::move(locations), num_workers,
+                                 result->agent_state_arena_.get())
             : SerialSimulation(result->init_time_, std::move(agents),
-                               std::move(locations));
+                               std::move(locations),
+                               result->agent_state_arena_.get());
     result->sim_->AddObserverFactory(result->summary_observer_.get());
     if (ABSL_PREDICT_TRUE(absl::GetFlag(FLAGS_disable_learning_observer))) {
       LOG(WARNING) << "Learning outputs disabled.";
@@ -607,6 +710,15 @@ class RiskLearningSimulation : public Simulation {
       result->sim_->AddObserverFactory(
           result->hazard_histogram_observer_.get());
     }
+    // Without tracing or learning outputs, agents only use the hazard of
+    // their exposures, so each is sent one exposure per location.
+    if (!config.tracing_policy().trace_on_positive() &&
+        !retain_exposures_without_app) {
+      result->sim_->SetExposureAggregation(
+          result->hazards_ != nullptr
+              ? result->hazards_->GetTransmissionModel()
+              : result->transmission_model_.get());
+    }
     return std::move(result);
   }
 
@@ -627,7 +739,7 @@ class RiskLearningSimulation : public Simulation {
       PopulationProfileData& profile) {
     absl::BitGenRef gen = GetBitGen();
     return {
-        .random_location_edges = profile.random_edges_distribution(gen),
+        .random_location_edges = SampleRandomLocationEdges(profile, gen),
     };
   }
 
@@ -665,6 +777,9 @@ class RiskLearningSimulation : public Simulation {
                    LocationReference::Type_ARRAYSIZE>
       exposure_generators_;
   std::unique_ptr<HazardTransmissionModel> transmission_model_;
+  // Set when hazards are appended to test results, in which case it provides
+  // the transmission model shared by all agents.
+  std::unique_ptr<HazardTable> hazards_;
   std::unique_ptr<RiskLearningInfectivityModel> infectivity_model_;
   std::unique_ptr<RiskScoreModel> risk_score_model_;
   std::vector<std::pair<absl::Time, std::unique_ptr<RiskScoreModel>>>
@@ -681,6 +796,8 @@ class RiskLearningSimulation : public Simulation {
   std::unique_ptr<ObserverFactoryBase> summary_observer_;
   std::unique_ptr<ObserverFactoryBase> learning_observer_;
   std::unique_ptr<ObserverFactoryBase> hazard_histogram_observer_;
+  // Holds agent state when running out of core.  It must outlive sim_.
+  std::unique_ptr<PagedArena> agent_state_arena_;
   std::unique_ptr<Simulation> sim_;
   absl::Time init_time_;
   int current_step_ = 0;
@@ -692,20 +809,161 @@ class RiskLearningSimulation : public Simulation {
       current_lockdown_multipliers_;
 };
 
+size_t Population::SpaceUsed() const {
+  size_t bytes = sizeof(*this) +
+                 (agents.capacity() - agents.size()) * sizeof(AgentProto) +
+                 (locations.capacity() - locations.size()) * sizeof(Location);
+  for (const AgentProto& agent : agents) bytes += agent.SpaceUsedLong();
+  for (const Location& location : locations) {
+    bytes += location.proto.SpaceUsedLong() +
+             sizeof(location) - sizeof(location.proto) +
+             location.edges.capacity() * sizeof(location.edges[0]);
+  }
+  return bytes;
+}
+
+absl::StatusOr<std::unique_ptr<Population>> LoadPopulation(
+    const RiskLearningSimulationConfig& config) {
+  auto population = absl::make_unique<Population>();
+  absl::Mutex mu;
+  std::vector<absl::Status> statuses;
+  auto executor = NewExecutor(absl::GetFlag(FLAGS_num_reader_threads));
+  auto exec = executor->NewExecution();
+  for (const std::string& location_file : config.location_file()) {
+    exec->Add([&location_file, &population, &mu, &statuses]() {
+      std::vector<Population::Location> locations;
+      auto reader = MakeRecordReader(location_file);
+      absl::string_view record;
+      while (reader.ReadRecord(record)) {
+        locations.emplace_back();
+        Population::Location& location = locations.back();
+        if (!DecodeLocationProto(record, &location.proto, &location.edges)) {
+          absl::MutexLock l(&mu);
+          statuses.push_back(absl::InvalidArgumentError(
+              absl::StrCat("Invalid location record in ", location_file)));
+          return;
+        }
+      }
+      absl::MutexLock l(&mu);
+      if (!reader.status().ok()) {
+        statuses.push_back(reader.status());
+        return;
+      }
+      reader.Close();
+      std::move(locations.begin(), locations.end(),
+                std::back_inserter(population->locations));
+    });
+  }
+  for (const std::string& agent_file : config.agent_file()) {
+    exec->Add([&agent_file, &population, &mu, &statuses]() {
+      std::vector<AgentProto> agents;
+      auto reader = MakeRecordReader(agent_file);
+      AgentProto proto;
+      while (reader.ReadRecord(proto)) agents.push_back(std::move(proto));
+      absl::MutexLock l(&mu);
+      if (!reader.status().ok()) {
+        statuses.push_back(reader.status());
+        return;
+      }
+      reader.Close();
+      std::move(agents.begin(), agents.end(),
+                std::back_inserter(population->agents));
+    });
+  }
+  exec->Wait();
+  if (!statuses.empty()) return statuses[0];
+  population->agents.shrink_to_fit();
+  population->locations.shrink_to_fit();
+  return population;
+}
+
+RunOptions RunOptionsFromFlags() {
+  return {
+      .agent_state_file = absl::GetFlag(FLAGS_agent_state_file),
+      .agent_state_file_bytes =
+          static_cast<size_t>(absl::GetFlag(FLAGS_agent_state_file_gb)) << 30,
+      .progress_prometheus_path = absl::GetFlag(FLAGS_progress_prometheus_path),
+      .progress_json_path = absl::GetFlag(FLAGS_progress_json_path),
+      .progress_http_port = absl::GetFlag(FLAGS_progress_http_port),
+      .progress_interval = absl::GetFlag(FLAGS_progress_interval),
+  };
+}
+
 absl::StatusOr<std::unique_ptr<Simulation>> BuildSimulation(
     const RiskLearningSimulationConfig& config, int num_workers) {
-  return RiskLearningSimulation::Build(config, num_workers);
+  return RiskLearningSimulation::Build(config, /*population=*/nullptr,
+                                       num_workers, RunOptionsFromFlags());
 }
 
-absl::Status RunSimulation(const RiskLearningSimulationConfig& config,
-                           int num_workers) {
-  auto sim_or = BuildSimulation(config, num_workers);
+absl::StatusOr<std::unique_ptr<Simulation>> BuildSimulation(
+    const RiskLearningSimulationConfig& config, const Population& population,
+    int num_workers) {
+  return BuildSimulation(config, population, num_workers,
+                         RunOptionsFromFlags());
+}
+
+absl::StatusOr<std::unique_ptr<Simulation>> BuildSimulation(
+    const RiskLearningSimulationConfig& config, const Population& population,
+    int num_workers, const RunOptions& options) {
+  return RiskLearningSimulation::Build(config, &population, num_workers,
+                                       options);
+}
+
+namespace {
+
+absl::Status StepSimulation(
+    const RiskLearningSimulationConfig& config, const RunOptions& options,
+    absl::StatusOr<std::unique_ptr<Simulation>> sim_or) {
   if (!sim_or.ok()) return sim_or.status();
   auto step_size_or = DecodeGoogleApiProto(config.step_size());
   if (!step_size_or.ok()) return step_size_or.status();
   const auto step_size = step_size_or.value();
-  sim_or.value()->Step(config.steps(), step_size);
+  Simulation& sim = *sim_or.value();
+  std::unique_ptr<ProgressExporter> progress;
+  if (!options.progress_prometheus_path.empty() ||
+      !options.progress_json_path.empty() || options.progress_http_port != 0) {
+    ProgressExporter::Options progress_options = {
+        .prometheus_path = options.progress_prometheus_path,
+        .json_path = options.progress_json_path,
+        .total_steps = config.steps(),
+        .interval = options.progress_interval,
+        .http_port = options.progress_http_port,
+    };
+    for (const std::string& filename :
+         {config.summary_filename(), config.learning_filename(),
+          config.hazard_histogram_filename()}) {
+      if (!filename.empty()) progress_options.output_files.push_back(filename);
+    }
+    progress =
+        absl::make_unique<ProgressExporter>(&sim, std::move(progress_options));
+    absl::Status status = progress->Start();
+    if (!status.ok()) LOG(WARNING) << "Not serving progress: " << status;
+    sim.AddObserverFactory(progress.get());
+  }
+  sim.Step(config.steps(), step_size);
+  if (progress != nullptr) sim.RemoveObserverFactory(progress.get());
   return absl::OkStatus();
 }
 
+}  // namespace
+
+absl::Status RunSimulation(const RiskLearningSimulationConfig& config,
+                           int num_workers) {
+  return StepSimulation(config, RunOptionsFromFlags(),
+                        BuildSimulation(config, num_workers));
+}
+
+absl::Status RunSimulation(const RiskLearningSimulationConfig& config,
+                           const Population& population, int num_workers) {
+  return RunSimulation(config, population, num_workers, RunOptionsFromFlags());
+}
+
+absl::Status RunSimulation(const RiskLearningSimulationConfig& config,
+                           const Population& population, int num_workers,
+                           const RunOptions& options) {
+  return StepSimulation(
+      config, options,
+      BuildSimulation(config, population, num_workers, options));
+}
+
 }  // namespace abesim
@@ -18,23 +18,83 @@
 #define AGENT_BASED_EPIDEMIC_SIM_APPLICATIONS_RISK_LEARNING_SIMULATION_H_
 
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population_profile.pb.h"
 #include "agent_based_epidemic_sim/applications/risk_learning/config.pb.h"
+#include "agent_based_epidemic_sim/core/graph_location.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/location_type.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
 #include "agent_based_epidemic_sim/core/simulation.h"
 
 namespace abesim {
 
-// Runs a home-work-home simulation from config.
+// The decoded contents of the agent and location files of a config.
+// Simulations only read from a Population, so one can be loaded once and
+// shared by any number of simulations, including concurrently running ones.
+struct Population {
+  struct Location {
+    LocationProto proto;
+    // The edges of a graph location, as returned by DecodeLocationProto.
+    EdgeList edges;
+  };
+
+  // Returns the approximate number of bytes used by the population.
+  size_t SpaceUsed() const;
+
+  std::vector<AgentProto> agents;
+  std::vector<Location> locations;
+};
+
+// Settings of a single run that do not change what is simulated.
+struct RunOptions {
+  // If set, run out of core, keeping agent state in a temporary file at this
+  // path rather than in memory.
+  std::string agent_state_file;
+  size_t agent_state_file_bytes = size_t{64} << 30;
+  // Where to report the progress of the run.  See ProgressExporter::Options.
+  std::string progress_prometheus_path;
+  std::string progress_json_path;
+  int progress_http_port = 0;
+  absl::Duration progress_interval = absl::Seconds(30);
+};
+
+// Returns the RunOptions set by the command line flags.
+RunOptions RunOptionsFromFlags();
+
+// Reads the agent and location files named in config.
+absl::StatusOr<std::unique_ptr<Population>> LoadPopulation(
+    const RiskLearningSimulationConfig& config);
+
+// Runs a home-work-home simulation from config, with the RunOptions set by
+// the command line flags.
 absl::Status RunSimulation(const RiskLearningSimulationConfig& config,
                            int num_workers);
+// As above, but simulates population instead of reading the agent and
+// location files named in config.
+absl::Status RunSimulation(const RiskLearningSimulationConfig& config,
+                           const Population& population, int num_workers);
+// As above, but with the given RunOptions instead of the flags, so that
+// concurrent runs in one process do not share files or ports.
+absl::Status RunSimulation(const RiskLearningSimulationConfig& config,
+                           const Population& population, int num_workers,
+                           const RunOptions& options);
 
 absl::StatusOr<std::unique_ptr<Simulation>> BuildSimulation(
     const RiskLearningSimulationConfig& config, int num_workers);
+absl::StatusOr<std::unique_ptr<Simulation>> BuildSimulation(
+    const RiskLearningSimulationConfig& config, const Population& population,
+    int num_workers);
+absl::StatusOr<std::unique_ptr<Simulation>> BuildSimulation(
+    const RiskLearningSimulationConfig& config, const Population& population,
+    int num_workers, const RunOptions& options);
 
 }  // namespace abesim
 
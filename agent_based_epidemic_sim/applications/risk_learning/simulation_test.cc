@@ -121,5 +121,48 @@ TEST(SimulationTest, RunsSimulationNoLearningPath) {
   PANDEMIC_ASSERT_OK(status);
 }
 
+TEST(SimulationTest, RunsSimulationWithoutTracing) {
+  RiskLearningSimulationConfig config;
+  PrepareConfig(&config);
+  // Without tracing or learning outputs, exposures are aggregated.
+  config.mutable_tracing_policy()->set_trace_on_positive(false);
+  config.set_summary_filename(
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "summary_no_tracing"));
+  PANDEMIC_ASSERT_OK(RunSimulation(config, /*num_workers=*/2));
+}
+
+TEST(SimulationTest, RejectsProfilesWithTooManyRandomEdges) {
+  RiskLearningSimulationConfig config;
+  PrepareConfig(&config);
+  config.set_summary_filename(
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "summary_many_edges"));
+  // Visits carry at most kint16max random location edges.
+  config.mutable_profiles(0)->mutable_random_visit_params()->set_mean(40000);
+  config.mutable_profiles(0)->mutable_random_visit_params()->set_stddev(400);
+  EXPECT_EQ(RunSimulation(config, /*num_workers=*/1).code(),
+            absl::StatusCode::kInvalidArgument);
+}
+
+TEST(SimulationTest, RunsSimulationsFromLoadedPopulation) {
+  RiskLearningSimulationConfig config;
+  PrepareConfig(&config);
+  auto population = LoadPopulation(config);
+  PANDEMIC_ASSERT_OK(population.status());
+  ASSERT_EQ((*population)->agents.size(), 100);
+  ASSERT_EQ((*population)->locations.size(), 2);
+  for (const Population::Location& location : (*population)->locations) {
+    EXPECT_EQ(location.edges.size(), 500);
+  }
+  EXPECT_GT((*population)->SpaceUsed(), 1000 * sizeof(std::pair<int64, int64>));
+  // The population is not consumed by the simulations built from it.
+  for (int i = 0; i < 2; ++i) {
+    config.set_summary_filename(
+        absl::StrCat(getenv("TEST_TMPDIR"), "/", "summary_population_", i));
+    PANDEMIC_ASSERT_OK(
+        RunSimulation(config, **population, /*num_workers=*/2));
+  }
+  EXPECT_EQ((*population)->locations[0].edges.size(), 500);
+}
+
 }  // namespace
 }  // namespace abesim
@@ -21,12 +21,10 @@
 
 #include "absl/base/optimization.h"
 #include "absl/flags/flag.h"
-#include "absl/random/distributions.h"
-#include "absl/random/random.h"
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
-#include "agent_based_epidemic_sim/core/random.h"
 
 ABSL_FLAG(bool, test_triple_exposure_generator_fixed_distance, false,
           "Whether the distance between agents at the time of an exposure "
@@ -40,10 +38,7 @@ namespace abesim {
 float TripleExposureGenerator::DrawDistance() const {
   if (ABSL_PREDICT_TRUE(!absl::GetFlag(
           FLAGS_test_triple_exposure_generator_fixed_distance))) {
-    absl::BitGenRef bitgen = GetBitGen();
-    std::gamma_distribution<float> distance_distribution(
-        distance_params_.shape, distance_params_.scale);
-    return distance_distribution(bitgen);
+    return distance_sampler_.Sample(GetBulkRandom());
   }
   return distance_params_.shape * distance_params_.scale;  // Mean.
 }
@@ -51,10 +46,8 @@ float TripleExposureGenerator::DrawDistance() const {
 absl::Duration TripleExposureGenerator::DrawDuration() const {
   if (ABSL_PREDICT_TRUE(!absl::GetFlag(
           FLAGS_test_triple_exposure_generator_fixed_duration))) {
-    const float u = absl::Uniform(GetBitGen(), 0.0, 1.0);
-    const float duration_intervals =
-        duration_params_.shape / std::pow(u, 1 / duration_params_.scale);
-    return duration_intervals * duration_params_.output_multiplier_minutes;
+    return duration_sampler_.Sample(GetBulkRandom()) *
+           duration_params_.output_multiplier_minutes;
   }
   return duration_params_.output_multiplier_minutes * duration_params_.shape *
          duration_params_.scale / (duration_params_.shape - 1);  // Mean.
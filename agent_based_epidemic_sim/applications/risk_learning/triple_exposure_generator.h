@@ -20,6 +20,7 @@
 #include <random>
 
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
 namespace abesim {
 
@@ -58,7 +59,9 @@ class TripleExposureGenerator : public ExposureGenerator {
       const BleParams& ble_params = BleParams())
       : distance_params_(distance_params),
         duration_params_(duration_params),
-        ble_params_(ble_params) {}
+        ble_params_(ble_params),
+        distance_sampler_(distance_params.shape, distance_params.scale),
+        duration_sampler_(duration_params.shape, duration_params.scale) {}
 
   virtual ~TripleExposureGenerator() = default;
   // Generate a pair of Exposure objects representing a single "contact" between
@@ -83,6 +86,9 @@ class TripleExposureGenerator : public ExposureGenerator {
   const DistanceGammaDistributionParams distance_params_;
   const DurationParetoDistributionParams duration_params_;
   const BleParams ble_params_;
+  const GammaSampler distance_sampler_;
+  // Samples durations in units of output_multiplier_minutes.
+  const ParetoSampler duration_sampler_;
 };
 
 }  // namespace abesim
@@ -17,6 +17,9 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_AGENT_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_AGENT_H_
 
+#include <memory>
+#include <vector>
+
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/broker.h"
@@ -25,6 +28,7 @@
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
 #include "agent_based_epidemic_sim/core/visit.h"
 
 namespace abesim {
@@ -70,6 +74,32 @@ class Agent {
       const Timestep& timestep,
       absl::Span<const InfectionOutcome> infection_outcomes) = 0;
 
+  // Returns the TransmissionModel that the next call to
+  // ProcessInfectionOutcomes would use to resolve the agent's exposures, or
+  // nullptr if the agent is not at risk of infection or does not resolve
+  // exposures through a TransmissionModel.  Engines use this to resolve the
+  // exposures of many agents in one TransmissionModel::GetInfectionOutcomes
+  // call, and then call ProcessResolvedInfectionOutcomes instead of
+  // ProcessInfectionOutcomes.
+  virtual TransmissionModel* PendingTransmissionModel() const {
+    return nullptr;
+  }
+
+  // Returns the slot under which the agent was registered with its
+  // TransmissionModel, which engines pass on in ExposureRange::slot.
+  virtual int TransmissionSlot() const { return kNoTransmissionSlot; }
+
+  // As ProcessInfectionOutcomes, but with the outcome of the agent's pending
+  // TransmissionModel over infection_outcomes already computed.  Only called
+  // for agents with a non-null PendingTransmissionModel and at least one
+  // InfectionOutcome.
+  virtual void ProcessResolvedInfectionOutcomes(
+      const Timestep& timestep,
+      absl::Span<const InfectionOutcome> infection_outcomes,
+      const HealthTransition& transmission_outcome) {
+    ProcessInfectionOutcomes(timestep, infection_outcomes);
+  }
+
   // Receive contact reports from agents contacted in previous timesteps and
   // send new contact reports to prior contacts.  Also perform clinical tests
   // to be performed during the current timestep.
@@ -81,6 +111,10 @@ class Agent {
 
   virtual HealthState::State CurrentHealthState() const = 0;
 
+  // Returns the number of people the agent stands for, all of whom are in
+  // CurrentHealthState().
+  virtual int weight() const { return 1; }
+
   virtual TestResult CurrentTestResult(const Timestep& timestep) const = 0;
 
   virtual absl::Span<const HealthTransition> HealthTransitions() const = 0;
@@ -92,6 +126,19 @@ class Agent {
   // value may be nullptr if the agent doesn't support storing exposures.
   virtual const ExposureStore* exposure_store() const = 0;
 
+  // Moves the agents that split off this one during the current timestep to
+  // the end of agents.  An agent that stands for several people splits off
+  // the ones that become infected, so they may be traced and tested
+  // individually.  Engines call this after ComputeVisits and add the agents to
+  // the simulation.  Split agents must already have sent the visits of the
+  // current timestep.
+  virtual void TakeSplitAgents(std::vector<std::unique_ptr<Agent>>* agents) {}
+
+  // Infects a SUSCEPTIBLE agent at the given time, whatever its exposures, as
+  // when an infection is imported from outside the simulated population.
+  // Returns false if the agent cannot be infected this way.
+  virtual bool SeedInfection(absl::Time time) { return false; }
+
   virtual ~Agent() = default;
 };
 
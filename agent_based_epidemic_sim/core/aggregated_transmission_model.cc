@@ -14,9 +14,13 @@
 
 #include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
 
-#include "absl/random/distributions.h"
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/constants.h"
-#include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
 namespace {
@@ -31,26 +35,124 @@ float ProbabilityExposureInfects(const Exposure& exposure,
                   kEpsilon);
 }
 
-}  // namespace
+// Returns the probability that exposure fails to infect.  This is
+// exp(ProbabilityExposureInfects), computed without the transcendental calls
+// so that a host's probability of escape is a plain product.
+float ProbabilityExposureEscapes(const Exposure& exposure,
+                                 const float transmissibility) {
+  const float escape = 1 -
+                       exposure.infectivity *
+                           absl::ToDoubleHours(exposure.duration) / 24.0f *
+                           kSusceptibility * transmissibility +
+                       kEpsilon;
+  return exposure.infectivity > 0 ? escape : 1.0f;
+}
 
-HealthTransition AggregatedTransmissionModel::GetInfectionOutcome(
-    absl::Span<const Exposure* const> exposures) {
-  absl::Time latest_exposure_time = absl::InfinitePast();
+// Returns the probability that a host with the given exposures is infected,
+// and sets latest_exposure_time to the end of its last infectious exposure.
+float ProbabilityOfInfection(const absl::Span<const Exposure* const> exposures,
+                             const float transmissibility,
+                             absl::Time* const latest_exposure_time) {
+  *latest_exposure_time = absl::InfinitePast();
   float sum_exposures = 0.0f;
   for (const Exposure* exposure : exposures) {
     if (exposure->infectivity > 0) {
-      latest_exposure_time = std::max(
-          latest_exposure_time, exposure->start_time + exposure->duration);
-      sum_exposures += ProbabilityExposureInfects(*exposure, transmissibility_);
+      *latest_exposure_time = std::max(
+          *latest_exposure_time, exposure->start_time + exposure->duration);
+      sum_exposures += ProbabilityExposureInfects(*exposure, transmissibility);
     }
   }
-  const float prob_infection = 1 - std::exp(sum_exposures);
+  return 1 - std::exp(sum_exposures);
+}
+
+}  // namespace
+
+HealthTransition AggregatedTransmissionModel::GetInfectionOutcome(
+    absl::Span<const Exposure* const> exposures) {
   HealthTransition health_transition;
-  health_transition.time = latest_exposure_time;
-  health_transition.health_state = absl::Bernoulli(GetBitGen(), prob_infection)
-                                       ? HealthState::EXPOSED
-                                       : HealthState::SUSCEPTIBLE;
+  const float prob_infection = ProbabilityOfInfection(
+      exposures, transmissibility_, &health_transition.time);
+  health_transition.health_state =
+      GetBulkRandom().Uniform() < prob_infection ? HealthState::EXPOSED
+                                                 : HealthState::SUSCEPTIBLE;
   return health_transition;
 }
 
+int AggregatedTransmissionModel::GetWeightedInfectionOutcome(
+    const int slot, const absl::Span<const Exposure* const> exposures,
+    const int weight, HealthTransition* const infection) {
+  absl::Time latest_exposure_time;
+  const float prob_infection = ProbabilityOfInfection(
+      exposures, transmissibility_, &latest_exposure_time);
+  const int infected = std::binomial_distribution<int>(
+      weight, std::clamp(prob_infection, 0.0f, 1.0f))(GetBulkRandom());
+  if (infected > 0) {
+    *infection = {.time = latest_exposure_time,
+                  .health_state = HealthState::EXPOSED};
+  }
+  return infected;
+}
+
+bool AggregatedTransmissionModel::AggregateExposures(
+    const absl::Span<const Exposure* const> exposures,
+    Exposure* const aggregate) const {
+  if (exposures.empty()) return false;
+  absl::Time latest_exposure_time;
+  const float prob_infection = ProbabilityOfInfection(
+      exposures, transmissibility_, &latest_exposure_time);
+  const Exposure* latest = exposures.front();
+  for (const Exposure* exposure : exposures) {
+    if (exposure->infectivity > 0 &&
+        exposure->start_time + exposure->duration == latest_exposure_time) {
+      latest = exposure;
+    }
+  }
+  *aggregate = *latest;
+  // A day-long exposure escapes with probability
+  // 1 - infectivity * kSusceptibility * transmissibility + kEpsilon, which
+  // must equal 1 - prob_infection.
+  const float scale = kSusceptibility * transmissibility_;
+  if (latest->infectivity <= 0 || scale <= 0 ||
+      prob_infection + kEpsilon <= 0) {
+    aggregate->infectivity = 0;
+    return true;
+  }
+  aggregate->duration = absl::Hours(24);
+  aggregate->start_time = latest_exposure_time - aggregate->duration;
+  aggregate->infectivity = (prob_infection + kEpsilon) / scale;
+  return true;
+}
+
+void AggregatedTransmissionModel::GetInfectionOutcomes(
+    const absl::Span<const InfectionOutcome> infection_outcomes,
+    const absl::Span<const ExposureRange> hosts,
+    const absl::Span<HealthTransition> health_transitions) {
+  DCHECK_EQ(hosts.size(), health_transitions.size());
+  thread_local std::vector<float> escapes;
+  thread_local std::vector<float> draws;
+  escapes.resize(infection_outcomes.size());
+  for (int i = 0; i < infection_outcomes.size(); ++i) {
+    escapes[i] = ProbabilityExposureEscapes(infection_outcomes[i].exposure,
+                                            transmissibility_);
+  }
+  draws.resize(hosts.size());
+  GetBulkRandom().FillUniform(absl::MakeSpan(draws));
+  for (int i = 0; i < hosts.size(); ++i) {
+    absl::Time latest_exposure_time = absl::InfinitePast();
+    float prob_escape = 1.0f;
+    for (int j = hosts[i].begin; j < hosts[i].end; ++j) {
+      prob_escape *= escapes[j];
+      const Exposure& exposure = infection_outcomes[j].exposure;
+      if (exposure.infectivity > 0) {
+        latest_exposure_time = std::max(
+            latest_exposure_time, exposure.start_time + exposure.duration);
+      }
+    }
+    health_transitions[i] = {.time = latest_exposure_time,
+                             .health_state = draws[i] < 1 - prob_escape
+                                                 ? HealthState::EXPOSED
+                                                 : HealthState::SUSCEPTIBLE};
+  }
+}
+
 }  // namespace abesim
@@ -35,6 +35,26 @@ class AggregatedTransmissionModel : public TransmissionModel {
   HealthTransition GetInfectionOutcome(
       absl::Span<const Exposure* const> exposures) override;
 
+  // Computes the infection outcomes of a batch of hosts. Equivalent to calling
+  // GetInfectionOutcome for each host, but the per-exposure escape terms are
+  // computed in one pass over the chunk and random draws are made together.
+  void GetInfectionOutcomes(
+      absl::Span<const InfectionOutcome> infection_outcomes,
+      absl::Span<const ExposureRange> hosts,
+      absl::Span<HealthTransition> health_transitions) override;
+
+  // Computes the probability of infection once and samples the number of
+  // hosts infected from a binomial distribution.
+  int GetWeightedInfectionOutcome(int slot,
+                                  absl::Span<const Exposure* const> exposures,
+                                  int weight,
+                                  HealthTransition* infection) override;
+
+  // Combines exposures into one whose probability of escaping infection is
+  // the product of theirs, ending with the last infectious exposure.
+  bool AggregateExposures(absl::Span<const Exposure* const> exposures,
+                          Exposure* aggregate) const override;
+
  private:
   const float transmissibility_;
 };
@@ -15,6 +15,7 @@
 #include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
 
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/visit.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -49,5 +50,86 @@ TEST(AggregatedTransmissionModelTest, GetsInfectionOutcomes) {
                                   .health_state = HealthState::SUSCEPTIBLE}));
 }
 
+TEST(AggregatedTransmissionModelTest, GetsBatchedInfectionOutcomes) {
+  const float kTransmissibility = 1;
+  std::vector<InfectionOutcome> outcomes{
+      {.agent_uuid = 1,
+       .exposure = {.duration = absl::Seconds(1), .infectivity = 1}},
+      {.agent_uuid = 1,
+       .exposure = {.duration = absl::Seconds(86400), .infectivity = 1}},
+      {.agent_uuid = 2,
+       .exposure = {.duration = absl::Seconds(1), .infectivity = 1}},
+      {.agent_uuid = 3,
+       .exposure = {.duration = absl::Seconds(86400), .infectivity = 0}}};
+  std::vector<ExposureRange> hosts{{.agent_uuid = 1, .begin = 0, .end = 2},
+                                   {.agent_uuid = 2, .begin = 2, .end = 3},
+                                   {.agent_uuid = 3, .begin = 3, .end = 4}};
+  std::vector<HealthTransition> transitions(hosts.size());
+  AggregatedTransmissionModel transmission_model(kTransmissibility);
+  transmission_model.GetInfectionOutcomes(outcomes, hosts,
+                                          absl::MakeSpan(transitions));
+  EXPECT_THAT(
+      transitions,
+      testing::ElementsAre(
+          HealthTransition{.time = absl::FromUnixSeconds(86400LL),
+                           .health_state = HealthState::EXPOSED},
+          HealthTransition{.time = absl::FromUnixSeconds(1LL),
+                           .health_state = HealthState::SUSCEPTIBLE},
+          HealthTransition{.time = absl::InfinitePast(),
+                           .health_state = HealthState::SUSCEPTIBLE}));
+}
+
+TEST(AggregatedTransmissionModelTest, GetsWeightedInfectionOutcomes) {
+  const float kTransmissibility = 1;
+  AggregatedTransmissionModel transmission_model(kTransmissibility);
+  std::vector<Exposure> exposures{
+      {.duration = absl::Seconds(1), .infectivity = 1},
+      {.duration = absl::Seconds(86400), .infectivity = 1}};
+  HealthTransition infection;
+  EXPECT_EQ(transmission_model.GetWeightedInfectionOutcome(
+                kNoTransmissionSlot, MakePointers(exposures), 5, &infection),
+            5);
+  EXPECT_THAT(infection,
+              Eq(HealthTransition{.time = absl::FromUnixSeconds(86400LL),
+                                  .health_state = HealthState::EXPOSED}));
+
+  exposures = {{.duration = absl::Seconds(86400), .infectivity = 0}};
+  EXPECT_EQ(transmission_model.GetWeightedInfectionOutcome(
+                kNoTransmissionSlot, MakePointers(exposures), 5, &infection),
+            0);
+}
+
+TEST(AggregatedTransmissionModelTest, AggregatesExposures) {
+  const float kTransmissibility = 0.5;
+  AggregatedTransmissionModel transmission_model(kTransmissibility);
+  std::vector<Exposure> exposures{
+      {.start_time = absl::FromUnixSeconds(0),
+       .duration = absl::Hours(12),
+       .infectivity = 0.5},
+      {.start_time = absl::FromUnixSeconds(0) + absl::Hours(8),
+       .duration = absl::Hours(6),
+       .infectivity = 1},
+      {.start_time = absl::FromUnixSeconds(0) + absl::Hours(10),
+       .duration = absl::Hours(24),
+       .infectivity = 0}};
+  Exposure aggregate;
+  ASSERT_TRUE(transmission_model.AggregateExposures(MakePointers(exposures),
+                                                    &aggregate));
+  // The aggregate escapes infection as often as all of the exposures do, and
+  // ends with the last infectious one.
+  const float scale = kSusceptibility * kTransmissibility;
+  const double escape = (1 - 0.25 * scale + 1e-8) * (1 - 0.25 * scale + 1e-8);
+  EXPECT_NEAR(1 - aggregate.infectivity * scale + 1e-8, escape, 1e-6);
+  EXPECT_EQ(aggregate.duration, absl::Hours(24));
+  EXPECT_EQ(aggregate.start_time + aggregate.duration,
+            absl::FromUnixSeconds(0) + absl::Hours(14));
+
+  exposures = {{.duration = absl::Hours(24), .infectivity = 0},
+               {.duration = absl::Hours(12), .infectivity = 0}};
+  ASSERT_TRUE(transmission_model.AggregateExposures(MakePointers(exposures),
+                                                    &aggregate));
+  EXPECT_EQ(aggregate.infectivity, 0);
+}
+
 }  // namespace
 }  // namespace abesim
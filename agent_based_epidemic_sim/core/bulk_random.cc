@@ -0,0 +1,259 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/bulk_random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#include "absl/numeric/int128.h"
+#include "absl/random/distributions.h"
+#include "absl/random/poisson_distribution.h"
+#include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+constexpr float kTwoPi = 6.28318530718f;
+
+// Converts a probability in [0, 1) to a threshold on uniform 64-bit values.
+uint64 CutoffBits(const double p) {
+  return static_cast<uint64>(std::ldexp(std::max(p, 0.0), 64));
+}
+
+uint64 SplitMix64(uint64* state) {
+  uint64 z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+}  // namespace
+
+BulkRandom::BulkRandom(uint64 seed) {
+  for (int lane = 0; lane < kLanes; ++lane) {
+    s0_[lane] = SplitMix64(&seed);
+    s1_[lane] = SplitMix64(&seed);
+    s2_[lane] = SplitMix64(&seed);
+    s3_[lane] = SplitMix64(&seed);
+  }
+}
+
+void BulkRandom::Step(uint64* const out) {
+  for (int lane = 0; lane < kLanes; ++lane) {
+    out[lane] = s0_[lane] + s3_[lane];
+    const uint64 t = s1_[lane] << 17;
+    s2_[lane] ^= s0_[lane];
+    s3_[lane] ^= s1_[lane];
+    s1_[lane] ^= s2_[lane];
+    s0_[lane] ^= s3_[lane];
+    s2_[lane] ^= t;
+    s3_[lane] = (s3_[lane] << 45) | (s3_[lane] >> 19);
+  }
+}
+
+void BulkRandom::FillBits(const absl::Span<uint64> out) {
+  size_t i = 0;
+  for (; i + kLanes <= out.size(); i += kLanes) {
+    Step(out.data() + i);
+  }
+  if (i < out.size()) {
+    uint64 tail[kLanes];
+    Step(tail);
+    std::copy(tail, tail + (out.size() - i), out.data() + i);
+  }
+}
+
+void BulkRandom::FillUniform(const absl::Span<float> out) {
+  uint64 bits[kBlockSize];
+  for (size_t i = 0; i < out.size(); i += kBlockSize) {
+    const size_t n = std::min<size_t>(kBlockSize, out.size() - i);
+    FillBits(absl::MakeSpan(bits, n));
+    for (size_t j = 0; j < n; ++j) {
+      out[i + j] = ToUniform(bits[j]);
+    }
+  }
+}
+
+void BulkRandom::FillNormal(const absl::Span<float> out) {
+  // Box-Muller: each pair of uniforms yields a pair of normals.
+  uint64 bits[kBlockSize];
+  float radius[kBlockSize / 2];
+  float angle[kBlockSize / 2];
+  for (size_t i = 0; i < out.size(); i += kBlockSize) {
+    const size_t n = std::min<size_t>(kBlockSize, out.size() - i);
+    const size_t pairs = (n + 1) / 2;
+    FillBits(absl::MakeSpan(bits, 2 * pairs));
+    for (size_t j = 0; j < pairs; ++j) {
+      radius[j] = std::sqrt(-2.0f * std::log(ToOpenUniform(bits[2 * j])));
+      angle[j] = kTwoPi * ToUniform(bits[2 * j + 1]);
+    }
+    for (size_t j = 0; j < n / 2; ++j) {
+      out[i + 2 * j] = radius[j] * std::cos(angle[j]);
+      out[i + 2 * j + 1] = radius[j] * std::sin(angle[j]);
+    }
+    if (n % 2 == 1) {
+      out[i + n - 1] = radius[pairs - 1] * std::cos(angle[pairs - 1]);
+    }
+  }
+}
+
+void BulkRandom::FillExponential(const absl::Span<float> out) {
+  uint64 bits[kBlockSize];
+  for (size_t i = 0; i < out.size(); i += kBlockSize) {
+    const size_t n = std::min<size_t>(kBlockSize, out.size() - i);
+    FillBits(absl::MakeSpan(bits, n));
+    for (size_t j = 0; j < n; ++j) {
+      out[i + j] = -std::log(ToOpenUniform(bits[j]));
+    }
+  }
+}
+
+BulkRandom& GetBulkRandom() {
+  thread_local BulkRandom random(absl::Uniform<uint64>(GetBitGen()));
+  return random;
+}
+
+GammaSampler::GammaSampler(const float shape, const float scale)
+    : shape_(shape), scale_(scale) {
+  CHECK_GT(shape, 0) << "Gamma shape must be positive.";
+  CHECK_GT(scale, 0) << "Gamma scale must be positive.";
+  // Shapes below 1 are sampled as Gamma(shape + 1) * U^(1 / shape).
+  d_ = (shape < 1 ? shape + 1 : shape) - 1.0f / 3.0f;
+  c_ = 1.0f / std::sqrt(9.0f * d_);
+}
+
+float GammaSampler::Sample(BulkRandom& random) const {
+  float sample;
+  while (true) {
+    const float x = random.Normal();
+    float v = 1.0f + c_ * x;
+    if (v <= 0.0f) continue;
+    v = v * v * v;
+    const float u = random.Uniform();
+    const float x2 = x * x;
+    if (u < 1.0f - 0.0331f * x2 * x2 ||
+        std::log(u) < 0.5f * x2 + d_ * (1.0f - v + std::log(v))) {
+      sample = d_ * v;
+      break;
+    }
+  }
+  if (shape_ < 1) {
+    sample *= std::pow(1.0f - random.Uniform(), 1.0f / shape_);
+  }
+  return sample * scale_;
+}
+
+void GammaSampler::Fill(BulkRandom& random, const absl::Span<float> out) const {
+  for (float& value : out) {
+    value = Sample(random);
+  }
+}
+
+ParetoSampler::ParetoSampler(const float scale, const float shape)
+    : scale_(scale), inverse_shape_(1.0f / shape) {
+  CHECK_GT(scale, 0) << "Pareto scale must be positive.";
+  CHECK_GT(shape, 0) << "Pareto shape must be positive.";
+}
+
+float ParetoSampler::Sample(BulkRandom& random) const {
+  return scale_ * std::pow(1.0f - random.Uniform(), -inverse_shape_);
+}
+
+void ParetoSampler::Fill(BulkRandom& random,
+                         const absl::Span<float> out) const {
+  random.FillUniform(out);
+  for (float& value : out) {
+    value = scale_ * std::pow(1.0f - value, -inverse_shape_);
+  }
+}
+
+NegativeBinomialSampler::NegativeBinomialSampler(const float successes,
+                                                 const float p)
+    : rate_(successes, (1.0f - p) / p) {
+  CHECK(p > 0 && p < 1) << "Success probability must be in (0, 1).";
+}
+
+int64 NegativeBinomialSampler::Sample(BulkRandom& random) const {
+  return absl::poisson_distribution<int64>(rate_.Sample(random))(random);
+}
+
+DiscreteAliasSampler::DiscreteAliasSampler(
+    const absl::Span<const double> weights)
+    : probabilities_(weights.begin(), weights.end()),
+      cutoffs_(weights.size()),
+      aliases_(weights.size()) {
+  CHECK(!weights.empty()) << "Alias sampler requires at least one weight.";
+  const double total =
+      std::accumulate(probabilities_.begin(), probabilities_.end(), 0.0);
+  CHECK_GT(total, 0) << "Alias sampler weights must not all be zero.";
+  const int n = weights.size();
+  std::vector<double> scaled(n);
+  std::vector<int> small, large;
+  for (int i = 0; i < n; ++i) {
+    CHECK_GE(weights[i], 0) << "Alias sampler weights must be non-negative.";
+    probabilities_[i] /= total;
+    scaled[i] = probabilities_[i] * n;
+    (scaled[i] < 1.0 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    const int s = small.back();
+    small.pop_back();
+    const int l = large.back();
+    cutoffs_[s] = CutoffBits(scaled[s]);
+    aliases_[s] = l;
+    scaled[l] -= 1.0 - scaled[s];
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // Whatever remains is full up to rounding error.  A full bucket is its own
+  // alias, so its cutoff need not reach 1.
+  for (const int i : small) {
+    cutoffs_[i] = ~uint64{0};
+    aliases_[i] = i;
+  }
+  for (const int i : large) {
+    cutoffs_[i] = ~uint64{0};
+    aliases_[i] = i;
+  }
+}
+
+int DiscreteAliasSampler::SampleFromBits(const uint64 bits) const {
+  // bits / 2^64 * n, split into the bucket (the high word) and the position
+  // within it (the low word), so the bucket uses the high bits of the draw and
+  // the cutoff the independent bits below them, with full precision.
+  const absl::uint128 x = absl::uint128(bits) * cutoffs_.size();
+  const int bucket = absl::Uint128High64(x);
+  return absl::Uint128Low64(x) < cutoffs_[bucket] ? bucket : aliases_[bucket];
+}
+
+int DiscreteAliasSampler::Sample(BulkRandom& random) const {
+  return SampleFromBits(random());
+}
+
+void DiscreteAliasSampler::Fill(BulkRandom& random,
+                                const absl::Span<int> out) const {
+  thread_local std::vector<uint64> bits;
+  bits.resize(out.size());
+  random.FillBits(absl::MakeSpan(bits));
+  for (size_t i = 0; i < out.size(); ++i) {
+    out[i] = SampleFromBits(bits[i]);
+  }
+}
+
+}  // namespace abesim
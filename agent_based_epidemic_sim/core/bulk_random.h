@@ -0,0 +1,192 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_BULK_RANDOM_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_BULK_RANDOM_H_
+
+#include <vector>
+
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// A source of random numbers that generates variates in blocks rather than
+// one at a time.  The underlying generator runs kLanes independent
+// xoshiro256+ streams side by side, so a block is produced by a loop over
+// plain arrays that the compiler can vectorize.
+//
+// BulkRandom satisfies the UniformRandomBitGenerator requirements, so it can
+// also drive absl and std distributions directly, without going through the
+// type-erased absl::BitGenRef.
+//
+// BulkRandom is not thread-safe.  Use GetBulkRandom() to get the instance
+// owned by the current thread.
+class BulkRandom {
+ public:
+  using result_type = uint64;
+
+  // Number of independent streams advanced together.
+  static constexpr int kLanes = 8;
+  // Number of variates of each kind buffered for single draws.
+  static constexpr int kBlockSize = 256;
+
+  explicit BulkRandom(uint64 seed);
+
+  BulkRandom(const BulkRandom&) = delete;
+  BulkRandom& operator=(const BulkRandom&) = delete;
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return ~result_type{0}; }
+  result_type operator()() {
+    if (next_bits_ == kBlockSize) {
+      FillBits(absl::MakeSpan(bits_));
+      next_bits_ = 0;
+    }
+    return bits_[next_bits_++];
+  }
+
+  // Returns a uniform variate in [0, 1).
+  float Uniform() { return ToUniform((*this)()); }
+  // Returns a standard normal variate.
+  float Normal() {
+    if (next_normal_ == kBlockSize) {
+      FillNormal(absl::MakeSpan(normals_));
+      next_normal_ = 0;
+    }
+    return normals_[next_normal_++];
+  }
+  // Returns an exponential variate with rate 1.
+  float Exponential() {
+    if (next_exponential_ == kBlockSize) {
+      FillExponential(absl::MakeSpan(exponentials_));
+      next_exponential_ = 0;
+    }
+    return exponentials_[next_exponential_++];
+  }
+
+  // Fills out with uniformly distributed bits.
+  void FillBits(absl::Span<uint64> out);
+  // Fills out with uniform variates in [0, 1).
+  void FillUniform(absl::Span<float> out);
+  // Fills out with standard normal variates.
+  void FillNormal(absl::Span<float> out);
+  // Fills out with exponential variates with rate 1.
+  void FillExponential(absl::Span<float> out);
+
+ private:
+  // Converts the high bits of x to a float in [0, 1).
+  static float ToUniform(const uint64 x) {
+    return static_cast<float>(x >> 40) * 0x1.0p-24f;
+  }
+  // Converts the high bits of x to a float in (0, 1].
+  static float ToOpenUniform(const uint64 x) {
+    return static_cast<float>((x >> 40) + 1) * 0x1.0p-24f;
+  }
+
+  // Advances every lane once, writing one output per lane to out.
+  void Step(uint64* out);
+
+  alignas(64) uint64 s0_[kLanes];
+  alignas(64) uint64 s1_[kLanes];
+  alignas(64) uint64 s2_[kLanes];
+  alignas(64) uint64 s3_[kLanes];
+
+  alignas(64) uint64 bits_[kBlockSize];
+  float normals_[kBlockSize];
+  float exponentials_[kBlockSize];
+  int next_bits_ = kBlockSize;
+  int next_normal_ = kBlockSize;
+  int next_exponential_ = kBlockSize;
+};
+
+// Get a BulkRandom that can be used on the current thread.  The returned
+// reference may not be passed to another thread.
+BulkRandom& GetBulkRandom();
+
+// Samples from a gamma distribution with the given shape and scale using the
+// method of Marsaglia and Tsang.
+class GammaSampler {
+ public:
+  GammaSampler(float shape, float scale);
+
+  float Sample(BulkRandom& random) const;
+  void Fill(BulkRandom& random, absl::Span<float> out) const;
+
+  float shape() const { return shape_; }
+  float scale() const { return scale_; }
+
+ private:
+  float shape_;
+  float scale_;
+  // Parameters of the Marsaglia-Tsang sampler for shape max(shape_, 1).
+  float d_;
+  float c_;
+};
+
+// Samples from a Pareto distribution with minimum value `scale` and tail index
+// `shape` by inverting the CDF.
+class ParetoSampler {
+ public:
+  ParetoSampler(float scale, float shape);
+
+  float Sample(BulkRandom& random) const;
+  void Fill(BulkRandom& random, absl::Span<float> out) const;
+
+ private:
+  float scale_;
+  float inverse_shape_;
+};
+
+// Samples the number of failures before `successes` successes in Bernoulli
+// trials with success probability `p`, as a gamma-Poisson mixture.
+// `successes` need not be an integer.
+class NegativeBinomialSampler {
+ public:
+  NegativeBinomialSampler(float successes, float p);
+
+  int64 Sample(BulkRandom& random) const;
+
+ private:
+  GammaSampler rate_;
+};
+
+// Samples indices in [0, weights.size()) with probability proportional to
+// weights, in constant time per sample, using Walker's alias method.
+class DiscreteAliasSampler {
+ public:
+  explicit DiscreteAliasSampler(absl::Span<const double> weights);
+
+  int Sample(BulkRandom& random) const;
+  void Fill(BulkRandom& random, absl::Span<int> out) const;
+
+  // Returns the normalized probability of each index.
+  const std::vector<double>& probabilities() const { return probabilities_; }
+
+ private:
+  // Samples an index from 64 uniformly distributed bits.
+  int SampleFromBits(uint64 bits) const;
+
+  std::vector<double> probabilities_;
+  // Probability of keeping each bucket rather than taking its alias, in units
+  // of 2^-64.
+  std::vector<uint64> cutoffs_;
+  std::vector<int> aliases_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_BULK_RANDOM_H_
@@ -0,0 +1,182 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/bulk_random.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+#include "absl/random/distributions.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::Each;
+using testing::Ge;
+using testing::Lt;
+
+constexpr int kSamples = 100000;
+constexpr uint64 kSeed = 1234;
+
+double Mean(const std::vector<float>& values) {
+  return std::accumulate(values.begin(), values.end(), 0.0) / values.size();
+}
+
+double Variance(const std::vector<float>& values) {
+  const double mean = Mean(values);
+  double sum = 0;
+  for (const float value : values) sum += (value - mean) * (value - mean);
+  return sum / values.size();
+}
+
+TEST(BulkRandomTest, IsDeterministicGivenSeed) {
+  BulkRandom a(kSeed);
+  BulkRandom b(kSeed);
+  BulkRandom c(kSeed + 1);
+  std::vector<uint64> bits_a(100), bits_b(100), bits_c(100);
+  a.FillBits(absl::MakeSpan(bits_a));
+  b.FillBits(absl::MakeSpan(bits_b));
+  c.FillBits(absl::MakeSpan(bits_c));
+  EXPECT_EQ(bits_a, bits_b);
+  EXPECT_NE(bits_a, bits_c);
+}
+
+TEST(BulkRandomTest, FillsUniforms) {
+  BulkRandom random(kSeed);
+  // An odd size exercises the partial final block.
+  std::vector<float> values(kSamples + 3);
+  random.FillUniform(absl::MakeSpan(values));
+  EXPECT_THAT(values, Each(Ge(0.0f)));
+  EXPECT_THAT(values, Each(Lt(1.0f)));
+  EXPECT_NEAR(Mean(values), 0.5, 0.01);
+  EXPECT_NEAR(Variance(values), 1.0 / 12, 0.01);
+}
+
+TEST(BulkRandomTest, FillsNormals) {
+  BulkRandom random(kSeed);
+  std::vector<float> values(kSamples + 1);
+  random.FillNormal(absl::MakeSpan(values));
+  EXPECT_NEAR(Mean(values), 0.0, 0.02);
+  EXPECT_NEAR(Variance(values), 1.0, 0.02);
+}
+
+TEST(BulkRandomTest, FillsExponentials) {
+  BulkRandom random(kSeed);
+  std::vector<float> values(kSamples);
+  random.FillExponential(absl::MakeSpan(values));
+  EXPECT_THAT(values, Each(Ge(0.0f)));
+  EXPECT_NEAR(Mean(values), 1.0, 0.02);
+}
+
+TEST(BulkRandomTest, ServesSingleDraws) {
+  BulkRandom random(kSeed);
+  std::vector<float> normals(kSamples);
+  for (float& value : normals) value = random.Normal();
+  EXPECT_NEAR(Mean(normals), 0.0, 0.02);
+  std::vector<float> exponentials(kSamples);
+  for (float& value : exponentials) value = random.Exponential();
+  EXPECT_NEAR(Mean(exponentials), 1.0, 0.02);
+}
+
+TEST(BulkRandomTest, DrivesAbslDistributions) {
+  BulkRandom random(kSeed);
+  int successes = 0;
+  for (int i = 0; i < kSamples; ++i) {
+    successes += absl::Bernoulli(random, 0.25);
+  }
+  EXPECT_NEAR(static_cast<double>(successes) / kSamples, 0.25, 0.01);
+}
+
+TEST(GammaSamplerTest, MatchesMoments) {
+  BulkRandom random(kSeed);
+  for (const float shape : {0.5f, 1.472f, 4.0f}) {
+    const float scale = 1.898f;
+    GammaSampler sampler(shape, scale);
+    std::vector<float> values(kSamples);
+    sampler.Fill(random, absl::MakeSpan(values));
+    EXPECT_THAT(values, Each(Ge(0.0f)));
+    EXPECT_NEAR(Mean(values), shape * scale, 0.02 * shape * scale);
+    EXPECT_NEAR(Variance(values), shape * scale * scale,
+                0.05 * shape * scale * scale);
+  }
+}
+
+TEST(ParetoSamplerTest, MatchesMedian) {
+  BulkRandom random(kSeed);
+  const float scale = 1.5f;
+  const float shape = 2.0f;
+  ParetoSampler sampler(scale, shape);
+  std::vector<float> values(kSamples);
+  sampler.Fill(random, absl::MakeSpan(values));
+  EXPECT_THAT(values, Each(Ge(scale)));
+  std::nth_element(values.begin(), values.begin() + kSamples / 2,
+                   values.end());
+  EXPECT_NEAR(values[kSamples / 2], scale * std::pow(2.0f, 1.0f / shape),
+              0.02);
+}
+
+TEST(NegativeBinomialSamplerTest, MatchesMoments) {
+  BulkRandom random(kSeed);
+  const float successes = 2.5f;
+  const float p = 0.3f;
+  NegativeBinomialSampler sampler(successes, p);
+  std::vector<float> values(kSamples);
+  for (float& value : values) value = sampler.Sample(random);
+  EXPECT_NEAR(Mean(values), successes * (1 - p) / p, 0.1);
+  EXPECT_NEAR(Variance(values), successes * (1 - p) / (p * p), 1.0);
+}
+
+TEST(DiscreteAliasSamplerTest, MatchesProbabilities) {
+  BulkRandom random(kSeed);
+  const std::vector<double> weights = {1, 0, 2, 7};
+  DiscreteAliasSampler sampler(weights);
+  EXPECT_THAT(sampler.probabilities(),
+              testing::ElementsAre(0.1, 0.0, 0.2, 0.7));
+  std::vector<int> samples(kSamples);
+  sampler.Fill(random, absl::MakeSpan(samples));
+  std::vector<int> counts(weights.size());
+  for (const int sample : samples) counts[sample]++;
+  for (int i = 0; i < weights.size(); ++i) {
+    EXPECT_NEAR(static_cast<double>(counts[i]) / kSamples,
+                sampler.probabilities()[i], 0.01);
+  }
+}
+
+TEST(DiscreteAliasSamplerTest, MatchesProbabilitiesOfManyBuckets) {
+  // With this many buckets a single float draw leaves only a few bits to
+  // compare against the cutoffs, which are just below 1 for the lighter half
+  // of the buckets.
+  BulkRandom random(kSeed);
+  const int kBuckets = 1 << 20;
+  std::vector<double> weights(kBuckets);
+  for (int i = 0; i < kBuckets; ++i) weights[i] = i % 2 == 0 ? 1.0 : 1.1;
+  DiscreteAliasSampler sampler(weights);
+  std::vector<int> samples(10 * kSamples);
+  sampler.Fill(random, absl::MakeSpan(samples));
+  int even = 0;
+  int top_half = 0;
+  for (const int sample : samples) {
+    even += sample % 2 == 0;
+    top_half += sample >= kBuckets / 2;
+  }
+  EXPECT_NEAR(static_cast<double>(even) / samples.size(), 1.0 / 2.1, 0.005);
+  EXPECT_NEAR(static_cast<double>(top_half) / samples.size(), 0.5, 0.005);
+}
+
+}  // namespace
+}  // namespace abesim
@@ -22,26 +22,21 @@
 #include <random>
 
 #include "absl/container/flat_hash_map.h"
-#include "absl/random/discrete_distribution.h"
-#include "absl/random/random.h"
+#include "absl/memory/memory.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/parameter_distribution.pb.h"
-#include "agent_based_epidemic_sim/core/random.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 #include "google/protobuf/any.pb.h"
 
 namespace abesim {
 
 // Creates a sampler based on non-uniform discrete distributions.
-// Assumes the number of buckets is relatively small.
 template <typename T>
 class DiscreteDistributionSampler {
  public:
   // Returns a value sampled from the distribution.
-  T Sample() {
-    absl::BitGenRef gen = GetBitGen();
-    return values_[distribution_(gen)];
-  }
+  T Sample() { return values_[sampler_.Sample(GetBulkRandom())]; }
 
   // Creates a DiscreteDistributionSampler from the given distribution.
   static std::unique_ptr<DiscreteDistributionSampler<T>> FromProto(
@@ -49,7 +44,7 @@ class DiscreteDistributionSampler {
 
   // Returns the associated probabilities of the distribution.
   const std::vector<double> GetProbabilities() {
-    return distribution_.probabilities();
+    return sampler_.probabilities();
   }
 
   // Returns the values for the distribution buckets.
@@ -57,12 +52,12 @@ class DiscreteDistributionSampler {
 
  private:
   DiscreteDistributionSampler(std::vector<T> values,
-                              absl::discrete_distribution<int> distribution)
-      : values_(std::move(values)), distribution_(std::move(distribution)) {}
+                              DiscreteAliasSampler sampler)
+      : values_(std::move(values)), sampler_(std::move(sampler)) {}
   static auto ValueGetter();
 
   const std::vector<T> values_;
-  absl::discrete_distribution<int> distribution_;
+  const DiscreteAliasSampler sampler_;
 };
 
 template <typename T>
@@ -81,11 +76,10 @@ DiscreteDistributionSampler<T>::FromProto(
   for (const auto& bucket : dist_proto.buckets()) {
     values.push_back(value_getter(bucket));
   }
-  absl::discrete_distribution<int> dist(probabilities.begin(),
-                                        probabilities.end());
+  DiscreteAliasSampler sampler(probabilities);
 
   return absl::WrapUnique(
-      new DiscreteDistributionSampler<T>(values, std::move(dist)));
+      new DiscreteDistributionSampler<T>(values, std::move(sampler)));
 }
 
 template <typename T>
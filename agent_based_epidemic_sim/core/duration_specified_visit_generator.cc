@@ -14,27 +14,38 @@
 
 #include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
 
-#include "absl/random/distributions.h"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
 #include "absl/time/time.h"
-#include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
 
-void DurationSpecifiedVisitGenerator::GenerateVisits(
-    const Timestep& timestep, const RiskScore& risk_score,
-    std::vector<Visit>* visits) const {
+namespace {
+
+// Generates visits to num_visits locations in turn.  location_uuid(i) gives
+// the location of the ith visit and sample_duration(i, adjustment) samples its
+// unnormalized duration.
+template <typename LocationUuidFn, typename SampleDurationFn>
+void GenerateDurationSpecifiedVisits(const Timestep& timestep,
+                                     const RiskScore& risk_score,
+                                     const int num_visits,
+                                     const LocationUuidFn& location_uuid,
+                                     const SampleDurationFn& sample_duration,
+                                     std::vector<Visit>* visits) {
   DCHECK(visits != nullptr);
-  std::vector<float> durations;
-  absl::BitGenRef gen = GetBitGen();
-  for (const LocationDuration& location_duration : location_durations_) {
-    auto adjustment = risk_score.GetVisitAdjustment(
-        timestep, location_duration.location_uuid);
-    if (!absl::Bernoulli(gen, adjustment.frequency_adjustment)) {
+  thread_local std::vector<float> durations;
+  durations.clear();
+  BulkRandom& random = GetBulkRandom();
+  for (int i = 0; i < num_visits; ++i) {
+    auto adjustment = risk_score.GetVisitAdjustment(timestep, location_uuid(i));
+    if (random.Uniform() >= adjustment.frequency_adjustment) {
       durations.push_back(0.0);
     } else {
-      float sample =
-          location_duration.sample_duration(adjustment.duration_adjustment);
+      float sample = sample_duration(i, adjustment.duration_adjustment);
       durations.push_back(std::max(0.0f, sample));
     }
   }
@@ -45,9 +56,9 @@ void DurationSpecifiedVisitGenerator::GenerateVisits(
     normalizer = durations[0] = 1.0f;
   }
   absl::Time start_time = timestep.start_time();
-  for (int i = 0; i < location_durations_.size(); ++i) {
+  for (int i = 0; i < num_visits; ++i) {
     absl::Time end_time;
-    if (i == location_durations_.size() - 1) {
+    if (i == num_visits - 1) {
       end_time = timestep.end_time();
     } else {
       end_time = std::min(
@@ -55,7 +66,7 @@ void DurationSpecifiedVisitGenerator::GenerateVisits(
           start_time + (durations[i] / normalizer) * timestep.duration());
     }
     if (end_time <= start_time) continue;
-    Visit visit{.location_uuid = location_durations_[i].location_uuid,
+    Visit visit{.location_uuid = location_uuid(i),
                 .start_time = start_time,
                 .end_time = end_time};
     start_time = end_time;
@@ -63,4 +74,33 @@ void DurationSpecifiedVisitGenerator::GenerateVisits(
   }
 }
 
+}  // namespace
+
+void DurationSpecifiedVisitGenerator::GenerateVisits(
+    const Timestep& timestep, const RiskScore& risk_score,
+    std::vector<Visit>* visits) const {
+  GenerateDurationSpecifiedVisits(
+      timestep, risk_score, location_durations_.size(),
+      [this](const int i) { return location_durations_[i].location_uuid; },
+      [this](const int i, const float adjustment) {
+        return location_durations_[i].sample_duration(adjustment);
+      },
+      visits);
+}
+
+void ScheduledVisitGenerator::GenerateVisits(const Timestep& timestep,
+                                             const RiskScore& risk_score,
+                                             std::vector<Visit>* visits) const {
+  const std::vector<ScheduledVisit>& schedule = *schedule_;
+  GenerateDurationSpecifiedVisits(
+      timestep, risk_score, schedule.size(),
+      [this, &schedule](const int i) {
+        return location_uuids_[schedule[i].location_index];
+      },
+      [&schedule](const int i, const float adjustment) {
+        return schedule[i].sample_duration(adjustment);
+      },
+      visits);
+}
+
 }  // namespace abesim
@@ -17,10 +17,14 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_DURATION_SPECIFIED_VISIT_GENERATOR_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_DURATION_SPECIFIED_VISIT_GENERATOR_H_
 
+#include <functional>
 #include <memory>
+#include <vector>
 
+#include "absl/container/inlined_vector.h"
 #include "absl/random/random.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
@@ -55,6 +59,35 @@ class DurationSpecifiedVisitGenerator : public VisitGenerator {
   std::vector<LocationDuration> location_durations_;
 };
 
+// One visit of a schedule shared between agents.  The visit is to the agent's
+// location at location_index in its own list of locations.
+struct ScheduledVisit {
+  int location_index;
+  // As LocationDuration::sample_duration.
+  std::function<float(float adjustment)> sample_duration;
+};
+
+// Generates visits exactly as DurationSpecifiedVisitGenerator does, but takes
+// the duration samplers from a schedule shared by many agents, so that each
+// agent only stores the uuids of its own locations.  This keeps per-agent
+// generators small enough to be stored by value in a contiguous array.
+class ScheduledVisitGenerator : public VisitGenerator {
+ public:
+  // schedule must outlive the generator.  location_uuids must have an entry
+  // for every location_index used by schedule.
+  ScheduledVisitGenerator(const std::vector<ScheduledVisit>* schedule,
+                          absl::Span<const int64> location_uuids)
+      : schedule_(schedule),
+        location_uuids_(location_uuids.begin(), location_uuids.end()) {}
+
+  void GenerateVisits(const Timestep& timestep, const RiskScore& risk_score,
+                      std::vector<Visit>* visits) const override;
+
+ private:
+  const std::vector<ScheduledVisit>* schedule_;
+  absl::InlinedVector<int64, 2> location_uuids_;
+};
+
 }  // namespace abesim
 
 #endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_DURATION_SPECIFIED_VISIT_GENERATOR_H_
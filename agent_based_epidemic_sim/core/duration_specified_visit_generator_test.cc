@@ -180,5 +180,36 @@ TEST(DurationSpecifiedVisitGeneratorTest, GeneratesDurationAdjustedVisits) {
   EXPECT_EQ(timestep.end_time(), visits[1].end_time);
 }
 
+TEST(ScheduledVisitGeneratorTest, SharesScheduleBetweenAgents) {
+  // Home, then work, then home again.
+  const std::vector<ScheduledVisit> schedule = {
+      {.location_index = 0,
+       .sample_duration = [](float adjustment) { return 8 * adjustment; }},
+      {.location_index = 1,
+       .sample_duration = [](float adjustment) { return 8 * adjustment; }},
+      {.location_index = 0,
+       .sample_duration = [](float adjustment) { return 8 * adjustment; }},
+  };
+  const std::vector<int64> first_locations = {10, 20};
+  const std::vector<int64> second_locations = {11, 21};
+  ScheduledVisitGenerator first(&schedule, first_locations);
+  ScheduledVisitGenerator second(&schedule, second_locations);
+  auto risk_score = NewNullRiskScore();
+  Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+
+  std::vector<Visit> visits;
+  first.GenerateVisits(timestep, *risk_score, &visits);
+  second.GenerateVisits(timestep, *risk_score, &visits);
+  ASSERT_EQ(6, visits.size());
+  const std::vector<int64> expected_locations = {10, 20, 10, 11, 21, 11};
+  for (int i = 0; i < visits.size(); ++i) {
+    EXPECT_EQ(expected_locations[i], visits[i].location_uuid);
+    EXPECT_THAT(visits[i].end_time,
+                TimeNear(visits[i].start_time + absl::Hours(8)));
+  }
+  EXPECT_EQ(timestep.end_time(), visits[2].end_time);
+  EXPECT_EQ(timestep.start_time(), visits[3].start_time);
+}
+
 }  // namespace
 }  // namespace abesim
@@ -313,11 +313,21 @@ struct ContactReport {
 
   absl::optional<absl::Time> initial_symptom_onset_time;
 
+  // Recursive tracing state.  Reports that may be forwarded carry the agent
+  // whose test result they report, the number of hops they have taken from
+  // it, and the number of further hops they may take.  Reports with no hops
+  // remaining are never forwarded.
+  int64 index_agent_uuid = 0;
+  int32 hop = 1;
+  int32 hops_remaining = 0;
+
   friend bool operator==(const ContactReport& a, const ContactReport& b) {
     return (a.from_agent_uuid == b.from_agent_uuid &&
             a.to_agent_uuid == b.to_agent_uuid &&
             a.test_result == b.test_result &&
-            a.initial_symptom_onset_time == b.initial_symptom_onset_time);
+            a.initial_symptom_onset_time == b.initial_symptom_onset_time &&
+            a.index_agent_uuid == b.index_agent_uuid && a.hop == b.hop &&
+            a.hops_remaining == b.hops_remaining);
   }
 
   friend bool operator!=(const ContactReport& a, const ContactReport& b) {
@@ -329,6 +339,11 @@ struct ContactReport {
     strm << "{" << contact_report.from_agent_uuid << ", "
          << contact_report.to_agent_uuid << ", " << contact_report.test_result
          << ", ";
+    if (contact_report.hops_remaining > 0 || contact_report.hop > 1) {
+      strm << "index " << contact_report.index_agent_uuid << " hop "
+           << contact_report.hop << " of "
+           << contact_report.hop + contact_report.hops_remaining << ", ";
+    }
     if (!contact_report.initial_symptom_onset_time.has_value()) {
       return strm << "?]";
     }
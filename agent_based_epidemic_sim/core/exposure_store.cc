@@ -1,10 +1,18 @@
 #include "agent_based_epidemic_sim/core/exposure_store.h"
 
+#include <algorithm>
+
 #include "agent_based_epidemic_sim/core/event.h"
 
 namespace abesim {
+namespace {
+
+// The smallest buffer allocated once the store receives exposures.
+constexpr size_t kMinCapacity = 14;
+
+}  // namespace
 
-ExposureStore::ExposureStore() : buffer_(14) {}
+ExposureStore::ExposureStore() = default;
 
 void ExposureStore::GarbageCollect(absl::Time before) {
   while (head_ != tail_ && buffer_[head_].exposure.start_time < before) {
@@ -24,12 +32,14 @@ void ExposureStore::GarbageCollect(absl::Time before) {
 
 void ExposureStore::AddExposures(
     absl::Span<const InfectionOutcome> infection_outcomes) {
+  if (infection_outcomes.empty()) return;
   // Ensure there is enough space for all the new records.
   const size_t current = size();
   const size_t desired = infection_outcomes.size() + current;
   if (desired >= buffer_.size()) {
     // Reallocate the circular buffer.
-    std::vector<Record> tmp(std::max(buffer_.size() * 2, desired + 1));
+    RecordBuffer tmp(
+        std::max({buffer_.size() * 2, desired + 1, kMinCapacity}));
     size_t id = head_id_;
     for (int i = 0; i < current; ++i) {
       tmp[i] = std::move(GetRecordById(id++));
@@ -75,6 +85,13 @@ ExposureStore::Record& ExposureStore::GetRecordById(const size_t i) {
   return buffer_[idx];
 }
 
+void ExposureStore::Compact() {
+  if (size() != 0) return;
+  RecordBuffer().swap(buffer_);
+  decltype(agents_)().swap(agents_);
+  head_ = tail_ = 0;
+}
+
 size_t ExposureStore::size() const {
   if (tail_ >= head_) return tail_ - head_;
   return buffer_.size() - head_ + tail_;
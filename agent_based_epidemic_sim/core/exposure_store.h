@@ -4,12 +4,14 @@
 #include <functional>
 #include <limits>
 #include <memory>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/paged_arena.h"
 
 namespace abesim {
 
@@ -48,6 +50,10 @@ class ExposureStore {
   // Return the number of exposures currently stored.
   size_t size() const;
 
+  // Release the memory held by the store if it is empty.  Agents that are
+  // unlikely to receive further exposures call this to shrink their state.
+  void Compact();
+
  private:
   struct Record {
     size_t newer_id = 0;
@@ -56,6 +62,10 @@ class ExposureStore {
     Exposure exposure;
     std::unique_ptr<ContactReport> contact_report;
   };
+  // Records are the bulk of an agent's state, so they are allocated from the
+  // simulation's PagedArena when running out of core.
+  using RecordBuffer = std::vector<Record, PagedAllocator<Record>>;
+
   const Record& GetRecordById(size_t i) const;
   Record& GetRecordById(size_t i);
 
@@ -65,19 +75,22 @@ class ExposureStore {
   // buffer.
   size_t head_id_ = 1;
 
-  // agents_ gives quick access to the list of records for each agent.
+  // agents_ gives quick access to the list of records for each agent.  It
+  // grows with the records, so it is paged along with them.
   struct Sentinel {
     size_t oldest_id = 0;
     size_t newest_id = 0;
   };
-  absl::flat_hash_map<int64, Sentinel> agents_;
+  absl::flat_hash_map<int64, Sentinel, absl::Hash<int64>, std::equal_to<int64>,
+                      PagedAllocator<std::pair<const int64, Sentinel>>>
+      agents_;
 
   // buffer_ is a circular buffer, the oldest exposures index is head_,
   // tail_ is one past the index of the newest exposure.  If head_ == tail_ the
   // buffer is empty.  Note that indexes and ids are not the same.
   size_t head_ = 0;
   size_t tail_ = 0;
-  std::vector<Record> buffer_;
+  RecordBuffer buffer_;
 };
 
 template <typename Fn>
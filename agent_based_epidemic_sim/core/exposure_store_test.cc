@@ -103,5 +103,26 @@ TEST(ExposureStoreTest, AddsAndRemovesExposures) {
   }
 }
 
+TEST(ExposureStoreTest, CompactsOnlyWhenEmpty) {
+  ExposureStore store;
+  store.Compact();
+  EXPECT_EQ(store.size(), 0);
+
+  store.AddExposures(Outcomes(2, {10, 11}));
+  store.Compact();
+  EXPECT_EQ(store.size(), 2);
+
+  store.GarbageCollect(TestDay(3));
+  store.Compact();
+  EXPECT_EQ(store.size(), 0);
+
+  store.AddExposures(Outcomes(4, {12, 12, 13}));
+  EXPECT_EQ(store.size(), 3);
+  std::vector<int64> agents;
+  store.PerAgent(absl::InfinitePast(),
+                 [&agents](int64 uuid) { agents.push_back(uuid); });
+  EXPECT_THAT(agents, testing::UnorderedElementsAre(12, 13));
+}
+
 }  // namespace
 }  // namespace abesim
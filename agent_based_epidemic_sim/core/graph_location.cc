@@ -18,16 +18,15 @@
 #include <memory>
 #include <random>
 #include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
-#include "absl/random/bit_gen_ref.h"
-#include "absl/random/distributions.h"
-#include "absl/random/random.h"
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
 #include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
-#include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/core/visit.h"
 
 namespace abesim {
 
@@ -36,8 +35,7 @@ namespace {
 class GraphLocation : public Location {
  public:
   GraphLocation(int64 uuid, std::function<float()> location_transmissibility,
-                std::function<float()> drop_probability,
-                std::vector<std::pair<int64, int64>> graph,
+                std::function<float()> drop_probability, EdgeList graph,
                 const ExposureGenerator& exposure_generator)
       : graph_(std::move(graph)),
         uuid_(uuid),
@@ -49,52 +47,119 @@ class GraphLocation : public Location {
 
   void ProcessVisits(absl::Span<const Visit> visits,
                      Broker<InfectionOutcome>* infection_broker) override {
-    thread_local absl::flat_hash_map<int64, Visit> visit_map;
-    visit_map.clear();
+    // Index the stays of each agent.  An agent usually has a single stay, but
+    // one that is here several times or whose health changes while it is here
+    // has several, chained through next_stay.
+    thread_local std::vector<Visit> stays;
+    stays.clear();
+    ExpandVisitStays(visits, &stays);
+    thread_local absl::flat_hash_map<int64, int> first_stay;
+    thread_local std::vector<int> next_stay;
+    first_stay.clear();
+    next_stay.assign(stays.size(), -1);
+    for (int i = stays.size() - 1; i >= 0; --i) {
+      auto [it, inserted] = first_stay.try_emplace(stays[i].agent_uuid, i);
+      if (!inserted) {
+        next_stay[i] = it->second;
+        it->second = i;
+      }
+    }
+    // The people of a cohort have the uuids [uuid, uuid + weight), and the
+    // graph connects each of them.  They are all present for the cohort's
+    // stays.
     for (const Visit& visit : visits) {
-      visit_map[visit.agent_uuid] = visit;
+      if (visit.weight == 1) continue;
+      const int stay = first_stay[visit.agent_uuid];
+      for (int64 person = visit.agent_uuid + 1;
+           person < visit.agent_uuid + visit.weight; ++person) {
+        first_stay.try_emplace(person, stay);
+      }
     }
 
     MaybeUpdateGraph(visits);
 
-    absl::BitGenRef gen = GetBitGen();
+    // Draw the uniforms that decide which potential contacts are dropped for
+    // all edges at once.
+    thread_local std::vector<float> drop_draws;
+    drop_draws.resize(graph_.size());
+    GetBulkRandom().FillUniform(absl::MakeSpan(drop_draws));
 
-    for (const std::pair<int64, int64>& edge : graph_) {
+    for (int i = 0; i < graph_.size(); ++i) {
+      const std::pair<int64, int64>& edge = graph_[i];
       // Randomly drop some potential contacts.
-      if (absl::Bernoulli(gen, drop_probability_())) {
+      if (drop_draws[i] < drop_probability_()) {
         continue;
       }
 
       // If either of the participants are not present, no contact is generated.
-      auto visit_a = visit_map.find(edge.first);
-      if (visit_a == visit_map.end()) continue;
-      auto visit_b = visit_map.find(edge.second);
-      if (visit_b == visit_map.end()) continue;
+      auto stay_a = first_stay.find(edge.first);
+      if (stay_a == first_stay.end()) continue;
+      auto stay_b = first_stay.find(edge.second);
+      if (stay_b == first_stay.end()) continue;
 
+      const std::pair<const Visit*, const Visit*> contact =
+          ContactStays(stays, next_stay, stay_a->second, stay_b->second);
+      const Visit& visit_a = *contact.first;
+      const Visit& visit_b = *contact.second;
+      // Two people of the same cohort are never infectious.
+      if (visit_a.agent_uuid == visit_b.agent_uuid) continue;
       ExposurePair host_exposures = exposure_generator_.Generate(
-          location_transmissibility_(), visit_a->second, visit_b->second);
+          location_transmissibility_(), visit_a, visit_b);
+      ScaleToOnePerson(visit_a, host_exposures.host_a);
+      ScaleToOnePerson(visit_b, host_exposures.host_b);
       infection_broker->Send(
           {{
-               .agent_uuid = edge.first,
+               .agent_uuid = visit_a.agent_uuid,
                .exposure = host_exposures.host_a,
                .exposure_type = InfectionOutcomeProto::CONTACT,
-               .source_uuid = edge.second,
+               .source_uuid = visit_b.agent_uuid,
            },
            {
-               .agent_uuid = edge.second,
+               .agent_uuid = visit_b.agent_uuid,
                .exposure = host_exposures.host_b,
                .exposure_type = InfectionOutcomeProto::CONTACT,
-               .source_uuid = edge.first,
+               .source_uuid = visit_a.agent_uuid,
            }});
     }
   }
 
  protected:
-  std::vector<std::pair<int64, int64>> graph_;
+  EdgeList graph_;
 
  private:
   virtual void MaybeUpdateGraph(absl::Span<const Visit> visits) {}
 
+  // An edge exposes a single person of a cohort, but the cohort gives its
+  // exposures to all of its people.  Dividing the infectivity of the exposure
+  // among them keeps the expected number of infections of a cohort with
+  // small hazards that of its people.
+  static void ScaleToOnePerson(const Visit& host, Exposure& exposure) {
+    if (host.weight > 1) exposure.infectivity /= host.weight;
+  }
+
+  // Returns the stays chained from a and b during which the two agents are
+  // together the longest.  Agents on an edge are in contact once per step even
+  // if they are never here at the same time, in which case the stays closest
+  // in time are used.
+  static std::pair<const Visit*, const Visit*> ContactStays(
+      absl::Span<const Visit> stays, absl::Span<const int> next_stay, int a,
+      int b) {
+    std::pair<const Visit*, const Visit*> best;
+    absl::Duration best_overlap = -absl::InfiniteDuration();
+    for (int i = a; i >= 0; i = next_stay[i]) {
+      for (int j = b; j >= 0; j = next_stay[j]) {
+        const absl::Duration overlap =
+            std::min(stays[i].end_time, stays[j].end_time) -
+            std::max(stays[i].start_time, stays[j].start_time);
+        if (overlap > best_overlap) {
+          best_overlap = overlap;
+          best = {&stays[i], &stays[j]};
+        }
+      }
+    }
+    return best;
+  }
+
   const int64 uuid_;
   const std::function<float()> location_transmissibility_;
   const std::function<float()> drop_probability_;
@@ -121,7 +186,7 @@ class RandomGraphLocation : public GraphLocation {
     internal::AgentUuidsFromRandomLocationVisits(visits, lockdown_multiplier_(),
                                                  agent_uuids);
     // Connect random pairs till none remain.
-    std::shuffle(agent_uuids.begin(), agent_uuids.end(), GetBitGen());
+    std::shuffle(agent_uuids.begin(), agent_uuids.end(), GetBulkRandom());
     internal::ConnectAdjacentNodes(agent_uuids, graph_);
   }
 
@@ -139,15 +204,19 @@ void AgentUuidsFromRandomLocationVisits(absl::Span<const Visit> visits,
                                         std::vector<int64>& agent_uuids) {
   agent_uuids.clear();
   for (const Visit& visit : visits) {
-    agent_uuids.resize(
-        agent_uuids.size() +
-            visit.location_dynamics.random_location_edges * lockdown_multiplier,
-        visit.agent_uuid);
+    // Each person of a cohort makes its own edges.
+    for (int64 person = visit.agent_uuid;
+         person < visit.agent_uuid + visit.weight; ++person) {
+      agent_uuids.resize(agent_uuids.size() +
+                             visit.location_dynamics.random_location_edges *
+                                 lockdown_multiplier,
+                         person);
+    }
   }
 }
 
 void ConnectAdjacentNodes(absl::Span<const int64> agent_uuids,
-                          std::vector<std::pair<int64, int64>>& graph) {
+                          EdgeList& graph) {
   graph.clear();
   while (agent_uuids.size() >= 2) {
     int64 a = agent_uuids[0];
@@ -171,8 +240,7 @@ void ConnectAdjacentNodes(absl::Span<const int64> agent_uuids,
 
 std::unique_ptr<Location> NewGraphLocation(
     int64 uuid, std::function<float()> location_transmissibility,
-    std::function<float()> drop_probability,
-    std::vector<std::pair<int64, int64>> graph,
+    std::function<float()> drop_probability, EdgeList graph,
     const ExposureGenerator& exposure_generator) {
   return absl::make_unique<GraphLocation>(
       uuid, std::move(location_transmissibility), std::move(drop_probability),
@@ -18,31 +18,45 @@
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_GRAPH_LOCATION_H_
 
 #include <memory>
+#include <utility>
+#include <vector>
 
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
+#include "agent_based_epidemic_sim/core/huge_page_allocator.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/location.h"
 
 namespace abesim {
 
+// The edges of a location's graph.  Every edge is visited each step, and the
+// graphs of large locations have millions of them, so they are backed by huge
+// pages.
+using EdgeList = std::vector<std::pair<int64, int64>,
+                             HugePageAllocator<std::pair<int64, int64>>>;
+
 // Creates a new location that samples edges from the given graph of possible
 // agent  connections.  drop_probability indicates the probability that a given
 // connection should be ignored on each ProcessVisits call.
 // location_transmissibility is a function that returns the transmissibility
 // factor of this location and should be a floating ponit number between 0
 // and 1.  It is taken as a function because the value may change from one
-// timestep to another.
+// timestep to another.  The location takes graph, so callers should move it
+// in rather than keep a copy alive.
+//
+// Edges connect individual people.  A weighted visit stands for the people of
+// a cohort, the uuids [agent_uuid, agent_uuid + weight), so their edges expose
+// the cohort agent, with the infectivity of each exposure divided by weight.
 std::unique_ptr<Location> NewGraphLocation(
     int64 uuid, std::function<float()> location_transmissibility,
-    std::function<float()> drop_probability,
-    std::vector<std::pair<int64, int64>> graph,
+    std::function<float()> drop_probability, EdgeList graph,
     const ExposureGenerator& exposure_generator);
 
 // Creates a new location that dynamically connects visiting agents. On each
 // call to ProcessVisits, samples edges between all agents with visits to the
 // location. The number of edges for each agent is taken from the
-// VisitLocationDynamics of each agents visit message.
+// VisitLocationDynamics of each agents visit message, for each person of a
+// weighted visit.
 std::unique_ptr<Location> NewRandomGraphLocation(
     int64 uuid, std::function<float()> location_transmissibility,
     std::function<float()> lockdown_multiplier,
@@ -53,7 +67,8 @@ std::unique_ptr<Location> NewRandomGraphLocation(
 namespace internal {
 
 // Extracts a list of agent UUIDs from visits. An agent is repeated once for
-// each edge needed by it.
+// each edge needed by it.  A weighted visit gives the uuids of each of its
+// people.
 void AgentUuidsFromRandomLocationVisits(absl::Span<const Visit> visits,
                                         float lockdown_multiplier,
                                         std::vector<int64>& agent_uuids);
@@ -62,7 +77,7 @@ void AgentUuidsFromRandomLocationVisits(absl::Span<const Visit> visits,
 // except where adjacent elements are identical.
 // E.g. given [a, b, a, c, c, c, d] constructs graph with edges [a-b, a-c, c-d].
 void ConnectAdjacentNodes(absl::Span<const int64> agent_uuids,
-                          std::vector<std::pair<int64, int64>>& graph);
+                          EdgeList& graph);
 
 }  // namespace internal
 }  // namespace abesim
@@ -51,7 +51,7 @@ class FakeExposureGenerator : public ExposureGenerator {
 static constexpr int kLocationUUID = 1;
 
 Visit GenerateVisit(int64 agent, HealthState::State health_state,
-                    int random_location_edges = 1) {
+                    int16 random_location_edges = 1) {
   return {
       .location_uuid = kLocationUUID,
       .agent_uuid = agent,
@@ -123,6 +123,34 @@ TEST(GraphLocationTest, AllSamplesDropped) {
   EXPECT_TRUE(broker.visits().empty());
 }
 
+TEST(GraphLocationTest, ExposesCohortsThroughTheEdgesOfTheirPeople) {
+  FakeExposureGenerator generator;
+  // Agent 10 is a cohort of the people 10, 11 and 12.
+  auto location = NewGraphLocation(
+      kLocationUUID, []() { return 1.0; }, []() { return 0.0; },
+      {{0, 10}, {0, 11}, {1, 12}, {10, 11}}, generator);
+  FakeBroker broker;
+  Visit cohort = GenerateVisit(10, HealthState::SUSCEPTIBLE);
+  cohort.weight = 3;
+  location->ProcessVisits(
+      {
+          GenerateVisit(0, HealthState::INFECTIOUS),
+          GenerateVisit(1, HealthState::SUSCEPTIBLE),
+          cohort,
+      },
+      &broker);
+  // Each edge of a person exposes the cohort for one of its three people.
+  // People of the same cohort are not in contact through the cohort.
+  EXPECT_THAT(broker.visits(), testing::UnorderedElementsAreArray({
+                                   ExpectedOutcome(0, 10, 0.0, 1.0),       //
+                                   ExpectedOutcome(10, 0, 1.0f / 3, 1.0),  //
+                                   ExpectedOutcome(0, 10, 0.0, 1.0),       //
+                                   ExpectedOutcome(10, 0, 1.0f / 3, 1.0),  //
+                                   ExpectedOutcome(1, 10, 0.0, 1.0),       //
+                                   ExpectedOutcome(10, 1, 0.0, 1.0),       //
+                               }));
+}
+
 TEST(AgentUuidsFromRandomLocationVisits, Basic) {
   std::vector<int64> agent_uuids;
   internal::AgentUuidsFromRandomLocationVisits(
@@ -157,8 +185,19 @@ TEST(AgentUuidsFromRandomLocationVisits, ClearsOutputArg) {
                                {0, 0, 1, 1, 1, 2, 4, 4, 4, 4, 5, 5}));
 }
 
+TEST(AgentUuidsFromRandomLocationVisits, RepeatsEachPersonOfACohort) {
+  std::vector<int64> agent_uuids;
+  Visit cohort = GenerateVisit(4, HealthState::SUSCEPTIBLE, 2);
+  cohort.weight = 3;
+  internal::AgentUuidsFromRandomLocationVisits(
+      {GenerateVisit(0, HealthState::INFECTIOUS, 1), cohort}, 1.0f,
+      agent_uuids);
+  EXPECT_THAT(agent_uuids,
+              testing::UnorderedElementsAreArray({0, 4, 4, 5, 5, 6, 6}));
+}
+
 TEST(ConnectAdjacentNodes, Basic) {
-  std::vector<std::pair<int64, int64>> graph;
+  EdgeList graph;
   internal::ConnectAdjacentNodes({1, 2, 3, 4, 5, 6, 7}, graph);
   EXPECT_THAT(graph, testing::ElementsAreArray({
                          testing::Pair(1, 2),
@@ -169,7 +208,7 @@ TEST(ConnectAdjacentNodes, Basic) {
 
 TEST(ConnectAdjacentNodes, EdgesAreSortedAndDistinct) {
   // Tests that the graph's edges are sorted and distinct.
-  std::vector<std::pair<int64, int64>> graph;
+  EdgeList graph;
   internal::ConnectAdjacentNodes({2, 1, 3, 1, 3, 4, 1, 2}, graph);
   EXPECT_THAT(graph, testing::ElementsAreArray({
                          testing::Pair(1, 2),
@@ -180,7 +219,7 @@ TEST(ConnectAdjacentNodes, EdgesAreSortedAndDistinct) {
 
 TEST(ConnectAdjacentNodes, NoSelfEdges) {
   // Tests that the graph does not include self-edges.
-  std::vector<std::pair<int64, int64>> graph;
+  EdgeList graph;
   internal::ConnectAdjacentNodes({1, 1, 2, 3, 3, 4}, graph);
   EXPECT_THAT(graph, testing::ElementsAreArray({
                          testing::Pair(1, 2),
@@ -0,0 +1,315 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/huge_page_allocator.h"
+
+#include <linux/perf_event.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// Allocations of at least kMinArenaBlock bytes and at most half a huge page
+// are rounded up to a power of two and carved out of huge pages shared by
+// blocks of that size.  Message queues grow by doubling, so they pass through
+// these sizes before they are large enough to be mapped on their own.
+constexpr size_t kMinArenaBlock = size_t{64} << 10;
+constexpr size_t kMaxArenaBlock = kHugePageSize / 2;
+constexpr int kNumArenaClasses = 5;
+static_assert(kMinArenaBlock << (kNumArenaClasses - 1) == kMaxArenaBlock);
+
+std::atomic<size_t> mapped_bytes{0};
+std::atomic<size_t> arena_bytes{0};
+std::atomic<size_t> allocations{0};
+std::atomic<size_t> hugetlb_allocations{0};
+// Once a hugetlbfs mapping fails, don't bother trying again.
+std::atomic<bool> try_hugetlb{true};
+
+size_t RoundUp(const size_t bytes) {
+  return (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+}
+
+void* MapAnonymous(const size_t bytes, const int extra_flags) {
+  void* const ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | extra_flags, -1, 0);
+  return ptr == MAP_FAILED ? nullptr : ptr;
+}
+
+// Maps bytes at a huge page aligned address, so that the kernel can back the
+// whole range with transparent huge pages.
+void* MapAligned(const size_t bytes) {
+  char* const region =
+      static_cast<char*>(MapAnonymous(bytes + kHugePageSize, 0));
+  if (region == nullptr) return nullptr;
+  const uintptr_t address = reinterpret_cast<uintptr_t>(region);
+  char* const aligned =
+      region + (kHugePageSize - address % kHugePageSize) % kHugePageSize;
+  if (aligned > region) munmap(region, aligned - region);
+  char* const end = aligned + bytes;
+  if (end < region + bytes + kHugePageSize) {
+    munmap(end, region + bytes + kHugePageSize - end);
+  }
+#ifdef MADV_HUGEPAGE
+  if (madvise(aligned, bytes, MADV_HUGEPAGE) != 0) {
+    VLOG(1) << "Transparent huge pages are not available.";
+  }
+#endif
+  return aligned;
+}
+
+// Maps rounded bytes, a whole number of huge pages.
+void* MapHugePages(const size_t rounded) {
+  void* ptr = nullptr;
+#ifdef MAP_HUGETLB
+  if (try_hugetlb.load(std::memory_order_relaxed)) {
+    ptr = MapAnonymous(rounded, MAP_HUGETLB);
+    if (ptr != nullptr) {
+      ++hugetlb_allocations;
+    } else {
+      try_hugetlb = false;
+    }
+  }
+#endif
+  if (ptr == nullptr) ptr = MapAligned(rounded);
+  if (ptr == nullptr) throw std::bad_alloc();
+  ++allocations;
+  return ptr;
+}
+
+// Returns the index of the smallest arena block size that holds bytes.
+int ArenaClass(const size_t bytes) {
+  int arena_class = 0;
+  while ((kMinArenaBlock << arena_class) < bytes) ++arena_class;
+  return arena_class;
+}
+
+// Returns the huge page that holds an arena block.  Arena pages are always
+// huge page aligned.
+char* PageOf(char* const block) {
+  return block - reinterpret_cast<uintptr_t>(block) % kHugePageSize;
+}
+
+int BlocksPerPage(const int arena_class) {
+  return kHugePageSize / (kMinArenaBlock << arena_class);
+}
+
+void Unmap(void* const ptr, const size_t bytes) {
+  if (munmap(ptr, bytes) != 0) {
+    LOG(DFATAL) << "Failed to unmap " << bytes << " bytes.";
+  }
+}
+
+// Free blocks of each size.  Huge pages are split into blocks of one size
+// when that size runs out.  They are kept for reuse while the queues are
+// refilled within a step, and unmapped by Release once all of their blocks
+// are free.
+class Arena {
+ public:
+  void* Allocate(const int arena_class) {
+    absl::MutexLock l(&mu_);
+    std::vector<char*>& free_blocks = free_blocks_[arena_class];
+    if (free_blocks.empty()) {
+      char* const page = static_cast<char*>(MapHugePages(kHugePageSize));
+      arena_bytes += kHugePageSize;
+      const size_t block_size = kMinArenaBlock << arena_class;
+      for (size_t offset = 0; offset < kHugePageSize; offset += block_size) {
+        free_blocks.push_back(page + offset);
+      }
+      pages_[page] = {.arena_class = arena_class,
+                      .free_blocks = BlocksPerPage(arena_class)};
+    }
+    char* const block = free_blocks.back();
+    free_blocks.pop_back();
+    --pages_[PageOf(block)].free_blocks;
+    return block;
+  }
+
+  void Deallocate(void* const ptr, const int arena_class) {
+    absl::MutexLock l(&mu_);
+    char* const block = static_cast<char*>(ptr);
+    free_blocks_[arena_class].push_back(block);
+    ++pages_[PageOf(block)].free_blocks;
+  }
+
+  void Release() {
+    absl::MutexLock l(&mu_);
+    auto is_free = [this](char* const page) {
+      const Page& state = pages_[page];
+      return state.free_blocks == BlocksPerPage(state.arena_class);
+    };
+    for (std::vector<char*>& free_blocks : free_blocks_) {
+      free_blocks.erase(std::remove_if(free_blocks.begin(), free_blocks.end(),
+                                       [&is_free](char* const block) {
+                                         return is_free(PageOf(block));
+                                       }),
+                        free_blocks.end());
+    }
+    for (auto iter = pages_.begin(); iter != pages_.end();) {
+      if (is_free(iter->first)) {
+        Unmap(iter->first, kHugePageSize);
+        arena_bytes -= kHugePageSize;
+        pages_.erase(iter++);
+      } else {
+        ++iter;
+      }
+    }
+  }
+
+ private:
+  struct Page {
+    int arena_class;
+    int free_blocks;
+  };
+
+  absl::Mutex mu_;
+  std::vector<char*> free_blocks_[kNumArenaClasses] ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<char*, Page> pages_ ABSL_GUARDED_BY(mu_);
+};
+
+Arena& GetArena() {
+  static Arena* const arena = new Arena;
+  return *arena;
+}
+
+int64 ReadCount(const int fd) {
+  uint64_t count;
+  return read(fd, &count, sizeof(count)) == sizeof(count) ? count : 0;
+}
+
+// TlbMissCounters keeps the perf events counting the data TLB misses of each
+// thread.  Threads count separately because an event inherited by threads
+// only adds their misses to its own once they exit, and executor workers
+// live as long as their simulation.
+class TlbMissCounters {
+ public:
+  // Opens a counter for the calling thread, or returns -1 where the kernel
+  // does not allow it.
+  int Open() {
+    if (!try_open_) return -1;
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                  (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                  (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    const int fd = syscall(SYS_perf_event_open, &attr, /*pid=*/0, /*cpu=*/-1,
+                           /*group_fd=*/-1, PERF_FLAG_FD_CLOEXEC);
+    if (fd < 0) {
+      // Once the kernel refuses, don't bother trying again.
+      if (try_open_.exchange(false)) {
+        VLOG(1) << "Data TLB misses cannot be counted: "
+                << std::strerror(errno);
+      }
+      return -1;
+    }
+    absl::MutexLock l(&mu_);
+    fds_.push_back(fd);
+    return fd;
+  }
+
+  // Closes the counter of a thread that is exiting, keeping its count.
+  void Close(const int fd) {
+    absl::MutexLock l(&mu_);
+    closed_misses_ += ReadCount(fd);
+    fds_.erase(std::find(fds_.begin(), fds_.end(), fd));
+    close(fd);
+  }
+
+  // Returns the misses counted by all threads, or -1 if none were counted.
+  int64 Total() {
+    absl::MutexLock l(&mu_);
+    if (fds_.empty() && closed_misses_ == 0) return -1;
+    int64 total = closed_misses_;
+    for (const int fd : fds_) total += ReadCount(fd);
+    return total;
+  }
+
+ private:
+  std::atomic<bool> try_open_{true};
+  absl::Mutex mu_;
+  std::vector<int> fds_ ABSL_GUARDED_BY(mu_);
+  int64 closed_misses_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+TlbMissCounters& GetTlbMissCounters() {
+  static TlbMissCounters* const counters = new TlbMissCounters;
+  return *counters;
+}
+
+struct ThreadTlbMissCounter {
+  ThreadTlbMissCounter() : fd(GetTlbMissCounters().Open()) {}
+  ~ThreadTlbMissCounter() {
+    if (fd >= 0) GetTlbMissCounters().Close(fd);
+  }
+  const int fd;
+};
+
+}  // namespace
+
+void* AllocateHugePages(const size_t bytes) {
+  if (bytes < kMinArenaBlock) return ::operator new(bytes);
+  if (bytes <= kMaxArenaBlock) return GetArena().Allocate(ArenaClass(bytes));
+  const size_t rounded = RoundUp(bytes);
+  void* const ptr = MapHugePages(rounded);
+  mapped_bytes += rounded;
+  return ptr;
+}
+
+void DeallocateHugePages(void* const ptr, const size_t bytes) {
+  if (bytes < kMinArenaBlock) {
+    ::operator delete(ptr);
+    return;
+  }
+  if (bytes <= kMaxArenaBlock) {
+    GetArena().Deallocate(ptr, ArenaClass(bytes));
+    return;
+  }
+  const size_t rounded = RoundUp(bytes);
+  mapped_bytes -= rounded;
+  Unmap(ptr, rounded);
+}
+
+void ReleaseFreeHugePages() { GetArena().Release(); }
+
+int64 ThreadTlbMisses() {
+  thread_local const ThreadTlbMissCounter counter;
+  return counter.fd >= 0 ? ReadCount(counter.fd) : -1;
+}
+
+HugePageStats GetHugePageStats() {
+  const int64 dtlb_misses = GetTlbMissCounters().Total();
+  return {.mapped_bytes = mapped_bytes.load(),
+          .arena_bytes = arena_bytes.load(),
+          .allocations = allocations.load(),
+          .hugetlb_allocations = hugetlb_allocations.load(),
+          .dtlb_misses = dtlb_misses};
+}
+
+}  // namespace abesim
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_HUGE_PAGE_ALLOCATOR_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_HUGE_PAGE_ALLOCATOR_H_
+
+#include <cstddef>
+#include <new>
+
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// Size of the huge pages that large allocations are backed by.
+constexpr size_t kHugePageSize = size_t{2} << 20;
+
+// Returns memory for bytes, backed by huge pages where the system provides
+// them.  Allocations larger than half a huge page are mapped directly, rounded
+// up to a whole number of huge pages.  Allocations from 64KiB up to half a
+// huge page share huge pages held by an arena, and smaller ones come from the
+// heap.
+void* AllocateHugePages(size_t bytes);
+// Releases memory returned by AllocateHugePages for the same number of bytes.
+void DeallocateHugePages(void* ptr, size_t bytes);
+// Unmaps the huge pages of the arena whose blocks are all free.  The arena is
+// shared by every simulation in the process and freed blocks are otherwise
+// kept for reuse, as the queues of one step are refilled in the next.  So
+// simulations never call this; the owner of a long-lived process does, once
+// the runs it started have finished.
+void ReleaseFreeHugePages();
+
+// Returns the data TLB misses in user space of the calling thread since its
+// first call, or -1 where the kernel does not allow counting them.  Each
+// thread's counter is opened by its first call and closed when it exits.
+int64 ThreadTlbMisses();
+
+struct HugePageStats {
+  // Bytes currently mapped for large allocations.
+  size_t mapped_bytes;
+  // Bytes of huge pages held by the arena, which keeps them once freed until
+  // ReleaseFreeHugePages is called.
+  size_t arena_bytes;
+  // Number of mappings made so far, for large allocations and the arena, and
+  // how many of them were served from reserved hugetlbfs pages rather than
+  // transparent huge pages.
+  size_t allocations;
+  size_t hugetlb_allocations;
+  // Data TLB misses counted by ThreadTlbMisses across all threads, including
+  // those that have exited, or -1 if none are counted.
+  int64 dtlb_misses;
+};
+HugePageStats GetHugePageStats();
+
+// A stateless STL allocator for containers that may grow very large, such as
+// the simulation's message queues.  Backing them by huge pages greatly
+// reduces the number of TLB misses incurred when streaming through them.
+template <typename T>
+class HugePageAllocator {
+ public:
+  using value_type = T;
+
+  HugePageAllocator() = default;
+  template <typename U>
+  HugePageAllocator(const HugePageAllocator<U>&) {}  // NOLINT
+
+  T* allocate(const size_t n) {
+    return static_cast<T*>(AllocateHugePages(n * sizeof(T)));
+  }
+  void deallocate(T* const ptr, const size_t n) {
+    DeallocateHugePages(ptr, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const HugePageAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const HugePageAllocator<U>&) const {
+    return false;
+  }
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_HUGE_PAGE_ALLOCATOR_H_
@@ -0,0 +1,131 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/huge_page_allocator.h"
+
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <thread>  // NOLINT: Open source only.
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+TEST(HugePageAllocatorTest, SmallAllocationsUseTheHeap) {
+  const HugePageStats before = GetHugePageStats();
+  void* const ptr = AllocateHugePages(1000);
+  EXPECT_EQ(GetHugePageStats().allocations, before.allocations);
+  DeallocateHugePages(ptr, 1000);
+}
+
+TEST(HugePageAllocatorTest, MediumAllocationsShareHugePages) {
+  const HugePageStats before = GetHugePageStats();
+  const size_t bytes = 600 << 10;
+  void* const first = AllocateHugePages(bytes);
+  void* const second = AllocateHugePages(bytes);
+  std::memset(first, 1, bytes);
+  std::memset(second, 2, bytes);
+  // Both fit in the 1MiB blocks of a single huge page.
+  const HugePageStats during = GetHugePageStats();
+  EXPECT_GT(during.arena_bytes, 0);
+  EXPECT_LE(during.arena_bytes, before.arena_bytes + kHugePageSize);
+  EXPECT_EQ(during.mapped_bytes, before.mapped_bytes);
+
+  // Freed blocks are reused rather than unmapped.
+  DeallocateHugePages(second, bytes);
+  EXPECT_EQ(AllocateHugePages(bytes), second);
+  DeallocateHugePages(second, bytes);
+  DeallocateHugePages(first, bytes);
+  EXPECT_EQ(GetHugePageStats().arena_bytes, during.arena_bytes);
+}
+
+TEST(HugePageAllocatorTest, ReleasesPagesWhoseBlocksAreAllFree) {
+  ReleaseFreeHugePages();
+  const HugePageStats before = GetHugePageStats();
+  const size_t bytes = 600 << 10;
+  void* const first = AllocateHugePages(bytes);
+  void* const second = AllocateHugePages(bytes);
+  DeallocateHugePages(second, bytes);
+  // The page still holds first.
+  ReleaseFreeHugePages();
+  EXPECT_EQ(GetHugePageStats().arena_bytes, before.arena_bytes + kHugePageSize);
+  DeallocateHugePages(first, bytes);
+  ReleaseFreeHugePages();
+  EXPECT_EQ(GetHugePageStats().arena_bytes, before.arena_bytes);
+}
+
+TEST(HugePageAllocatorTest, LargeAllocationsAreMappedInHugePages) {
+  const HugePageStats before = GetHugePageStats();
+  const size_t bytes = kHugePageSize + 1;
+  char* const ptr = static_cast<char*>(AllocateHugePages(bytes));
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(ptr) % kHugePageSize, 0);
+  std::memset(ptr, 1, bytes);
+  const HugePageStats during = GetHugePageStats();
+  EXPECT_EQ(during.allocations, before.allocations + 1);
+  EXPECT_EQ(during.mapped_bytes, before.mapped_bytes + 2 * kHugePageSize);
+  DeallocateHugePages(ptr, bytes);
+  EXPECT_EQ(GetHugePageStats().mapped_bytes, before.mapped_bytes);
+}
+
+TEST(HugePageAllocatorTest, BacksVectors) {
+  std::vector<int, HugePageAllocator<int>> values;
+  for (int i = 0; i < kHugePageSize; ++i) values.push_back(i);
+  EXPECT_GT(GetHugePageStats().mapped_bytes, 0);
+  EXPECT_EQ(std::accumulate(values.begin(), values.end(), int64_t{0}),
+            int64_t{kHugePageSize} * (kHugePageSize - 1) / 2);
+  values.clear();
+  values.shrink_to_fit();
+  EXPECT_EQ(GetHugePageStats().mapped_bytes, 0);
+}
+
+TEST(HugePageAllocatorTest, CountsTlbMisses) {
+  const int64 thread_before = ThreadTlbMisses();
+  const HugePageStats before = GetHugePageStats();
+  if (thread_before < 0) {
+    GTEST_SKIP() << "Data TLB misses cannot be counted.";
+  }
+  // Touch one byte of each 4KiB page of a buffer too large for the TLB.
+  std::vector<char> buffer(size_t{256} << 20, 1);
+  int64_t sum = 0;
+  for (size_t i = 0; i < buffer.size(); i += 4096) sum += buffer[i];
+  EXPECT_EQ(sum, buffer.size() / 4096);
+  EXPECT_GT(ThreadTlbMisses(), thread_before);
+  EXPECT_GT(GetHugePageStats().dtlb_misses, before.dtlb_misses);
+}
+
+TEST(HugePageAllocatorTest, KeepsTlbMissesOfExitedThreads) {
+  if (ThreadTlbMisses() < 0) {
+    GTEST_SKIP() << "Data TLB misses cannot be counted.";
+  }
+  const int64 before = GetHugePageStats().dtlb_misses;
+  int64 thread_misses = 0;
+  std::thread thread([&thread_misses]() {
+    const int64 start = ThreadTlbMisses();
+    std::vector<char> buffer(size_t{256} << 20, 1);
+    int64_t sum = 0;
+    for (size_t i = 0; i < buffer.size(); i += 4096) sum += buffer[i];
+    EXPECT_EQ(sum, buffer.size() / 4096);
+    thread_misses = ThreadTlbMisses() - start;
+  });
+  thread.join();
+  EXPECT_GT(thread_misses, 0);
+  EXPECT_GE(GetHugePageStats().dtlb_misses, before + thread_misses);
+}
+
+}  // namespace
+}  // namespace abesim
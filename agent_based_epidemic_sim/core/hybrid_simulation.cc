@@ -0,0 +1,429 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/hybrid_simulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/memory/memory.h"
+#include "absl/random/distributions.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/health_state.h"
+#include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+
+namespace {
+
+// Returns the number of successes of n trials that each succeed with the
+// probability that an event of the given daily rate happens during duration.
+int64 SampleTransitions(const int64 n, const double daily_rate,
+                        const absl::Duration duration, absl::BitGenRef gen) {
+  if (n <= 0 || daily_rate <= 0) return 0;
+  const double p =
+      1.0 - std::exp(-daily_rate * absl::ToDoubleHours(duration) / 24);
+  return std::binomial_distribution<int64>(n, std::min(p, 1.0))(gen);
+}
+
+// Adds the counters of stats to total, leaving total->steps as it is.
+void AddStats(const SimulationStats& stats, SimulationStats* total) {
+  total->agent_updates += stats.agent_updates;
+  total->visits += stats.visits;
+  total->contact_reports += stats.contact_reports;
+  total->infection_outcomes += stats.infection_outcomes;
+  total->agent_phase_time += stats.agent_phase_time;
+  total->location_phase_time += stats.location_phase_time;
+  total->observer_phase_time += stats.observer_phase_time;
+  total->dtlb_misses += stats.dtlb_misses;
+}
+
+// Infectious pressure that one region exerts on another during a step.
+struct RegionExport {
+  int to_region;
+  double infectious;
+};
+
+class RegionExportQueue : public Broker<RegionExport> {
+ public:
+  void Send(absl::Span<const RegionExport> msgs) override {
+    exports_.insert(exports_.end(), msgs.begin(), msgs.end());
+  }
+
+  // Returns the infectious pressure imported by each of num_regions regions
+  // and empties the queue.
+  std::vector<double> TakeImports(const int num_regions) {
+    std::vector<double> imports(num_regions);
+    for (const RegionExport& msg : exports_) {
+      imports[msg.to_region] += msg.infectious;
+    }
+    exports_.clear();
+    return imports;
+  }
+
+ private:
+  std::vector<RegionExport> exports_;
+};
+
+class CensusObserver : public AgentInfectionObserver {
+ public:
+  void Observe(const Agent& agent,
+               absl::Span<const InfectionOutcome> outcomes) override {
+    // An agent counts for each of the people it stands for.
+    const int weight = agent.weight();
+    switch (CompartmentOf(agent.CurrentHealthState())) {
+      case Compartment::kSusceptible:
+        census_.susceptible += weight;
+        break;
+      case Compartment::kExposed:
+        census_.exposed += weight;
+        break;
+      case Compartment::kInfectious:
+        census_.infectious += weight;
+        break;
+      case Compartment::kRemoved:
+        census_.removed += weight;
+        break;
+    }
+  }
+  bool ObservesOutcomes() const override { return false; }
+
+ private:
+  friend class CensusObserverFactory;
+  Compartments census_;
+};
+
+// Counts the agents of a materialized region in each compartment.
+class CensusObserverFactory : public ObserverFactory<CensusObserver> {
+ public:
+  explicit CensusObserverFactory(const Compartments& census)
+      : census_(census) {}
+
+  std::unique_ptr<CensusObserver> MakeObserver(
+      const Timestep& timestep) const override {
+    return absl::make_unique<CensusObserver>();
+  }
+
+  void Aggregate(
+      const Timestep& timestep,
+      absl::Span<std::unique_ptr<CensusObserver> const> observers) override {
+    census_ = Compartments();
+    for (const auto& observer : observers) {
+      census_.susceptible += observer->census_.susceptible;
+      census_.exposed += observer->census_.exposed;
+      census_.infectious += observer->census_.infectious;
+      census_.removed += observer->census_.removed;
+    }
+  }
+
+  const Compartments& census() const { return census_; }
+
+ private:
+  Compartments census_;
+};
+
+bool IsValidGeoid(absl::string_view geoid) {
+  static constexpr int kGeoidLengths[] = {2, 5, 11, 12, 15};
+  return std::find(std::begin(kGeoidLengths), std::end(kGeoidLengths),
+                   geoid.size()) != std::end(kGeoidLengths) &&
+         std::all_of(geoid.begin(), geoid.end(), absl::ascii_isdigit);
+}
+
+class HybridSimulationImpl : public HybridSimulation {
+ public:
+  struct Region {
+    std::string geoid;
+    Compartments compartments;
+    // The regions this one exports infectious pressure to, and the rate.
+    std::vector<std::pair<int, double>> flows;
+    // Set while the region is materialized.  The simulation owns agents and
+    // must be destroyed before census.
+    std::unique_ptr<CensusObserverFactory> census;
+    std::unique_ptr<Simulation> simulation;
+    std::vector<Agent*> agents;
+    // Set if materializing the region failed, so that it is not retried.
+    bool materialize_failed = false;
+  };
+
+  HybridSimulationImpl(const absl::Time start, Options options,
+                       RegionMaterializer materializer,
+                       std::vector<Region> regions)
+      : time_(start),
+        options_(std::move(options)),
+        materializer_(std::move(materializer)),
+        regions_(std::move(regions)) {}
+
+  void Step(const int steps, const absl::Duration step_duration) override {
+    for (int step = 0; step < steps; ++step) {
+      for (Region& region : regions_) {
+        if (region.simulation != nullptr) {
+          if (region.compartments.exposed + region.compartments.infectious ==
+              0) {
+            Summarize(region);
+          }
+        } else if (!region.materialize_failed &&
+                   region.compartments.prevalence() > 0 &&
+                   region.compartments.prevalence() >=
+                       options_.materialize_prevalence) {
+          Materialize(region);
+        }
+      }
+
+      for (const Region& region : regions_) {
+        for (const auto& [to_region, rate] : region.flows) {
+          export_queue_.Send(
+              {{.to_region = to_region,
+                .infectious = rate * region.compartments.infectious}});
+        }
+      }
+      const std::vector<double> imports =
+          export_queue_.TakeImports(regions_.size());
+
+      // Observers of the materialized regions run inside their Step, so the
+      // step is counted before them, as BaseSimulation counts it before its
+      // observer phase.
+      ++steps_;
+      for (int i = 0; i < regions_.size(); ++i) {
+        Region& region = regions_[i];
+        if (region.simulation == nullptr) {
+          region.compartments =
+              StepCompartments(options_.params, region.compartments,
+                               imports[i], step_duration, gen_);
+          continue;
+        }
+        const Compartments& c = region.compartments;
+        SeedImports(region,
+                    SampleTransitions(
+                        c.susceptible,
+                        options_.params.transmission_rate * imports[i] /
+                            std::max<int64>(c.total(), 1),
+                        step_duration, gen_));
+        region.simulation->Step(1, step_duration);
+        region.compartments = region.census->census();
+      }
+      time_ += step_duration;
+    }
+  }
+
+  void AddObserverFactory(ObserverFactoryBase* factory) override {
+    observer_factories_.push_back(factory);
+    for (Region& region : regions_) {
+      if (region.simulation != nullptr) {
+        region.simulation->AddObserverFactory(factory);
+      }
+    }
+  }
+
+  void RemoveObserverFactory(ObserverFactoryBase* factory) override {
+    observer_factories_.erase(std::remove(observer_factories_.begin(),
+                                          observer_factories_.end(), factory),
+                              observer_factories_.end());
+    for (Region& region : regions_) {
+      if (region.simulation != nullptr) {
+        region.simulation->RemoveObserverFactory(factory);
+      }
+    }
+  }
+
+  void SetExposureAggregation(const TransmissionModel* const model) override {
+    exposure_aggregation_ = model;
+    for (Region& region : regions_) {
+      if (region.simulation != nullptr) {
+        region.simulation->SetExposureAggregation(model);
+      }
+    }
+  }
+
+  SimulationStats GetStats() const override {
+    SimulationStats stats = summarized_stats_;
+    stats.steps = steps_;
+    for (const Region& region : regions_) {
+      if (region.simulation != nullptr) {
+        AddStats(region.simulation->GetStats(), &stats);
+      }
+    }
+    return stats;
+  }
+
+  int num_regions() const override { return regions_.size(); }
+  const std::string& geoid(const int region) const override {
+    return regions_[region].geoid;
+  }
+  Compartments RegionCompartments(const int region) const override {
+    return regions_[region].compartments;
+  }
+  bool IsMaterialized(const int region) const override {
+    return regions_[region].simulation != nullptr;
+  }
+
+ private:
+  void Materialize(Region& region) {
+    absl::StatusOr<MaterializedRegion> materialized =
+        materializer_(region.geoid, region.compartments, time_);
+    if (!materialized.ok()) {
+      LOG(ERROR) << "Failed to materialize region " << region.geoid << ": "
+                 << materialized.status();
+      region.materialize_failed = true;
+      return;
+    }
+    LOG(INFO) << "Materializing region " << region.geoid << " with "
+              << region.compartments;
+    region.agents.reserve(materialized->agents.size());
+    for (const auto& agent : materialized->agents) {
+      region.agents.push_back(agent.get());
+    }
+
+    region.census = absl::make_unique<CensusObserverFactory>(
+        region.compartments);
+    region.simulation =
+        options_.num_workers > 1
+            ? ParallelSimulation(time_, std::move(materialized->agents),
+                                 std::move(materialized->locations),
+                                 options_.num_workers)
+            : SerialSimulation(time_, std::move(materialized->agents),
+                               std::move(materialized->locations));
+    region.simulation->AddObserverFactory(region.census.get());
+    region.simulation->SetExposureAggregation(exposure_aggregation_);
+    for (ObserverFactoryBase* factory : observer_factories_) {
+      region.simulation->AddObserverFactory(factory);
+    }
+  }
+
+  // Infects up to imports distinct SUSCEPTIBLE agents of a materialized
+  // region, the infections the compartmental model would have imported.
+  void SeedImports(Region& region, int64 imports) {
+    if (imports == 0) return;
+    std::vector<Agent*> susceptible;
+    for (Agent* agent : region.agents) {
+      if (agent->CurrentHealthState() == HealthState::SUSCEPTIBLE) {
+        susceptible.push_back(agent);
+      }
+    }
+    for (size_t i = 0; i < susceptible.size() && imports > 0; ++i) {
+      const size_t pick = absl::Uniform<size_t>(gen_, i, susceptible.size());
+      std::swap(susceptible[i], susceptible[pick]);
+      if (susceptible[i]->SeedInfection(time_)) --imports;
+    }
+  }
+
+  void Summarize(Region& region) {
+    LOG(INFO) << "Summarizing region " << region.geoid << " as "
+              << region.compartments;
+    region.agents.clear();
+    AddStats(region.simulation->GetStats(), &summarized_stats_);
+    region.simulation.reset();
+    region.census.reset();
+  }
+
+  absl::Time time_;
+  const Options options_;
+  const RegionMaterializer materializer_;
+  std::vector<Region> regions_;
+  std::vector<ObserverFactoryBase*> observer_factories_;
+  const TransmissionModel* exposure_aggregation_ = nullptr;
+  RegionExportQueue export_queue_;
+  absl::BitGen gen_;
+  int64 steps_ = 0;
+  // Work done by regions that have since been summarized.
+  SimulationStats summarized_stats_;
+};
+
+}  // namespace
+
+Compartment CompartmentOf(const HealthState::State health_state) {
+  if (health_state == HealthState::SUSCEPTIBLE) {
+    return Compartment::kSusceptible;
+  }
+  if (health_state == HealthState::EXPOSED) return Compartment::kExposed;
+  if (IsInfectious(health_state)) return Compartment::kInfectious;
+  return Compartment::kRemoved;
+}
+
+Compartments StepCompartments(const CompartmentalModelParams& params,
+                              const Compartments& compartments,
+                              const double imported_infectious,
+                              const absl::Duration duration,
+                              absl::BitGenRef gen) {
+  if (compartments.total() == 0) return compartments;
+  const double force_of_infection =
+      params.transmission_rate *
+      (compartments.infectious + imported_infectious) / compartments.total();
+  const int64 infected =
+      SampleTransitions(compartments.susceptible, force_of_infection,
+                        duration, gen);
+  const int64 infectious = SampleTransitions(
+      compartments.exposed, params.incubation_rate, duration, gen);
+  const int64 removed = SampleTransitions(
+      compartments.infectious, params.recovery_rate, duration, gen);
+  return {.susceptible = compartments.susceptible - infected,
+          .exposed = compartments.exposed + infected - infectious,
+          .infectious = compartments.infectious + infectious - removed,
+          .removed = compartments.removed + removed};
+}
+
+absl::StatusOr<std::unique_ptr<HybridSimulation>> NewHybridSimulation(
+    const absl::Time start, HybridSimulation::Options options,
+    RegionMaterializer materializer) {
+  const auto& geoids = options.regions.geoid();
+  if (options.initial_compartments.size() != geoids.size()) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Got ", options.initial_compartments.size(),
+                     " initial compartments for ", geoids.size(), " regions"));
+  }
+  std::vector<HybridSimulationImpl::Region> regions(geoids.size());
+  absl::flat_hash_map<std::string, int> region_index;
+  for (int i = 0; i < geoids.size(); ++i) {
+    if (!IsValidGeoid(geoids[i])) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Invalid census geoid: ", geoids[i]));
+    }
+    if (!region_index.try_emplace(geoids[i], i).second) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("Duplicate census geoid: ", geoids[i]));
+    }
+    regions[i].geoid = geoids[i];
+    regions[i].compartments = options.initial_compartments[i];
+  }
+  for (const HybridSimulation::Flow& flow : options.flows) {
+    auto from = region_index.find(flow.from_geoid);
+    auto to = region_index.find(flow.to_geoid);
+    if (from == region_index.end() || to == region_index.end()) {
+      return absl::InvalidArgumentError(absl::StrCat(
+          "Flow between unknown regions: ", flow.from_geoid, " -> ",
+          flow.to_geoid));
+    }
+    regions[from->second].flows.emplace_back(to->second, flow.rate);
+  }
+  std::unique_ptr<HybridSimulation> simulation =
+      absl::make_unique<HybridSimulationImpl>(start, std::move(options),
+                                              std::move(materializer),
+                                              std::move(regions));
+  return simulation;
+}
+
+}  // namespace abesim
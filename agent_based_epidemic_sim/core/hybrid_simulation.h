@@ -0,0 +1,157 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_HYBRID_SIMULATION_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_HYBRID_SIMULATION_H_
+
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "absl/random/bit_gen_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/agent_synthesis/population.pb.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+
+namespace abesim {
+
+// The number of people of a region in each compartment of an SEIR model.
+struct Compartments {
+  int64 susceptible = 0;
+  int64 exposed = 0;
+  int64 infectious = 0;
+  // Everyone that can no longer be infected or infect others.
+  int64 removed = 0;
+
+  int64 total() const { return susceptible + exposed + infectious + removed; }
+  // The fraction of the region that is infected.
+  double prevalence() const {
+    return total() == 0 ? 0.0 : double(exposed + infectious) / total();
+  }
+
+  friend bool operator==(const Compartments& a, const Compartments& b) {
+    return a.susceptible == b.susceptible && a.exposed == b.exposed &&
+           a.infectious == b.infectious && a.removed == b.removed;
+  }
+
+  friend std::ostream& operator<<(std::ostream& strm,
+                                  const Compartments& compartments) {
+    return strm << "{" << compartments.susceptible << ", "
+                << compartments.exposed << ", " << compartments.infectious
+                << ", " << compartments.removed << "}";
+  }
+};
+
+enum class Compartment { kSusceptible, kExposed, kInfectious, kRemoved };
+
+// Returns the compartment of an agent in the given health state.
+Compartment CompartmentOf(HealthState::State health_state);
+
+// Rates of the stochastic SEIR model, per day.
+struct CompartmentalModelParams {
+  double transmission_rate = 0.3;
+  double incubation_rate = 1.0 / 5;
+  double recovery_rate = 1.0 / 7;
+};
+
+// Advances compartments by one step of the given duration using a chain
+// binomial model.  imported_infectious is the number of infectious people
+// elsewhere whose contacts fall in this region.
+Compartments StepCompartments(const CompartmentalModelParams& params,
+                              const Compartments& compartments,
+                              double imported_infectious,
+                              absl::Duration duration, absl::BitGenRef gen);
+
+// The agents and locations of a region that is simulated agent by agent.
+struct MaterializedRegion {
+  std::vector<std::unique_ptr<Agent>> agents;
+  std::vector<std::unique_ptr<Location>> locations;
+};
+
+// Builds the agents and locations of the region with the given geoid, whose
+// health matches compartments, at the given time.
+using RegionMaterializer = std::function<absl::StatusOr<MaterializedRegion>(
+    absl::string_view geoid, const Compartments& compartments,
+    absl::Time time)>;
+
+// A HybridSimulation simulates a set of census regions.  Each region runs as
+// a stochastic compartmental model until the fraction of it that is infected
+// reaches a threshold, at which point it is materialized into agents and
+// locations that are simulated like any other.  Once a materialized region
+// has no infections left, it is summarized back into compartments and its
+// agents are released.  Regions influence each other through flows, which
+// carry part of the infectious pressure of a region to another every step.
+// A materialized region imports as many infections as its compartments would
+// have, each seeded into a distinct randomly chosen SUSCEPTIBLE agent.
+//
+// Agents that stand for several people, such as cohorts, are counted by
+// weight when a region is summarized.
+//
+// ObserverFactories are registered with each materialized region, and so
+// aggregate once per materialized region per step.  Exposure aggregation, when
+// set, also applies to each materialized region.
+//
+// HybridSimulation is a library; applications supply the RegionMaterializer
+// that builds agents for their population.
+class HybridSimulation : public Simulation {
+ public:
+  struct Flow {
+    std::string from_geoid;
+    std::string to_geoid;
+    // The fraction of the contacts of the infectious people of from_geoid
+    // that happen in to_geoid.
+    double rate = 0;
+  };
+
+  struct Options {
+    // The regions, at any level of the census geography.
+    UsCensusLocator regions;
+    // The initial compartments of each region, in the order of regions.
+    std::vector<Compartments> initial_compartments;
+    std::vector<Flow> flows;
+    CompartmentalModelParams params;
+    // A region is materialized once this fraction of it is infected.
+    double materialize_prevalence = 0.01;
+    // Workers used to simulate each materialized region.
+    int num_workers = 1;
+  };
+
+  virtual int num_regions() const = 0;
+  virtual const std::string& geoid(int region) const = 0;
+  // The compartments of the region as of the end of the last step.
+  virtual Compartments RegionCompartments(int region) const = 0;
+  virtual bool IsMaterialized(int region) const = 0;
+};
+
+// Returns an error if options are invalid: geoids must be well formed and
+// unique, there must be initial compartments for each and flows must refer to
+// known regions.
+absl::StatusOr<std::unique_ptr<HybridSimulation>> NewHybridSimulation(
+    absl::Time start, HybridSimulation::Options options,
+    RegionMaterializer materializer);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_HYBRID_SIMULATION_H_
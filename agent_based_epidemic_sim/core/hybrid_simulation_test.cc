@@ -0,0 +1,326 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/hybrid_simulation.h"
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/random/random.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/util/test_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::NiceMock;
+using testing::Return;
+
+// A MockAgent that stands for several people.
+class WeightedMockAgent : public MockAgent {
+ public:
+  explicit WeightedMockAgent(const int weight) : weight_(weight) {}
+  int weight() const override { return weight_; }
+
+ private:
+  const int weight_;
+};
+
+// Agents of materialized regions, whose health states are set by the test.
+struct FakeRegion {
+  // The number of people each agent stands for.
+  int weight = 1;
+  std::vector<HealthState::State> health_states;
+  std::vector<std::string> materialized_geoids;
+  std::vector<Compartments> materialized_compartments;
+  int64 outcomes_received = 0;
+  int64 seeded = 0;
+  // The outcomes a location of the region sends agent 0 every step.
+  int contacts_per_step = 0;
+
+  RegionMaterializer Materializer() {
+    return [this](absl::string_view geoid, const Compartments& compartments,
+                  absl::Time time) -> absl::StatusOr<MaterializedRegion> {
+      materialized_geoids.emplace_back(geoid);
+      materialized_compartments.push_back(compartments);
+      health_states.assign(compartments.susceptible / weight,
+                           HealthState::SUSCEPTIBLE);
+      health_states.resize(
+          health_states.size() + compartments.infectious / weight,
+          HealthState::INFECTIOUS);
+      MaterializedRegion region;
+      for (int i = 0; i < health_states.size(); ++i) {
+        auto agent = absl::make_unique<NiceMock<WeightedMockAgent>>(weight);
+        ON_CALL(*agent, uuid()).WillByDefault(Return(i));
+        ON_CALL(*agent, CurrentHealthState()).WillByDefault([this, i]() {
+          return health_states[i];
+        });
+        ON_CALL(*agent, ProcessInfectionOutcomes)
+            .WillByDefault([this](const Timestep& timestep,
+                                  absl::Span<const InfectionOutcome> outcomes) {
+              outcomes_received += outcomes.size();
+            });
+        ON_CALL(*agent, SeedInfection).WillByDefault([this, i](absl::Time) {
+          EXPECT_EQ(health_states[i], HealthState::SUSCEPTIBLE);
+          health_states[i] = HealthState::EXPOSED;
+          ++seeded;
+          return true;
+        });
+        region.agents.push_back(std::move(agent));
+      }
+      if (contacts_per_step > 0) {
+        auto location = absl::make_unique<NiceMock<MockLocation>>();
+        ON_CALL(*location, uuid()).WillByDefault(Return(0));
+        ON_CALL(*location, ProcessVisits)
+            .WillByDefault([this](absl::Span<const Visit> visits,
+                                  Broker<InfectionOutcome>* broker) {
+              for (int i = 0; i < contacts_per_step; ++i) {
+                broker->Send({{.agent_uuid = 0,
+                               .exposure = {.duration = absl::Hours(1),
+                                            .infectivity = 0.1}}});
+              }
+            });
+        region.locations.push_back(std::move(location));
+      }
+      return region;
+    };
+  }
+};
+
+HybridSimulation::Options TwoRegionOptions(const Compartments& a,
+                                           const Compartments& b) {
+  HybridSimulation::Options options;
+  options.regions = ParseTextProtoOrDie<UsCensusLocator>(R"(
+    geoid: "11001" geoid: "24031"
+  )");
+  options.initial_compartments = {a, b};
+  return options;
+}
+
+TEST(HybridSimulationTest, StepsCompartments) {
+  absl::BitGen gen;
+  const CompartmentalModelParams params;
+  Compartments compartments = {.susceptible = 990, .infectious = 10};
+  for (int i = 0; i < 100; ++i) {
+    compartments =
+        StepCompartments(params, compartments, 0, absl::Hours(24), gen);
+    EXPECT_EQ(compartments.total(), 1000);
+  }
+  EXPECT_GT(compartments.removed, 10);
+
+  const Compartments healthy = {.susceptible = 1000};
+  EXPECT_EQ(StepCompartments(params, healthy, 0, absl::Hours(24), gen),
+            healthy);
+}
+
+TEST(HybridSimulationTest, RejectsInvalidOptions) {
+  FakeRegion fake;
+  HybridSimulation::Options options = TwoRegionOptions({}, {});
+  options.initial_compartments.pop_back();
+  EXPECT_FALSE(
+      NewHybridSimulation(absl::UnixEpoch(), options, fake.Materializer())
+          .ok());
+
+  options = TwoRegionOptions({}, {});
+  options.regions.set_geoid(1, "1100");
+  EXPECT_FALSE(
+      NewHybridSimulation(absl::UnixEpoch(), options, fake.Materializer())
+          .ok());
+
+  options = TwoRegionOptions({}, {});
+  options.regions.set_geoid(1, "11001");
+  EXPECT_FALSE(
+      NewHybridSimulation(absl::UnixEpoch(), options, fake.Materializer())
+          .ok());
+
+  options = TwoRegionOptions({}, {});
+  options.flows.push_back({.from_geoid = "11001", .to_geoid = "11"});
+  EXPECT_FALSE(
+      NewHybridSimulation(absl::UnixEpoch(), options, fake.Materializer())
+          .ok());
+}
+
+TEST(HybridSimulationTest, MaterializesAndSummarizesRegions) {
+  FakeRegion fake;
+  const Compartments infected = {.susceptible = 95, .infectious = 5};
+  const Compartments healthy = {.susceptible = 100};
+  auto simulation = NewHybridSimulation(
+      absl::UnixEpoch(), TwoRegionOptions(infected, healthy),
+      fake.Materializer());
+  PANDEMIC_ASSERT_OK(simulation);
+  HybridSimulation& sim = **simulation;
+
+  sim.Step(1, absl::Hours(24));
+  EXPECT_TRUE(sim.IsMaterialized(0));
+  EXPECT_FALSE(sim.IsMaterialized(1));
+  EXPECT_EQ(sim.RegionCompartments(0), infected);
+  EXPECT_EQ(sim.RegionCompartments(1), healthy);
+  EXPECT_THAT(fake.materialized_geoids, testing::ElementsAre("11001"));
+  EXPECT_THAT(fake.materialized_compartments, testing::ElementsAre(infected));
+
+  // Once the agents have all recovered the region goes back to compartments.
+  fake.health_states.assign(100, HealthState::RECOVERED);
+  sim.Step(2, absl::Hours(24));
+  EXPECT_FALSE(sim.IsMaterialized(0));
+  EXPECT_EQ(sim.RegionCompartments(0), Compartments{.removed = 100});
+  EXPECT_EQ(fake.materialized_geoids.size(), 1);
+}
+
+TEST(HybridSimulationTest, SummarizesAgentsByWeight) {
+  FakeRegion fake;
+  fake.weight = 10;
+  const Compartments infected = {.susceptible = 90, .infectious = 10};
+  auto simulation = NewHybridSimulation(
+      absl::UnixEpoch(), TwoRegionOptions(infected, {.susceptible = 100}),
+      fake.Materializer());
+  PANDEMIC_ASSERT_OK(simulation);
+  HybridSimulation& sim = **simulation;
+
+  sim.Step(1, absl::Hours(24));
+  ASSERT_TRUE(sim.IsMaterialized(0));
+  ASSERT_EQ(fake.health_states.size(), 10);
+  EXPECT_EQ(sim.RegionCompartments(0), infected);
+
+  fake.health_states.assign(10, HealthState::RECOVERED);
+  sim.Step(2, absl::Hours(24));
+  EXPECT_FALSE(sim.IsMaterialized(0));
+  EXPECT_EQ(sim.RegionCompartments(0), Compartments{.removed = 100});
+}
+
+TEST(HybridSimulationTest, CountsStatsOfMaterializedRegions) {
+  FakeRegion fake;
+  auto simulation = NewHybridSimulation(
+      absl::UnixEpoch(),
+      TwoRegionOptions({.susceptible = 95, .infectious = 5},
+                       {.susceptible = 100}),
+      fake.Materializer());
+  PANDEMIC_ASSERT_OK(simulation);
+  HybridSimulation& sim = **simulation;
+
+  sim.Step(1, absl::Hours(24));
+  EXPECT_EQ(sim.GetStats().steps, 1);
+  EXPECT_EQ(sim.GetStats().agent_updates, 100);
+
+  // The work of a region is still counted once it has been summarized.
+  fake.health_states.assign(100, HealthState::RECOVERED);
+  sim.Step(2, absl::Hours(24));
+  ASSERT_FALSE(sim.IsMaterialized(0));
+  EXPECT_EQ(sim.GetStats().steps, 3);
+  EXPECT_EQ(sim.GetStats().agent_updates, 200);
+}
+
+TEST(HybridSimulationTest, FlowsSpreadInfectionBetweenRegions) {
+  FakeRegion fake;
+  HybridSimulation::Options options =
+      TwoRegionOptions({.susceptible = 500, .infectious = 500},
+                       {.susceptible = 1000});
+  options.params.transmission_rate = 100;
+  options.materialize_prevalence = 2;
+  options.flows.push_back(
+      {.from_geoid = "11001", .to_geoid = "24031", .rate = 1});
+  auto simulation =
+      NewHybridSimulation(absl::UnixEpoch(), options, fake.Materializer());
+  PANDEMIC_ASSERT_OK(simulation);
+  (*simulation)->Step(1, absl::Hours(24));
+  EXPECT_GT((*simulation)->RegionCompartments(1).exposed, 0);
+  EXPECT_TRUE(fake.materialized_geoids.empty());
+}
+
+TEST(HybridSimulationTest, ImportsInfectionsIntoMaterializedRegions) {
+  FakeRegion fake;
+  HybridSimulation::Options options =
+      TwoRegionOptions({.infectious = 500, .removed = 500},
+                       {.susceptible = 3, .infectious = 7});
+  options.params.transmission_rate = 100;
+  options.materialize_prevalence = 0.6;
+  options.flows.push_back(
+      {.from_geoid = "11001", .to_geoid = "24031", .rate = 1});
+  auto simulation =
+      NewHybridSimulation(absl::UnixEpoch(), options, fake.Materializer());
+  PANDEMIC_ASSERT_OK(simulation);
+  // Every susceptible agent is infected once, and only once.
+  (*simulation)->Step(2, absl::Hours(24));
+  EXPECT_FALSE((*simulation)->IsMaterialized(0));
+  EXPECT_TRUE((*simulation)->IsMaterialized(1));
+  EXPECT_EQ(fake.seeded, 3);
+  EXPECT_EQ((*simulation)->RegionCompartments(1),
+            (Compartments{.exposed = 3, .infectious = 7}));
+}
+
+TEST(HybridSimulationTest, ImportsInfectionsAtTheCompartmentalRate) {
+  const int kSusceptible = 10000;
+  const int kInfectious = 500;
+  const int kImportedInfectious = 2000;
+  FakeRegion fake;
+  HybridSimulation::Options options = TwoRegionOptions(
+      {.infectious = kImportedInfectious},
+      {.susceptible = kSusceptible, .infectious = kInfectious});
+  options.flows.push_back(
+      {.from_geoid = "11001", .to_geoid = "24031", .rate = 1});
+  // Only the importing region is materialized.
+  auto simulation = NewHybridSimulation(
+      absl::UnixEpoch(), options,
+      [&fake](absl::string_view geoid, const Compartments& compartments,
+              absl::Time time) -> absl::StatusOr<MaterializedRegion> {
+        if (geoid == "11001") return absl::UnavailableError("Not here.");
+        return fake.Materializer()(geoid, compartments, time);
+      });
+  PANDEMIC_ASSERT_OK(simulation);
+  (*simulation)->Step(1, absl::Hours(24));
+  ASSERT_TRUE((*simulation)->IsMaterialized(1));
+
+  // The compartmental model infects each susceptible person with the
+  // probability of an event at the imported force of infection.
+  const double p =
+      1 - std::exp(-options.params.transmission_rate * kImportedInfectious /
+                   (kSusceptible + kInfectious));
+  const double mean = kSusceptible * p;
+  const double stddev = std::sqrt(kSusceptible * p * (1 - p));
+  EXPECT_NEAR(fake.seeded, mean, 5 * stddev);
+}
+
+TEST(HybridSimulationTest, AggregatesExposuresInMaterializedRegions) {
+  AggregatedTransmissionModel transmission_model(/*transmissibility=*/1);
+  for (const bool aggregate : {false, true}) {
+    FakeRegion fake;
+    fake.contacts_per_step = 3;
+    auto simulation = NewHybridSimulation(
+        absl::UnixEpoch(),
+        TwoRegionOptions({.susceptible = 95, .infectious = 5},
+                         {.susceptible = 100}),
+        fake.Materializer());
+    PANDEMIC_ASSERT_OK(simulation);
+    if (aggregate) (*simulation)->SetExposureAggregation(&transmission_model);
+    // Outcomes sent during a step reach agents in the next one.
+    (*simulation)->Step(2, absl::Hours(24));
+    EXPECT_TRUE((*simulation)->IsMaterialized(0));
+    EXPECT_EQ(fake.outcomes_received, aggregate ? 1 : 3);
+  }
+}
+
+}  // namespace
+}  // namespace abesim
@@ -0,0 +1,293 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/in_process_cluster.h"
+
+#include <atomic>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "agent_based_epidemic_sim/core/broker.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/port/executor.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// A barrier that can be passed any number of times by a fixed number of
+// threads.
+class Barrier {
+ public:
+  explicit Barrier(const int num_threads) : num_threads_(num_threads) {}
+
+  void Wait() {
+    absl::MutexLock l(&mu_);
+    const int64 generation = generation_;
+    if (++waiting_ == num_threads_) {
+      waiting_ = 0;
+      ++generation_;
+      return;
+    }
+    auto passed = [this, generation]() {
+      mu_.AssertHeld();
+      return generation_ != generation;
+    };
+    mu_.Await(absl::Condition(&passed));
+  }
+
+ private:
+  const int num_threads_;
+  absl::Mutex mu_;
+  int waiting_ ABSL_GUARDED_BY(mu_) = 0;
+  int64 generation_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+// The stream of messages of one type between all nodes.
+template <typename Msg>
+class Exchange {
+ public:
+  Exchange(const int num_nodes, std::function<int(const Msg&)> dest_node)
+      : dest_node_(std::move(dest_node)),
+        mailboxes_(num_nodes),
+        barrier_(num_nodes) {}
+
+  int DestNode(const Msg& msg) const { return dest_node_(msg); }
+
+  // Queues the messages in msgs that are destined for node.
+  void Post(const int node, const absl::Span<const Msg> msgs) {
+    Mailbox& mailbox = mailboxes_[node];
+    int64 count = 0;
+    absl::MutexLock l(&mailbox.mu);
+    for (const Msg& msg : msgs) {
+      if (DestNode(msg) == node) {
+        mailbox.msgs.push_back(msg);
+        ++count;
+      }
+    }
+    messages_ += count;
+  }
+
+  // Waits until every node has finished sending for the current phase, then
+  // delivers the messages queued for node to receiver.
+  void Deliver(const int node, Broker<Msg>* const receiver) {
+    barrier_.Wait();
+    Mailbox& mailbox = mailboxes_[node];
+    {
+      absl::MutexLock l(&mailbox.mu);
+      if (!mailbox.msgs.empty()) {
+        if (receiver != nullptr) {
+          receiver->Send(mailbox.msgs);
+        } else {
+          LOG(DFATAL) << "Node " << node << " received " << mailbox.msgs.size()
+                      << " messages without a receive broker.";
+        }
+        mailbox.msgs.clear();
+      }
+    }
+    // Keep nodes from starting the next phase until all mailboxes are empty.
+    barrier_.Wait();
+  }
+
+  InProcessCluster::MessageStats GetStats() const {
+    const int64 messages = messages_.load();
+    return {.messages = messages,
+            .bytes = static_cast<int64>(messages * sizeof(Msg))};
+  }
+
+ private:
+  struct Mailbox {
+    absl::Mutex mu;
+    std::vector<Msg> msgs ABSL_GUARDED_BY(mu);
+  };
+
+  const std::function<int(const Msg&)> dest_node_;
+  std::vector<Mailbox> mailboxes_;
+  Barrier barrier_;
+  std::atomic<int64> messages_{0};
+};
+
+// A node's view of an Exchange.
+template <typename Msg>
+class Messenger : public DistributedMessenger<Msg> {
+ public:
+  Messenger(const int node, const int num_nodes,
+            const InProcessCluster::Options& options,
+            std::atomic<int64>* const network_nanos,
+            Exchange<Msg>* const exchange)
+      : node_(node),
+        num_nodes_(num_nodes),
+        options_(options),
+        network_nanos_(network_nanos),
+        exchange_(exchange) {}
+
+  bool IsMessageRemote(const Msg& msg) const override {
+    return exchange_->DestNode(msg) != node_;
+  }
+
+  void Send(const absl::Span<const Msg> msgs) override {
+    for (int node = 0; node < num_nodes_; ++node) {
+      if (node != node_) exchange_->Post(node, msgs);
+    }
+    phase_bytes_ += msgs.size() * sizeof(Msg);
+  }
+
+  void SetReceiveBrokerForNextPhase(Broker<Msg>* const broker) override {
+    receiver_ = broker;
+  }
+
+  void FlushAndAwaitRemotes() override {
+    absl::Duration delay = options_.latency;
+    if (options_.bandwidth > 0) {
+      delay += absl::Seconds(phase_bytes_ / options_.bandwidth);
+    }
+    phase_bytes_ = 0;
+    if (delay > absl::ZeroDuration()) {
+      absl::SleepFor(delay);
+      *network_nanos_ += absl::ToInt64Nanoseconds(delay);
+    }
+    exchange_->Deliver(node_, receiver_);
+  }
+
+ private:
+  const int node_;
+  const int num_nodes_;
+  const InProcessCluster::Options& options_;
+  std::atomic<int64>* const network_nanos_;
+  Exchange<Msg>* const exchange_;
+  Broker<Msg>* receiver_ = nullptr;
+  // Bytes sent to other nodes since the last FlushAndAwaitRemotes.
+  std::atomic<int64> phase_bytes_{0};
+};
+
+}  // namespace
+
+class InProcessCluster::Network {
+ public:
+  explicit Network(const Options& options)
+      : visits(options.num_nodes,
+               [&options](const Visit& visit) {
+                 return options.location_node(visit.location_uuid);
+               }),
+        contact_reports(options.num_nodes,
+                        [&options](const ContactReport& report) {
+                          return options.agent_node(report.to_agent_uuid);
+                        }),
+        outcomes(options.num_nodes,
+                 [&options](const InfectionOutcome& outcome) {
+                   return options.agent_node(outcome.agent_uuid);
+                 }) {}
+
+  Exchange<Visit> visits;
+  Exchange<ContactReport> contact_reports;
+  Exchange<InfectionOutcome> outcomes;
+  std::atomic<int64> network_nanos{0};
+};
+
+class InProcessCluster::Node : public DistributedManager {
+ public:
+  Node(const int node, const Options& options, Network* const network)
+      : visits_(node, options.num_nodes, options, &network->network_nanos,
+                &network->visits),
+        contact_reports_(node, options.num_nodes, options,
+                         &network->network_nanos, &network->contact_reports),
+        outcomes_(node, options.num_nodes, options, &network->network_nanos,
+                  &network->outcomes) {}
+
+  DistributedMessenger<Visit>* VisitMessenger() override { return &visits_; }
+  DistributedMessenger<ContactReport>* ContactReportMessenger() override {
+    return &contact_reports_;
+  }
+  DistributedMessenger<InfectionOutcome>* OutcomeMessenger() override {
+    return &outcomes_;
+  }
+
+ private:
+  Messenger<Visit> visits_;
+  Messenger<ContactReport> contact_reports_;
+  Messenger<InfectionOutcome> outcomes_;
+};
+
+InProcessCluster::InProcessCluster(Options options)
+    : options_(std::move(options)),
+      network_(absl::make_unique<Network>(options_)) {
+  CHECK_GT(options_.num_nodes, 0);
+  CHECK(options_.agent_node != nullptr);
+  CHECK(options_.location_node != nullptr);
+  for (int node = 0; node < options_.num_nodes; ++node) {
+    nodes_.push_back(absl::make_unique<Node>(node, options_, network_.get()));
+  }
+}
+
+InProcessCluster::~InProcessCluster() = default;
+
+DistributedManager* InProcessCluster::Manager(const int node) {
+  return nodes_[node].get();
+}
+
+std::vector<std::unique_ptr<Simulation>> InProcessCluster::BuildSimulations(
+    const absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
+    std::vector<std::unique_ptr<Location>> locations, const int num_workers) {
+  std::vector<std::vector<std::unique_ptr<Agent>>> node_agents(num_nodes());
+  for (auto& agent : agents) {
+    const int node = options_.agent_node(agent->uuid());
+    for (int i = 1; i < agent->weight(); ++i) {
+      CHECK_EQ(options_.agent_node(agent->uuid() + i), node)
+          << "People of agent " << agent->uuid() << " are on another node.";
+    }
+    node_agents[node].push_back(std::move(agent));
+  }
+  std::vector<std::vector<std::unique_ptr<Location>>> node_locations(
+      num_nodes());
+  for (auto& location : locations) {
+    node_locations[options_.location_node(location->uuid())].push_back(
+        std::move(location));
+  }
+  std::vector<std::unique_ptr<Simulation>> simulations;
+  for (int node = 0; node < num_nodes(); ++node) {
+    simulations.push_back(ParallelDistributedSimulation(
+        start, std::move(node_agents[node]), std::move(node_locations[node]),
+        num_workers, Manager(node)));
+  }
+  return simulations;
+}
+
+void InProcessCluster::Step(
+    const absl::Span<const std::unique_ptr<Simulation>> simulations,
+    const int steps, const absl::Duration step_duration) {
+  CHECK_EQ(simulations.size(), num_nodes());
+  auto executor = NewExecutor(num_nodes());
+  auto execution = executor->NewExecution();
+  for (const auto& simulation : simulations) {
+    Simulation* const sim = simulation.get();
+    execution->Add([sim, steps, step_duration]() {
+      sim->Step(steps, step_duration);
+    });
+  }
+  execution->Wait();
+}
+
+InProcessCluster::Stats InProcessCluster::GetStats() const {
+  return {
+      .visits = network_->visits.GetStats(),
+      .contact_reports = network_->contact_reports.GetStats(),
+      .outcomes = network_->outcomes.GetStats(),
+      .network_time = absl::Nanoseconds(network_->network_nanos.load()),
+  };
+}
+
+}  // namespace abesim
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_IN_PROCESS_CLUSTER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_IN_PROCESS_CLUSTER_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/distributed.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+
+namespace abesim {
+
+// InProcessCluster emulates the nodes of a distributed simulation within a
+// single process.  Each node gets a DistributedManager whose messengers
+// exchange messages with the other nodes through memory, optionally delayed
+// to model network latency and bandwidth.  This makes it possible to test
+// ParallelDistributedSimulation, and to measure how much communication a
+// given partitioning of agents and locations across nodes costs, without
+// running a real cluster.
+class InProcessCluster {
+ public:
+  struct Options {
+    int num_nodes = 1;
+    // Return the node that owns the agent or location with the given uuid.
+    // Every uuid a cohort reserves for its people must map to the node of the
+    // cohort, since they split off on that node (see SEIRAgent::Cohort).
+    std::function<int(int64 uuid)> agent_node;
+    std::function<int(int64 uuid)> location_node;
+    // Delay added every time a node exchanges messages with the others.
+    absl::Duration latency = absl::ZeroDuration();
+    // Bytes per second each node can send.  Zero means unlimited.
+    double bandwidth = 0;
+  };
+
+  // Counts of messages sent between nodes.
+  struct MessageStats {
+    int64 messages = 0;
+    int64 bytes = 0;
+  };
+  struct Stats {
+    MessageStats visits;
+    MessageStats contact_reports;
+    MessageStats outcomes;
+    // Total time nodes spent waiting on the emulated network.
+    absl::Duration network_time;
+  };
+
+  explicit InProcessCluster(Options options);
+  ~InProcessCluster();
+
+  InProcessCluster(const InProcessCluster&) = delete;
+  InProcessCluster& operator=(const InProcessCluster&) = delete;
+
+  int num_nodes() const { return options_.num_nodes; }
+  DistributedManager* Manager(int node);
+
+  // Splits agents and locations between the nodes and builds a
+  // ParallelDistributedSimulation with num_workers threads for each node.
+  std::vector<std::unique_ptr<Simulation>> BuildSimulations(
+      absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
+      std::vector<std::unique_ptr<Location>> locations, int num_workers);
+
+  // Runs Step on the simulations of all nodes concurrently.  simulations must
+  // have been built by BuildSimulations.
+  void Step(absl::Span<const std::unique_ptr<Simulation>> simulations,
+            int steps, absl::Duration step_duration);
+
+  Stats GetStats() const;
+
+ private:
+  class Network;
+  class Node;
+
+  const Options options_;
+  std::unique_ptr<Network> network_;
+  std::vector<std::unique_ptr<Node>> nodes_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_IN_PROCESS_CLUSTER_H_
@@ -0,0 +1,242 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/in_process_cluster.h"
+
+#include <array>
+#include <memory>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/visit.h"
+#include "agent_based_epidemic_sim/util/test_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using OutcomeMap = absl::flat_hash_map<int64, int>;
+using VisitMap = absl::flat_hash_map<std::pair<int64, int64>, int>;
+using ReportMap = absl::flat_hash_map<std::pair<int64, int64>, int>;
+ABSL_CONST_INIT absl::Mutex map_mu(absl::kConstInit);
+
+const int kNumLocations = 512;
+const int kNumAgents = 512;
+const int kVisitsPerAgent = 5;
+const int kReportsPerAgent = 3;
+const int kNumSteps = 4;
+
+std::array<int64, kVisitsPerAgent> VisitLocations(const int64 agent_id) {
+  std::array<int64, kVisitsPerAgent> ret;
+  for (int i = 0; i < kVisitsPerAgent; i++) {
+    ret[i] = (agent_id + 7 * i) % kNumLocations;
+  }
+  return ret;
+}
+
+std::array<int64, kReportsPerAgent> ReportRecipients(const int64 agent_id) {
+  std::array<int64, kReportsPerAgent> ret;
+  for (int i = 0; i < kReportsPerAgent; i++) {
+    ret[i] = (agent_id + 5 * i) % kNumAgents;
+  }
+  return ret;
+}
+
+struct Counts {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+};
+
+std::unique_ptr<Agent> MakeAgent(const int64 uuid, Counts* const counts) {
+  auto agent = absl::make_unique<testing::NiceMock<MockAgent>>();
+  ON_CALL(*agent, uuid()).WillByDefault(testing::Return(uuid));
+  ON_CALL(*agent, ComputeVisits(testing::_, testing::_))
+      .WillByDefault([uuid](const Timestep&, Broker<Visit>* visit_broker) {
+        for (const int64 location_uuid : VisitLocations(uuid)) {
+          visit_broker->Send(
+              {{.location_uuid = location_uuid, .agent_uuid = uuid}});
+        }
+      });
+  ON_CALL(*agent, ProcessInfectionOutcomes(testing::_, testing::_))
+      .WillByDefault([uuid, counts](
+                         const Timestep&,
+                         absl::Span<const InfectionOutcome> outcomes) {
+        absl::MutexLock l(&map_mu);
+        for (const InfectionOutcome& outcome : outcomes) {
+          ASSERT_EQ(outcome.agent_uuid, uuid);
+        }
+        counts->outcomes[uuid] += outcomes.size();
+      });
+  ON_CALL(*agent, UpdateContactReports(testing::_, testing::_, testing::_))
+      .WillByDefault([uuid, counts](const Timestep&,
+                                    absl::Span<const ContactReport> reports,
+                                    Broker<ContactReport>* report_broker) {
+        {
+          absl::MutexLock l(&map_mu);
+          for (const ContactReport& report : reports) {
+            ASSERT_EQ(report.to_agent_uuid, uuid);
+            counts->reports[{report.from_agent_uuid, uuid}]++;
+          }
+        }
+        for (const int64 to_agent_uuid : ReportRecipients(uuid)) {
+          report_broker->Send(
+              {{.from_agent_uuid = uuid, .to_agent_uuid = to_agent_uuid}});
+        }
+      });
+  return agent;
+}
+
+std::unique_ptr<Location> MakeLocation(const int64 uuid,
+                                       Counts* const counts) {
+  auto location = absl::make_unique<testing::NiceMock<MockLocation>>();
+  ON_CALL(*location, uuid()).WillByDefault(testing::Return(uuid));
+  ON_CALL(*location, ProcessVisits(testing::_, testing::_))
+      .WillByDefault([uuid, counts](absl::Span<const Visit> visits,
+                                    Broker<InfectionOutcome>* outcome_broker) {
+        for (const Visit& visit : visits) {
+          ASSERT_EQ(visit.location_uuid, uuid);
+          {
+            absl::MutexLock l(&map_mu);
+            counts->visits[{uuid, visit.agent_uuid}]++;
+          }
+          outcome_broker->Send({{.agent_uuid = visit.agent_uuid}});
+        }
+      });
+  return location;
+}
+
+std::vector<std::unique_ptr<Agent>> MakeAgents(Counts* const counts) {
+  std::vector<std::unique_ptr<Agent>> agents;
+  for (int i = 0; i < kNumAgents; ++i) agents.push_back(MakeAgent(i, counts));
+  return agents;
+}
+
+std::vector<std::unique_ptr<Location>> MakeLocations(Counts* const counts) {
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int i = 0; i < kNumLocations; ++i) {
+    locations.push_back(MakeLocation(i, counts));
+  }
+  return locations;
+}
+
+// Runs the population on a single node and on a cluster with the given
+// options, and checks that both see exactly the same messages.
+InProcessCluster::Stats RunAndCompare(InProcessCluster::Options options) {
+  Counts expected;
+  auto sim = ParallelSimulation(absl::UnixEpoch(), MakeAgents(&expected),
+                                MakeLocations(&expected), 2);
+  sim->Step(kNumSteps, absl::Hours(24));
+
+  Counts counts;
+  InProcessCluster cluster(std::move(options));
+  auto sims = cluster.BuildSimulations(absl::UnixEpoch(), MakeAgents(&counts),
+                                       MakeLocations(&counts), 2);
+  EXPECT_EQ(sims.size(), cluster.num_nodes());
+  cluster.Step(sims, kNumSteps, absl::Hours(24));
+
+  absl::MutexLock l(&map_mu);
+  EXPECT_EQ(counts.outcomes, expected.outcomes);
+  EXPECT_EQ(counts.visits, expected.visits);
+  EXPECT_EQ(counts.reports, expected.reports);
+  EXPECT_EQ(expected.visits.size(), kNumAgents * kVisitsPerAgent);
+  return cluster.GetStats();
+}
+
+TEST(InProcessClusterTest, MatchesSingleNodeSimulation) {
+  const int kNumNodes = 3;
+  auto node = [](const int64 uuid) { return uuid % kNumNodes; };
+  const InProcessCluster::Stats stats = RunAndCompare(
+      {.num_nodes = kNumNodes, .agent_node = node, .location_node = node});
+
+  // Count the messages that have to cross between nodes.
+  int64 remote_visits = 0;
+  int64 remote_reports = 0;
+  for (int64 agent = 0; agent < kNumAgents; ++agent) {
+    for (const int64 location : VisitLocations(agent)) {
+      if (node(location) != node(agent)) ++remote_visits;
+    }
+    for (const int64 to_agent : ReportRecipients(agent)) {
+      if (node(to_agent) != node(agent)) ++remote_reports;
+    }
+  }
+  EXPECT_EQ(stats.visits.messages, kNumSteps * remote_visits);
+  EXPECT_EQ(stats.visits.bytes, stats.visits.messages * sizeof(Visit));
+  EXPECT_EQ(stats.outcomes.messages, kNumSteps * remote_visits);
+  EXPECT_EQ(stats.outcomes.bytes,
+            stats.outcomes.messages * sizeof(InfectionOutcome));
+  EXPECT_EQ(stats.contact_reports.messages, kNumSteps * remote_reports);
+  EXPECT_EQ(stats.contact_reports.bytes,
+            stats.contact_reports.messages * sizeof(ContactReport));
+  EXPECT_EQ(stats.network_time, absl::ZeroDuration());
+}
+
+TEST(InProcessClusterTest, ColocatedPartitionSendsLessTraffic) {
+  const int kNumNodes = 4;
+  // Agents and the locations they visit are mostly on the same node when the
+  // uuid space is split into contiguous blocks.
+  auto block = [](const int64 uuid) {
+    return uuid * kNumNodes / kNumAgents;
+  };
+  auto strided = [](const int64 uuid) { return uuid % kNumNodes; };
+  const InProcessCluster::Stats block_stats = RunAndCompare(
+      {.num_nodes = kNumNodes, .agent_node = block, .location_node = block});
+  const InProcessCluster::Stats strided_stats =
+      RunAndCompare({.num_nodes = kNumNodes,
+                     .agent_node = strided,
+                     .location_node = strided});
+  EXPECT_GT(block_stats.visits.messages, 0);
+  EXPECT_LT(block_stats.visits.messages, strided_stats.visits.messages);
+  EXPECT_LT(block_stats.contact_reports.messages,
+            strided_stats.contact_reports.messages);
+}
+
+TEST(InProcessClusterTest, ModelsNetworkLatency) {
+  const int kNumNodes = 2;
+  auto node = [](const int64 uuid) { return uuid % kNumNodes; };
+  const InProcessCluster::Stats stats =
+      RunAndCompare({.num_nodes = kNumNodes,
+                     .agent_node = node,
+                     .location_node = node,
+                     .latency = absl::Milliseconds(1)});
+  // Each node flushes visits, contact reports and outcomes once per step.
+  EXPECT_EQ(stats.network_time, kNumNodes * kNumSteps * absl::Milliseconds(3));
+}
+
+// An agent that stands for two people.
+class CohortAgent : public testing::NiceMock<MockAgent> {
+ public:
+  int weight() const override { return 2; }
+};
+
+TEST(InProcessClusterTest, RejectsCohortsSplitAcrossNodes) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  auto node = [](const int64 uuid) { return static_cast<int>(uuid % 2); };
+  InProcessCluster cluster(
+      {.num_nodes = 2, .agent_node = node, .location_node = node});
+  std::vector<std::unique_ptr<Agent>> agents;
+  auto agent = absl::make_unique<CohortAgent>();
+  ON_CALL(*agent, uuid()).WillByDefault(testing::Return(4));
+  agents.push_back(std::move(agent));
+  EXPECT_DEATH(cluster.BuildSimulations(absl::UnixEpoch(), std::move(agents),
+                                        {}, /*num_workers=*/1),
+               "People of agent 4 are on another node");
+}
+
+}  // namespace
+}  // namespace abesim
@@ -20,6 +20,7 @@
 #include "absl/random/random.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
+#include "agent_based_epidemic_sim/core/visit.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
@@ -109,17 +110,25 @@ void LocationDiscreteEventSimulator::ProcessVisits(
                        });
   };
   DCHECK(matches_uuid_fn(visits)) << "Found incorrect Visit uuid.";
-  thread_local std::vector<Event> events(2 * visits.size());
+  // Each stay of a visit arrives and departs on its own.  Nodes point into
+  // stays, so it must not grow once the events are built.
+  thread_local std::vector<Visit> stays;
+  stays.clear();
+  ExpandVisitStays(visits, &stays);
+  thread_local std::vector<Event> events(2 * stays.size());
   events.clear();
   thread_local std::vector<std::unique_ptr<VisitNode>> visit_nodes(
-      visits.size());
+      stays.size());
   visit_nodes.clear();
-  ConvertVisitsToEvents(visits, &events, &visit_nodes);
+  ConvertVisitsToEvents(stays, &events, &visit_nodes);
   std::sort(events.begin(), events.end(), IsEventEarlier);
   std::list<VisitNode*> active_visits;
   for (Event& event : events) {
     if (event.type == EventType::ARRIVAL) {
       for (VisitNode* node : active_visits) {
+        // An agent whose health changes during its stay sends consecutive
+        // stays, which must not be mistaken for a contact.
+        if (node->visit->agent_uuid == event.node->visit->agent_uuid) continue;
         RecordContact(event.node, node, exposure_generator_.get());
       }
       event.node->pos = active_visits.insert(active_visits.end(), event.node);
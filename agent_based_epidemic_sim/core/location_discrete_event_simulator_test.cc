@@ -40,6 +40,7 @@ const std::vector<std::vector<float>> kFarProximityTraceDistribution = {
     {kFarProximity}};
 const ProximityTrace kFarProximityTrace({kFarProximity});
 
+using testing::UnorderedElementsAre;
 using testing::UnorderedElementsAreArray;
 
 std::vector<InfectionOutcome> InfectionOutcomesFromContacts(
@@ -192,6 +193,139 @@ TEST(LocationDiscreteEventSimulatorTest, ProcessVisitsRejectsWrongUuid) {
                      "");
 }
 
+TEST(LocationDiscreteEventSimulatorTest, ProcessesConsecutiveVisits) {
+  const int64 kUuid = 42LL;
+  // Agent 0 becomes infectious during its stay, which it sends as two visits.
+  // Agent 1 stays throughout.
+  Visit visit{.location_uuid = kUuid,
+              .agent_uuid = 0LL,
+              .start_time = absl::FromUnixSeconds(0LL),
+              .end_time = absl::FromUnixSeconds(500LL),
+              .health_state = HealthState::EXPOSED,
+              .infectivity = 0.0f,
+              .symptom_factor = 0.0f};
+  Visit infectious = visit;
+  infectious.start_time = absl::FromUnixSeconds(500LL);
+  infectious.end_time = absl::FromUnixSeconds(1000LL);
+  infectious.health_state = HealthState::INFECTIOUS;
+  infectious.infectivity = 1.0f;
+  std::vector<Visit> visits{visit, infectious,
+                            Visit{.location_uuid = kUuid,
+                                  .agent_uuid = 1LL,
+                                  .start_time = absl::FromUnixSeconds(0LL),
+                                  .end_time = absl::FromUnixSeconds(1000LL),
+                                  .health_state = HealthState::SUSCEPTIBLE,
+                                  .infectivity = 0.0f,
+                                  .symptom_factor = 0.0f}};
+
+  std::vector<InfectionOutcome> outcomes;
+  MockBroker<InfectionOutcome> infection_broker;
+  EXPECT_CALL(infection_broker, Send)
+      .WillRepeatedly([&outcomes](absl::Span<const InfectionOutcome> sent) {
+        outcomes.insert(outcomes.end(), sent.begin(), sent.end());
+      });
+  MicroExposureGeneratorBuilder meg_builder(kCloseProximityTraceDistribution);
+  LocationDiscreteEventSimulator(kUuid, meg_builder.Build())
+      .ProcessVisits(visits, &infection_broker);
+
+  // Each visit of agent 0 is a contact with agent 1, and agent 0 never
+  // contacts itself across its visits.
+  ASSERT_EQ(outcomes.size(), 4);
+  std::vector<float> infectivities;
+  for (const InfectionOutcome& outcome : outcomes) {
+    EXPECT_NE(outcome.agent_uuid, outcome.source_uuid);
+    if (outcome.agent_uuid == 1LL) {
+      infectivities.push_back(outcome.exposure.infectivity);
+    }
+  }
+  EXPECT_THAT(infectivities, UnorderedElementsAre(0.0f, 1.0f));
+}
+
+TEST(LocationDiscreteEventSimulatorTest, ProcessesEachStayOfAVisit) {
+  const int64 kUuid = 42LL;
+  // Agent 0 is here for the first and last hour, and away for an hour in
+  // between.  Agent 1 only overlaps its second stay, and agent 2 is here while
+  // agent 0 is away.
+  std::vector<Visit> visits{Visit{.location_uuid = kUuid,
+                                  .agent_uuid = 0LL,
+                                  .start_time = absl::FromUnixSeconds(0LL),
+                                  .end_time = absl::FromUnixSeconds(10800LL),
+                                  .health_state = HealthState::INFECTIOUS,
+                                  .infectivity = 1.0f,
+                                  .symptom_factor = 1.0f,
+                                  .absence = {.start_minutes = 60,
+                                              .end_minutes = 120}},
+                            Visit{.location_uuid = kUuid,
+                                  .agent_uuid = 1LL,
+                                  .start_time = absl::FromUnixSeconds(9000LL),
+                                  .end_time = absl::FromUnixSeconds(10000LL),
+                                  .health_state = HealthState::SUSCEPTIBLE,
+                                  .infectivity = 0.0f,
+                                  .symptom_factor = 0.0f},
+                            Visit{.location_uuid = kUuid,
+                                  .agent_uuid = 2LL,
+                                  .start_time = absl::FromUnixSeconds(4000LL),
+                                  .end_time = absl::FromUnixSeconds(5000LL),
+                                  .health_state = HealthState::SUSCEPTIBLE,
+                                  .infectivity = 0.0f,
+                                  .symptom_factor = 0.0f}};
+
+  std::vector<InfectionOutcome> outcomes;
+  MockBroker<InfectionOutcome> infection_broker;
+  EXPECT_CALL(infection_broker, Send)
+      .WillRepeatedly([&outcomes](absl::Span<const InfectionOutcome> sent) {
+        outcomes.insert(outcomes.end(), sent.begin(), sent.end());
+      });
+  MicroExposureGeneratorBuilder meg_builder(kCloseProximityTraceDistribution);
+  LocationDiscreteEventSimulator(kUuid, meg_builder.Build())
+      .ProcessVisits(visits, &infection_broker);
+
+  ASSERT_EQ(outcomes.size(), 2);
+  for (const InfectionOutcome& outcome : outcomes) {
+    EXPECT_NE(outcome.agent_uuid, 2LL);
+    EXPECT_NE(outcome.source_uuid, 2LL);
+    EXPECT_EQ(outcome.exposure.start_time, absl::FromUnixSeconds(9000LL));
+  }
+}
+
+TEST(LocationDiscreteEventSimulatorTest, ExposesWeightedVisitsOnce) {
+  const int64 kUuid = 42LL;
+  // Agent 1 stands for a cohort of 3 susceptible people.
+  std::vector<Visit> visits{Visit{.location_uuid = kUuid,
+                                  .agent_uuid = 0LL,
+                                  .start_time = absl::FromUnixSeconds(0LL),
+                                  .end_time = absl::FromUnixSeconds(1000LL),
+                                  .health_state = HealthState::INFECTIOUS,
+                                  .infectivity = 1.0f,
+                                  .symptom_factor = 1.0f},
+                            Visit{.location_uuid = kUuid,
+                                  .agent_uuid = 1LL,
+                                  .start_time = absl::FromUnixSeconds(0LL),
+                                  .end_time = absl::FromUnixSeconds(1000LL),
+                                  .health_state = HealthState::SUSCEPTIBLE,
+                                  .infectivity = 0.0f,
+                                  .symptom_factor = 0.0f,
+                                  .weight = 3}};
+
+  std::vector<InfectionOutcome> outcomes;
+  MockBroker<InfectionOutcome> infection_broker;
+  EXPECT_CALL(infection_broker, Send)
+      .WillRepeatedly([&outcomes](absl::Span<const InfectionOutcome> sent) {
+        outcomes.insert(outcomes.end(), sent.begin(), sent.end());
+      });
+  MicroExposureGeneratorBuilder meg_builder(kCloseProximityTraceDistribution);
+  LocationDiscreteEventSimulator(kUuid, meg_builder.Build())
+      .ProcessVisits(visits, &infection_broker);
+
+  // The cohort resolves its weight itself, so it gets a single exposure.
+  int64 outcomes_for_agent_1 = 0;
+  for (const InfectionOutcome& outcome : outcomes) {
+    if (outcome.agent_uuid == 1LL) ++outcomes_for_agent_1;
+  }
+  EXPECT_EQ(outcomes_for_agent_1, 1);
+  EXPECT_EQ(outcomes.size(), 2);
+}
+
 TEST(LocationDiscreteEventSimulatorTest,
      ProcessVisitsRejectsStartTimeNotBeforeEndTime) {
   auto infection_broker = absl::make_unique<MockBroker<InfectionOutcome>>();
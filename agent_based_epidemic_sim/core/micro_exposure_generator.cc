@@ -21,11 +21,11 @@
 
 #include "absl/random/distributions.h"
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/exposure_generator.h"
 #include "agent_based_epidemic_sim/core/parameter_distribution.pb.h"
-#include "agent_based_epidemic_sim/core/random.h"
 
 namespace abesim {
 
@@ -66,7 +66,7 @@ ProximityTrace MicroExposureGenerator::GenerateProximityTrace() const {
   ProximityTrace full_length_proximity_trace;
   full_length_proximity_trace.values.fill(std::numeric_limits<float>::max());
 
-  absl::BitGenRef gen = GetBitGen();
+  BulkRandom& gen = GetBulkRandom();
   int proximity_trace_length = absl::Uniform<int>(gen, 1, kMaxTraceLength);
   for (int i = 0; i < proximity_trace_length; ++i) {
     full_length_proximity_trace.values[i] =
@@ -77,7 +77,7 @@ ProximityTrace MicroExposureGenerator::GenerateProximityTrace() const {
 
 ProximityTrace MicroExposureGenerator::DrawProximityTrace() const {
   return proximity_trace_distribution_[absl::Uniform<int>(
-      GetBitGen(), 0, proximity_trace_distribution_.size() - 1)];
+      GetBulkRandom(), 0, proximity_trace_distribution_.size() - 1)];
 }
 
 }  // namespace abesim
@@ -28,6 +28,9 @@ void ObserverManager::AggregateForTimestep(const Timestep& timestep) {
   for (auto& factory : factories_) {
     factory->Aggregate(timestep);
   }
+  for (auto& factory : factories_) {
+    factory->Flush();
+  }
   shards_.clear();
 }
 
@@ -17,6 +17,7 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_OBSERVER_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_OBSERVER_H_
 
+#include <algorithm>
 #include <memory>
 
 #include "absl/container/flat_hash_set.h"
@@ -104,6 +105,9 @@ class AgentInfectionObserver {
   virtual ~AgentInfectionObserver() = default;
   // Observes all the InfectionOutcomes for a given agent for this timestep.
   virtual void Observe(const Agent&, absl::Span<const InfectionOutcome>) = 0;
+  // Returns false if Observe only looks at the agent and not its outcomes, in
+  // which case engines may combine the outcomes before they are observed.
+  virtual bool ObservesOutcomes() const { return true; }
 };
 
 class LocationVisitObserver {
@@ -120,6 +124,12 @@ class ObserverFactoryBase {
  public:
   virtual ~ObserverFactoryBase() = default;
 
+  // Called at the end of each timestep, once every factory has aggregated it.
+  // Factories that write a file across timesteps flush it here, so that
+  // completed timesteps reach the file before Close.  Must not wait on the
+  // disk.
+  virtual void Flush() {}
+
  private:
   friend class ObserverManager;
   virtual void MakeObserverForShard(const Timestep&, ObserverShard*) = 0;
@@ -161,6 +171,15 @@ class ObserverShard : public AgentInfectionObserver,
   void Observe(const Location& location,
                absl::Span<const Visit> visits) override;
 
+  // Returns true if any observer of this shard observes InfectionOutcomes.
+  bool ObservesInfectionOutcomes() const {
+    return std::any_of(agent_infection_observers_.begin(),
+                       agent_infection_observers_.end(),
+                       [](const AgentInfectionObserver* observer) {
+                         return observer->ObservesOutcomes();
+                       });
+  }
+
  private:
   template <typename Observer>
   friend class ObserverFactory;
@@ -186,7 +205,7 @@ class ObserverManager {
   void AddFactory(ObserverFactoryBase* factory);
   // Removes an ObserverFactory.
   void RemoveFactory(ObserverFactoryBase* factory);
-  // Calls ObserverFactory::Aggregate for all added factories.
+  // Calls ObserverFactory::Aggregate, then Flush, for all added factories.
   void AggregateForTimestep(const Timestep& timestep);
   // Make a new ObserverShard that can be used by a worker thread to report
   // observations.  Note that the manager retains ownership and that the
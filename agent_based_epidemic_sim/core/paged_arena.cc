@@ -0,0 +1,221 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/paged_arena.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// Arenas that PagedAllocator may need to return memory to.  Deallocation
+// happens far more often than arenas are created, so lookups are lock-free.
+constexpr int kMaxArenas = 8;
+std::atomic<PagedArena*> live_arenas[kMaxArenas];
+
+thread_local PagedArena* current_arena = nullptr;
+thread_local int current_chunk = -1;
+
+// Allocations are rounded up to a power of two no smaller than this.
+constexpr size_t kMinBlockSize = 16;
+
+int SizeClass(const size_t bytes) {
+  int size_class = 0;
+  size_t block_size = kMinBlockSize;
+  while (block_size < bytes) {
+    block_size <<= 1;
+    ++size_class;
+  }
+  return size_class;
+}
+
+size_t PageSize() { return sysconf(_SC_PAGESIZE); }
+
+absl::Status ErrnoStatus(absl::string_view what) {
+  return absl::InternalError(absl::StrCat(what, ": ", std::strerror(errno)));
+}
+
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<PagedArena>> PagedArena::Create(
+    const std::string& path, size_t capacity) {
+  const size_t page_size = PageSize();
+  capacity = (capacity + page_size - 1) / page_size * page_size;
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) return ErrnoStatus(absl::StrCat("Opening ", path));
+  if (ftruncate(fd, capacity) != 0) {
+    absl::Status status = ErrnoStatus(absl::StrCat("Resizing ", path));
+    close(fd);
+    unlink(path.c_str());
+    return status;
+  }
+  void* const base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_NORESERVE, fd, 0);
+  if (base == MAP_FAILED) {
+    absl::Status status = ErrnoStatus(absl::StrCat("Mapping ", path));
+    close(fd);
+    unlink(path.c_str());
+    return status;
+  }
+  auto arena = absl::WrapUnique(
+      new PagedArena(path, fd, static_cast<char*>(base), capacity));
+  for (std::atomic<PagedArena*>& slot : live_arenas) {
+    PagedArena* expected = nullptr;
+    if (slot.compare_exchange_strong(expected, arena.get())) {
+      arena->SetNumChunks(1);
+      return arena;
+    }
+  }
+  return absl::ResourceExhaustedError(
+      absl::StrCat("At most ", kMaxArenas, " PagedArenas may exist at once."));
+}
+
+PagedArena::~PagedArena() {
+  for (std::atomic<PagedArena*>& slot : live_arenas) {
+    PagedArena* expected = this;
+    slot.compare_exchange_strong(expected, nullptr);
+  }
+  munmap(base_, capacity_);
+  close(fd_);
+  unlink(path_.c_str());
+}
+
+void PagedArena::SetNumChunks(const int num_chunks) {
+  CHECK_GT(num_chunks, 0);
+  for (const auto& chunk : chunks_) {
+    absl::MutexLock l(&chunk->mu);
+    CHECK(chunk->next == chunk->begin)
+        << "SetNumChunks called after allocating from the arena.";
+  }
+  const size_t page_size = PageSize();
+  const size_t chunk_size = capacity_ / num_chunks / page_size * page_size;
+  CHECK_GT(chunk_size, 0) << "Too many chunks for arena of " << capacity_
+                          << " bytes.";
+  chunks_.clear();
+  for (int i = 0; i < num_chunks; ++i) {
+    auto chunk = absl::make_unique<Chunk>();
+    chunk->begin = chunk->next = base_ + i * chunk_size;
+    chunk->end = chunk->begin + chunk_size;
+    chunks_.push_back(std::move(chunk));
+  }
+}
+
+void* PagedArena::Allocate(const int chunk_index, const size_t bytes) {
+  const int size_class = SizeClass(bytes);
+  if (size_class >= kNumSizeClasses) return nullptr;
+  const size_t block_size = kMinBlockSize << size_class;
+  Chunk& chunk = *chunks_[chunk_index];
+  absl::MutexLock l(&chunk.mu);
+  void*& free_list = chunk.free_lists[size_class];
+  if (free_list != nullptr) {
+    void* const block = free_list;
+    free_list = *static_cast<void**>(block);
+    return block;
+  }
+  if (static_cast<size_t>(chunk.end - chunk.next) < block_size) return nullptr;
+  void* const block = chunk.next;
+  chunk.next += block_size;
+  return block;
+}
+
+void PagedArena::Deallocate(void* const ptr, const size_t bytes) {
+  DCHECK(Contains(ptr));
+  const size_t chunk_size = chunks_[0]->end - chunks_[0]->begin;
+  Chunk& chunk = *chunks_[(static_cast<char*>(ptr) - base_) / chunk_size];
+  absl::MutexLock l(&chunk.mu);
+  void*& free_list = chunk.free_lists[SizeClass(bytes)];
+  *static_cast<void**>(ptr) = free_list;
+  free_list = ptr;
+}
+
+void PagedArena::Prefetch(const int chunk_index) {
+  Chunk& chunk = *chunks_[chunk_index];
+  char* next;
+  {
+    absl::MutexLock l(&chunk.mu);
+    next = chunk.next;
+  }
+  if (next == chunk.begin) return;
+  if (madvise(chunk.begin, next - chunk.begin, MADV_WILLNEED) != 0) {
+    LOG(WARNING) << "Failed to prefetch arena chunk " << chunk_index << ": "
+                 << std::strerror(errno);
+  }
+}
+
+void PagedArena::WriteBack(const int chunk_index) {
+  Chunk& chunk = *chunks_[chunk_index];
+  char* next;
+  {
+    absl::MutexLock l(&chunk.mu);
+    next = chunk.next;
+  }
+  if (next == chunk.begin) return;
+  // The mapping is shared, so dropping the pages keeps their contents in the
+  // page cache until the kernel has written them to the file.
+  if (msync(chunk.begin, next - chunk.begin, MS_ASYNC) != 0 ||
+      madvise(chunk.begin, next - chunk.begin, MADV_DONTNEED) != 0) {
+    LOG(WARNING) << "Failed to write back arena chunk " << chunk_index << ": "
+                 << std::strerror(errno);
+  }
+}
+
+PagedArena::Scope::Scope(PagedArena* const arena, const int chunk)
+    : previous_arena_(current_arena), previous_chunk_(current_chunk) {
+  DCHECK_LT(chunk, arena->num_chunks());
+  current_arena = arena;
+  current_chunk = chunk;
+}
+
+PagedArena::Scope::~Scope() {
+  current_arena = previous_arena_;
+  current_chunk = previous_chunk_;
+}
+
+void* PagedArena::AllocateInScope(const size_t bytes) {
+  if (current_arena != nullptr) {
+    void* const ptr = current_arena->Allocate(current_chunk, bytes);
+    if (ptr != nullptr) return ptr;
+    if (current_arena->heap_fallback_bytes_.fetch_add(
+            bytes, std::memory_order_relaxed) == 0) {
+      LOG(WARNING) << "Chunk " << current_chunk << " of PagedArena "
+                   << current_arena->path_ << " cannot fit " << bytes
+                   << " bytes, so agent state is spilling onto the heap.";
+    }
+  }
+  return ::operator new(bytes);
+}
+
+void PagedArena::DeallocateAny(void* const ptr, const size_t bytes) {
+  for (const std::atomic<PagedArena*>& slot : live_arenas) {
+    PagedArena* const arena = slot.load(std::memory_order_acquire);
+    if (arena != nullptr && arena->Contains(ptr)) {
+      arena->Deallocate(ptr, bytes);
+      return;
+    }
+  }
+  ::operator delete(ptr);
+}
+
+}  // namespace abesim
@@ -0,0 +1,173 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_PAGED_ARENA_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_PAGED_ARENA_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+// PagedArena is memory backed by a file rather than by anonymous memory, so
+// that the kernel can evict it to disk instead of running out of memory.  It
+// is used to run simulations whose agent state does not fit in RAM.
+//
+// The arena is split into equally sized chunks, one for each chunk of agents
+// the simulation processes together.  While a Scope is active on a thread,
+// PagedAllocator allocates from the scope's chunk, so the state of agents that
+// are processed together is stored together in the file.  The simulation
+// prefetches each chunk before processing it and writes it back afterwards,
+// so that chunks stream sequentially through memory.
+//
+// Only containers that use PagedAllocator live in the arena.  These hold the
+// state that grows with the length of a run: exposure records and the map
+// from contacts to them, health histories and the histories of risk scores.
+// Objects of a fixed size per agent stay on the heap: the agent itself (200
+// bytes for an SEIRAgent), its risk score unless shared, the live state of an
+// SEIRAgent that has not frozen (136 bytes), and a ContactReport (96 bytes)
+// for each exposure that has been notified.  The arena is sized for the paged
+// state alone.  Allocations that do not fit in their chunk fall back to the
+// heap and are counted by heap_fallback_bytes().
+class PagedArena {
+ public:
+  // Creates an arena backed by a new file at path that can hold up to
+  // capacity bytes.  The file is sparse, so space is only used on disk as it
+  // is written, and it is removed when the arena is destroyed.
+  static absl::StatusOr<std::unique_ptr<PagedArena>> Create(
+      const std::string& path, size_t capacity);
+
+  PagedArena(const PagedArena&) = delete;
+  PagedArena& operator=(const PagedArena&) = delete;
+  ~PagedArena();
+
+  // Splits the arena into num_chunks chunks of equal size.  Must be called
+  // before anything is allocated from the arena.
+  void SetNumChunks(int num_chunks);
+  int num_chunks() const { return chunks_.size(); }
+
+  // Returns memory for bytes from the given chunk, or nullptr if the chunk is
+  // full.
+  void* Allocate(int chunk, size_t bytes);
+  // Returns memory obtained from Allocate to the arena.
+  void Deallocate(void* ptr, size_t bytes);
+  // Returns true if ptr points into the arena.
+  bool Contains(const void* ptr) const {
+    return ptr >= base_ && ptr < base_ + capacity_;
+  }
+
+  // Returns the number of bytes allocated from the heap within a Scope of
+  // this arena because they did not fit in the scope's chunk.  Nonzero when
+  // the arena is too small for the simulation.
+  int64 heap_fallback_bytes() const {
+    return heap_fallback_bytes_.load(std::memory_order_relaxed);
+  }
+
+  // Asks the kernel to start reading the given chunk into memory.
+  void Prefetch(int chunk);
+  // Starts writing the given chunk back to the file and releases its memory.
+  // The contents are read back from the file the next time they are used.
+  void WriteBack(int chunk);
+
+  // While a Scope is alive, PagedAllocators on the current thread allocate
+  // from the given chunk of arena.  Scopes may be nested.
+  class Scope {
+   public:
+    Scope(PagedArena* arena, int chunk);
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    ~Scope();
+
+   private:
+    PagedArena* const previous_arena_;
+    const int previous_chunk_;
+  };
+
+  // Returns memory for bytes from the current Scope's chunk, or from the heap
+  // if there is no current Scope or the chunk is full.  The first allocation
+  // that falls back to the heap because an arena is full is logged.
+  static void* AllocateInScope(size_t bytes);
+  // Releases memory returned by AllocateInScope.
+  static void DeallocateAny(void* ptr, size_t bytes);
+
+ private:
+  // Allocations are rounded up to a power of two, giving this many size
+  // classes.
+  static constexpr int kNumSizeClasses = 48;
+
+  struct Chunk {
+    absl::Mutex mu;
+    char* begin;
+    char* next ABSL_GUARDED_BY(mu);
+    char* end;
+    // Freed blocks of each size class, linked through their first word.
+    void* free_lists[kNumSizeClasses] ABSL_GUARDED_BY(mu) = {};
+  };
+
+  PagedArena(std::string path, int fd, char* base, size_t capacity)
+      : path_(std::move(path)), fd_(fd), base_(base), capacity_(capacity) {}
+
+  const std::string path_;
+  const int fd_;
+  char* const base_;
+  const size_t capacity_;
+  std::vector<std::unique_ptr<Chunk>> chunks_;
+  std::atomic<int64> heap_fallback_bytes_{0};
+};
+
+// A stateless STL allocator that allocates from the current
+// PagedArena::Scope, falling back to the heap.  Containers using it may be
+// freely moved between scopes and threads.
+template <typename T>
+class PagedAllocator {
+ public:
+  using value_type = T;
+  static_assert(alignof(T) <= alignof(std::max_align_t),
+                "PagedAllocator does not support over-aligned types.");
+
+  PagedAllocator() = default;
+  template <typename U>
+  PagedAllocator(const PagedAllocator<U>&) {}  // NOLINT
+
+  T* allocate(const size_t n) {
+    return static_cast<T*>(PagedArena::AllocateInScope(n * sizeof(T)));
+  }
+  void deallocate(T* const ptr, const size_t n) {
+    PagedArena::DeallocateAny(ptr, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(const PagedAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const PagedAllocator<U>&) const {
+    return false;
+  }
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_PAGED_ARENA_H_
@@ -0,0 +1,108 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/paged_arena.h"
+
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+constexpr size_t kCapacity = 1 << 20;
+
+using PagedVector = std::vector<int, PagedAllocator<int>>;
+
+class PagedArenaTest : public testing::Test {
+ protected:
+  void SetUp() override {
+    auto arena = PagedArena::Create(
+        absl::StrCat(getenv("TEST_TMPDIR"), "/", "paged_arena"), kCapacity);
+    ASSERT_TRUE(arena.ok()) << arena.status();
+    arena_ = std::move(*arena);
+  }
+
+  std::unique_ptr<PagedArena> arena_;
+};
+
+TEST_F(PagedArenaTest, AllocatesFromChunks) {
+  arena_->SetNumChunks(4);
+  EXPECT_EQ(arena_->num_chunks(), 4);
+  void* const first = arena_->Allocate(0, 100);
+  void* const second = arena_->Allocate(3, 100);
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(second, nullptr);
+  EXPECT_TRUE(arena_->Contains(first));
+  EXPECT_TRUE(arena_->Contains(second));
+  EXPECT_LT(first, second);
+  int on_stack;
+  EXPECT_FALSE(arena_->Contains(&on_stack));
+}
+
+TEST_F(PagedArenaTest, ReusesFreedBlocks) {
+  void* const block = arena_->Allocate(0, 64);
+  arena_->Deallocate(block, 64);
+  EXPECT_EQ(arena_->Allocate(0, 60), block);
+  EXPECT_NE(arena_->Allocate(0, 64), block);
+}
+
+TEST_F(PagedArenaTest, ReturnsNullWhenChunkIsFull) {
+  arena_->SetNumChunks(2);
+  EXPECT_EQ(arena_->Allocate(0, kCapacity), nullptr);
+  EXPECT_NE(arena_->Allocate(1, kCapacity / 4), nullptr);
+}
+
+TEST_F(PagedArenaTest, AllocatorUsesCurrentScope) {
+  PagedVector outside(10);
+  EXPECT_FALSE(arena_->Contains(outside.data()));
+  PagedVector inside;
+  {
+    PagedArena::Scope scope(arena_.get(), 0);
+    inside.resize(1000);
+    EXPECT_EQ(arena_->heap_fallback_bytes(), 0);
+    // Too large for the arena, so falls back to the heap.
+    PagedVector too_large(kCapacity);
+    EXPECT_FALSE(arena_->Contains(too_large.data()));
+    EXPECT_EQ(arena_->heap_fallback_bytes(), kCapacity * sizeof(int));
+  }
+  EXPECT_TRUE(arena_->Contains(inside.data()));
+  // Growing outside the scope moves the contents to the heap.
+  std::iota(inside.begin(), inside.end(), 0);
+  inside.resize(10000);
+  EXPECT_FALSE(arena_->Contains(inside.data()));
+  EXPECT_EQ(inside[999], 999);
+}
+
+TEST_F(PagedArenaTest, KeepsContentsAcrossWriteBack) {
+  arena_->SetNumChunks(2);
+  PagedVector values;
+  {
+    PagedArena::Scope scope(arena_.get(), 1);
+    values.resize(1000);
+  }
+  std::iota(values.begin(), values.end(), 0);
+  arena_->WriteBack(1);
+  arena_->Prefetch(1);
+  std::vector<int> expected(1000);
+  std::iota(expected.begin(), expected.end(), 0);
+  EXPECT_THAT(values, testing::ElementsAreArray(expected));
+}
+
+}  // namespace
+}  // namespace abesim
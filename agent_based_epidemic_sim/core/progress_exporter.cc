@@ -0,0 +1,336 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/progress_exporter.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// How often the HTTP server checks whether it should stop.
+constexpr int kPollMillis = 200;
+constexpr size_t kMaxRequestBytes = 4096;
+
+SimulationStats Subtract(const SimulationStats& a, const SimulationStats& b) {
+  return {
+      .steps = a.steps - b.steps,
+      .agent_updates = a.agent_updates - b.agent_updates,
+      .visits = a.visits - b.visits,
+      .contact_reports = a.contact_reports - b.contact_reports,
+      .infection_outcomes = a.infection_outcomes - b.infection_outcomes,
+      .agent_phase_time = a.agent_phase_time - b.agent_phase_time,
+      .location_phase_time = a.location_phase_time - b.location_phase_time,
+      .observer_phase_time = a.observer_phase_time - b.observer_phase_time,
+      .dtlb_misses = a.dtlb_misses - b.dtlb_misses,
+  };
+}
+
+double Rate(const int64 count, const absl::Duration duration) {
+  return duration > absl::ZeroDuration()
+             ? count / absl::ToDoubleSeconds(duration)
+             : 0.0;
+}
+
+absl::Status WriteAtomically(const std::string& path,
+                             const absl::string_view contents) {
+  const std::string tmp_path = absl::StrCat(path, ".tmp");
+  FILE* const file = std::fopen(tmp_path.c_str(), "w");
+  if (file == nullptr) {
+    return absl::InternalError(
+        absl::StrCat(tmp_path, ": ", std::strerror(errno)));
+  }
+  const bool written =
+      std::fwrite(contents.data(), 1, contents.size(), file) ==
+      contents.size();
+  if (std::fclose(file) != 0 || !written) {
+    return absl::InternalError(absl::StrCat("Failed to write ", tmp_path));
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    return absl::InternalError(
+        absl::StrCat("Renaming ", tmp_path, ": ", std::strerror(errno)));
+  }
+  return absl::OkStatus();
+}
+
+void SendResponse(const int fd, const absl::string_view content_type,
+                  const absl::string_view body) {
+  const std::string response = absl::StrCat(
+      "HTTP/1.1 200 OK\r\nContent-Type: ", content_type,
+      "\r\nContent-Length: ", body.size(), "\r\nConnection: close\r\n\r\n",
+      body);
+  size_t sent = 0;
+  while (sent < response.size()) {
+    const ssize_t n =
+        send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) return;
+    sent += n;
+  }
+}
+
+}  // namespace
+
+std::string FormatPrometheus(const ProgressSnapshot& snapshot) {
+  const SimulationStats& stats = snapshot.stats;
+  std::string out;
+  auto metric = [&out](absl::string_view name, absl::string_view help,
+                       absl::string_view type) {
+    absl::StrAppend(&out, "# HELP abesim_", name, " ", help, "\n",
+                    "# TYPE abesim_", name, " ", type, "\n");
+  };
+  metric("steps_total", "Simulation steps completed.", "counter");
+  absl::StrAppend(&out, "abesim_steps_total ", stats.steps, "\n");
+  metric("total_steps", "Simulation steps in the run.", "gauge");
+  absl::StrAppend(&out, "abesim_total_steps ", snapshot.total_steps, "\n");
+  metric("steps_per_second", "Simulation steps per second.", "gauge");
+  absl::StrAppend(&out, "abesim_steps_per_second ", snapshot.steps_per_second,
+                  "\n");
+  metric("agent_updates_total", "Agents updated.", "counter");
+  absl::StrAppend(&out, "abesim_agent_updates_total ", stats.agent_updates,
+                  "\n");
+  metric("agent_updates_per_second", "Agents updated per second.", "gauge");
+  absl::StrAppend(&out, "abesim_agent_updates_per_second ",
+                  snapshot.agent_updates_per_second, "\n");
+  metric("messages_total", "Messages delivered by type.", "counter");
+  absl::StrAppend(&out, "abesim_messages_total{type=\"visit\"} ",
+                  stats.visits, "\n",
+                  "abesim_messages_total{type=\"contact_report\"} ",
+                  stats.contact_reports, "\n",
+                  "abesim_messages_total{type=\"infection_outcome\"} ",
+                  stats.infection_outcomes, "\n");
+  metric("messages_per_second", "Messages delivered per second by type.",
+         "gauge");
+  absl::StrAppend(&out, "abesim_messages_per_second{type=\"visit\"} ",
+                  snapshot.visits_per_second, "\n",
+                  "abesim_messages_per_second{type=\"contact_report\"} ",
+                  snapshot.contact_reports_per_second, "\n",
+                  "abesim_messages_per_second{type=\"infection_outcome\"} ",
+                  snapshot.infection_outcomes_per_second, "\n");
+  metric("phase_seconds_total", "Wall time spent in each phase of a step.",
+         "counter");
+  absl::StrAppend(
+      &out, "abesim_phase_seconds_total{phase=\"agent\"} ",
+      absl::ToDoubleSeconds(stats.agent_phase_time), "\n",
+      "abesim_phase_seconds_total{phase=\"location\"} ",
+      absl::ToDoubleSeconds(stats.location_phase_time), "\n",
+      "abesim_phase_seconds_total{phase=\"observer\"} ",
+      absl::ToDoubleSeconds(stats.observer_phase_time), "\n");
+  metric("dtlb_misses_total",
+         "Data TLB misses during the agent and location phases.", "counter");
+  absl::StrAppend(&out, "abesim_dtlb_misses_total ", stats.dtlb_misses, "\n");
+  metric("rss_bytes", "Resident set size of the process.", "gauge");
+  absl::StrAppend(&out, "abesim_rss_bytes ", snapshot.rss_bytes, "\n");
+  metric("output_bytes", "Bytes written to output files.", "gauge");
+  absl::StrAppend(&out, "abesim_output_bytes ", snapshot.output_bytes, "\n");
+  if (snapshot.eta != absl::InfiniteDuration()) {
+    metric("eta_seconds", "Estimated time until the run finishes.", "gauge");
+    absl::StrAppend(&out, "abesim_eta_seconds ",
+                    absl::ToDoubleSeconds(snapshot.eta), "\n");
+  }
+  metric("snapshot_timestamp_seconds", "Time the snapshot was taken.",
+         "gauge");
+  absl::StrAppend(&out, "abesim_snapshot_timestamp_seconds ",
+                  absl::ToUnixSeconds(snapshot.time), "\n");
+  return out;
+}
+
+std::string FormatJson(const ProgressSnapshot& snapshot) {
+  const SimulationStats& stats = snapshot.stats;
+  return absl::StrFormat(
+      "{\"time\": %d, \"steps\": %d, \"total_steps\": %d, "
+      "\"steps_per_second\": %g, \"agent_updates\": %d, "
+      "\"agent_updates_per_second\": %g, "
+      "\"messages\": {\"visit\": %d, \"contact_report\": %d, "
+      "\"infection_outcome\": %d}, "
+      "\"messages_per_second\": {\"visit\": %g, \"contact_report\": %g, "
+      "\"infection_outcome\": %g}, "
+      "\"phase_seconds\": {\"agent\": %g, \"location\": %g, "
+      "\"observer\": %g}, \"dtlb_misses\": %d, "
+      "\"rss_bytes\": %d, \"output_bytes\": %d, \"eta_seconds\": %s}\n",
+      absl::ToUnixSeconds(snapshot.time), stats.steps, snapshot.total_steps,
+      snapshot.steps_per_second, stats.agent_updates,
+      snapshot.agent_updates_per_second, stats.visits, stats.contact_reports,
+      stats.infection_outcomes, snapshot.visits_per_second,
+      snapshot.contact_reports_per_second,
+      snapshot.infection_outcomes_per_second,
+      absl::ToDoubleSeconds(stats.agent_phase_time),
+      absl::ToDoubleSeconds(stats.location_phase_time),
+      absl::ToDoubleSeconds(stats.observer_phase_time), stats.dtlb_misses,
+      snapshot.rss_bytes, snapshot.output_bytes,
+      snapshot.eta == absl::InfiniteDuration()
+          ? "null"
+          : absl::StrCat(absl::ToDoubleSeconds(snapshot.eta)));
+}
+
+int64 GetRssBytes() {
+  FILE* const statm = std::fopen("/proc/self/statm", "r");
+  if (statm == nullptr) return 0;
+  long size_pages = 0;      // NOLINT: Matches the scanf format.
+  long resident_pages = 0;  // NOLINT
+  const int fields = std::fscanf(statm, "%ld %ld", &size_pages,
+                                 &resident_pages);
+  std::fclose(statm);
+  if (fields != 2) return 0;
+  return static_cast<int64>(resident_pages) * sysconf(_SC_PAGESIZE);
+}
+
+ProgressExporter::ProgressExporter(const Simulation* const simulation,
+                                   Options options)
+    : simulation_(simulation),
+      options_(std::move(options)),
+      start_time_(absl::Now()),
+      initial_stats_(simulation->GetStats()) {
+  last_.time = start_time_;
+  last_.total_steps = options_.total_steps;
+}
+
+ProgressExporter::~ProgressExporter() {
+  stop_.Notify();
+  if (server_ != nullptr) server_->join();
+}
+
+absl::Status ProgressExporter::Start() {
+  if (options_.http_port == 0) return absl::OkStatus();
+  const int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return absl::InternalError(absl::StrCat("socket: ", std::strerror(errno)));
+  }
+  const int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(options_.http_port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) ||
+      listen(fd, SOMAXCONN)) {
+    absl::Status status = absl::InternalError(absl::StrCat(
+        "Listening on port ", options_.http_port, ": ", std::strerror(errno)));
+    close(fd);
+    return status;
+  }
+  server_ = absl::make_unique<std::thread>([this, fd]() { Serve(fd); });
+  return absl::OkStatus();
+}
+
+void ProgressExporter::Serve(const int listen_fd) {
+  while (!stop_.HasBeenNotified()) {
+    pollfd poll_fd = {.fd = listen_fd, .events = POLLIN};
+    if (poll(&poll_fd, 1, kPollMillis) <= 0) continue;
+    const int fd = accept(listen_fd, nullptr, nullptr);
+    if (fd < 0) continue;
+    const timeval timeout = {.tv_sec = 1};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    std::string request;
+    char buffer[512];
+    while (request.size() < kMaxRequestBytes &&
+           !absl::StrContains(request, "\r\n\r\n")) {
+      const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0) break;
+      request.append(buffer, n);
+    }
+    const ProgressSnapshot snapshot = LastSnapshot();
+    if (absl::StartsWith(request, "GET /metrics")) {
+      SendResponse(fd, "text/plain; version=0.0.4", FormatPrometheus(snapshot));
+    } else {
+      SendResponse(fd, "application/json", FormatJson(snapshot));
+    }
+    close(fd);
+  }
+  close(listen_fd);
+}
+
+ProgressSnapshot ProgressExporter::TakeSnapshot() const {
+  ProgressSnapshot snapshot;
+  snapshot.time = absl::Now();
+  snapshot.stats = Subtract(simulation_->GetStats(), initial_stats_);
+  snapshot.total_steps = options_.total_steps;
+  const absl::Duration window = snapshot.time - last_.time;
+  const SimulationStats delta = Subtract(snapshot.stats, last_.stats);
+  snapshot.steps_per_second = Rate(delta.steps, window);
+  snapshot.agent_updates_per_second = Rate(delta.agent_updates, window);
+  snapshot.visits_per_second = Rate(delta.visits, window);
+  snapshot.contact_reports_per_second = Rate(delta.contact_reports, window);
+  snapshot.infection_outcomes_per_second =
+      Rate(delta.infection_outcomes, window);
+  snapshot.rss_bytes = GetRssBytes();
+  for (const std::string& output_file : options_.output_files) {
+    struct stat st;
+    if (stat(output_file.c_str(), &st) == 0) {
+      snapshot.output_bytes += st.st_size;
+    }
+  }
+  const int64 steps = snapshot.stats.steps;
+  if (steps >= options_.total_steps && options_.total_steps > 0) {
+    snapshot.eta = absl::ZeroDuration();
+  } else if (steps > 0 && options_.total_steps > 0) {
+    snapshot.eta = (snapshot.time - start_time_) / steps *
+                   (options_.total_steps - steps);
+  }
+  return snapshot;
+}
+
+void ProgressExporter::Export() {
+  ProgressSnapshot snapshot;
+  {
+    absl::MutexLock l(&mu_);
+    snapshot = TakeSnapshot();
+    last_ = snapshot;
+  }
+  for (const auto& [path, contents] :
+       {std::make_pair(options_.prometheus_path, FormatPrometheus(snapshot)),
+        std::make_pair(options_.json_path, FormatJson(snapshot))}) {
+    if (path.empty()) continue;
+    absl::Status status = WriteAtomically(path, contents);
+    if (!status.ok()) LOG(WARNING) << status;
+  }
+}
+
+ProgressSnapshot ProgressExporter::LastSnapshot() const {
+  absl::MutexLock l(&mu_);
+  return last_;
+}
+
+void ProgressExporter::Aggregate(
+    const Timestep& timestep,
+    absl::Span<std::unique_ptr<NullObserver> const> observers) {
+  const int64 steps = simulation_->GetStats().steps - initial_stats_.steps;
+  bool due;
+  {
+    absl::MutexLock l(&mu_);
+    due = absl::Now() - last_.time >= options_.interval ||
+          (options_.total_steps > 0 && steps >= options_.total_steps);
+  }
+  if (due) Export();
+}
+
+}  // namespace abesim
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_PROGRESS_EXPORTER_H_
+#define AGENT_BASED_EPIDEMIC_SIM_CORE_PROGRESS_EXPORTER_H_
+
+#include <memory>
+#include <string>
+#include <thread>  // NOLINT: Open source only.
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/core/timestep.h"
+
+namespace abesim {
+
+// The progress of a run at a point in time.  Rates are averaged over the time
+// since the previous snapshot.
+struct ProgressSnapshot {
+  absl::Time time;
+  // Counters since the start of the run.
+  SimulationStats stats;
+  int64 total_steps = 0;
+  double steps_per_second = 0;
+  double agent_updates_per_second = 0;
+  double visits_per_second = 0;
+  double contact_reports_per_second = 0;
+  double infection_outcomes_per_second = 0;
+  // Resident set size of the process.
+  int64 rss_bytes = 0;
+  // Total size of the run's output files.
+  int64 output_bytes = 0;
+  // Estimated time until total_steps are done, or InfiniteDuration if
+  // unknown.
+  absl::Duration eta = absl::InfiniteDuration();
+};
+
+// Formats snapshot in the Prometheus text exposition format, for use with the
+// node exporter's textfile collector.
+std::string FormatPrometheus(const ProgressSnapshot& snapshot);
+// Formats snapshot as a JSON object.
+std::string FormatJson(const ProgressSnapshot& snapshot);
+
+// Returns the resident set size of this process, or 0 if it is unknown.
+int64 GetRssBytes();
+
+// ProgressExporter needs no per-shard observers, so its observers are empty.
+struct NullObserver {};
+
+// ProgressExporter periodically publishes a ProgressSnapshot of a simulation.
+// Register it with that simulation to take a snapshot at the end of every
+// step; snapshots are published at most once every interval, and always after
+// the last step.  Other simulations running in the process are not counted.
+// Files are replaced atomically so that readers never see a partial snapshot.
+class ProgressExporter : public ObserverFactory<NullObserver> {
+ public:
+  struct Options {
+    // Files to write snapshots to.  Either may be empty.
+    std::string prometheus_path;
+    std::string json_path;
+    // Number of steps in the run, used to estimate the time left.
+    int64 total_steps = 0;
+    absl::Duration interval = absl::Seconds(30);
+    // Files whose sizes are reported as the output bytes written.
+    std::vector<std::string> output_files;
+    // If nonzero, the latest snapshot is also served over HTTP on this
+    // localhost port: /metrics in the Prometheus format, anything else as
+    // JSON.
+    int http_port = 0;
+  };
+
+  // simulation must outlive the exporter.
+  ProgressExporter(const Simulation* simulation, Options options);
+  ~ProgressExporter() override;
+
+  ProgressExporter(const ProgressExporter&) = delete;
+  ProgressExporter& operator=(const ProgressExporter&) = delete;
+
+  // Starts serving HTTP if options.http_port is set.
+  absl::Status Start();
+
+  // Takes a snapshot and publishes it.
+  void Export();
+  ProgressSnapshot LastSnapshot() const;
+
+  std::unique_ptr<NullObserver> MakeObserver(
+      const Timestep& timestep) const override {
+    return nullptr;
+  }
+  void Aggregate(
+      const Timestep& timestep,
+      absl::Span<std::unique_ptr<NullObserver> const> observers) override;
+
+ private:
+  ProgressSnapshot TakeSnapshot() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  void Serve(int listen_fd);
+
+  const Simulation* const simulation_;
+  const Options options_;
+  const absl::Time start_time_;
+  // The simulation's counters at the start of the run.
+  const SimulationStats initial_stats_;
+
+  mutable absl::Mutex mu_;
+  // The last snapshot published.
+  ProgressSnapshot last_ ABSL_GUARDED_BY(mu_);
+
+  absl::Notification stop_;
+  std::unique_ptr<std::thread> server_;
+};
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_CORE_PROGRESS_EXPORTER_H_
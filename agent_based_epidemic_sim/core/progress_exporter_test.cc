@@ -0,0 +1,160 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/progress_exporter.h"
+
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/port/file_utils.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "agent_based_epidemic_sim/util/test_util.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::HasSubstr;
+using testing::Not;
+
+ProgressSnapshot TestSnapshot() {
+  ProgressSnapshot snapshot;
+  snapshot.time = absl::FromUnixSeconds(1600000000);
+  snapshot.stats = {.steps = 5,
+                    .agent_updates = 500,
+                    .visits = 1000,
+                    .contact_reports = 20,
+                    .infection_outcomes = 900,
+                    .agent_phase_time = absl::Seconds(2),
+                    .location_phase_time = absl::Seconds(3),
+                    .observer_phase_time = absl::Milliseconds(500),
+                    .dtlb_misses = 7000};
+  snapshot.total_steps = 10;
+  snapshot.steps_per_second = 0.5;
+  snapshot.rss_bytes = 4096;
+  snapshot.output_bytes = 123;
+  snapshot.eta = absl::Seconds(10);
+  return snapshot;
+}
+
+TEST(ProgressExporterTest, FormatsPrometheus) {
+  const std::string text = FormatPrometheus(TestSnapshot());
+  EXPECT_THAT(text, HasSubstr("# TYPE abesim_steps_total counter\n"));
+  EXPECT_THAT(text, HasSubstr("\nabesim_steps_total 5\n"));
+  EXPECT_THAT(text, HasSubstr("\nabesim_total_steps 10\n"));
+  EXPECT_THAT(text, HasSubstr("\nabesim_steps_per_second 0.5\n"));
+  EXPECT_THAT(text,
+              HasSubstr("\nabesim_messages_total{type=\"visit\"} 1000\n"));
+  EXPECT_THAT(text,
+              HasSubstr("abesim_phase_seconds_total{phase=\"location\"} 3\n"));
+  EXPECT_THAT(text, HasSubstr("\nabesim_dtlb_misses_total 7000\n"));
+  EXPECT_THAT(text, HasSubstr("\nabesim_output_bytes 123\n"));
+  EXPECT_THAT(text, HasSubstr("\nabesim_eta_seconds 10\n"));
+
+  ProgressSnapshot unknown_eta = TestSnapshot();
+  unknown_eta.eta = absl::InfiniteDuration();
+  EXPECT_THAT(FormatPrometheus(unknown_eta), Not(HasSubstr("eta")));
+}
+
+TEST(ProgressExporterTest, FormatsJson) {
+  const std::string json = FormatJson(TestSnapshot());
+  EXPECT_THAT(json, HasSubstr("\"steps\": 5, \"total_steps\": 10"));
+  EXPECT_THAT(json, HasSubstr("\"contact_report\": 20"));
+  EXPECT_THAT(json, HasSubstr("\"observer\": 0.5}, \"dtlb_misses\": 7000"));
+  EXPECT_THAT(json, HasSubstr("\"eta_seconds\": 10}"));
+
+  ProgressSnapshot unknown_eta = TestSnapshot();
+  unknown_eta.eta = absl::InfiniteDuration();
+  EXPECT_THAT(FormatJson(unknown_eta), HasSubstr("\"eta_seconds\": null}"));
+}
+
+TEST(ProgressExporterTest, ReportsRss) { EXPECT_GT(GetRssBytes(), 0); }
+
+// Returns a simulation of one agent and one location.
+std::unique_ptr<Simulation> MakeSimulation() {
+  std::vector<std::unique_ptr<Agent>> agents;
+  agents.push_back(absl::make_unique<testing::NiceMock<MockAgent>>());
+  std::vector<std::unique_ptr<Location>> locations;
+  locations.push_back(absl::make_unique<testing::NiceMock<MockLocation>>());
+  return SerialSimulation(absl::UnixEpoch(), std::move(agents),
+                          std::move(locations));
+}
+
+TEST(ProgressExporterTest, ExportsAfterLastStep) {
+  const std::string dir = getenv("TEST_TMPDIR");
+  const std::string output_file = absl::StrCat(dir, "/progress_output");
+  {
+    auto writer = file::OpenOrDie(output_file, /*fail_if_file_exists=*/false);
+    PANDEMIC_ASSERT_OK(writer->WriteString("0123456789"));
+    PANDEMIC_ASSERT_OK(writer->Close());
+  }
+  ProgressExporter::Options options = {
+      .prometheus_path = absl::StrCat(dir, "/progress.prom"),
+      .json_path = absl::StrCat(dir, "/progress.json"),
+      .total_steps = 3,
+      .interval = absl::InfiniteDuration(),
+      .output_files = {output_file},
+  };
+  auto sim = MakeSimulation();
+  ProgressExporter exporter(sim.get(), options);
+  PANDEMIC_ASSERT_OK(exporter.Start());
+  sim->AddObserverFactory(&exporter);
+
+  sim->Step(2, absl::Hours(24));
+  EXPECT_EQ(exporter.LastSnapshot().stats.steps, 0);
+  sim->Step(1, absl::Hours(24));
+  const ProgressSnapshot snapshot = exporter.LastSnapshot();
+  EXPECT_EQ(snapshot.stats.steps, 3);
+  EXPECT_EQ(snapshot.stats.agent_updates, 3);
+  EXPECT_EQ(snapshot.output_bytes, 10);
+  EXPECT_EQ(snapshot.eta, absl::ZeroDuration());
+
+  std::string prometheus;
+  PANDEMIC_ASSERT_OK(file::GetContents(options.prometheus_path, &prometheus));
+  EXPECT_THAT(prometheus, HasSubstr("\nabesim_steps_total 3\n"));
+  std::string json;
+  PANDEMIC_ASSERT_OK(file::GetContents(options.json_path, &json));
+  EXPECT_THAT(json, HasSubstr("\"steps\": 3,"));
+  struct stat st;
+  EXPECT_NE(stat(absl::StrCat(options.json_path, ".tmp").c_str(), &st), 0);
+}
+
+TEST(ProgressExporterTest, CountsOnlyItsSimulation) {
+  auto sim = MakeSimulation();
+  auto other_sim = MakeSimulation();
+  ProgressExporter exporter(sim.get(), {.total_steps = 2});
+  sim->AddObserverFactory(&exporter);
+
+  other_sim->Step(3, absl::Hours(24));
+  sim->Step(1, absl::Hours(24));
+  EXPECT_EQ(exporter.LastSnapshot().stats.steps, 0);
+  sim->Step(1, absl::Hours(24));
+  const ProgressSnapshot snapshot = exporter.LastSnapshot();
+  EXPECT_EQ(snapshot.stats.steps, 2);
+  EXPECT_EQ(snapshot.stats.agent_updates, 2);
+}
+
+}  // namespace
+}  // namespace abesim
@@ -21,11 +21,11 @@
 #include "absl/meta/type_traits.h"
 #include "absl/random/distributions.h"
 #include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/bulk_random.h"
 #include "agent_based_epidemic_sim/core/enum_indexed_array.h"
 #include "agent_based_epidemic_sim/core/event.h"
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
 #include "agent_based_epidemic_sim/core/ptts_transition_model.pb.h"
-#include "agent_based_epidemic_sim/core/random.h"
 
 namespace abesim {
 
@@ -70,7 +70,7 @@ std::unique_ptr<TransitionModel> PTTSTransitionModel::CreateFromProto(
 
 HealthTransition PTTSTransitionModel::GetNextHealthTransition(
     const HealthTransition& latest_transition) {
-  absl::BitGenRef gen = GetBitGen();
+  BulkRandom& gen = GetBulkRandom();
   auto edge = std::lower_bound(
       edges_.begin(), edges_.end(), latest_transition.health_state,
       [](const Edge& e, const HealthState::State& s) { return e.src < s; });
@@ -15,6 +15,7 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_RISK_SCORE_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_RISK_SCORE_H_
 
+#include <limits>
 #include <memory>
 
 #include "absl/time/time.h"
@@ -69,11 +70,20 @@ class RiskScore {
   struct ContactTracingPolicy {
     bool report_recursively;
     bool send_report;
+    // When reporting recursively, the number of hops reports travel from this
+    // agent.  Direct contacts are one hop away.
+    int max_hops = 1;
+    // The most contact reports this agent forwards on behalf of other agents
+    // in a timestep.  Forwarding that does not fit is deferred to later
+    // timesteps.
+    int max_forwarded_reports_per_step = std::numeric_limits<int>::max();
 
     friend bool operator==(const ContactTracingPolicy& a,
                            const ContactTracingPolicy& b) {
       return (a.report_recursively == b.report_recursively &&
-              a.send_report == b.send_report);
+              a.send_report == b.send_report && a.max_hops == b.max_hops &&
+              a.max_forwarded_reports_per_step ==
+                  b.max_forwarded_reports_per_step);
     }
 
     friend bool operator!=(const ContactTracingPolicy& a,
@@ -85,7 +95,10 @@ class RiskScore {
         std::ostream& strm,
         const ContactTracingPolicy& contact_tracing_policy) {
       return strm << "{" << contact_tracing_policy.report_recursively << ", "
-                  << contact_tracing_policy.send_report << "}";
+                  << contact_tracing_policy.send_report << ", "
+                  << contact_tracing_policy.max_hops << ", "
+                  << contact_tracing_policy.max_forwarded_reports_per_step
+                  << "}";
     }
   };
   // Gets the policy to be used when sending contact reports.
@@ -95,6 +108,11 @@ class RiskScore {
   // Gets the duration for which to retain contacts.
   virtual absl::Duration ContactRetentionDuration() const = 0;
 
+  // Returns false if the agent's exposures can never be traced or observed,
+  // e.g. it does not use an exposure notification app, in which case agents
+  // do not retain them at all.
+  virtual bool RetainsExposures() const { return true; }
+
   // Gets the current risk score for the agent.
   virtual float GetRiskScore() const = 0;
 
@@ -109,6 +127,11 @@ class RiskScoreGenerator {
  public:
   // Get a policy for the next worker.
   virtual std::unique_ptr<RiskScore> NextRiskScore() = 0;
+  // Get a policy for the next worker that is owned by the generator and shared
+  // with other workers, or nullptr if the generator only produces per-worker
+  // policies.  A shared policy ignores all notifications, is safe to query
+  // from several threads at once, and must outlive the workers using it.
+  virtual RiskScore* NextSharedRiskScore() { return nullptr; }
   virtual ~RiskScoreGenerator() = default;
 };
 
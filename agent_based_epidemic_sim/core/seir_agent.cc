@@ -14,10 +14,13 @@
 
 #include "agent_based_epidemic_sim/core/seir_agent.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iterator>
 #include <memory>
+#include <vector>
 
+#include "absl/memory/memory.h"
 #include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/event.h"
@@ -97,9 +100,68 @@ std::unique_ptr<SEIRAgent> SEIRAgent::Create(
     std::unique_ptr<TransitionModel> transition_model,
     const VisitGenerator& visit_generator,
     std::unique_ptr<RiskScore> risk_score) {
+  RiskScore* const unowned_risk_score = risk_score.get();
   return absl::WrapUnique(new SEIRAgent(
       uuid, health_transition, transmission_model, infectivity_model,
-      std::move(transition_model), visit_generator, std::move(risk_score)));
+      std::move(transition_model), visit_generator, std::move(risk_score),
+      unowned_risk_score));
+}
+
+/* static */
+std::unique_ptr<SEIRAgent> SEIRAgent::CreateWithSharedRiskScore(
+    const int64 uuid, const HealthTransition& health_transition,
+    TransmissionModel* transmission_model,
+    const InfectivityModel* infectivity_model,
+    std::unique_ptr<TransitionModel> transition_model,
+    const VisitGenerator& visit_generator, RiskScore* const risk_score) {
+  return absl::WrapUnique(new SEIRAgent(
+      uuid, health_transition, transmission_model, infectivity_model,
+      std::move(transition_model), visit_generator, nullptr, risk_score));
+}
+
+/* static */
+std::unique_ptr<SEIRAgent> SEIRAgent::CreateCohort(
+    const int64 uuid, TransmissionModel* transmission_model,
+    const InfectivityModel* infectivity_model,
+    std::unique_ptr<TransitionModel> transition_model,
+    const VisitGenerator& visit_generator,
+    std::unique_ptr<RiskScore> risk_score, Cohort cohort) {
+  CHECK(cohort.weight == 1 || cohort.risk_score_factory != nullptr)
+      << "Cohort of agent " << uuid << " cannot build split agents.";
+  std::unique_ptr<SEIRAgent> agent = CreateSusceptible(
+      uuid, transmission_model, infectivity_model, std::move(transition_model),
+      visit_generator, std::move(risk_score));
+  agent->SetCohort(std::move(cohort));
+  return agent;
+}
+
+/* static */
+std::unique_ptr<SEIRAgent> SEIRAgent::CreateCohortWithSharedRiskScore(
+    const int64 uuid, TransmissionModel* transmission_model,
+    const InfectivityModel* infectivity_model,
+    std::unique_ptr<TransitionModel> transition_model,
+    const VisitGenerator& visit_generator, RiskScore* const risk_score,
+    Cohort cohort) {
+  std::unique_ptr<SEIRAgent> agent = CreateWithSharedRiskScore(
+      uuid,
+      {.time = absl::InfiniteFuture(),
+       .health_state = HealthState::SUSCEPTIBLE},
+      transmission_model, infectivity_model, std::move(transition_model),
+      visit_generator, risk_score);
+  agent->SetCohort(std::move(cohort));
+  return agent;
+}
+
+void SEIRAgent::SetCohort(Cohort cohort) {
+  CHECK_GE(cohort.weight, 1) << "Cohort of agent " << uuid_ << " is empty.";
+  CHECK_LE(cohort.weight, kMaxVisitWeight)
+      << "Cohort of agent " << uuid_ << " is too large for its visits.";
+  if (cohort.weight == 1) return;
+  CHECK(cohort.transition_model_factory != nullptr)
+      << "Cohort of agent " << uuid_ << " cannot build split agents.";
+  const int64 last_uuid = uuid_ + cohort.weight - 1;
+  Live().cohort = absl::WrapUnique(new CohortState{
+      .cohort = std::move(cohort), .next_split_uuid = last_uuid});
 }
 
 void SEIRAgent::SplitAndAssignHealthStates(std::vector<Visit>* visits) const {
@@ -134,51 +196,148 @@ void SEIRAgent::SplitAndAssignHealthStates(std::vector<Visit>* visits) const {
   }
 }
 
-void SEIRAgent::SeedInfection(const absl::Time time) {
+const SEIRAgent::LiveState& SEIRAgent::live() const {
+  if (live_ != nullptr) return *live_;
+  static const LiveState* const kFrozen = new LiveState{
+      .next_health_transition = {.time = absl::InfiniteFuture(),
+                                 .health_state = HealthState::REMOVED}};
+  return *kFrozen;
+}
+
+SEIRAgent::LiveState& SEIRAgent::Live() {
+  if (live_ == nullptr) {
+    live_ = absl::make_unique<LiveState>();
+    live_->next_health_transition = {.time = absl::InfiniteFuture(),
+                                      .health_state = CurrentHealthState()};
+  }
+  return *live_;
+}
+
+bool SEIRAgent::SeedInfection(const absl::Time time) {
+  if (weight() > 1) return false;
   SetNextHealthTransition({
       .time = time,
       .health_state = HealthState::EXPOSED,
   });
   UpdateHealthTransition(Timestep(time, absl::Seconds(1LL)));
+  return true;
 }
 
 void SEIRAgent::UpdateHealthTransition(const Timestep& timestep) {
-  const absl::Time original_transition_time = next_health_transition_.time;
-  if (IsInfectedState(next_health_transition_.health_state) &&
+  HealthTransition& next_health_transition = Live().next_health_transition;
+  const absl::Time original_transition_time = next_health_transition.time;
+  if (IsInfectedState(next_health_transition.health_state) &&
       !initial_infection_time_.has_value()) {
     initial_infection_time_ = original_transition_time;
   }
-  if (IsSymptomaticState(next_health_transition_.health_state) &&
+  if (IsSymptomaticState(next_health_transition.health_state) &&
       !initial_symptom_onset_time_.has_value()) {
     initial_symptom_onset_time_ = original_transition_time;
   }
-  health_transitions_.push_back(next_health_transition_);
-  risk_score_->AddHealthStateTransistion(next_health_transition_);
-  next_health_transition_ =
-      transition_model_->GetNextHealthTransition(next_health_transition_);
+  health_transitions_.push_back(next_health_transition);
+  risk_score_->AddHealthStateTransistion(next_health_transition);
+  CHECK(live_->transition_model != nullptr)
+      << "Agent " << uuid_ << " left a terminal health state.";
+  next_health_transition =
+      live_->transition_model->GetNextHealthTransition(next_health_transition);
   absl::Duration health_state_duration =
-      next_health_transition_.time - original_transition_time;
+      next_health_transition.time - original_transition_time;
   if (health_state_duration < timestep.duration()) {
     // TODO: Clean up enforcement of minimums/maximums on dwell times,
     // particularly for long-running (recurrent) states like SUSCEPTIBLE.
-    next_health_transition_.time =
+    next_health_transition.time =
         original_transition_time + timestep.duration();
   }
 }
 
 void SEIRAgent::MaybeUpdateHealthTransitions(const Timestep& timestep) {
-  while (next_health_transition_.time < timestep.end_time()) {
+  while (NextHealthTransition().time < timestep.end_time()) {
     UpdateHealthTransition(timestep);
   }
 }
 
+void SEIRAgent::MaybeFreeze() {
+  const HealthState::State state = CurrentHealthState();
+  if (frozen() ||
+      (state != HealthState::RECOVERED && state != HealthState::REMOVED) ||
+      live_->next_health_transition.time != absl::InfiniteFuture()) {
+    return;
+  }
+  // The transition model is never consulted again.
+  live_->transition_model.reset();
+  // The agent may still trace or be traced, so exposures are kept for as long
+  // as they are retained.
+  live_->exposures.Compact();
+  if (live_->exposures.size() > 0 || live_->forwarding != nullptr ||
+      live_->cohort != nullptr) {
+    return;
+  }
+  // Only the health history and the state of test reporting are left, which
+  // the agent keeps while frozen.
+  live_ = nullptr;
+  health_transitions_.shrink_to_fit();
+}
+
 void SEIRAgent::ComputeVisits(const Timestep& timestep,
                               Broker<Visit>* visit_broker) const {
   thread_local std::vector<Visit> visits;
   visits.clear();
   visit_generator_.GenerateVisits(timestep, *risk_score_, &visits);
   SplitAndAssignHealthStates(&visits);
+  const CohortState* cohort = live().cohort.get();
+  if (cohort != nullptr) {
+    for (Visit& visit : visits) visit.weight = weight();
+  }
+  CoalesceVisits(&visits);
   visit_broker->Send(visits);
+  // People that split off in this timestep are not yet known to the engine,
+  // so their visits are sent for them.  visits is reused by their calls.
+  if (cohort != nullptr) {
+    for (const std::unique_ptr<Agent>& agent : cohort->split_agents) {
+      agent->ComputeVisits(timestep, visit_broker);
+    }
+  }
+}
+
+void SEIRAgent::TakeSplitAgents(std::vector<std::unique_ptr<Agent>>* agents) {
+  if (frozen()) return;
+  std::unique_ptr<CohortState>& cohort = live_->cohort;
+  if (cohort == nullptr || cohort->split_agents.empty()) return;
+  std::move(cohort->split_agents.begin(), cohort->split_agents.end(),
+            std::back_inserter(*agents));
+  cohort->split_agents.clear();
+}
+
+void SEIRAgent::SplitInfected(
+    const Timestep& timestep,
+    const absl::Span<const InfectionOutcome> infection_outcomes,
+    const HealthTransition& infection, const int infected) {
+  CohortState& cohort_state = *live_->cohort;
+  Cohort& cohort = cohort_state.cohort;
+  // The last person of the cohort is this agent itself.  People that split off
+  // are not registered with the transmission model, so they have no slot.
+  const int splits = std::min(infected, cohort.weight - 1);
+  for (int i = 0; i < splits; ++i) {
+    std::unique_ptr<SEIRAgent> person =
+        owned_risk_score_ == nullptr
+            ? CreateWithSharedRiskScore(
+                  cohort_state.next_split_uuid--, infection,
+                  transmission_model_, infectivity_model_,
+                  cohort.transition_model_factory(), visit_generator_,
+                  risk_score_)
+            : Create(cohort_state.next_split_uuid--, infection,
+                     transmission_model_, infectivity_model_,
+                     cohort.transition_model_factory(), visit_generator_,
+                     cohort.risk_score_factory());
+    if (person->risk_score_->RetainsExposures()) {
+      person->live_->exposures.AddExposures(infection_outcomes);
+    }
+    person->risk_score_->UpdateLatestTimestep(timestep);
+    person->MaybeUpdateHealthTransitions(timestep);
+    cohort_state.split_agents.push_back(std::move(person));
+  }
+  cohort.weight -= splits;
+  if (infected > splits) live_->next_health_transition = infection;
 }
 
 void SEIRAgent::UpdateContactReports(
@@ -199,23 +358,104 @@ void SEIRAgent::UpdateContactReports(
       };
   DCHECK(matches_uuid_fn(contact_reports))
       << "Found incorrect ContactReport uuid.";
+  ExpireTracedIndexAgents(timestep.start_time() -
+                          risk_score_->ContactRetentionDuration());
   for (const ContactReport& contact_report : contact_reports) {
-    exposures_.ProcessNotification(
-        contact_report, [this, &contact_report](const Exposure& exposure) {
-          risk_score_->AddExposureNotification(exposure, contact_report);
-        });
+    // A frozen agent has no exposures to be notified of.
+    if (!frozen()) {
+      live_->exposures.ProcessNotification(
+          contact_report, [this, &contact_report](const Exposure& exposure) {
+            risk_score_->AddExposureNotification(exposure, contact_report);
+          });
+    }
+    if (contact_report.hops_remaining > 0) {
+      QueueForwarding(timestep, contact_report);
+    }
   }
   SendContactReports(timestep, broker);
 }
 
+void SEIRAgent::QueueForwarding(const Timestep& timestep,
+                                const ContactReport& report) {
+  // The report has come back around to the index case.
+  if (report.index_agent_uuid == uuid()) return;
+  std::unique_ptr<ForwardingState>& forwarding = Live().forwarding;
+  if (forwarding == nullptr) {
+    forwarding = absl::make_unique<ForwardingState>();
+  }
+  const bool inserted =
+      forwarding->traced_index_agents
+          .emplace(report.index_agent_uuid, timestep.start_time())
+          .second;
+  if (inserted) forwarding->frontier.push_back(report);
+}
+
+void SEIRAgent::ExpireTracedIndexAgents(
+    const absl::Time earliest_retained_time) {
+  if (frozen() || live_->forwarding == nullptr) return;
+  std::unique_ptr<ForwardingState>& forwarding = live_->forwarding;
+  auto& traced = forwarding->traced_index_agents;
+  for (auto iter = traced.begin(); iter != traced.end();) {
+    if (iter->second < earliest_retained_time) {
+      traced.erase(iter++);
+    } else {
+      ++iter;
+    }
+  }
+  if (traced.empty() && forwarding->frontier.empty()) forwarding = nullptr;
+}
+
+void SEIRAgent::ForwardContactReports(
+    const RiskScore::ContactTracingPolicy& policy,
+    std::vector<ContactReport>* contact_reports) {
+  if (frozen() || live_->forwarding == nullptr ||
+      live_->forwarding->frontier.empty()) {
+    return;
+  }
+  // Each queued report is forwarded to all contacts at once, so the fanout of
+  // a timestep may exceed the limit by the contacts of one report.
+  std::vector<ContactReport>& frontier = live_->forwarding->frontier;
+  const ExposureStore& exposures = live_->exposures;
+  int64 forwarded = 0;
+  auto next = frontier.begin();
+  for (; next != frontier.end() &&
+         forwarded < policy.max_forwarded_reports_per_step;
+       ++next) {
+    const ContactReport& received = *next;
+    exposures.PerAgent(absl::InfinitePast(), [this, &received,
+                                              contact_reports,
+                                              &forwarded](const int64 uuid) {
+      // Both have already seen a report from this index case.
+      if (uuid == received.from_agent_uuid ||
+          uuid == received.index_agent_uuid) {
+        return;
+      }
+      contact_reports->push_back({
+          .from_agent_uuid = this->uuid(),
+          .to_agent_uuid = uuid,
+          .test_result = received.test_result,
+          .initial_symptom_onset_time = received.initial_symptom_onset_time,
+          .index_agent_uuid = received.index_agent_uuid,
+          .hop = received.hop + 1,
+          .hops_remaining = received.hops_remaining - 1,
+      });
+      ++forwarded;
+    });
+  }
+  frontier.erase(frontier.begin(), next);
+  if (frontier.empty()) frontier.shrink_to_fit();
+}
+
 void SEIRAgent::SendContactReports(const Timestep& timestep,
                                    Broker<ContactReport>* broker) {
   const RiskScore::ContactTracingPolicy& contact_tracing_policy =
       risk_score_->GetContactTracingPolicy(timestep);
-  if (contact_tracing_policy.report_recursively) {
-    LOG(DFATAL) << "Recursive contact tracing not yet supported.";
+  std::vector<ContactReport> contact_reports;
+  ForwardContactReports(contact_tracing_policy, &contact_reports);
+  if (!contact_tracing_policy.send_report) {
+    if (!contact_reports.empty()) broker->Send(contact_reports);
+    return;
   }
-  if (!contact_tracing_policy.send_report) return;
 
   const TestResult test_result = risk_score_->GetTestResult(timestep);
   if (test_result != last_test_result_sent_) {
@@ -223,19 +463,28 @@ void SEIRAgent::SendContactReports(const Timestep& timestep,
     last_test_result_sent_ = test_result;
   }
 
-  std::vector<ContactReport> contact_reports;
-  exposures_.PerAgent(contact_report_send_cutoff_,
-                      [this, &test_result, &contact_reports](const int64 uuid) {
-                        contact_reports.push_back({
-                            .from_agent_uuid = this->uuid(),
-                            .to_agent_uuid = uuid,
-                            .test_result = test_result,
-                            .initial_symptom_onset_time =
-                                initial_symptom_onset_time_.has_value()
-                                    ? initial_symptom_onset_time_
-                                    : test_result.time_requested,
-                        });
-                      });
+  // Reports from the index case may be forwarded by its contacts for the
+  // remaining hops.
+  const int32 hops_remaining =
+      contact_tracing_policy.report_recursively
+          ? std::max(contact_tracing_policy.max_hops - 1, 0)
+          : 0;
+  const ExposureStore& exposures = live().exposures;
+  exposures.PerAgent(contact_report_send_cutoff_, [this, &test_result,
+                                                   hops_remaining,
+                                                   &contact_reports](
+                                                      const int64 uuid) {
+    contact_reports.push_back({
+        .from_agent_uuid = this->uuid(),
+        .to_agent_uuid = uuid,
+        .test_result = test_result,
+        .initial_symptom_onset_time = initial_symptom_onset_time_.has_value()
+                                          ? initial_symptom_onset_time_
+                                          : test_result.time_requested,
+        .index_agent_uuid = hops_remaining > 0 ? this->uuid() : 0,
+        .hops_remaining = hops_remaining,
+    });
+  });
   contact_report_send_cutoff_ = timestep.start_time();
   broker->Send(contact_reports);
 }
@@ -248,7 +497,7 @@ absl::Duration SEIRAgent::DurationSinceFirstInfection(
   return -1.0 * absl::InfiniteDuration();
 }
 
-void SEIRAgent::ProcessInfectionOutcomes(
+void SEIRAgent::RecordInfectionOutcomes(
     const Timestep& timestep,
     const absl::Span<const InfectionOutcome> infection_outcomes) {
   auto matches_uuid_fn =
@@ -269,25 +518,63 @@ void SEIRAgent::ProcessInfectionOutcomes(
 
   const absl::Time earliest_retained_contact_time =
       timestep.start_time() - risk_score_->ContactRetentionDuration();
-  exposures_.GarbageCollect(earliest_retained_contact_time);
-  exposures_.AddExposures(infection_outcomes);
-
-  std::vector<const Exposure*> exposures;
-  exposures.reserve(infection_outcomes.size());
-  for (const InfectionOutcome& infection_outcome : infection_outcomes) {
-    exposures.push_back(&infection_outcome.exposure);
+  if (!frozen()) {
+    live_->exposures.GarbageCollect(earliest_retained_contact_time);
+  }
+  if (risk_score_->RetainsExposures() && !infection_outcomes.empty()) {
+    Live().exposures.AddExposures(infection_outcomes);
   }
   risk_score_->UpdateLatestTimestep(timestep);
+}
 
-  if (next_health_transition_.health_state == HealthState::SUSCEPTIBLE &&
-      !exposures.empty()) {
-    const HealthTransition health_transition =
-        transmission_model_->GetInfectionOutcome(exposures);
-    if (health_transition.health_state == HealthState::EXPOSED) {
-      next_health_transition_ = health_transition;
+void SEIRAgent::ProcessInfectionOutcomes(
+    const Timestep& timestep,
+    const absl::Span<const InfectionOutcome> infection_outcomes) {
+  RecordInfectionOutcomes(timestep, infection_outcomes);
+
+  if (NextHealthTransition().health_state == HealthState::SUSCEPTIBLE &&
+      !infection_outcomes.empty()) {
+    std::vector<const Exposure*> exposures;
+    exposures.reserve(infection_outcomes.size());
+    for (const InfectionOutcome& infection_outcome : infection_outcomes) {
+      exposures.push_back(&infection_outcome.exposure);
     }
+    if (weight() > 1) {
+      HealthTransition infection;
+      const int infected = transmission_model_->GetWeightedInfectionOutcome(
+          transmission_slot_, exposures, weight(), &infection);
+      if (infected > 0) {
+        SplitInfected(timestep, infection_outcomes, infection, infected);
+      }
+    } else {
+      const HealthTransition health_transition =
+          transmission_model_->GetHostInfectionOutcome(transmission_slot_,
+                                                       exposures);
+      if (health_transition.health_state == HealthState::EXPOSED) {
+        live_->next_health_transition = health_transition;
+      }
+    }
+  }
+  MaybeUpdateHealthTransitions(timestep);
+  MaybeFreeze();
+}
+
+void SEIRAgent::ProcessResolvedInfectionOutcomes(
+    const Timestep& timestep,
+    const absl::Span<const InfectionOutcome> infection_outcomes,
+    const HealthTransition& transmission_outcome) {
+  // Only susceptible agents are pending transmission, but an agent that has
+  // settled in a terminal state stays there whatever the outcome.
+  const bool susceptible =
+      NextHealthTransition().health_state == HealthState::SUSCEPTIBLE;
+  DCHECK(susceptible || frozen()) << "Agent " << uuid_ << " is not pending.";
+  RecordInfectionOutcomes(timestep, infection_outcomes);
+  if (susceptible &&
+      transmission_outcome.health_state == HealthState::EXPOSED) {
+    live_->next_health_transition = transmission_outcome;
   }
   MaybeUpdateHealthTransitions(timestep);
+  MaybeFreeze();
 }
 
 float SEIRAgent::CurrentInfectivity(const absl::Time& current_time) const {
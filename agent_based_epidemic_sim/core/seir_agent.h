@@ -18,8 +18,13 @@
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_SEIR_AGENT_H_
 
 #include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/agent.h"
@@ -28,6 +33,7 @@
 #include "agent_based_epidemic_sim/core/exposure_store.h"
 #include "agent_based_epidemic_sim/core/infectivity_model.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/paged_arena.h"
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
 #include "agent_based_epidemic_sim/core/risk_score.h"
 #include "agent_based_epidemic_sim/core/transition_model.h"
@@ -57,13 +63,59 @@ class SEIRAgent : public Agent {
       const VisitGenerator& visit_generator,
       std::unique_ptr<RiskScore> risk_score);
 
+  // Constructs an agent with a specified health state transition and an
+  // unowned risk score that may be shared with other agents.
+  static std::unique_ptr<SEIRAgent> CreateWithSharedRiskScore(
+      const int64 uuid, const HealthTransition& health_transition,
+      TransmissionModel* transmission_model,
+      const InfectivityModel* infectivity_model,
+      std::unique_ptr<TransitionModel> transition_model,
+      const VisitGenerator& visit_generator, RiskScore* risk_score);
+
+  // Describes a group of identical susceptible people simulated as a single
+  // agent.  Its people share their exposures.  Graph locations, where each
+  // person has their own contacts, scale the exposures of a cohort down to
+  // one person.
+  struct Cohort {
+    // The number of people.  They are given the uuids [uuid, uuid + weight),
+    // so no other agent may use those.
+    int weight = 1;
+    // Build the models of a person once it splits off the cohort.  The
+    // risk_score_factory is not used by cohorts with a shared risk score,
+    // whose people keep sharing it.
+    std::function<std::unique_ptr<TransitionModel>()> transition_model_factory;
+    std::function<std::unique_ptr<RiskScore>()> risk_score_factory;
+  };
+
+  // Constructs a SUSCEPTIBLE agent that stands for cohort.weight people.
+  // The agent's visits carry its weight, and the people that become infected
+  // split off as individual agents.  Once all but one are infected, the agent
+  // carries on as the remaining person.  Split agents keep the exposures that
+  // infected them, but the earlier exposures of the cohort stay with it.
+  static std::unique_ptr<SEIRAgent> CreateCohort(
+      const int64 uuid, TransmissionModel* transmission_model,
+      const InfectivityModel* infectivity_model,
+      std::unique_ptr<TransitionModel> transition_model,
+      const VisitGenerator& visit_generator,
+      std::unique_ptr<RiskScore> risk_score, Cohort cohort);
+
+  // As CreateCohort, but the cohort and the people that split off it use an
+  // unowned risk score that may be shared with other agents.
+  static std::unique_ptr<SEIRAgent> CreateCohortWithSharedRiskScore(
+      const int64 uuid, TransmissionModel* transmission_model,
+      const InfectivityModel* infectivity_model,
+      std::unique_ptr<TransitionModel> transition_model,
+      const VisitGenerator& visit_generator, RiskScore* risk_score,
+      Cohort cohort);
+
   SEIRAgent(const SEIRAgent&) = delete;
   SEIRAgent& operator=(const SEIRAgent&) = delete;
 
   int64 uuid() const override { return uuid_; }
 
   // Computes the set of visits that an agent will make in a given timestep and
-  // calculates health states for those visits.
+  // calculates health states for those visits.  Returns to a location are
+  // coalesced into one visit where possible.
   void ComputeVisits(const Timestep& timestep,
                      Broker<Visit>* visit_broker) const override;
 
@@ -79,6 +131,27 @@ class SEIRAgent : public Agent {
       const Timestep& timestep,
       absl::Span<const InfectionOutcome> infection_outcomes) override;
 
+  // Agents that stand for several people sample their infections themselves.
+  TransmissionModel* PendingTransmissionModel() const override {
+    return NextHealthTransition().health_state == HealthState::SUSCEPTIBLE &&
+                   weight() == 1
+               ? transmission_model_
+               : nullptr;
+  }
+
+  int TransmissionSlot() const override { return transmission_slot_; }
+
+  // Sets the slot under which the agent was registered with its
+  // TransmissionModel.
+  void SetTransmissionSlot(const int slot) { transmission_slot_ = slot; }
+
+  // Updates health state from infections whose transmission outcome has
+  // already been computed by PendingTransmissionModel().
+  void ProcessResolvedInfectionOutcomes(
+      const Timestep& timestep,
+      absl::Span<const InfectionOutcome> infection_outcomes,
+      const HealthTransition& transmission_outcome) override;
+
   HealthState::State CurrentHealthState() const override {
     return health_transitions_.back().health_state;
   }
@@ -93,15 +166,20 @@ class SEIRAgent : public Agent {
   }
 
   HealthTransition NextHealthTransition() const {
-    return next_health_transition_;
+    if (frozen()) {
+      return {.time = absl::InfiniteFuture(),
+              .health_state = CurrentHealthState()};
+    }
+    return live_->next_health_transition;
   }
 
   void SetNextHealthTransition(HealthTransition transition) {
-    next_health_transition_ = transition;
+    Live().next_health_transition = transition;
   }
 
-  // Seeds an infection starting at the specified time.
-  void SeedInfection(absl::Time time);
+  // Seeds an infection starting at the specified time.  A cohort of several
+  // people cannot be seeded.
+  bool SeedInfection(absl::Time time) override;
 
   std::optional<absl::Time> symptom_onset() const override {
     return initial_infection_time_;
@@ -110,7 +188,22 @@ class SEIRAgent : public Agent {
     return initial_infection_time_;
   }
 
-  const ExposureStore* exposure_store() const override { return &exposures_; }
+  const ExposureStore* exposure_store() const override {
+    return &live().exposures;
+  }
+
+  void TakeSplitAgents(std::vector<std::unique_ptr<Agent>>* agents) override;
+
+  int weight() const override {
+    const CohortState* cohort = live().cohort.get();
+    return cohort == nullptr ? 1 : cohort->cohort.weight;
+  }
+
+  // Whether the agent has settled in a health state it can never leave and
+  // holds no state beyond its health history and test reporting.  A frozen
+  // agent is rehydrated as soon as it needs to retain an exposure or forward a
+  // report.
+  bool frozen() const { return live_ == nullptr; }
 
   static const InfectivityModel* default_infectivity_model();
 
@@ -120,7 +213,7 @@ class SEIRAgent : public Agent {
             const InfectivityModel* infectivity_model,
             std::unique_ptr<TransitionModel> transition_model,
             const VisitGenerator& visit_generator,
-            std::unique_ptr<RiskScore> risk_score)
+            std::unique_ptr<RiskScore> owned_risk_score, RiskScore* risk_score)
       : uuid_(uuid),
         contact_report_send_cutoff_(absl::InfinitePast()),
         last_test_result_sent_({
@@ -128,12 +221,14 @@ class SEIRAgent : public Agent {
             .time_received = absl::InfiniteFuture(),
             .outcome = TestOutcome::NEGATIVE,
         }),
+        live_(absl::make_unique<LiveState>()),
         transmission_model_(transmission_model),
         infectivity_model_(infectivity_model),
-        transition_model_(std::move(transition_model)),
         visit_generator_(visit_generator),
-        risk_score_(std::move(risk_score)) {
-    next_health_transition_ = initial_health_transition;
+        owned_risk_score_(std::move(owned_risk_score)),
+        risk_score_(risk_score) {
+    live_->next_health_transition = initial_health_transition;
+    live_->transition_model = std::move(transition_model);
     health_transitions_.push_back({.time = absl::InfinitePast(),
                                    .health_state = HealthState::SUSCEPTIBLE});
     risk_score_->AddHealthStateTransistion(health_transitions_.back());
@@ -145,9 +240,27 @@ class SEIRAgent : public Agent {
   // Samples a new HealthTransition and advances the health state.
   void UpdateHealthTransition(const Timestep& timestep);
 
+  // Retains the given infection outcomes for contact tracing and informs the
+  // risk score of the new timestep.
+  void RecordInfectionOutcomes(
+      const Timestep& timestep,
+      absl::Span<const InfectionOutcome> infection_outcomes);
+
+  // Makes the agent stand for cohort.weight people.
+  void SetCohort(Cohort cohort);
+
+  // Splits the given number of newly infected people off the cohort.
+  void SplitInfected(const Timestep& timestep,
+                     absl::Span<const InfectionOutcome> infection_outcomes,
+                     const HealthTransition& infection, int infected);
+
   // Conditionally advances the health state transitions.
   void MaybeUpdateHealthTransitions(const Timestep& timestep);
 
+  // Shrinks the state of an agent that has reached a health state it can
+  // never leave, and freezes it once nothing but its history is left.
+  void MaybeFreeze();
+
   // Splits visits on HealthTransition boundaries so that a unique HealthState
   // can be assigned to each visit.
   void SplitAndAssignHealthStates(std::vector<Visit>* visits) const;
@@ -155,21 +268,33 @@ class SEIRAgent : public Agent {
   void SendContactReports(const Timestep& timestep,
                           Broker<ContactReport>* broker);
 
+  // Queues report to be forwarded to this agent's contacts, unless a report
+  // from the same index case has been queued within the contact retention
+  // window.
+  void QueueForwarding(const Timestep& timestep, const ContactReport& report);
+  // Forgets the index cases queued before earliest_retained_time, along with
+  // the exposures that their reports were forwarded to.
+  void ExpireTracedIndexAgents(absl::Time earliest_retained_time);
+  // Forwards queued reports to this agent's retained contacts, within the
+  // fanout allowed by policy.
+  void ForwardContactReports(
+      const RiskScore::ContactTracingPolicy& policy,
+      std::vector<ContactReport>* contact_reports);
+
   absl::Duration DurationSinceFirstInfection(
       const absl::Time& current_time) const;
 
   const int64 uuid_;
   // The health state changes this agent has observed. Ordered in chronological
   // order. Note that the next pending state transition is stored in
-  // next_health_transition for ease of notation.
-  // TODO: Implement state persistence and clean up.
-  std::vector<HealthTransition> health_transitions_;
-  HealthTransition next_health_transition_;
+  // LiveState::next_health_transition for ease of notation.  The whole history
+  // is kept, since observers report it, but it is shrunk to fit once the agent
+  // freezes.  It grows over the run, so it is paged with the exposures.
+  std::vector<HealthTransition, PagedAllocator<HealthTransition>>
+      health_transitions_;
   absl::optional<absl::Time> initial_infection_time_;
   absl::optional<absl::Time> initial_symptom_onset_time_;
 
-  ExposureStore exposures_;
-
   // This is the last contact that we sent last_test_result_sent_ to.
   // Before we send any test results, or if we remove all considered contacts
   // last_contact_report_considered_ is set to contacts_.end() which is a
@@ -185,16 +310,60 @@ class SEIRAgent : public Agent {
   absl::Time contact_report_send_cutoff_;
   TestResult last_test_result_sent_;
 
+  // State for forwarding the reports of other agents when tracing
+  // recursively.  Most agents never forward a report, so it is only allocated
+  // when the first report that may be forwarded arrives.
+  struct ForwardingState {
+    // The index cases whose reports have been queued, and the start of the
+    // timestep each was queued in.
+    absl::flat_hash_map<int64, absl::Time> traced_index_agents;
+    // Reports waiting to be forwarded, oldest first.
+    std::vector<ContactReport> frontier;
+  };
+
+  // State of an agent that stands for several people, which only such agents
+  // allocate.
+  struct CohortState {
+    Cohort cohort;
+    // The uuid of the next person to split off.  People split off from the
+    // last uuid down, so the people left keep [uuid, uuid + weight).
+    int64 next_split_uuid;
+    // People that split off in the current timestep, until the engine takes
+    // them.
+    std::vector<std::unique_ptr<Agent>> split_agents;
+  };
+
+  // The state of an agent that may still change health state, hold exposures,
+  // forward reports or split people off.  Released when the agent freezes.
+  struct LiveState {
+    HealthTransition next_health_transition;
+    ExposureStore exposures;
+    std::unique_ptr<ForwardingState> forwarding;
+    std::unique_ptr<CohortState> cohort;
+    // TODO: It may be possible to share the transition_model. The
+    // visit_generator will likely be initialized uniquely for the agent, but
+    // may be shared among "equivalence" classes of agents.
+    // Released once the agent reaches a terminal state.
+    std::unique_ptr<TransitionModel> transition_model;
+  };
+  // Null while the agent is frozen.
+  std::unique_ptr<LiveState> live_;
+
+  // The live state, or for a frozen agent an empty one that stands for it.
+  // Its next_health_transition is not the agent's; use NextHealthTransition().
+  const LiveState& live() const;
+  // The live state, rehydrating the agent if it is frozen.
+  LiveState& Live();
+
   // Unowned (shared between agents at risk for the given disease).
   TransmissionModel* const transmission_model_;
+  int transmission_slot_ = kNoTransmissionSlot;
   const InfectivityModel* infectivity_model_;
 
-  // TODO: It may be possible to share the transition_model. The
-  // visit_generator will likely be initialized uniquely for the agent, but may
-  // be shared among "equivalence" classes of agents.
-  std::unique_ptr<TransitionModel> transition_model_;
   const VisitGenerator& visit_generator_;
-  std::unique_ptr<RiskScore> risk_score_;
+  // Null when the agent uses a risk score shared with other agents.
+  std::unique_ptr<RiskScore> owned_risk_score_;
+  RiskScore* const risk_score_;
 };
 
 }  // namespace abesim
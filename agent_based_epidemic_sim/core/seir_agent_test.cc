@@ -15,6 +15,7 @@
 #include "agent_based_epidemic_sim/core/seir_agent.h"
 
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/broker.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/event.h"
@@ -33,11 +34,15 @@ namespace abesim {
 namespace {
 
 using testing::_;
+using testing::AllOf;
+using testing::ElementsAre;
 using testing::Eq;
+using testing::Field;
 using testing::NotNull;
 using testing::Ref;
 using testing::Return;
 using testing::SetArgPointee;
+using testing::SizeIs;
 
 absl::Time TimeFromDayAndHour(const int day, const int hour) {
   return absl::UnixEpoch() + absl::Hours(24 * day + hour);
@@ -91,6 +96,8 @@ TEST(SEIRAgentTest, ComputesVisits) {
   EXPECT_CALL(*visit_generator,
               GenerateVisits(timestep, Ref(*risk_score), NotNull()))
       .WillOnce(SetArgPointee<2>(visits));
+  // Visits are sent by location.  None are coalesced, since the agent's health
+  // changes while it is away from home.
   std::vector<Visit> expected_visits{
       Visit{.location_uuid = 0LL,
             .agent_uuid = kUuid,
@@ -98,16 +105,22 @@ TEST(SEIRAgentTest, ComputesVisits) {
             .end_time = absl::FromUnixSeconds(28800LL),
             .health_state = HealthState::EXPOSED,
             .infectivity = 0},
+      Visit{.location_uuid = 0LL,
+            .agent_uuid = kUuid,
+            .start_time = absl::FromUnixSeconds(57600LL),
+            .end_time = absl::FromUnixSeconds(86400LL),
+            .health_state = HealthState::INFECTIOUS,
+            .infectivity = kInfectivityArray[0]},
       Visit{.location_uuid = 1LL,
             .agent_uuid = kUuid,
             .start_time = absl::FromUnixSeconds(28800LL),
             .end_time = absl::FromUnixSeconds(43200LL),
             .health_state = HealthState::EXPOSED,
             .infectivity = 0},
-      Visit{.location_uuid = 0LL,
+      Visit{.location_uuid = 1LL,
             .agent_uuid = kUuid,
-            .start_time = absl::FromUnixSeconds(57600LL),
-            .end_time = absl::FromUnixSeconds(86400LL),
+            .start_time = absl::FromUnixSeconds(43200LL),
+            .end_time = absl::FromUnixSeconds(57600LL),
             .health_state = HealthState::INFECTIOUS,
             .infectivity = kInfectivityArray[0]},
       Visit{.location_uuid = 1LL,
@@ -115,13 +128,7 @@ TEST(SEIRAgentTest, ComputesVisits) {
             .start_time = absl::FromUnixSeconds(86401LL),
             .end_time = absl::FromUnixSeconds(86402LL),
             .health_state = HealthState::INFECTIOUS,
-            .infectivity = kInfectivityArray[1]},
-      Visit{.location_uuid = 1LL,
-            .agent_uuid = kUuid,
-            .start_time = absl::FromUnixSeconds(43200LL),
-            .end_time = absl::FromUnixSeconds(57600LL),
-            .health_state = HealthState::INFECTIOUS,
-            .infectivity = kInfectivityArray[0]}};
+            .infectivity = kInfectivityArray[1]}};
   EXPECT_CALL(*visit_broker, Send(Eq(expected_visits)));
   auto agent = SEIRAgent::Create(
       kUuid,
@@ -162,6 +169,52 @@ TEST(SEIRAgentTest, InitializesSusceptibleState) {
   agent->ComputeVisits(timestep, visit_broker.get());
 }
 
+TEST(SEIRAgentTest, CoalescesReturnsToALocation) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  MockBroker<Visit> visit_broker;
+  MockTransmissionModel transmission_model;
+  auto risk_score = NewNullRiskScore();
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  // Home -> work -> home.
+  std::vector<Visit> visits{Visit{.location_uuid = 0LL,
+                                  .start_time = absl::FromUnixSeconds(0LL),
+                                  .end_time = absl::FromUnixSeconds(28800LL)},
+                            Visit{.location_uuid = 1LL,
+                                  .start_time = absl::FromUnixSeconds(28800LL),
+                                  .end_time = absl::FromUnixSeconds(64800LL)},
+                            Visit{.location_uuid = 0LL,
+                                  .start_time = absl::FromUnixSeconds(64800LL),
+                                  .end_time = absl::FromUnixSeconds(86400LL)}};
+  EXPECT_CALL(*visit_generator, GenerateVisits)
+      .WillOnce(SetArgPointee<2>(visits));
+  std::vector<Visit> sent;
+  EXPECT_CALL(visit_broker, Send)
+      .WillOnce([&sent](absl::Span<const Visit> msgs) {
+        sent.assign(msgs.begin(), msgs.end());
+      });
+  auto agent = SEIRAgent::CreateSusceptible(
+      42LL, &transmission_model, SEIRAgent::default_infectivity_model(),
+      std::move(transition_model), *visit_generator, std::move(risk_score));
+  agent->ComputeVisits(timestep, &visit_broker);
+
+  // The agent is home twice, which is sent as a single visit.
+  ASSERT_THAT(sent, SizeIs(2));
+  EXPECT_EQ(NumVisitStays(sent[0]), 2);
+  EXPECT_EQ(NumVisitStays(sent[1]), 1);
+  std::vector<Visit> stays;
+  ExpandVisitStays(sent, &stays);
+  ASSERT_THAT(stays, SizeIs(3));
+  const int order[] = {0, 2, 1};
+  for (int i = 0; i < stays.size(); ++i) {
+    const Visit& visit = visits[order[i]];
+    EXPECT_EQ(stays[i].location_uuid, visit.location_uuid);
+    EXPECT_EQ(stays[i].start_time, visit.start_time);
+    EXPECT_EQ(stays[i].end_time, visit.end_time);
+    EXPECT_EQ(stays[i].agent_uuid, 42);
+  }
+}
+
 TEST(SEIRAgentTest, InitializesNonSusceptibleState) {
   auto transition_model = absl::make_unique<MockTransitionModel>();
   auto visit_generator = absl::make_unique<MockVisitGenerator>();
@@ -293,6 +346,68 @@ TEST(SEIRAgentTest, RespectsTimestepBasedDwellTimeAndFiltersZeroIntervals) {
   agent->ComputeVisits(timestep, visit_broker.get());
 }
 
+TEST(SEIRAgentTest, FreezesAndRehydratesTerminalState) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  auto visit_broker = absl::make_unique<MockBroker<Visit>>();
+  MockTransmissionModel transmission_model;
+  EXPECT_CALL(*transition_model, GetNextHealthTransition)
+      .WillOnce(Return(HealthTransition{.time = absl::InfiniteFuture(),
+                                        .health_state = HealthState::REMOVED}));
+  const int64 kUuid = 42LL;
+  auto agent = SEIRAgent::Create(
+      kUuid,
+      {.time = TimeFromDayAndHour(0, 12), .health_state = HealthState::REMOVED},
+      &transmission_model, SEIRAgent::default_infectivity_model(),
+      std::move(transition_model), *visit_generator, NewNullRiskScore());
+
+  agent->ProcessInfectionOutcomes(Timestep(TimeFromDay(0), absl::Hours(24)),
+                                  {});
+  EXPECT_EQ(agent->HealthTransitions().size(), 2);
+  EXPECT_TRUE(agent->frozen());
+  EXPECT_EQ(agent->NextHealthTransition(),
+            (HealthTransition{.time = absl::InfiniteFuture(),
+                              .health_state = HealthState::REMOVED}));
+  EXPECT_EQ(agent->exposure_store()->size(), 0);
+
+  const Timestep timestep(TimeFromDay(1), absl::Hours(24));
+  const Contact contact = {
+      .other_uuid = 7LL,
+      .exposure = {.start_time = TimeFromDay(1), .duration = absl::Hours(1)}};
+  agent->ProcessInfectionOutcomes(timestep,
+                                  OutcomesFromContacts(kUuid, {contact}));
+  // Observers report the full history of terminal agents.
+  EXPECT_EQ(agent->HealthTransitions().size(), 2);
+  EXPECT_EQ(agent->HealthTransitions().back(),
+            (HealthTransition{.time = TimeFromDayAndHour(0, 12),
+                              .health_state = HealthState::REMOVED}));
+  // The exposure is retained for tracing.
+  EXPECT_FALSE(agent->frozen());
+  EXPECT_EQ(agent->exposure_store()->size(), 1);
+
+  std::vector<Visit> visits{Visit{.location_uuid = 0LL,
+                                  .start_time = TimeFromDay(1),
+                                  .end_time = TimeFromDay(2)}};
+  EXPECT_CALL(*visit_generator, GenerateVisits(timestep, _, NotNull()))
+      .WillOnce(SetArgPointee<2>(visits));
+  EXPECT_CALL(*visit_broker,
+              Send(Eq(std::vector<Visit>{
+                  Visit{.location_uuid = 0LL,
+                        .agent_uuid = kUuid,
+                        .start_time = TimeFromDay(1),
+                        .end_time = TimeFromDay(2),
+                        .health_state = HealthState::REMOVED,
+                        .infectivity = 0}})));
+  agent->ComputeVisits(timestep, visit_broker.get());
+
+  // The agent freezes again once the exposure is no longer retained.
+  agent->ProcessInfectionOutcomes(Timestep(TimeFromDay(2), absl::Hours(24)),
+                                  {});
+  EXPECT_TRUE(agent->frozen());
+  EXPECT_EQ(agent->exposure_store()->size(), 0);
+  EXPECT_EQ(agent->HealthTransitions().size(), 2);
+}
+
 TEST(SEIRAgentTest, ProcessesInfectionOutcomesIgnoresIfAlreadyExposed) {
   auto transition_model = absl::make_unique<MockTransitionModel>();
   EXPECT_CALL(*transition_model, GetNextHealthTransition(Eq(HealthTransition{
@@ -370,6 +485,146 @@ TEST(SEIRAgentTest, ProcessesInfectionOutcomesRemainsSusceptible) {
                                   .health_state = HealthState::SUSCEPTIBLE}));
 }
 
+TEST(SEIRAgentTest, ProcessesResolvedInfectionOutcomes) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  EXPECT_CALL(*transition_model, GetNextHealthTransition(Eq(HealthTransition{
+                                     .time = absl::FromUnixSeconds(-1LL),
+                                     .health_state = HealthState::EXPOSED})))
+      .WillOnce(
+          Return(HealthTransition{.time = absl::FromUnixSeconds(86400LL),
+                                  .health_state = HealthState::INFECTIOUS}));
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  MockTransmissionModel transmission_model;
+  EXPECT_CALL(transmission_model, GetInfectionOutcome(_)).Times(0);
+  auto risk_score = NewNullRiskScore();
+  const int64 kUuid = 42LL;
+
+  auto agent = SEIRAgent::CreateSusceptible(
+      kUuid, &transmission_model, SEIRAgent::default_infectivity_model(),
+      std::move(transition_model), *visit_generator, std::move(risk_score));
+  EXPECT_EQ(agent->PendingTransmissionModel(), &transmission_model);
+
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  std::vector<InfectionOutcome> infection_outcomes{
+      InfectionOutcome{.agent_uuid = kUuid,
+                       .exposure = {.start_time = absl::FromUnixSeconds(-1LL),
+                                    .infectivity = 1.0f},
+                       .exposure_type = InfectionOutcomeProto::CONTACT,
+                       .source_uuid = 2LL}};
+  agent->ProcessResolvedInfectionOutcomes(
+      timestep, infection_outcomes,
+      {.time = absl::FromUnixSeconds(-1LL),
+       .health_state = HealthState::EXPOSED});
+  EXPECT_EQ(agent->CurrentHealthState(), HealthState::EXPOSED);
+  EXPECT_EQ(agent->NextHealthTransition().time, absl::FromUnixSeconds(86400LL));
+  EXPECT_EQ(agent->PendingTransmissionModel(), nullptr);
+  EXPECT_EQ(agent->exposure_store()->size(), 1);
+}
+
+// A risk score whose exposures can never be traced.
+class UntracedRiskScore : public MockRiskScore {
+ public:
+  bool RetainsExposures() const override { return false; }
+};
+
+TEST(SEIRAgentTest, DoesNotRetainUntracedExposures) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  EXPECT_CALL(*transition_model, GetNextHealthTransition).Times(0);
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  MockTransmissionModel transmission_model;
+  auto risk_score = absl::make_unique<testing::NiceMock<UntracedRiskScore>>();
+  ON_CALL(*risk_score, ContactRetentionDuration())
+      .WillByDefault(Return(absl::Hours(24 * 14)));
+  const int64 kUuid = 42LL;
+
+  auto agent = SEIRAgent::CreateSusceptible(
+      kUuid, &transmission_model, SEIRAgent::default_infectivity_model(),
+      std::move(transition_model), *visit_generator, std::move(risk_score));
+
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  std::vector<InfectionOutcome> infection_outcomes{
+      InfectionOutcome{.agent_uuid = kUuid,
+                       .exposure = {.start_time = absl::FromUnixSeconds(-1LL),
+                                    .infectivity = 1.0f},
+                       .exposure_type = InfectionOutcomeProto::CONTACT,
+                       .source_uuid = 2LL}};
+  agent->ProcessResolvedInfectionOutcomes(
+      timestep, infection_outcomes,
+      {.time = absl::FromUnixSeconds(-1LL),
+       .health_state = HealthState::SUSCEPTIBLE});
+  EXPECT_EQ(agent->CurrentHealthState(), HealthState::SUSCEPTIBLE);
+  EXPECT_EQ(agent->exposure_store()->size(), 0);
+}
+
+// Returns a REMOVED agent that has frozen at the end of day 0 and does not
+// retain its exposures.
+std::unique_ptr<SEIRAgent> FrozenUntracedAgent(
+    const int64 uuid, TransmissionModel* transmission_model,
+    const VisitGenerator& visit_generator) {
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  EXPECT_CALL(*transition_model, GetNextHealthTransition)
+      .WillOnce(Return(HealthTransition{.time = absl::InfiniteFuture(),
+                                        .health_state = HealthState::REMOVED}));
+  auto risk_score = absl::make_unique<testing::NiceMock<UntracedRiskScore>>();
+  ON_CALL(*risk_score, ContactRetentionDuration())
+      .WillByDefault(Return(absl::Hours(24 * 14)));
+  auto agent = SEIRAgent::Create(
+      uuid,
+      {.time = TimeFromDayAndHour(0, 12), .health_state = HealthState::REMOVED},
+      transmission_model, SEIRAgent::default_infectivity_model(),
+      std::move(transition_model), visit_generator, std::move(risk_score));
+  agent->ProcessInfectionOutcomes(Timestep(TimeFromDay(0), absl::Hours(24)),
+                                  {});
+  return agent;
+}
+
+TEST(SEIRAgentTest, DoesNotInfectFrozenAgent) {
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  MockTransmissionModel transmission_model;
+  EXPECT_CALL(transmission_model, GetInfectionOutcome).Times(0);
+  const int64 kUuid = 42LL;
+  auto agent =
+      FrozenUntracedAgent(kUuid, &transmission_model, *visit_generator);
+  ASSERT_TRUE(agent->frozen());
+  EXPECT_EQ(agent->PendingTransmissionModel(), nullptr);
+
+  const Contact contact = {
+      .other_uuid = 7LL,
+      .exposure = {.start_time = TimeFromDay(1),
+                   .duration = absl::Hours(1),
+                   .infectivity = 1.0f}};
+  agent->ProcessInfectionOutcomes(Timestep(TimeFromDay(1), absl::Hours(24)),
+                                  OutcomesFromContacts(kUuid, {contact}));
+  EXPECT_TRUE(agent->frozen());
+  EXPECT_EQ(agent->CurrentHealthState(), HealthState::REMOVED);
+  EXPECT_EQ(agent->HealthTransitions().size(), 2);
+}
+
+TEST(SEIRAgentTest, IgnoresResolvedInfectionOfFrozenAgent) {
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  MockTransmissionModel transmission_model;
+  const int64 kUuid = 42LL;
+  auto agent =
+      FrozenUntracedAgent(kUuid, &transmission_model, *visit_generator);
+  ASSERT_TRUE(agent->frozen());
+
+  const Contact contact = {
+      .other_uuid = 7LL,
+      .exposure = {.start_time = TimeFromDay(1),
+                   .duration = absl::Hours(1),
+                   .infectivity = 1.0f}};
+  agent->ProcessResolvedInfectionOutcomes(
+      Timestep(TimeFromDay(1), absl::Hours(24)),
+      OutcomesFromContacts(kUuid, {contact}),
+      {.time = TimeFromDay(1), .health_state = HealthState::EXPOSED});
+  EXPECT_TRUE(agent->frozen());
+  EXPECT_EQ(agent->CurrentHealthState(), HealthState::REMOVED);
+  EXPECT_EQ(agent->NextHealthTransition(),
+            (HealthTransition{.time = absl::InfiniteFuture(),
+                              .health_state = HealthState::REMOVED}));
+  EXPECT_EQ(agent->HealthTransitions().size(), 2);
+}
+
 TEST(SEIRAgentTest, ProcessesInfectionOutcomesMultipleExposuresSameContact) {
   auto transition_model = absl::make_unique<MockTransitionModel>();
   EXPECT_CALL(*transition_model, GetNextHealthTransition).Times(0);
@@ -894,6 +1149,176 @@ TEST(SEIRAgentTest, SendContactReportsBeforeAndAfterSymptoms) {
   agent->UpdateContactReports(timestep2, {}, contact_report_broker.get());
 }
 
+TEST(SEIRAgentTest, ForwardsContactReportsRecursively) {
+  const int64 kUuid = 42LL;
+  const int64 kIndexUuid = 7LL;
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  testing::NiceMock<MockTransmissionModel> transmission_model;
+  auto risk_score = absl::make_unique<testing::NiceMock<MockRiskScore>>();
+  ON_CALL(*risk_score, ContactRetentionDuration())
+      .WillByDefault(Return(absl::Hours(24 * 14)));
+  ON_CALL(*risk_score, GetContactTracingPolicy(_))
+      .WillByDefault(Return(RiskScore::ContactTracingPolicy{}));
+  auto agent = SEIRAgent::CreateSusceptible(
+      kUuid, &transmission_model, SEIRAgent::default_infectivity_model(),
+      std::move(transition_model), *visit_generator, std::move(risk_score));
+
+  std::vector<Contact> contacts;
+  for (const int64 other_uuid : std::vector<int64>{12, 13, 14, kIndexUuid}) {
+    contacts.push_back({.other_uuid = other_uuid,
+                        .exposure = {.start_time = absl::UnixEpoch(),
+                                     .duration = absl::Hours(1)}});
+  }
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  agent->ProcessInfectionOutcomes(timestep,
+                                  OutcomesFromContacts(kUuid, contacts));
+
+  const TestResult test_result = {.time_requested = absl::UnixEpoch(),
+                                  .time_received = absl::UnixEpoch(),
+                                  .outcome = TestOutcome::POSITIVE};
+  auto report = [&](const int64 from_agent_uuid) {
+    return ContactReport{.from_agent_uuid = from_agent_uuid,
+                         .to_agent_uuid = kUuid,
+                         .test_result = test_result,
+                         .index_agent_uuid = kIndexUuid,
+                         .hop = 2,
+                         .hops_remaining = 1};
+  };
+  auto forwarded = [&](const int64 to_agent_uuid) {
+    return ContactReport{.from_agent_uuid = kUuid,
+                         .to_agent_uuid = to_agent_uuid,
+                         .test_result = test_result,
+                         .index_agent_uuid = kIndexUuid,
+                         .hop = 3,
+                         .hops_remaining = 0};
+  };
+  MockBroker<ContactReport> broker;
+  // Neither the sender nor the index case are sent the report again.
+  EXPECT_CALL(broker, Send(testing::UnorderedElementsAre(forwarded(13LL),
+                                                         forwarded(14LL))));
+  agent->UpdateContactReports(timestep, {report(12LL)}, &broker);
+  testing::Mock::VerifyAndClearExpectations(&broker);
+
+  // Later reports from the same index case are not forwarded.
+  EXPECT_CALL(broker, Send(_)).Times(0);
+  agent->UpdateContactReports(timestep, {report(13LL)}, &broker);
+  testing::Mock::VerifyAndClearExpectations(&broker);
+
+  // Once the contacts it was forwarded to have expired, the index case is
+  // forgotten and its reports reach the agent's new contacts.
+  const Timestep later(absl::UnixEpoch() + absl::Hours(24 * 15),
+                       absl::Hours(24));
+  agent->ProcessInfectionOutcomes(
+      later, OutcomesFromContacts(
+                 kUuid, {{.other_uuid = 15LL,
+                          .exposure = {.start_time = later.start_time(),
+                                       .duration = absl::Hours(1)}}}));
+  EXPECT_CALL(broker, Send(testing::ElementsAre(forwarded(15LL))));
+  agent->UpdateContactReports(later, {report(12LL)}, &broker);
+}
+
+TEST(SEIRAgentTest, LimitsForwardedContactReportsPerStep) {
+  const int64 kUuid = 42LL;
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  testing::NiceMock<MockTransmissionModel> transmission_model;
+  auto risk_score = absl::make_unique<testing::NiceMock<MockRiskScore>>();
+  ON_CALL(*risk_score, ContactRetentionDuration())
+      .WillByDefault(Return(absl::Hours(24 * 14)));
+  ON_CALL(*risk_score, GetContactTracingPolicy(_))
+      .WillByDefault(Return(RiskScore::ContactTracingPolicy{
+          .report_recursively = false,
+          .send_report = false,
+          .max_forwarded_reports_per_step = 1}));
+  auto agent = SEIRAgent::CreateSusceptible(
+      kUuid, &transmission_model, SEIRAgent::default_infectivity_model(),
+      std::move(transition_model), *visit_generator, std::move(risk_score));
+
+  std::vector<Contact> contacts;
+  for (const int64 other_uuid : std::vector<int64>{12, 13, 14}) {
+    contacts.push_back({.other_uuid = other_uuid,
+                        .exposure = {.start_time = absl::UnixEpoch(),
+                                     .duration = absl::Hours(1)}});
+  }
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  agent->ProcessInfectionOutcomes(timestep,
+                                  OutcomesFromContacts(kUuid, contacts));
+
+  const std::vector<ContactReport> reports = {
+      {.from_agent_uuid = 12LL,
+       .to_agent_uuid = kUuid,
+       .index_agent_uuid = 1LL,
+       .hops_remaining = 2},
+      {.from_agent_uuid = 13LL,
+       .to_agent_uuid = kUuid,
+       .index_agent_uuid = 2LL,
+       .hops_remaining = 2},
+  };
+  std::vector<ContactReport> sent;
+  MockBroker<ContactReport> broker;
+  EXPECT_CALL(broker, Send(_))
+      .Times(2)
+      .WillRepeatedly([&sent](absl::Span<const ContactReport> reports) {
+        sent.assign(reports.begin(), reports.end());
+      });
+
+  // The first report is forwarded in full, which uses up the fanout of the
+  // step, so the second is deferred to the next step.
+  agent->UpdateContactReports(timestep, reports, &broker);
+  EXPECT_EQ(sent.size(), 2);
+  for (const ContactReport& report : sent) {
+    EXPECT_EQ(report.index_agent_uuid, 1LL);
+    EXPECT_EQ(report.hop, 2);
+    EXPECT_EQ(report.hops_remaining, 1);
+  }
+  agent->UpdateContactReports(timestep, {}, &broker);
+  EXPECT_EQ(sent.size(), 2);
+  for (const ContactReport& report : sent) {
+    EXPECT_EQ(report.index_agent_uuid, 2LL);
+  }
+}
+
+TEST(SEIRAgentTest, SendsRecursiveContactReportsFromIndexCase) {
+  const int64 kUuid = 42LL;
+  auto transition_model = absl::make_unique<MockTransitionModel>();
+  auto visit_generator = absl::make_unique<MockVisitGenerator>();
+  testing::NiceMock<MockTransmissionModel> transmission_model;
+  auto risk_score = absl::make_unique<testing::NiceMock<MockRiskScore>>();
+  ON_CALL(*risk_score, ContactRetentionDuration())
+      .WillByDefault(Return(absl::Hours(24 * 14)));
+  ON_CALL(*risk_score, GetContactTracingPolicy(_))
+      .WillByDefault(Return(RiskScore::ContactTracingPolicy{
+          .report_recursively = true, .send_report = true, .max_hops = 3}));
+  const TestResult test_result = {.time_requested = absl::UnixEpoch(),
+                                  .time_received = absl::UnixEpoch(),
+                                  .outcome = TestOutcome::POSITIVE};
+  ON_CALL(*risk_score, GetTestResult(_)).WillByDefault(Return(test_result));
+  auto agent = SEIRAgent::CreateSusceptible(
+      kUuid, &transmission_model, SEIRAgent::default_infectivity_model(),
+      std::move(transition_model), *visit_generator, std::move(risk_score));
+
+  const std::vector<Contact> contacts = {
+      {.other_uuid = 12LL,
+       .exposure = {.start_time = absl::UnixEpoch(),
+                    .duration = absl::Hours(1)}}};
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  agent->ProcessInfectionOutcomes(timestep,
+                                  OutcomesFromContacts(kUuid, contacts));
+
+  MockBroker<ContactReport> broker;
+  const std::vector<ContactReport> expected_contact_reports = {
+      {.from_agent_uuid = kUuid,
+       .to_agent_uuid = 12LL,
+       .test_result = test_result,
+       .initial_symptom_onset_time = absl::UnixEpoch(),
+       .index_agent_uuid = kUuid,
+       .hop = 1,
+       .hops_remaining = 2}};
+  EXPECT_CALL(broker, Send(Eq(expected_contact_reports)));
+  agent->UpdateContactReports(timestep, {}, &broker);
+}
+
 TEST(SEIRAgentTest, UpdateContactReportsRejectsWrongUuid) {
   auto transition_model = absl::make_unique<MockTransitionModel>();
   auto visit_generator = absl::make_unique<MockVisitGenerator>();
@@ -938,5 +1363,82 @@ TEST(SEIRAgentTest, SeedsInfection) {
               testing::ElementsAreArray(expected_health_transitions));
 }
 
+TEST(SEIRAgentTest, SplitsInfectedPeopleOffCohort) {
+  auto transition_model_factory = []() -> std::unique_ptr<TransitionModel> {
+    auto transition_model = absl::make_unique<MockTransitionModel>();
+    ON_CALL(*transition_model, GetNextHealthTransition)
+        .WillByDefault(
+            Return(HealthTransition{.time = absl::InfiniteFuture(),
+                                    .health_state = HealthState::INFECTIOUS}));
+    return transition_model;
+  };
+  MockVisitGenerator visit_generator;
+  ON_CALL(visit_generator, GenerateVisits)
+      .WillByDefault(SetArgPointee<2>(std::vector<Visit>{
+          {.location_uuid = 7LL,
+           .start_time = TimeFromDayAndHour(0, 8),
+           .end_time = TimeFromDayAndHour(0, 16)}}));
+  MockTransmissionModel transmission_model;
+  const HealthTransition infection = {.time = absl::FromUnixSeconds(-1LL),
+                                      .health_state = HealthState::EXPOSED};
+  EXPECT_CALL(transmission_model, GetInfectionOutcome).Times(0);
+  EXPECT_CALL(transmission_model,
+              GetWeightedInfectionOutcome(_, _, 3, NotNull()))
+      .WillOnce(testing::DoAll(SetArgPointee<3>(infection), Return(1)));
+  EXPECT_CALL(transmission_model,
+              GetWeightedInfectionOutcome(_, _, 2, NotNull()))
+      .WillOnce(testing::DoAll(SetArgPointee<3>(infection), Return(2)));
+  const int64 kUuid = 100LL;
+  auto agent = SEIRAgent::CreateCohort(
+      kUuid, &transmission_model, SEIRAgent::default_infectivity_model(),
+      transition_model_factory(), visit_generator, NewNullRiskScore(),
+      {.weight = 3,
+       .transition_model_factory = transition_model_factory,
+       .risk_score_factory = NewNullRiskScore});
+  EXPECT_EQ(agent->weight(), 3);
+  EXPECT_EQ(agent->PendingTransmissionModel(), nullptr);
+
+  const Timestep timestep(absl::UnixEpoch(), absl::Hours(24));
+  const std::vector<InfectionOutcome> infection_outcomes{
+      {.agent_uuid = kUuid,
+       .exposure = {.start_time = absl::FromUnixSeconds(-1LL),
+                    .infectivity = 1.0f},
+       .exposure_type = InfectionOutcomeProto::CONTACT,
+       .source_uuid = 2LL}};
+  agent->ProcessInfectionOutcomes(timestep, infection_outcomes);
+  EXPECT_EQ(agent->weight(), 2);
+  EXPECT_EQ(agent->CurrentHealthState(), HealthState::SUSCEPTIBLE);
+
+  // The cohort sends the visits of the person that split off until the
+  // engine takes it.
+  MockBroker<Visit> visit_broker;
+  EXPECT_CALL(visit_broker,
+              Send(ElementsAre(
+                  AllOf(Field(&Visit::agent_uuid, kUuid),
+                        Field(&Visit::weight, 2)))));
+  EXPECT_CALL(visit_broker,
+              Send(ElementsAre(
+                  AllOf(Field(&Visit::agent_uuid, kUuid + 2),
+                        Field(&Visit::weight, 1),
+                        Field(&Visit::health_state, HealthState::EXPOSED)))));
+  agent->ComputeVisits(timestep, &visit_broker);
+  std::vector<std::unique_ptr<Agent>> split_agents;
+  agent->TakeSplitAgents(&split_agents);
+  ASSERT_THAT(split_agents, SizeIs(1));
+  EXPECT_EQ(split_agents[0]->uuid(), kUuid + 2);
+  EXPECT_EQ(split_agents[0]->CurrentHealthState(), HealthState::EXPOSED);
+  EXPECT_EQ(split_agents[0]->exposure_store()->size(), 1);
+
+  // Once everyone is infected the cohort carries on as its last person.
+  const Timestep next_timestep(TimeFromDay(1), absl::Hours(24));
+  agent->ProcessInfectionOutcomes(next_timestep, infection_outcomes);
+  EXPECT_EQ(agent->weight(), 1);
+  EXPECT_EQ(agent->CurrentHealthState(), HealthState::EXPOSED);
+  split_agents.clear();
+  agent->TakeSplitAgents(&split_agents);
+  ASSERT_THAT(split_agents, SizeIs(1));
+  EXPECT_EQ(split_agents[0]->uuid(), kUuid + 1);
+}
+
 }  // namespace
 }  // namespace abesim
@@ -15,20 +15,28 @@
 #include "agent_based_epidemic_sim/core/simulation.h"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
 #include <memory>
+#include <ostream>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/container/fixed_array.h"
-#include "absl/container/flat_hash_map.h"
 #include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/clock.h"
+#include "absl/types/optional.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/broker.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/huge_page_allocator.h"
 #include "agent_based_epidemic_sim/core/location.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/paged_arena.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
 #include "agent_based_epidemic_sim/port/executor.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
@@ -38,14 +46,216 @@ namespace {
 
 const int kWorkChunkSize = 4096;
 const int kPerThreadBrokerBuffer = kWorkChunkSize * 8;
+// Entities are sorted concurrently in runs of this many before the runs are
+// merged.
+const int kSortRunSize = kWorkChunkSize * 16;
+
+// Message queues can hold hundreds of millions of messages, so they are
+// backed by huge pages to reduce TLB misses while they are sorted and read.
+template <typename Msg>
+using MessageQueue = std::vector<Msg, HugePageAllocator<Msg>>;
+
+// The tables of agents and locations are walked every step, so they are
+// backed by huge pages as well.
+template <typename Entity>
+using EntityTable = std::vector<std::unique_ptr<Entity>,
+                                HugePageAllocator<std::unique_ptr<Entity>>>;
+
+// Counters behind Simulation::GetStats.
+struct AtomicSimulationStats {
+  std::atomic<int64> steps{0};
+  std::atomic<int64> agent_updates{0};
+  std::atomic<int64> visits{0};
+  std::atomic<int64> contact_reports{0};
+  std::atomic<int64> infection_outcomes{0};
+  std::atomic<int64> agent_phase_nanos{0};
+  std::atomic<int64> location_phase_nanos{0};
+  std::atomic<int64> observer_phase_nanos{0};
+  std::atomic<int64> dtlb_misses{0};
+};
+
+void AddTime(std::atomic<int64>& nanos, const absl::Duration duration) {
+  nanos.fetch_add(absl::ToInt64Nanoseconds(duration),
+                  std::memory_order_relaxed);
+}
+
+// Adds the data TLB misses of the calling thread since ThreadTlbMisses
+// returned start.
+void AddTlbMisses(std::atomic<int64>& misses, const int64 start) {
+  if (start < 0) return;
+  misses.fetch_add(ThreadTlbMisses() - start, std::memory_order_relaxed);
+}
+
+// A ContactNotification is the form in which ContactReports travel through
+// the message queues.  An agent typically sends the same report to all of its
+// contacts, so the payload of each report is stored once in a
+// ContactReportTable and notifications refer to it by shard and index.
+struct ContactNotification {
+  int64 from_agent_uuid;
+  int64 to_agent_uuid;
+  int32 shard;
+  int32 report_id;
+
+  friend std::ostream& operator<<(std::ostream& strm,
+                                  const ContactNotification& notification) {
+    return strm << "{" << notification.from_agent_uuid << ", "
+                << notification.to_agent_uuid << ", " << notification.shard
+                << ":" << notification.report_id << "}";
+  }
+};
+
+bool SamePayload(const ContactReport& a, const ContactReport& b) {
+  return a.test_result == b.test_result &&
+         a.initial_symptom_onset_time == b.initial_symptom_onset_time &&
+         a.index_agent_uuid == b.index_agent_uuid && a.hop == b.hop &&
+         a.hops_remaining == b.hops_remaining;
+}
+
+// ContactReportTable holds the payloads of the ContactNotifications in flight.
+// Reports are sent in one agent phase and received in the next, so the table
+// keeps two generations: the one being sent and the one being received.  Each
+// shard may be written by one thread at a time.
+class ContactReportTable {
+ public:
+  explicit ContactReportTable(const int num_shards)
+      : sending_(num_shards), receiving_(num_shards) {}
+
+  // Called at the start of each agent phase.  Makes the reports sent since the
+  // last call readable and drops the ones read in the previous phase.
+  void Advance() {
+    sending_.swap(receiving_);
+    for (auto& shard : sending_) shard.clear();
+    ++generation_;
+  }
+  int64 generation() const { return generation_; }
+
+  int32 Add(const int shard, const ContactReport& report) {
+    sending_[shard].push_back(report);
+    return sending_[shard].size() - 1;
+  }
+
+  // Appends the reports of notifications, which must be sorted, to reports.
+  // Duplicate notifications are dropped.
+  void Expand(const absl::Span<const ContactNotification> notifications,
+              std::vector<ContactReport>* const reports) const {
+    const ContactNotification* last = nullptr;
+    for (const ContactNotification& notification : notifications) {
+      if (last != nullptr &&
+          last->from_agent_uuid == notification.from_agent_uuid &&
+          last->shard == notification.shard &&
+          last->report_id == notification.report_id) {
+        continue;
+      }
+      last = &notification;
+      reports->push_back(
+          receiving_[notification.shard][notification.report_id]);
+      reports->back().from_agent_uuid = notification.from_agent_uuid;
+      reports->back().to_agent_uuid = notification.to_agent_uuid;
+    }
+  }
+
+ private:
+  std::vector<std::vector<ContactReport>> sending_;
+  std::vector<std::vector<ContactReport>> receiving_;
+  int64 generation_ = 0;
+};
+
+// ContactReportCompactor turns the ContactReports sent by agents into
+// ContactNotifications, adding a payload to its shard of the table only when
+// it differs from the one before it.  It buffers the notifications it sends.
+class ContactReportCompactor : public Broker<ContactReport> {
+ public:
+  ContactReportCompactor(ContactReportTable* const table, const int shard,
+                         const int buffer_size,
+                         Broker<ContactNotification>* const receiver)
+      : table_(table), shard_(shard), buffer_(buffer_size, receiver) {}
+
+  void Send(const absl::Span<const ContactReport> reports) override {
+    for (const ContactReport& report : reports) {
+      if (generation_ != table_->generation() ||
+          !SamePayload(last_, report)) {
+        generation_ = table_->generation();
+        last_ = report;
+        last_id_ = table_->Add(shard_, report);
+      }
+      const ContactNotification notification = {
+          .from_agent_uuid = report.from_agent_uuid,
+          .to_agent_uuid = report.to_agent_uuid,
+          .shard = shard_,
+          .report_id = last_id_,
+      };
+      buffer_.Send(absl::MakeConstSpan(&notification, 1));
+    }
+  }
+
+  void Flush() { buffer_.Flush(); }
+
+ private:
+  ContactReportTable* const table_;
+  const int shard_;
+  BufferingBroker<ContactNotification> buffer_;
+  int64 generation_ = -1;
+  ContactReport last_;
+  int32 last_id_ = -1;
+};
+
+// Serializes calls to Send on a broker that is not thread-safe.
+template <typename Msg>
+class SynchronizedBroker : public Broker<Msg> {
+ public:
+  explicit SynchronizedBroker(Broker<Msg>* const receiver)
+      : receiver_(receiver) {}
+
+  void Send(const absl::Span<const Msg> msgs) override {
+    absl::MutexLock l(&mu_);
+    receiver_->Send(msgs);
+  }
+
+ private:
+  absl::Mutex mu_;
+  Broker<Msg>* const receiver_ ABSL_GUARDED_BY(mu_);
+};
 
 auto CompareUuid = [](const auto& a, const auto& b) {
   return a->uuid() < b->uuid();
 };
 
+// Sorts entities by uuid.  Given an executor, runs of entities are sorted
+// concurrently and then merged pairwise, each round of merges also running
+// concurrently.
+template <typename Entity>
+void SortByUuid(EntityTable<Entity>& entities, Executor* const executor) {
+  const size_t size = entities.size();
+  if (executor == nullptr || size <= kSortRunSize) {
+    std::sort(entities.begin(), entities.end(), CompareUuid);
+    return;
+  }
+  const auto begin = entities.begin();
+  std::unique_ptr<Execution> exec = executor->NewExecution();
+  for (size_t i = 0; i < size; i += kSortRunSize) {
+    exec->Add([begin, i, size]() {
+      std::sort(begin + i, begin + std::min<size_t>(size, i + kSortRunSize),
+                CompareUuid);
+    });
+  }
+  exec->Wait();
+  for (size_t width = kSortRunSize; width < size; width *= 2) {
+    exec = executor->NewExecution();
+    for (size_t i = 0; i + width < size; i += 2 * width) {
+      exec->Add([begin, i, width, size]() {
+        std::inplace_merge(begin + i, begin + i + width,
+                           begin + std::min(size, i + 2 * width), CompareUuid);
+      });
+    }
+    exec->Wait();
+  }
+}
+
 int64 GetDestId(const Visit& visit) { return visit.location_uuid; }
 int64 GetDestId(const InfectionOutcome& outcome) { return outcome.agent_uuid; }
-int64 GetDestId(const ContactReport& report) { return report.to_agent_uuid; }
+int64 GetDestId(const ContactNotification& notification) {
+  return notification.to_agent_uuid;
+}
 
 bool CompareDestId(const Visit& a, const Visit& b) {
   if (a.location_uuid != b.location_uuid) {
@@ -62,11 +272,16 @@ bool CompareDestId(const InfectionOutcome& a, const InfectionOutcome& b) {
   }
   return a.exposure.start_time < b.exposure.start_time;
 }
-bool CompareDestId(const ContactReport& a, const ContactReport& b) {
+bool CompareDestId(const ContactNotification& a,
+                   const ContactNotification& b) {
   if (a.to_agent_uuid != b.to_agent_uuid) {
     return a.to_agent_uuid < b.to_agent_uuid;
   }
-  return a.from_agent_uuid < b.from_agent_uuid;
+  if (a.from_agent_uuid != b.from_agent_uuid) {
+    return a.from_agent_uuid < b.from_agent_uuid;
+  }
+  if (a.shard != b.shard) return a.shard < b.shard;
+  return a.report_id < b.report_id;
 }
 
 template <typename Msg>
@@ -87,15 +302,150 @@ std::pair<absl::Span<const Msg>, absl::Span<Msg>> SplitMessages(
   return {messages.subspan(0, idx), messages.subspan(idx)};
 }
 
+// Resolves the exposures of every agent in a chunk that has a pending
+// TransmissionModel, with one TransmissionModel::GetInfectionOutcomes call per
+// distinct model rather than one call per agent.
+class ChunkTransmission {
+ public:
+  // Resolves the given agents' exposures.  outcomes must be sorted by
+  // destination and contain only messages for the given agents.
+  void Resolve(const absl::Span<const std::unique_ptr<Agent>> agents,
+               const absl::Span<const InfectionOutcome> outcomes) {
+    pending_.clear();
+    transitions_.assign(agents.size(), {});
+    resolved_.assign(agents.size(), false);
+    int begin = 0;
+    for (int i = 0; i < agents.size(); ++i) {
+      const int64 uuid = agents[i]->uuid();
+      int end = begin;
+      while (end < outcomes.size() && outcomes[end].agent_uuid == uuid) ++end;
+      if (end > begin) {
+        TransmissionModel* model = agents[i]->PendingTransmissionModel();
+        if (model != nullptr) {
+          pending_.push_back({.model = model,
+                              .agent_index = i,
+                              .range = {.agent_uuid = uuid,
+                                        .slot = agents[i]->TransmissionSlot(),
+                                        .begin = begin,
+                                        .end = end}});
+        }
+      }
+      begin = end;
+    }
+    // Agents almost always share a single TransmissionModel, in which case the
+    // chunk is resolved with a single call.
+    std::stable_sort(pending_.begin(), pending_.end(),
+                     [](const Pending& a, const Pending& b) {
+                       return std::less<TransmissionModel*>()(a.model, b.model);
+                     });
+    for (auto batch = pending_.begin(); batch != pending_.end();) {
+      auto batch_end = std::find_if(batch, pending_.end(),
+                                    [model = batch->model](const Pending& p) {
+                                      return p.model != model;
+                                    });
+      ranges_.clear();
+      for (auto iter = batch; iter != batch_end; ++iter) {
+        ranges_.push_back(iter->range);
+      }
+      batch_transitions_.resize(ranges_.size());
+      batch->model->GetInfectionOutcomes(outcomes, ranges_,
+                                         absl::MakeSpan(batch_transitions_));
+      for (int i = 0; i < ranges_.size(); ++i) {
+        const int agent_index = batch[i].agent_index;
+        transitions_[agent_index] = batch_transitions_[i];
+        resolved_[agent_index] = true;
+      }
+      batch = batch_end;
+    }
+  }
+
+  // Returns the resolved transmission outcome of the agent at the given index
+  // in the chunk, or nullptr if the agent resolves its own exposures.
+  const HealthTransition* Get(const int agent_index) const {
+    return resolved_[agent_index] ? &transitions_[agent_index] : nullptr;
+  }
+
+ private:
+  struct Pending {
+    TransmissionModel* model;
+    int agent_index;
+    ExposureRange range;
+  };
+  std::vector<Pending> pending_;
+  std::vector<ExposureRange> ranges_;
+  std::vector<HealthTransition> batch_transitions_;
+  std::vector<HealthTransition> transitions_;
+  std::vector<bool> resolved_;
+};
+
+// Buffers the InfectionOutcomes a location sends and passes them on with the
+// exposures of each agent combined into one by model.
+class ExposureAggregatingBroker : public Broker<InfectionOutcome> {
+ public:
+  ExposureAggregatingBroker(const TransmissionModel* const model,
+                            Broker<InfectionOutcome>* const broker)
+      : model_(model), broker_(broker) {}
+
+  void Send(const absl::Span<const InfectionOutcome> msgs) override {
+    outcomes_.insert(outcomes_.end(), msgs.begin(), msgs.end());
+  }
+
+  // Passes on the outcomes sent since the last call.  An agent's combined
+  // outcome keeps the source of its first.
+  void Flush() {
+    std::stable_sort(outcomes_.begin(), outcomes_.end(),
+                     [](const InfectionOutcome& a, const InfectionOutcome& b) {
+                       return a.agent_uuid < b.agent_uuid;
+                     });
+    aggregated_.clear();
+    for (auto begin = outcomes_.begin(); begin != outcomes_.end();) {
+      auto end = std::find_if(begin, outcomes_.end(),
+                              [uuid = begin->agent_uuid](const auto& outcome) {
+                                return outcome.agent_uuid != uuid;
+                              });
+      exposures_.clear();
+      for (auto iter = begin; iter != end; ++iter) {
+        exposures_.push_back(&iter->exposure);
+      }
+      InfectionOutcome outcome = *begin;
+      if (end - begin > 1 &&
+          model_->AggregateExposures(exposures_, &outcome.exposure)) {
+        outcome.exposure_type = InfectionOutcomeProto::CONTACT;
+        aggregated_.push_back(outcome);
+      } else {
+        aggregated_.insert(aggregated_.end(), begin, end);
+      }
+      begin = end;
+    }
+    broker_->Send(aggregated_);
+    outcomes_.clear();
+  }
+
+ private:
+  const TransmissionModel* const model_;
+  Broker<InfectionOutcome>* const broker_;
+  std::vector<InfectionOutcome> outcomes_;
+  std::vector<InfectionOutcome> aggregated_;
+  std::vector<const Exposure*> exposures_;
+};
+
 class BaseSimulation : public Simulation {
  public:
   BaseSimulation(absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
-                 std::vector<std::unique_ptr<Location>> locations)
+                 std::vector<std::unique_ptr<Location>> locations,
+                 Executor* const executor, PagedArena* const agent_state_arena)
       : time_(start),
-        agents_(std::move(agents)),
-        locations_(std::move(locations)) {
-    std::sort(agents_.begin(), agents_.end(), CompareUuid);
-    std::sort(locations_.begin(), locations_.end(), CompareUuid);
+        agents_(std::make_move_iterator(agents.begin()),
+                std::make_move_iterator(agents.end())),
+        locations_(std::make_move_iterator(locations.begin()),
+                   std::make_move_iterator(locations.end())),
+        agent_state_arena_(agent_state_arena) {
+    SortByUuid(agents_, executor);
+    SortByUuid(locations_, executor);
+    if (agent_state_arena_ != nullptr) {
+      agent_state_arena_->SetNumChunks(std::max<int>(
+          1, (agents_.size() + kWorkChunkSize - 1) / kWorkChunkSize));
+    }
   }
 
   void Step(const int steps, absl::Duration step_duration) final {
@@ -106,50 +456,105 @@ class BaseSimulation : public Simulation {
       auto agent_start = absl::Now();
       RunAgentPhase(
           timestep,
-          [&timestep](const absl::Span<const std::unique_ptr<Agent>> agents,
-                      absl::Span<InfectionOutcome> outcomes,
-                      absl::Span<ContactReport> reports,
-                      ObserverShard* const observer,
-                      Broker<Visit>* const visit_broker,
-                      Broker<ContactReport>* const contact_report_broker) {
+          [this, &timestep](
+              const absl::Span<const std::unique_ptr<Agent>> agents,
+              absl::Span<InfectionOutcome> outcomes,
+              absl::Span<ContactNotification> reports,
+              const ContactReportTable& report_table,
+              ObserverShard* const observer, Broker<Visit>* const visit_broker,
+              Broker<ContactReport>* const contact_report_broker) {
+            const int64 tlb_misses = ThreadTlbMisses();
+            stats_.agent_updates.fetch_add(agents.size(),
+                                           std::memory_order_relaxed);
+            stats_.infection_outcomes.fetch_add(outcomes.size(),
+                                                std::memory_order_relaxed);
+            stats_.contact_reports.fetch_add(reports.size(),
+                                             std::memory_order_relaxed);
             SortByDest(outcomes);
             SortByDest(reports);
-            for (const auto& agent : agents) {
+            thread_local ChunkTransmission transmission;
+            transmission.Resolve(agents, outcomes);
+            AgentStatePager pager(agent_state_arena_,
+                                  agents.data() - agents_.data());
+            thread_local std::vector<std::unique_ptr<Agent>> split_agents;
+            for (int i = 0; i < agents.size(); ++i) {
+              pager.Enter(i);
+              const auto& agent = agents[i];
               absl::Span<const InfectionOutcome> agent_outcomes;
               std::tie(agent_outcomes, outcomes) =
                   SplitMessages(agent->uuid(), outcomes);
-              absl::Span<const ContactReport> agent_reports;
-              std::tie(agent_reports, reports) =
+              absl::Span<const ContactNotification> agent_notifications;
+              std::tie(agent_notifications, reports) =
                   SplitMessages(agent->uuid(), reports);
-              agent->ProcessInfectionOutcomes(timestep, agent_outcomes);
+              thread_local std::vector<ContactReport> agent_reports;
+              agent_reports.clear();
+              report_table.Expand(agent_notifications, &agent_reports);
+              if (const HealthTransition* transmission_outcome =
+                      transmission.Get(i)) {
+                agent->ProcessResolvedInfectionOutcomes(
+                    timestep, agent_outcomes, *transmission_outcome);
+              } else {
+                agent->ProcessInfectionOutcomes(timestep, agent_outcomes);
+              }
               agent->UpdateContactReports(timestep, agent_reports,
                                           contact_report_broker);
               agent->ComputeVisits(timestep, visit_broker);
               observer->Observe(*agent, agent_outcomes);
+              const int num_split = split_agents.size();
+              agent->TakeSplitAgents(&split_agents);
+              for (int j = num_split; j < split_agents.size(); ++j) {
+                observer->Observe(*split_agents[j], {});
+              }
             }
             DCHECK(outcomes.empty()) << "Unprocessed InfectionOutcomes";
             DCHECK(reports.empty()) << "Unprocessed ContactReports";
+            if (!split_agents.empty()) AddSplitAgents(&split_agents);
+            AddTlbMisses(stats_.dtlb_misses, tlb_misses);
           });
-      LOG(INFO) << "Agent phase took " << absl::Now() - agent_start;
+      const absl::Duration agent_time = absl::Now() - agent_start;
+      AddTime(stats_.agent_phase_nanos, agent_time);
+      LOG(INFO) << "Agent phase took " << agent_time;
       auto location_start = absl::Now();
       RunLocationPhase(
           timestep,
-          [](const absl::Span<const std::unique_ptr<Location>> locations,
-             absl::Span<Visit> visits, ObserverShard* const observer,
-             Broker<InfectionOutcome>* const broker) {
+          [this](const absl::Span<const std::unique_ptr<Location>> locations,
+                 absl::Span<Visit> visits, ObserverShard* const observer,
+                 Broker<InfectionOutcome>* const broker) {
+            const int64 tlb_misses = ThreadTlbMisses();
+            stats_.visits.fetch_add(visits.size(), std::memory_order_relaxed);
             SortByDest(visits);
+            absl::optional<ExposureAggregatingBroker> aggregator;
+            if (exposure_aggregation_ != nullptr &&
+                !observer->ObservesInfectionOutcomes()) {
+              aggregator.emplace(exposure_aggregation_, broker);
+            }
             for (const auto& location : locations) {
               absl::Span<const Visit> location_visits;
               std::tie(location_visits, visits) =
                   SplitMessages(location->uuid(), visits);
-              location->ProcessVisits(location_visits, broker);
+              if (aggregator.has_value()) {
+                location->ProcessVisits(location_visits, &*aggregator);
+                aggregator->Flush();
+              } else {
+                location->ProcessVisits(location_visits, broker);
+              }
               observer->Observe(*location, location_visits);
             }
+            DCHECK(visits.empty())
+                << "Visit for unknown location: " << GetDestId(visits[0]);
+            AddTlbMisses(stats_.dtlb_misses, tlb_misses);
           });
-      LOG(INFO) << "Location phase took " << absl::Now() - location_start;
+      const absl::Duration location_time = absl::Now() - location_start;
+      AddTime(stats_.location_phase_nanos, location_time);
+      LOG(INFO) << "Location phase took " << location_time;
+      // The step is complete as far as observers are concerned.
+      stats_.steps.fetch_add(1, std::memory_order_relaxed);
       auto observer_start = absl::Now();
       observer_manager_.AggregateForTimestep(timestep);
-      LOG(INFO) << "Observer phase took " << absl::Now() - observer_start;
+      const absl::Duration observer_time = absl::Now() - observer_start;
+      AddTime(stats_.observer_phase_nanos, observer_time);
+      LOG(INFO) << "Observer phase took " << observer_time;
+      InsertSplitAgents();
       timestep.Advance();
     }
     time_ = timestep.start_time();
@@ -158,8 +563,8 @@ class BaseSimulation : public Simulation {
 
   using AgentPhaseFn = std::function<void(
       absl::Span<const std::unique_ptr<Agent>>, absl::Span<InfectionOutcome>,
-      absl::Span<ContactReport>, ObserverShard* observer, Broker<Visit>*,
-      Broker<ContactReport>*)>;
+      absl::Span<ContactNotification>, const ContactReportTable&,
+      ObserverShard* observer, Broker<Visit>*, Broker<ContactReport>*)>;
   using LocationPhaseFn = std::function<void(
       absl::Span<const std::unique_ptr<Location>>, absl::Span<Visit>,
       ObserverShard*, Broker<InfectionOutcome>*)>;
@@ -169,6 +574,11 @@ class BaseSimulation : public Simulation {
   virtual void RunLocationPhase(const Timestep& timestep,
                                 const LocationPhaseFn& fn) = 0;
 
+  // Called after agents that split off others have been added to agents().
+  // Engines that partition agents must repartition them, including messages
+  // already sent to agents.
+  virtual void OnAgentsAdded() {}
+
   void AddObserverFactory(ObserverFactoryBase* factory) override {
     observer_manager_.AddFactory(factory);
   }
@@ -177,16 +587,102 @@ class BaseSimulation : public Simulation {
     observer_manager_.RemoveFactory(factory);
   }
 
+  void SetExposureAggregation(const TransmissionModel* const model) override {
+    exposure_aggregation_ = model;
+  }
+
+  SimulationStats GetStats() const override {
+    return {
+        .steps = stats_.steps.load(),
+        .agent_updates = stats_.agent_updates.load(),
+        .visits = stats_.visits.load(),
+        .contact_reports = stats_.contact_reports.load(),
+        .infection_outcomes = stats_.infection_outcomes.load(),
+        .agent_phase_time = absl::Nanoseconds(stats_.agent_phase_nanos.load()),
+        .location_phase_time =
+            absl::Nanoseconds(stats_.location_phase_nanos.load()),
+        .observer_phase_time =
+            absl::Nanoseconds(stats_.observer_phase_nanos.load()),
+        .dtlb_misses = stats_.dtlb_misses.load(),
+    };
+  }
+
  protected:
   ObserverManager& GetObserverManager() { return observer_manager_; }
   absl::Span<const std::unique_ptr<Agent>> agents() { return agents_; }
   absl::Span<const std::unique_ptr<Location>> locations() { return locations_; }
 
  private:
+  // Queues agents that split off others during the agent phase, leaving
+  // agents empty.  May be called from any thread.
+  void AddSplitAgents(std::vector<std::unique_ptr<Agent>>* const agents) {
+    absl::MutexLock l(&split_agents_mu_);
+    std::move(agents->begin(), agents->end(),
+              std::back_inserter(split_agents_));
+    agents->clear();
+  }
+
+  // Adds the agents that split off others in the last step to the
+  // simulation, keeping agents_ sorted.  They are updated from the next step.
+  void InsertSplitAgents() {
+    absl::MutexLock l(&split_agents_mu_);
+    if (split_agents_.empty()) return;
+    CHECK(agent_state_arena_ == nullptr)
+        << "Agents may not split when agent state is paged.";
+    LOG(INFO) << "Adding " << split_agents_.size() << " split agents";
+    std::sort(split_agents_.begin(), split_agents_.end(), CompareUuid);
+    const int num_agents = agents_.size();
+    std::move(split_agents_.begin(), split_agents_.end(),
+              std::back_inserter(agents_));
+    split_agents_.clear();
+    std::inplace_merge(agents_.begin(), agents_.begin() + num_agents,
+                       agents_.end(), CompareUuid);
+    OnAgentsAdded();
+  }
+
+  // AgentStatePager walks the arena chunks in step with a span of agents
+  // that begins at index first of agents_, scoping allocations to the chunk
+  // of the current agent and paging chunks in and out as the walk crosses
+  // chunk boundaries.
+  class AgentStatePager {
+   public:
+    AgentStatePager(PagedArena* const arena, const int first)
+        : arena_(arena), first_(first) {}
+    ~AgentStatePager() {
+      scope_.reset();
+      if (chunk_ >= 0) arena_->WriteBack(chunk_);
+    }
+
+    // Called before processing the i'th agent of the span.
+    void Enter(const int i) {
+      if (arena_ == nullptr) return;
+      const int chunk = (first_ + i) / kWorkChunkSize;
+      if (chunk == chunk_) return;
+      scope_.reset();
+      if (chunk_ >= 0) arena_->WriteBack(chunk_);
+      chunk_ = chunk;
+      arena_->Prefetch(chunk_);
+      if (chunk_ + 1 < arena_->num_chunks()) arena_->Prefetch(chunk_ + 1);
+      scope_.emplace(arena_, chunk_);
+    }
+
+   private:
+    PagedArena* const arena_;
+    const int first_;
+    int chunk_ = -1;
+    absl::optional<PagedArena::Scope> scope_;
+  };
+
   absl::Time time_;
-  std::vector<std::unique_ptr<Agent>> agents_;
-  std::vector<std::unique_ptr<Location>> locations_;
+  EntityTable<Agent> agents_;
+  EntityTable<Location> locations_;
+  PagedArena* const agent_state_arena_;
+  const TransmissionModel* exposure_aggregation_ = nullptr;
+  AtomicSimulationStats stats_;
   class ObserverManager observer_manager_;
+  absl::Mutex split_agents_mu_;
+  std::vector<std::unique_ptr<Agent>> split_agents_
+      ABSL_GUARDED_BY(split_agents_mu_);
 };
 
 // A ConsumableBroker accumulates messages which can be consumed via the
@@ -195,10 +691,10 @@ template <typename Msg>
 class ConsumableBroker : public Broker<Msg> {
  private:
   struct Deleter {
-    void operator()(std::vector<Msg>* const msgs) { broker->Delete(msgs); }
+    void operator()(MessageQueue<Msg>* const msgs) { broker->Delete(msgs); }
     ConsumableBroker* const broker;
   };
-  virtual void Delete(std::vector<Msg>* const msgs) {
+  virtual void Delete(MessageQueue<Msg>* const msgs) {
     DCHECK_EQ(msgs, &consume_);
     consume_.clear();
     // We are using swapping buffers so we're always reading from one
@@ -213,31 +709,38 @@ class ConsumableBroker : public Broker<Msg> {
   void Send(const absl::Span<const Msg> msgs) override {
     send_.insert(send_.end(), msgs.begin(), msgs.end());
   }
-  virtual std::unique_ptr<std::vector<Msg>, Deleter> Consume() {
+  virtual std::unique_ptr<MessageQueue<Msg>, Deleter> Consume() {
     DCHECK(consume_.empty());
     consume_.swap(send_);
     return {&consume_, {this}};
   }
 
  private:
-  std::vector<Msg> send_;
-  std::vector<Msg> consume_;
+  MessageQueue<Msg> send_;
+  MessageQueue<Msg> consume_;
 };
 
 // Serial implements a simulation that runs in a single thread.
 class Serial : public BaseSimulation {
  public:
   Serial(absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
-         std::vector<std::unique_ptr<Location>> locations)
-      : BaseSimulation(start, std::move(agents), std::move(locations)) {}
+         std::vector<std::unique_ptr<Location>> locations,
+         PagedArena* const agent_state_arena)
+      : BaseSimulation(start, std::move(agents), std::move(locations),
+                       /*executor=*/nullptr, agent_state_arena),
+        report_table_(1),
+        report_compactor_(&report_table_, 0, kPerThreadBrokerBuffer,
+                          &report_broker_) {}
 
   void RunAgentPhase(const Timestep& timestep,
                      const AgentPhaseFn& fn) override {
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
+    report_table_.Advance();
     fn(agents(), absl::MakeSpan(*outcomes), absl::MakeSpan(*reports),
-       GetObserverManager().MakeShard(timestep), &visit_broker_,
-       &report_broker_);
+       report_table_, GetObserverManager().MakeShard(timestep), &visit_broker_,
+       &report_compactor_);
+    report_compactor_.Flush();
   }
   void RunLocationPhase(const Timestep& timestep,
                         const LocationPhaseFn& fn) override {
@@ -249,41 +752,53 @@ class Serial : public BaseSimulation {
  private:
   ConsumableBroker<InfectionOutcome> outcome_broker_;
   ConsumableBroker<Visit> visit_broker_;
-  ConsumableBroker<ContactReport> report_broker_;
+  ConsumableBroker<ContactNotification> report_broker_;
+  ContactReportTable report_table_;
+  ContactReportCompactor report_compactor_;
 };
 
 // The Chunker helps divide a list of entities, and messages destined for those
 // entities, into chunks of work.  Basically the first KWorkChunkSize entities
-// and messages targeted at them goin in the first chunk and so on.
+// and messages targeted at them goin in the first chunk and so on.  Entities
+// must be sorted by uuid, so that a message's chunk is found from the first
+// uuid of each chunk without building a per-entity index.
 template <typename Entity>
 class Chunker {
  public:
   explicit Chunker(const absl::Span<const std::unique_ptr<Entity>> entities)
-      : chunks_((entities.size() + kWorkChunkSize - 1) / kWorkChunkSize) {
-    size_t idx = 0;
+      : chunks_((entities.size() + kWorkChunkSize - 1) / kWorkChunkSize),
+        first_uuids_(chunks_.size()) {
+    DCHECK(std::is_sorted(entities.begin(), entities.end(), CompareUuid));
     for (int chunk = 0; chunk < chunks_.size(); ++chunk) {
-      chunks_[chunk] = entities.subspan(idx, kWorkChunkSize);
-      int end = idx + chunks_[chunk].size();
-      for (; idx < end; ++idx) {
-        chunk_map_[entities[idx]->uuid()] = chunk;
-      }
+      chunks_[chunk] = entities.subspan(chunk * kWorkChunkSize, kWorkChunkSize);
+      first_uuids_[chunk] = chunks_[chunk].front()->uuid();
     }
   }
 
+  // Returns the chunk of the entity a message is for.  The lookup is by
+  // range rather than by entity, which also routes the outcomes of agents that
+  // split off mid-step, before they are added: a split agent's uuid follows
+  // its cohort's, so its messages go to the cohort's chunk until Rechunk moves
+  // them.  A message for a uuid below every entity's has no chunk at all.
+  // A message for any other unknown uuid goes to the chunk of the entity below
+  // it, where optimized builds drop it and debug builds fail once the chunk's
+  // messages are consumed and none of its entities takes it.
   template <typename Msg>
   int Chunk(const Msg& msg) const {
-    int64 dest = GetDestId(msg);
-    auto iter = chunk_map_.find(dest);
-    DCHECK(iter != chunk_map_.end());
-    return iter->second;
+    const int64 dest = GetDestId(msg);
+    const int chunk = std::upper_bound(first_uuids_.begin(),
+                                       first_uuids_.end(), dest) -
+                      first_uuids_.begin() - 1;
+    CHECK_GE(chunk, 0) << "Message for unknown entity: " << dest;
+    return chunk;
   }
   absl::Span<const absl::Span<const std::unique_ptr<Entity>>> Chunks() const {
     return chunks_;
   }
 
  private:
-  absl::FixedArray<absl::Span<const std::unique_ptr<Entity>>> chunks_;
-  absl::flat_hash_map<int64, int> chunk_map_;
+  std::vector<absl::Span<const std::unique_ptr<Entity>>> chunks_;
+  std::vector<int64> first_uuids_;
 };
 
 // WorkQueueBroker is the thread-safe analog to ConsumableBroker.  It can
@@ -292,12 +807,12 @@ template <typename Entity, typename Msg>
 class WorkQueueBroker : public Broker<Msg> {
  private:
   struct Deleter {
-    void operator()(std::vector<std::vector<Msg>>* const msgs) {
+    void operator()(std::vector<MessageQueue<Msg>>* const msgs) {
       broker->Delete(msgs);
     }
     WorkQueueBroker* const broker;
   };
-  virtual void Delete(std::vector<std::vector<Msg>>* const msgs) {
+  virtual void Delete(std::vector<MessageQueue<Msg>>* const msgs) {
     absl::MutexLock l(&mu_);
     DCHECK_EQ(msgs, &consume_);
     std::for_each(consume_.begin(), consume_.end(), [](auto& v) { v.clear(); });
@@ -323,29 +838,44 @@ class WorkQueueBroker : public Broker<Msg> {
     }
     sent_msgs_ = true;
   }
-  virtual std::unique_ptr<std::vector<std::vector<Msg>>, Deleter> Consume() {
+  virtual std::unique_ptr<std::vector<MessageQueue<Msg>>, Deleter> Consume() {
     absl::MutexLock l(&mu_);
     DCHECK(std::all_of(consume_.begin(), consume_.end(),
-                       [](const std::vector<Msg>& v) { return v.empty(); }));
+                       [](const MessageQueue<Msg>& v) { return v.empty(); }));
     sent_msgs_ = false;
     consume_.swap(send_);
     return {&consume_, {this}};
   }
 
+  // Moves the messages sent so far to the chunks of their destinations after
+  // the chunker has changed.  Must not be called while messages are consumed.
+  void Rechunk() {
+    absl::MutexLock l(&mu_);
+    DCHECK(std::all_of(consume_.begin(), consume_.end(),
+                       [](const MessageQueue<Msg>& v) { return v.empty(); }));
+    std::vector<MessageQueue<Msg>> sent(chunker_.Chunks().size());
+    sent.swap(send_);
+    consume_.resize(send_.size());
+    for (const MessageQueue<Msg>& msgs : sent) {
+      for (const Msg& msg : msgs) send_[chunker_.Chunk(msg)].push_back(msg);
+    }
+  }
+
  private:
   const Chunker<Entity>& chunker_;
   absl::Mutex mu_;
   bool sent_msgs_ = false;
-  std::vector<std::vector<Msg>> send_ ABSL_GUARDED_BY(mu_);
-  std::vector<std::vector<Msg>> consume_ ABSL_GUARDED_BY(mu_);
+  std::vector<MessageQueue<Msg>> send_ ABSL_GUARDED_BY(mu_);
+  std::vector<MessageQueue<Msg>> consume_ ABSL_GUARDED_BY(mu_);
 };
 
 template <typename Worker>
 void ParallelAgentPhase(const Timestep& timestep, Executor& executor,
                         ObserverManager& observer_manager,
                         const Chunker<Agent>& chunker,
-                        std::vector<std::vector<InfectionOutcome>>& outcomes,
-                        std::vector<std::vector<ContactReport>>& reports,
+                        std::vector<MessageQueue<InfectionOutcome>>& outcomes,
+                        std::vector<MessageQueue<ContactNotification>>& reports,
+                        const ContactReportTable& report_table,
                         absl::FixedArray<Worker>& workers,
                         const BaseSimulation::AgentPhaseFn& fn) {
   absl::Mutex mu;
@@ -361,12 +891,12 @@ void ParallelAgentPhase(const Timestep& timestep, Executor& executor,
 
   std::unique_ptr<Execution> exec = executor.NewExecution();
   for (int w = 0; w < workers.size(); ++w) {
-    exec->Add([w, &workers, &outcomes, &reports, &chunker, &next_chunk, &mu,
-               &observers, &fn]() {
+    exec->Add([w, &workers, &outcomes, &reports, &report_table, &chunker,
+               &next_chunk, &mu, &observers, &fn]() {
       auto& worker = workers[w];
       while (true) {
         absl::Span<InfectionOutcome> my_outcomes;
-        absl::Span<ContactReport> my_reports;
+        absl::Span<ContactNotification> my_reports;
         absl::Span<const std::unique_ptr<Agent>> my_agents;
         {
           absl::MutexLock l(&mu);
@@ -377,13 +907,12 @@ void ParallelAgentPhase(const Timestep& timestep, Executor& executor,
           my_reports = absl::MakeSpan(reports[chunk]);
         }
         auto start = absl::Now();
-        fn(my_agents, my_outcomes, my_reports, observers[w],
+        fn(my_agents, my_outcomes, my_reports, report_table, observers[w],
            worker.visit_broker.get(), worker.report_broker.get());
         VLOG(2) << "Processed agent chunk on worker " << w << " in "
                 << absl::Now() - start;
       }
-      worker.visit_broker->Flush();
-      worker.report_broker->Flush();
+      worker.Flush();
     });
   }
   exec->Wait();
@@ -393,7 +922,7 @@ template <typename Worker>
 void ParallelLocationPhase(const Timestep& timestep, Executor& executor,
                            ObserverManager& observer_manager,
                            const Chunker<Location>& chunker,
-                           std::vector<std::vector<Visit>>& visits,
+                           std::vector<MessageQueue<Visit>>& visits,
                            absl::FixedArray<Worker>& workers,
                            const BaseSimulation::LocationPhaseFn& fn) {
   absl::Mutex mu;
@@ -432,35 +961,46 @@ class Parallel : public BaseSimulation {
  public:
   Parallel(absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
            std::vector<std::unique_ptr<Location>> locations,
-           const int num_workers)
-      : BaseSimulation(start, std::move(agents), std::move(locations)),
-        executor_(NewExecutor(num_workers)),
+           const int num_workers, std::unique_ptr<Executor> executor,
+           PagedArena* const agent_state_arena)
+      : BaseSimulation(start, std::move(agents), std::move(locations),
+                       executor.get(), agent_state_arena),
+        executor_(std::move(executor)),
         agent_chunker_(BaseSimulation::agents()),
         location_chunker_(BaseSimulation::locations()),
         agent_workers_(num_workers),
         location_workers_(num_workers),
         outcome_broker_(agent_chunker_),
         report_broker_(agent_chunker_),
-        visit_broker_(location_chunker_) {
+        visit_broker_(location_chunker_),
+        report_table_(num_workers) {
     for (int w = 0; w < num_workers; ++w) {
       agent_workers_[w].visit_broker =
           absl::make_unique<BufferingBroker<Visit>>(kPerThreadBrokerBuffer,
                                                     &visit_broker_);
       agent_workers_[w].report_broker =
-          absl::make_unique<BufferingBroker<ContactReport>>(
-              kPerThreadBrokerBuffer, &report_broker_);
+          absl::make_unique<ContactReportCompactor>(
+              &report_table_, w, kPerThreadBrokerBuffer, &report_broker_);
       location_workers_[w].outcome_broker =
           absl::make_unique<BufferingBroker<InfectionOutcome>>(
               kPerThreadBrokerBuffer, &outcome_broker_);
     }
   }
 
+  void OnAgentsAdded() override {
+    agent_chunker_ = Chunker<Agent>(BaseSimulation::agents());
+    outcome_broker_.Rechunk();
+    report_broker_.Rechunk();
+  }
+
   void RunAgentPhase(const Timestep& timestep,
                      const AgentPhaseFn& fn) override {
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
+    report_table_.Advance();
     ParallelAgentPhase(timestep, *executor_, GetObserverManager(),
-                       agent_chunker_, *outcomes, *reports, agent_workers_, fn);
+                       agent_chunker_, *outcomes, *reports, report_table_,
+                       agent_workers_, fn);
   }
   void RunLocationPhase(const Timestep& timestep,
                         const LocationPhaseFn& fn) override {
@@ -471,8 +1011,12 @@ class Parallel : public BaseSimulation {
 
  private:
   struct AgentWorker {
+    void Flush() {
+      visit_broker->Flush();
+      report_broker->Flush();
+    }
     std::unique_ptr<BufferingBroker<Visit>> visit_broker;
-    std::unique_ptr<BufferingBroker<ContactReport>> report_broker;
+    std::unique_ptr<ContactReportCompactor> report_broker;
   };
   struct LocationWorker {
     std::unique_ptr<BufferingBroker<InfectionOutcome>> outcome_broker;
@@ -484,8 +1028,9 @@ class Parallel : public BaseSimulation {
   absl::FixedArray<AgentWorker> agent_workers_;
   absl::FixedArray<LocationWorker> location_workers_;
   WorkQueueBroker<Agent, InfectionOutcome> outcome_broker_;
-  WorkQueueBroker<Agent, ContactReport> report_broker_;
+  WorkQueueBroker<Agent, ContactNotification> report_broker_;
   WorkQueueBroker<Location, Visit> visit_broker_;
+  ContactReportTable report_table_;
 };
 
 // DistributedParallel implements a simulation that runs in multiple threads and
@@ -496,9 +1041,12 @@ class DistributedParallel : public BaseSimulation {
                       std::vector<std::unique_ptr<Agent>> agents,
                       std::vector<std::unique_ptr<Location>> locations,
                       const int num_workers,
-                      DistributedManager* const distributed_manager)
-      : BaseSimulation(start, std::move(agents), std::move(locations)),
-        executor_(NewExecutor(num_workers)),
+                      std::unique_ptr<Executor> executor,
+                      DistributedManager* const distributed_manager,
+                      PagedArena* const agent_state_arena)
+      : BaseSimulation(start, std::move(agents), std::move(locations),
+                       executor.get(), agent_state_arena),
+        executor_(std::move(executor)),
         agent_chunker_(BaseSimulation::agents()),
         location_chunker_(BaseSimulation::locations()),
         agent_workers_(num_workers),
@@ -506,16 +1054,25 @@ class DistributedParallel : public BaseSimulation {
         outcome_broker_(agent_chunker_),
         report_broker_(agent_chunker_),
         visit_broker_(location_chunker_),
+        // The last shard holds reports received from remote nodes.
+        report_table_(num_workers + 1),
+        remote_report_compactor_(&report_table_, num_workers,
+                                 kPerThreadBrokerBuffer, &report_broker_),
+        remote_report_broker_(&remote_report_compactor_),
         distributed_manager_(distributed_manager) {
     for (int w = 0; w < num_workers; ++w) {
       agent_workers_[w].visit_broker =
           absl::make_unique<DistributingBroker<Visit>>(
               kPerThreadBrokerBuffer, distributed_manager->VisitMessenger(),
               &visit_broker_);
+      agent_workers_[w].local_report_broker =
+          absl::make_unique<ContactReportCompactor>(
+              &report_table_, w, kPerThreadBrokerBuffer, &report_broker_);
       agent_workers_[w].report_broker =
           absl::make_unique<DistributingBroker<ContactReport>>(
               kPerThreadBrokerBuffer,
-              distributed_manager->ContactReportMessenger(), &report_broker_);
+              distributed_manager->ContactReportMessenger(),
+              agent_workers_[w].local_report_broker.get());
       location_workers_[w].outcome_broker =
           absl::make_unique<DistributingBroker<InfectionOutcome>>(
               kPerThreadBrokerBuffer, distributed_manager->OutcomeMessenger(),
@@ -523,6 +1080,14 @@ class DistributedParallel : public BaseSimulation {
     }
   }
 
+  // Remote nodes must send the messages of split agents here, which is the
+  // case when the uuids reserved by a cohort are assigned to its node.
+  void OnAgentsAdded() override {
+    agent_chunker_ = Chunker<Agent>(BaseSimulation::agents());
+    outcome_broker_.Rechunk();
+    report_broker_.Rechunk();
+  }
+
   ~DistributedParallel() override {
     distributed_manager_->VisitMessenger()->SetReceiveBrokerForNextPhase(
         nullptr);
@@ -536,19 +1101,22 @@ class DistributedParallel : public BaseSimulation {
                      const AgentPhaseFn& fn) override {
     auto outcomes = outcome_broker_.Consume();
     auto reports = report_broker_.Consume();
+    report_table_.Advance();
 
     distributed_manager_->VisitMessenger()->SetReceiveBrokerForNextPhase(
         &visit_broker_);
     distributed_manager_->ContactReportMessenger()
-        ->SetReceiveBrokerForNextPhase(&report_broker_);
+        ->SetReceiveBrokerForNextPhase(&remote_report_broker_);
 
     ParallelAgentPhase(timestep, *executor_, GetObserverManager(),
-                       agent_chunker_, *outcomes, *reports, agent_workers_, fn);
+                       agent_chunker_, *outcomes, *reports, report_table_,
+                       agent_workers_, fn);
     distributed_manager_->VisitMessenger()->FlushAndAwaitRemotes();
     // TODO: We technically don't need to await remotes here, but we
     // should flush.  Consider splitting the two functions and calling
     // await remotes at the end of the location phase.
     distributed_manager_->ContactReportMessenger()->FlushAndAwaitRemotes();
+    remote_report_compactor_.Flush();
   }
   void RunLocationPhase(const Timestep& timestep,
                         const LocationPhaseFn& fn) override {
@@ -562,7 +1130,13 @@ class DistributedParallel : public BaseSimulation {
 
  private:
   struct AgentWorker {
+    void Flush() {
+      visit_broker->Flush();
+      report_broker->Flush();
+      local_report_broker->Flush();
+    }
     std::unique_ptr<DistributingBroker<Visit>> visit_broker;
+    std::unique_ptr<ContactReportCompactor> local_report_broker;
     std::unique_ptr<DistributingBroker<ContactReport>> report_broker;
   };
   struct LocationWorker {
@@ -575,8 +1149,11 @@ class DistributedParallel : public BaseSimulation {
   absl::FixedArray<AgentWorker> agent_workers_;
   absl::FixedArray<LocationWorker> location_workers_;
   WorkQueueBroker<Agent, InfectionOutcome> outcome_broker_;
-  WorkQueueBroker<Agent, ContactReport> report_broker_;
+  WorkQueueBroker<Agent, ContactNotification> report_broker_;
   WorkQueueBroker<Location, Visit> visit_broker_;
+  ContactReportTable report_table_;
+  ContactReportCompactor remote_report_compactor_;
+  SynchronizedBroker<ContactReport> remote_report_broker_;
   DistributedManager* const distributed_manager_;
 };
 
@@ -584,26 +1161,30 @@ class DistributedParallel : public BaseSimulation {
 
 std::unique_ptr<Simulation> SerialSimulation(
     absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
-    std::vector<std::unique_ptr<Location>> locations) {
+    std::vector<std::unique_ptr<Location>> locations,
+    PagedArena* const agent_state_arena) {
   return absl::make_unique<Serial>(start, std::move(agents),
-                                   std::move(locations));
+                                   std::move(locations), agent_state_arena);
 }
 
 std::unique_ptr<Simulation> ParallelSimulation(
     absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
-    std::vector<std::unique_ptr<Location>> locations, const int num_workers) {
+    std::vector<std::unique_ptr<Location>> locations, const int num_workers,
+    PagedArena* const agent_state_arena) {
   return absl::make_unique<Parallel>(start, std::move(agents),
-                                     std::move(locations), num_workers);
+                                     std::move(locations), num_workers,
+                                     NewExecutor(num_workers),
+                                     agent_state_arena);
 }
 
 std::unique_ptr<Simulation> ParallelDistributedSimulation(
     absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
     std::vector<std::unique_ptr<Location>> locations,
-    const int num_local_workers,
-    DistributedManager* const distributed_manager) {
+    const int num_local_workers, DistributedManager* const distributed_manager,
+    PagedArena* const agent_state_arena) {
   return absl::make_unique<DistributedParallel>(
       start, std::move(agents), std::move(locations), num_local_workers,
-      distributed_manager);
+      NewExecutor(num_local_workers), distributed_manager, agent_state_arena);
 }
 
 }  // namespace abesim
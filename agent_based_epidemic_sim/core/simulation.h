@@ -17,13 +17,35 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_SIMULATION_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_SIMULATION_H_
 
+#include "absl/time/time.h"
 #include "agent_based_epidemic_sim/core/agent.h"
 #include "agent_based_epidemic_sim/core/distributed.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/location.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/paged_arena.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
 
 namespace abesim {
 
+// Counters accumulated by a simulation since it was built.
+struct SimulationStats {
+  // Steps whose agent and location phases have finished.
+  int64 steps = 0;
+  int64 agent_updates = 0;
+  // Messages delivered to agents and locations.
+  int64 visits = 0;
+  int64 contact_reports = 0;
+  int64 infection_outcomes = 0;
+  // Wall time spent in each phase of a step.
+  absl::Duration agent_phase_time;
+  absl::Duration location_phase_time;
+  absl::Duration observer_phase_time;
+  // Data TLB misses in user space during the agent and location phases, or
+  // zero where the kernel does not allow counting them.
+  int64 dtlb_misses = 0;
+};
+
 // Simulation is the primary interface for managing pandemic simulations.
 // Simulations are not threadsafe, their methods should not be called
 // concurrently.
@@ -45,24 +67,54 @@ class Simulation {
   // factory.
   virtual void RemoveObserverFactory(ObserverFactoryBase* factory) = 0;
 
+  // Has the simulation combine the InfectionOutcomes each location sends an
+  // agent in a step into one, with model->AggregateExposures, before they are
+  // delivered.  This is only valid when every agent resolves its exposures
+  // with model and nothing else uses individual exposures, e.g. agents do no
+  // contact tracing.  It is skipped on steps where an observer looks at
+  // InfectionOutcomes (see AgentInfectionObserver::ObservesOutcomes), so
+  // observers added between steps see combined outcomes for the step before
+  // they were added.  nullptr, the default, turns it off.  The serial,
+  // parallel and distributed simulations below honor it, and
+  // HybridSimulation passes it on to each materialized region.
+  virtual void SetExposureAggregation(const TransmissionModel* model) {}
+
+  // Returns the counters of this simulation alone, so that simulations
+  // running in the same process are told apart.  Safe to call from an
+  // observer while the simulation steps.
+  virtual SimulationStats GetStats() const { return {}; }
+
   virtual ~Simulation() = default;
 };
 
+// If agent_state_arena is given, the simulation runs out of core: agent state
+// allocated with PagedAllocator during the agent phase is placed in the chunk
+// of the arena that corresponds to the agent's chunk of work, and each chunk
+// is prefetched before and written back after it is processed.  The arena
+// must outlive the simulation and must not have been allocated from yet.
+// Agents that split (see Agent::TakeSplitAgents) are added to the simulation
+// at the end of the step they split in; they are not supported when running
+// out of core.
 std::unique_ptr<Simulation> SerialSimulation(
     absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
-    std::vector<std::unique_ptr<Location>> locations);
+    std::vector<std::unique_ptr<Location>> locations,
+    PagedArena* agent_state_arena = nullptr);
 
 std::unique_ptr<Simulation> ParallelSimulation(
     absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
-    std::vector<std::unique_ptr<Location>> locations, int num_workers);
+    std::vector<std::unique_ptr<Location>> locations, int num_workers,
+    PagedArena* agent_state_arena = nullptr);
 
 // Create a parallel simulation with num_local_workers local worker threads
 // and also coorinate with distributed simulation nodes via the given
-// DistributedManager.
+// DistributedManager.  The people that split off an agent standing for
+// several people stay on the node of that agent, so the partition must send
+// the messages for every uuid the agent reserves for them to that node.
 std::unique_ptr<Simulation> ParallelDistributedSimulation(
     absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
     std::vector<std::unique_ptr<Location>> locations, int num_local_workers,
-    DistributedManager* distributed_manager);
+    DistributedManager* distributed_manager,
+    PagedArena* agent_state_arena = nullptr);
 
 }  // namespace abesim
 
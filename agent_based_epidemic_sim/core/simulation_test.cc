@@ -14,17 +14,32 @@
 
 #include "agent_based_epidemic_sim/core/simulation.h"
 
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstdlib>
 #include <memory>
+#include <optional>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/random/random.h"
+#include "absl/strings/str_cat.h"
 #include "absl/synchronization/mutex.h"
 #include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/huge_page_allocator.h"
 #include "agent_based_epidemic_sim/core/location.h"
 #include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/paged_arena.h"
+#include "agent_based_epidemic_sim/core/risk_score.h"
+#include "agent_based_epidemic_sim/core/seir_agent.h"
 #include "agent_based_epidemic_sim/core/timestep.h"
+#include "agent_based_epidemic_sim/core/transition_model.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
 #include "agent_based_epidemic_sim/util/test_util.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -167,6 +182,40 @@ class FakeObserver : public AgentInfectionObserver,
   absl::flat_hash_map<int64, PerLocation> location_stats_;
 };
 
+// Counts agent observations without looking at their outcomes.
+class AgentCountObserver : public AgentInfectionObserver {
+ public:
+  void Observe(const Agent& agent,
+               absl::Span<const InfectionOutcome> outcomes) override {
+    ++observations_;
+  }
+  bool ObservesOutcomes() const override { return false; }
+
+ private:
+  friend class AgentCountObserverFactory;
+  int64 observations_ = 0;
+};
+
+class AgentCountObserverFactory : public ObserverFactory<AgentCountObserver> {
+ public:
+  std::unique_ptr<AgentCountObserver> MakeObserver(
+      const Timestep&) const override {
+    return absl::make_unique<AgentCountObserver>();
+  }
+  void Aggregate(const Timestep& timestep,
+                 absl::Span<std::unique_ptr<AgentCountObserver> const>
+                     observers) override {
+    for (auto& observer : observers) {
+      observations_ += observer->observations_;
+    }
+  }
+
+  int64 observations() const { return observations_; }
+
+ private:
+  int64 observations_ = 0;
+};
+
 class FakeObserverFactory : public ObserverFactory<FakeObserver> {
  public:
   std::unique_ptr<FakeObserver> MakeObserver(const Timestep&) const override {
@@ -189,6 +238,8 @@ class FakeObserverFactory : public ObserverFactory<FakeObserver> {
     }
   }
 
+  const PerAgent& agent_stats(const int64 uuid) { return agent_stats_[uuid]; }
+
   void CheckResults() {
     for (int i = 0; i < kNumAgents; ++i) {
       EXPECT_EQ(agent_stats_[i].observations, kNumSteps);
@@ -226,6 +277,12 @@ std::unique_ptr<Simulation> BuildSimulator(SimBuilder builder,
   return sim;
 }
 
+std::unique_ptr<Simulation> SerialBuilder(
+    absl::Time start, std::vector<std::unique_ptr<Agent>> agents,
+    std::vector<std::unique_ptr<Location>> locations) {
+  return SerialSimulation(start, std::move(agents), std::move(locations));
+}
+
 void CheckSimulatorResults(const OutcomeMap& outcomes, const VisitMap& visits,
                            const ReportMap& reports) {
   absl::MutexLock l(&map_mu);
@@ -250,7 +307,7 @@ TEST(SimulationTest, AllAgentsAndLocationsAreProcessedSerially) {
   OutcomeMap outcomes;
   VisitMap visits;
   ReportMap reports;
-  auto sim = BuildSimulator(SerialSimulation, &outcomes, &visits, &reports);
+  auto sim = BuildSimulator(SerialBuilder, &outcomes, &visits, &reports);
   sim->Step(kNumSteps, absl::Hours(24));
   CheckSimulatorResults(outcomes, visits, reports);
 }
@@ -259,7 +316,7 @@ TEST(SimulationTest, AllAgentsAndLocationsAreProcessedSeriallyStepByStep) {
   OutcomeMap outcomes;
   VisitMap visits;
   ReportMap reports;
-  auto sim = BuildSimulator(SerialSimulation, &outcomes, &visits, &reports);
+  auto sim = BuildSimulator(SerialBuilder, &outcomes, &visits, &reports);
   for (int step = 0; step < kNumSteps; ++step) {
     sim->Step(1, absl::Hours(24));
   }
@@ -271,7 +328,7 @@ TEST(SimulationTest, AllAgentsAndLocationsAreProcessedSeriallyWithObserver) {
   VisitMap visits;
   ReportMap reports;
 
-  auto sim = BuildSimulator(SerialSimulation, &outcomes, &visits, &reports);
+  auto sim = BuildSimulator(SerialBuilder, &outcomes, &visits, &reports);
   FakeObserverFactory observer_factory;
   sim->AddObserverFactory(&observer_factory);
   sim->Step(kNumSteps, absl::Hours(24));
@@ -323,6 +380,531 @@ TEST(SimulationTest, AllAgentsAndLocationsAreProcessedInParallelWithObserver) {
   observer_factory.CheckResults();
 }
 
+TEST(SimulationTest, AllAgentsAndLocationsAreProcessedOutOfCore) {
+  // Enough agents for several chunks of work, so that the arena is paged one
+  // chunk at a time.
+  const int kNumOutOfCoreAgents = 10000;
+  auto arena = PagedArena::Create(
+      absl::StrCat(getenv("TEST_TMPDIR"), "/", "agent_state"), 64 << 20);
+  ASSERT_TRUE(arena.ok()) << arena.status();
+  // Everyone spends the whole day at location 0 and stays susceptible.
+  MockVisitGenerator visit_generator;
+  ON_CALL(visit_generator, GenerateVisits)
+      .WillByDefault([](const Timestep& timestep, const RiskScore&,
+                        std::vector<Visit>* visits) {
+        visits->push_back({.location_uuid = 0,
+                           .start_time = timestep.start_time(),
+                           .end_time = timestep.end_time()});
+      });
+  testing::NiceMock<MockTransmissionModel> transmission_model;
+  ON_CALL(transmission_model, GetInfectionOutcome)
+      .WillByDefault(testing::Return(
+          HealthTransition{.health_state = HealthState::SUSCEPTIBLE}));
+  std::vector<std::unique_ptr<Agent>> agents;
+  std::vector<const SEIRAgent*> seir_agents;
+  for (int i = 0; i < kNumOutOfCoreAgents; ++i) {
+    auto risk_score = absl::make_unique<testing::NiceMock<MockRiskScore>>();
+    ON_CALL(*risk_score, ContactRetentionDuration())
+        .WillByDefault(testing::Return(absl::Hours(24 * 14)));
+    auto agent = SEIRAgent::CreateSusceptible(
+        i, &transmission_model, SEIRAgent::default_infectivity_model(),
+        absl::make_unique<testing::NiceMock<MockTransitionModel>>(),
+        visit_generator, std::move(risk_score));
+    seir_agents.push_back(agent.get());
+    agents.push_back(std::move(agent));
+  }
+  // The location exposes each visitor to the agent after it.
+  std::vector<std::unique_ptr<Location>> locations;
+  auto location = absl::make_unique<testing::NiceMock<MockLocation>>();
+  ON_CALL(*location, uuid()).WillByDefault(testing::Return(0));
+  ON_CALL(*location, ProcessVisits)
+      .WillByDefault([](absl::Span<const Visit> visits,
+                        Broker<InfectionOutcome>* infection_broker) {
+        for (const Visit& visit : visits) {
+          infection_broker->Send(
+              {{.agent_uuid = visit.agent_uuid,
+                .exposure = {.start_time = visit.start_time,
+                             .duration = visit.end_time - visit.start_time,
+                             .infectivity = 1.0f},
+                .exposure_type = InfectionOutcomeProto::CONTACT,
+                .source_uuid = visit.agent_uuid + 1}});
+        }
+      });
+  locations.push_back(std::move(location));
+  auto sim = ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                std::move(locations), 3, arena->get());
+  sim->Step(kNumSteps, absl::Hours(24));
+  ASSERT_GT((*arena)->num_chunks(), 1);
+
+  // Each chunk was written back after its agents were last processed, so the
+  // exposures the agents accumulated over the steps are read back from the
+  // file.
+  for (const SEIRAgent* agent : seir_agents) {
+    std::vector<absl::Time> start_times;
+    agent->exposure_store()->PerExposure(
+        absl::InfinitePast(),
+        [&](const int64 source_uuid, const Exposure& exposure,
+            const ContactReport*) {
+          EXPECT_TRUE((*arena)->Contains(&exposure));
+          EXPECT_EQ(source_uuid, agent->uuid() + 1);
+          EXPECT_EQ(exposure.duration, absl::Hours(24));
+          start_times.push_back(exposure.start_time);
+        });
+    // Outcomes are delivered in the step after they are sent, and exposures
+    // are visited newest first.
+    ASSERT_EQ(start_times.size(), kNumSteps - 1) << agent->uuid();
+    for (int i = 0; i < start_times.size(); ++i) {
+      EXPECT_EQ(start_times[i],
+                absl::UnixEpoch() + (kNumSteps - 2 - i) * absl::Hours(24));
+    }
+    EXPECT_EQ(agent->CurrentHealthState(), HealthState::SUSCEPTIBLE);
+  }
+}
+
+TEST(SimulationTest, BacksMessageQueuesWithHugePages) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  };
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  sim->Step(kNumSteps, absl::Hours(24));
+  // The queue of visits to the single chunk of locations is smaller than a
+  // huge page, so it is served by the arena.
+  const HugePageStats stats = GetHugePageStats();
+  EXPECT_GT(stats.arena_bytes, 0);
+  EXPECT_GT(stats.allocations, 0);
+
+  void* const probe = mmap(nullptr, kHugePageSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (probe == MAP_FAILED) {
+    GTEST_SKIP() << "No hugetlbfs pages are reserved.";
+  }
+  munmap(probe, kHugePageSize);
+  EXPECT_GT(stats.hugetlb_allocations, 0);
+}
+
+TEST(SimulationTest, CountsTlbMissesOfWorkers) {
+  if (ThreadTlbMisses() < 0) {
+    GTEST_SKIP() << "Data TLB misses cannot be counted.";
+  }
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto builder = [](absl::Time start, auto agents, auto locations) {
+    return ParallelSimulation(start, std::move(agents), std::move(locations),
+                              3);
+  };
+  auto sim = BuildSimulator(builder, &outcomes, &visits, &reports);
+  sim->Step(kNumSteps, absl::Hours(24));
+  // The phases ran on the workers, which are still alive.
+  EXPECT_GT(sim->GetStats().dtlb_misses, 0);
+}
+
+TEST(SimulationTest, AccumulatesSimulationStats) {
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  auto sim = BuildSimulator(SerialBuilder, &outcomes, &visits, &reports);
+  auto other_sim = BuildSimulator(SerialBuilder, &outcomes, &visits, &reports);
+  other_sim->Step(1, absl::Hours(24));
+  const SimulationStats before = sim->GetStats();
+  EXPECT_EQ(before.steps, 0);
+  sim->Step(kNumSteps, absl::Hours(24));
+  const SimulationStats after = sim->GetStats();
+  EXPECT_EQ(after.steps - before.steps, kNumSteps);
+  EXPECT_EQ(after.agent_updates - before.agent_updates,
+            kNumSteps * kNumAgents);
+  EXPECT_EQ(after.visits - before.visits,
+            kNumSteps * kNumAgents * kVisitsPerAgent);
+  // Outcomes and reports are delivered in the step after they are sent.
+  EXPECT_EQ(after.infection_outcomes - before.infection_outcomes,
+            (kNumSteps - 1) * kNumAgents * kVisitsPerAgent);
+  EXPECT_EQ(after.contact_reports - before.contact_reports,
+            (kNumSteps - 1) * kNumAgents * kReportsPerAgent);
+  EXPECT_GT(after.agent_phase_time, before.agent_phase_time);
+  EXPECT_GT(after.location_phase_time, before.location_phase_time);
+}
+
+TEST(SimulationTest, DeliversContactReportPayloadsOnce) {
+  using Received = absl::flat_hash_map<int64, std::vector<ContactReport>>;
+  Received received;
+  auto make_agent = [&received](const int64 uuid) {
+    auto agent = absl::make_unique<testing::NiceMock<MockAgent>>();
+    ON_CALL(*agent, uuid()).WillByDefault(testing::Return(uuid));
+    ON_CALL(*agent, UpdateContactReports(testing::_, testing::_, testing::_))
+        .WillByDefault([uuid, &received](
+                           const Timestep& timestep,
+                           absl::Span<const ContactReport> reports,
+                           Broker<ContactReport>* broker) {
+          {
+            absl::MutexLock l(&map_mu);
+            std::vector<ContactReport>& agent_received = received[uuid];
+            agent_received.insert(agent_received.end(), reports.begin(),
+                                  reports.end());
+          }
+          if (uuid != 0) return;
+          const ContactReport positive = {
+              .from_agent_uuid = 0,
+              .to_agent_uuid = 1,
+              .test_result = {.outcome = TestOutcome::POSITIVE}};
+          // The duplicate report to agent 1 is only delivered once.
+          broker->Send({positive, positive,
+                        {.from_agent_uuid = 0,
+                         .to_agent_uuid = 2,
+                         .test_result = {.outcome = TestOutcome::NEGATIVE}},
+                        {.from_agent_uuid = 0,
+                         .to_agent_uuid = 3,
+                         .test_result = {.outcome = TestOutcome::POSITIVE},
+                         .index_agent_uuid = 7,
+                         .hop = 2,
+                         .hops_remaining = 1}});
+        });
+    return agent;
+  };
+  for (const int num_workers : {1, 2}) {
+    received.clear();
+    std::vector<std::unique_ptr<Agent>> agents;
+    for (int64 uuid = 0; uuid < 4; ++uuid) agents.push_back(make_agent(uuid));
+    std::vector<std::unique_ptr<Location>> locations;
+    auto sim = num_workers == 1
+                   ? SerialSimulation(absl::UnixEpoch(), std::move(agents),
+                                      std::move(locations))
+                   : ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                        std::move(locations), num_workers);
+    sim->Step(3, absl::Hours(24));
+
+    absl::MutexLock l(&map_mu);
+    EXPECT_TRUE(received[0].empty());
+    ASSERT_EQ(received[1].size(), 2);
+    for (const ContactReport& report : received[1]) {
+      EXPECT_EQ(report.test_result.outcome, TestOutcome::POSITIVE);
+      EXPECT_EQ(report.to_agent_uuid, 1);
+      EXPECT_EQ(report.hops_remaining, 0);
+    }
+    ASSERT_EQ(received[2].size(), 2);
+    for (const ContactReport& report : received[2]) {
+      EXPECT_EQ(report.test_result.outcome, TestOutcome::NEGATIVE);
+    }
+    ASSERT_EQ(received[3].size(), 2);
+    for (const ContactReport& report : received[3]) {
+      EXPECT_EQ(report.from_agent_uuid, 0);
+      EXPECT_EQ(report.to_agent_uuid, 3);
+      EXPECT_EQ(report.index_agent_uuid, 7);
+      EXPECT_EQ(report.hop, 2);
+      EXPECT_EQ(report.hops_remaining, 1);
+    }
+  }
+}
+
+// A TransmissionModel that records the batches it is asked to resolve.
+class FakeTransmissionModel : public TransmissionModel {
+ public:
+  HealthTransition GetInfectionOutcome(
+      absl::Span<const Exposure* const> exposures) override {
+    ADD_FAILURE() << "Exposures should be resolved in batches.";
+    return {.health_state = HealthState::SUSCEPTIBLE};
+  }
+  void GetInfectionOutcomes(
+      absl::Span<const InfectionOutcome> infection_outcomes,
+      absl::Span<const ExposureRange> hosts,
+      absl::Span<HealthTransition> health_transitions) override {
+    absl::MutexLock l(&map_mu);
+    ++batches;
+    for (int i = 0; i < hosts.size(); ++i) {
+      EXPECT_EQ(hosts[i].end - hosts[i].begin, kVisitsPerAgent);
+      for (int j = hosts[i].begin; j < hosts[i].end; ++j) {
+        EXPECT_EQ(infection_outcomes[j].agent_uuid, hosts[i].agent_uuid);
+      }
+      health_transitions[i] = {.time = absl::FromUnixSeconds(hosts[i].begin),
+                               .health_state = HealthState::SUSCEPTIBLE};
+    }
+    hosts_resolved += hosts.size();
+  }
+
+  int batches = 0;
+  int hosts_resolved = 0;
+};
+
+TEST(SimulationTest, ResolvesPendingTransmissionModelsInBatches) {
+  FakeTransmissionModel transmission_model;
+  std::vector<std::unique_ptr<Agent>> agents;
+  OutcomeMap outcomes;
+  VisitMap visits;
+  ReportMap reports;
+  for (int i = 0; i < kNumAgents; ++i) {
+    auto agent = MakeAgent(i, &outcomes, &reports);
+    auto* mock_agent = static_cast<MockAgent*>(agent.get());
+    ON_CALL(*mock_agent, PendingTransmissionModel())
+        .WillByDefault(testing::Return(&transmission_model));
+    EXPECT_CALL(*mock_agent, ProcessResolvedInfectionOutcomes(
+                                 testing::_, testing::SizeIs(kVisitsPerAgent),
+                                 testing::_))
+        .Times(kNumSteps - 1)
+        .WillRepeatedly(
+            [mock_agent](const Timestep& timestep,
+                         absl::Span<const InfectionOutcome> infection_outcomes,
+                         const HealthTransition&) {
+              mock_agent->ProcessInfectionOutcomes(timestep,
+                                                   infection_outcomes);
+            });
+    agents.push_back(std::move(agent));
+  }
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int i = 0; i < kNumLocations; ++i) {
+    locations.push_back(MakeLocation(i, &visits));
+  }
+  auto sim = ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                std::move(locations), 3);
+  sim->Step(kNumSteps, absl::Hours(24));
+  CheckSimulatorResults(outcomes, visits, reports);
+  // All agents fit in a single chunk, so each step after the first resolves
+  // its exposures with one call.
+  EXPECT_EQ(transmission_model.batches, kNumSteps - 1);
+  EXPECT_EQ(transmission_model.hosts_resolved, kNumAgents * (kNumSteps - 1));
+}
+
+TEST(SimulationTest, RoutesOutcomesToAgentsThatSplitMidStep) {
+  // Enough cohorts that adding the people that split off them moves agents
+  // between chunks of work.
+  const int kNumCohorts = 2100;
+  // Everyone spends the whole day at location 0, where all exposures infect.
+  MockVisitGenerator visit_generator;
+  ON_CALL(visit_generator, GenerateVisits)
+      .WillByDefault([](const Timestep& timestep, const RiskScore&,
+                        std::vector<Visit>* visits) {
+        visits->push_back({.location_uuid = 0,
+                           .start_time = timestep.start_time(),
+                           .end_time = timestep.end_time()});
+      });
+  testing::NiceMock<MockTransmissionModel> transmission_model;
+  ON_CALL(transmission_model, GetWeightedInfectionOutcome)
+      .WillByDefault(testing::DoAll(
+          testing::SetArgPointee<3>(
+              HealthTransition{.time = absl::UnixEpoch() + absl::Hours(12),
+                               .health_state = HealthState::EXPOSED}),
+          testing::ReturnArg<2>()));
+  auto transition_model_factory = []() -> std::unique_ptr<TransitionModel> {
+    auto transition_model =
+        absl::make_unique<testing::NiceMock<MockTransitionModel>>();
+    ON_CALL(*transition_model, GetNextHealthTransition)
+        .WillByDefault(testing::Return(
+            HealthTransition{.time = absl::InfiniteFuture(),
+                             .health_state = HealthState::INFECTIOUS}));
+    return transition_model;
+  };
+  for (const int num_workers : {1, 3}) {
+    // Cohorts of two have even uuids.  Both people are infected by the
+    // exposures of the first step, so in the second step the person with the
+    // next odd uuid splits off and visits location 0 through its cohort.
+    std::vector<std::unique_ptr<Agent>> agents;
+    for (int i = 0; i < kNumCohorts; ++i) {
+      agents.push_back(SEIRAgent::CreateCohort(
+          2 * i, &transmission_model, SEIRAgent::default_infectivity_model(),
+          transition_model_factory(), visit_generator, NewNullRiskScore(),
+          {.weight = 2,
+           .transition_model_factory = transition_model_factory,
+           .risk_score_factory = NewNullRiskScore}));
+    }
+    std::vector<std::unique_ptr<Location>> locations;
+    auto location = absl::make_unique<testing::NiceMock<MockLocation>>();
+    ON_CALL(*location, uuid()).WillByDefault(testing::Return(0));
+    ON_CALL(*location, ProcessVisits)
+        .WillByDefault([](absl::Span<const Visit> visits,
+                          Broker<InfectionOutcome>* infection_broker) {
+          for (const Visit& visit : visits) {
+            infection_broker->Send(
+                {{.agent_uuid = visit.agent_uuid,
+                  .exposure = {.start_time = visit.start_time,
+                               .duration = visit.end_time - visit.start_time,
+                               .infectivity = 1.0f}}});
+          }
+        });
+    locations.push_back(std::move(location));
+    auto sim = num_workers == 1
+                   ? SerialSimulation(absl::UnixEpoch(), std::move(agents),
+                                      std::move(locations))
+                   : ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                        std::move(locations), num_workers);
+    FakeObserverFactory observer_factory;
+    sim->AddObserverFactory(&observer_factory);
+    sim->Step(3, absl::Hours(24));
+
+    // Split people are observed from the step they split in, and the outcomes
+    // of that step reach them in the next.
+    for (int i = 0; i < kNumCohorts; ++i) {
+      EXPECT_EQ(observer_factory.agent_stats(2 * i).outcomes, 2);
+      EXPECT_EQ(observer_factory.agent_stats(2 * i + 1).observations, 2);
+      EXPECT_EQ(observer_factory.agent_stats(2 * i + 1).outcomes, 1);
+    }
+  }
+}
+
+TEST(SimulationTest, RejectsOutcomesForAgentsBelowAllUuids) {
+  // The engine's worker threads would deadlock a forked death test.
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  OutcomeMap outcomes;
+  ReportMap reports;
+  std::vector<std::unique_ptr<Agent>> agents;
+  agents.push_back(MakeAgent(kNumLocations, &outcomes, &reports));
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int i = 0; i < kNumLocations; ++i) {
+    auto location = absl::make_unique<testing::NiceMock<MockLocation>>();
+    ON_CALL(*location, uuid()).WillByDefault(testing::Return(i));
+    ON_CALL(*location, ProcessVisits(testing::_, testing::_))
+        .WillByDefault([](absl::Span<const Visit> visits,
+                          Broker<InfectionOutcome>* infection_broker) {
+          infection_broker->Send({{.agent_uuid = 0}});
+        });
+    locations.push_back(std::move(location));
+  }
+  auto sim = ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                std::move(locations), 3);
+  EXPECT_DEATH(sim->Step(1, absl::Hours(24)), "Message for unknown entity: 0");
+}
+
+TEST(SimulationTest, RejectsVisitsToUnknownLocationsInDebugBuilds) {
+  // The engine's worker threads would deadlock a forked death test.
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  std::vector<std::unique_ptr<Agent>> agents;
+  auto agent = absl::make_unique<testing::NiceMock<MockAgent>>();
+  ON_CALL(*agent, uuid()).WillByDefault(testing::Return(0));
+  // Location 1 does not exist, so the chunk of location 0 gets its visits.
+  ON_CALL(*agent, ComputeVisits)
+      .WillByDefault([](const Timestep& timestep, Broker<Visit>* broker) {
+        broker->Send({{.location_uuid = 1, .agent_uuid = 0}});
+      });
+  agents.push_back(std::move(agent));
+  VisitMap visits;
+  std::vector<std::unique_ptr<Location>> locations;
+  locations.push_back(MakeLocation(0, &visits));
+  auto sim = ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                std::move(locations), 3);
+  EXPECT_DEBUG_DEATH(sim->Step(1, absl::Hours(24)),
+                     "Visit for unknown location: 1");
+}
+
+TEST(SimulationTest, AggregatesExposuresOfEachAgentAtALocation) {
+  const int kContactsPerVisit = 3;
+  AggregatedTransmissionModel transmission_model(/*transmissibility=*/1);
+  for (const bool observe_outcomes : {false, true}) {
+    OutcomeMap outcomes;
+    ReportMap reports;
+    std::vector<std::unique_ptr<Agent>> agents;
+    for (int i = 0; i < kNumAgents; ++i) {
+      agents.push_back(MakeAgent(i, &outcomes, &reports));
+    }
+    std::vector<std::unique_ptr<Location>> locations;
+    for (int i = 0; i < kNumLocations; ++i) {
+      auto location = absl::make_unique<testing::NiceMock<MockLocation>>();
+      ON_CALL(*location, uuid()).WillByDefault(testing::Return(i));
+      ON_CALL(*location, ProcessVisits(testing::_, testing::_))
+          .WillByDefault([](absl::Span<const Visit> visits,
+                            Broker<InfectionOutcome>* infection_broker) {
+            for (const Visit& visit : visits) {
+              for (int j = 0; j < kContactsPerVisit; ++j) {
+                infection_broker->Send(
+                    {{.agent_uuid = visit.agent_uuid,
+                      .exposure = {.duration = absl::Hours(1),
+                                   .infectivity = 0.1}}});
+              }
+            }
+          });
+      locations.push_back(std::move(location));
+    }
+    auto sim = ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                  std::move(locations), 3);
+    sim->SetExposureAggregation(&transmission_model);
+    AgentCountObserverFactory count_factory;
+    sim->AddObserverFactory(&count_factory);
+    FakeObserverFactory observer_factory;
+    if (observe_outcomes) sim->AddObserverFactory(&observer_factory);
+    sim->Step(kNumSteps, absl::Hours(24));
+    EXPECT_EQ(count_factory.observations(), kNumAgents * kNumSteps);
+
+    // Each location sends an agent one combined outcome, unless an observer
+    // needs to see every outcome.
+    absl::MutexLock l(&map_mu);
+    for (int i = 0; i < kNumAgents; ++i) {
+      EXPECT_EQ(outcomes[i], kVisitsPerAgent * (kNumSteps - 1) *
+                                 (observe_outcomes ? kContactsPerVisit : 1));
+    }
+  }
+}
+
+// An agent cheap enough to build the hundreds of thousands needed for the
+// simulation to sort them in parallel.
+class CountingAgent : public Agent {
+ public:
+  explicit CountingAgent(const int64 uuid) : uuid_(uuid) {}
+
+  int64 uuid() const override { return uuid_; }
+  void ComputeVisits(const Timestep& timestep,
+                     Broker<Visit>* const visit_broker) const override {
+    visit_broker->Send(
+        {{.location_uuid = uuid_ % kNumLocations, .agent_uuid = uuid_}});
+  }
+  void ProcessInfectionOutcomes(
+      const Timestep& timestep,
+      absl::Span<const InfectionOutcome> infection_outcomes) override {
+    for (const InfectionOutcome& outcome : infection_outcomes) {
+      if (outcome.agent_uuid == uuid_) ++outcomes_;
+    }
+  }
+  void UpdateContactReports(const Timestep& timestep,
+                            absl::Span<const ContactReport> symptom_reports,
+                            Broker<ContactReport>* symptom_broker) override {}
+  HealthState::State CurrentHealthState() const override {
+    return HealthState::SUSCEPTIBLE;
+  }
+  TestResult CurrentTestResult(const Timestep& timestep) const override {
+    return {};
+  }
+  absl::Span<const HealthTransition> HealthTransitions() const override {
+    return {};
+  }
+  std::optional<absl::Time> symptom_onset() const override {
+    return std::nullopt;
+  }
+  std::optional<absl::Time> infection_onset() const override {
+    return std::nullopt;
+  }
+  const ExposureStore* exposure_store() const override { return nullptr; }
+
+  int outcomes() const { return outcomes_; }
+
+ private:
+  const int64 uuid_;
+  int outcomes_ = 0;
+};
+
+TEST(SimulationTest, BuildsLargeSimulationsInParallel) {
+  // Enough agents, in random order, that they are sorted in several runs.
+  const int kNumLargeAgents = 300000;
+  std::vector<std::unique_ptr<Agent>> agents;
+  std::vector<const CountingAgent*> counting_agents;
+  for (int i = 0; i < kNumLargeAgents; ++i) {
+    auto agent = absl::make_unique<CountingAgent>(i);
+    counting_agents.push_back(agent.get());
+    agents.push_back(std::move(agent));
+  }
+  absl::BitGen gen;
+  std::shuffle(agents.begin(), agents.end(), gen);
+  VisitMap visits;
+  std::vector<std::unique_ptr<Location>> locations;
+  for (int i = kNumLocations - 1; i >= 0; --i) {
+    locations.push_back(MakeLocation(i, &visits));
+  }
+  auto sim = ParallelSimulation(absl::UnixEpoch(), std::move(agents),
+                                std::move(locations), 4);
+  sim->Step(2, absl::Hours(24));
+  for (const CountingAgent* agent : counting_agents) {
+    EXPECT_EQ(agent->outcomes(), 1) << agent->uuid();
+  }
+}
+
 // TODO: Add a test for DistributedParallelSimulation using a mock
 // DistributedManager.  Currently I'm relying on the stubby test.
 
@@ -0,0 +1,52 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/transmission_model.h"
+
+#include <vector>
+
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+
+void TransmissionModel::GetInfectionOutcomes(
+    const absl::Span<const InfectionOutcome> infection_outcomes,
+    const absl::Span<const ExposureRange> hosts,
+    const absl::Span<HealthTransition> health_transitions) {
+  DCHECK_EQ(hosts.size(), health_transitions.size());
+  std::vector<const Exposure*> exposures;
+  for (int i = 0; i < hosts.size(); ++i) {
+    exposures.clear();
+    for (int j = hosts[i].begin; j < hosts[i].end; ++j) {
+      exposures.push_back(&infection_outcomes[j].exposure);
+    }
+    health_transitions[i] = GetHostInfectionOutcome(hosts[i].slot, exposures);
+  }
+}
+
+int TransmissionModel::GetWeightedInfectionOutcome(
+    const int slot, const absl::Span<const Exposure* const> exposures,
+    const int weight, HealthTransition* const infection) {
+  int infected = 0;
+  for (int i = 0; i < weight; ++i) {
+    const HealthTransition outcome = GetHostInfectionOutcome(slot, exposures);
+    if (outcome.health_state == HealthState::EXPOSED) {
+      *infection = outcome;
+      ++infected;
+    }
+  }
+  return infected;
+}
+
+}  // namespace abesim
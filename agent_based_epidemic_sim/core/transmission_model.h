@@ -19,16 +19,70 @@
 
 #include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/event.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/visit.h"
 
 namespace abesim {
 
+// The slot of a host that was not registered with its TransmissionModel.
+inline constexpr int kNoTransmissionSlot = -1;
+
+// The exposures of a single host within a batch of InfectionOutcomes. The
+// host's exposures are the InfectionOutcomes with indices in [begin, end).
+struct ExposureRange {
+  int64 agent_uuid;
+  // The dense index under which the host was registered with the model that
+  // resolves it, or kNoTransmissionSlot.
+  int slot = kNoTransmissionSlot;
+  int begin;
+  int end;
+};
+
 // Models transmission between hosts.
 class TransmissionModel {
  public:
   // Computes the infection outcome given exposures.
   virtual HealthTransition GetInfectionOutcome(
       absl::Span<const Exposure* const> exposures) = 0;
+
+  // Computes the infection outcome of the host registered in the given slot,
+  // or kNoTransmissionSlot.  Models that report per-host results override
+  // this; the default ignores the slot and calls GetInfectionOutcome.
+  virtual HealthTransition GetHostInfectionOutcome(
+      int slot, absl::Span<const Exposure* const> exposures) {
+    return GetInfectionOutcome(exposures);
+  }
+
+  // Computes the infection outcomes of a batch of hosts in one call.
+  // The exposures of all hosts are stored contiguously in infection_outcomes,
+  // hosts[i] identifies the exposures of the i-th host, and the outcome for
+  // that host is written to health_transitions[i].
+  // The default implementation calls GetInfectionOutcome once per host;
+  // models should override it when they can amortize work across hosts.
+  virtual void GetInfectionOutcomes(
+      absl::Span<const InfectionOutcome> infection_outcomes,
+      absl::Span<const ExposureRange> hosts,
+      absl::Span<HealthTransition> health_transitions);
+
+  // Computes how many of weight identical hosts, each with the given
+  // exposures, are infected.  When any are, infection is set to the transition
+  // they make.  The hosts share the given slot.  The default implementation
+  // calls GetHostInfectionOutcome once per host; models should override it to
+  // sample the count directly.
+  virtual int GetWeightedInfectionOutcome(
+      int slot, absl::Span<const Exposure* const> exposures, int weight,
+      HealthTransition* infection);
+
+  // Combines exposures into a single exposure that gives a host the same
+  // infection outcome, in distribution and time, as all of them together.
+  // Returns false if the model cannot, which is the default.  Engines use
+  // this to send each agent one exposure per location instead of one per
+  // contact when nothing else needs the individual exposures.
+  virtual bool AggregateExposures(absl::Span<const Exposure* const> exposures,
+                                  Exposure* aggregate) const {
+    return false;
+  }
+
   virtual ~TransmissionModel() = default;
 };
 
@@ -0,0 +1,114 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/visit.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+
+namespace abesim {
+
+namespace {
+
+// Sets minutes to duration rounded to the nearest minute if that fits.
+bool ToNearestMinutes(const absl::Duration duration, uint16* minutes) {
+  absl::Duration remainder;
+  const int64 nearest = absl::IDivDuration(duration + absl::Seconds(30),
+                                           absl::Minutes(1), &remainder);
+  if (duration < absl::ZeroDuration() || nearest > kuint16max) return false;
+  *minutes = nearest;
+  return true;
+}
+
+}  // namespace
+
+Visit GetVisitStay(const Visit& visit, const int i) {
+  Visit stay = visit;
+  stay.absence = {};
+  if (NumVisitStays(visit) == 1) return stay;
+  if (i == 0) {
+    stay.end_time =
+        visit.start_time + absl::Minutes(visit.absence.start_minutes);
+  } else {
+    stay.start_time =
+        visit.start_time + absl::Minutes(visit.absence.end_minutes);
+  }
+  return stay;
+}
+
+bool AppendVisitStay(const Visit& stay, Visit* visit) {
+  if (stay.location_uuid != visit->location_uuid ||
+      stay.agent_uuid != visit->agent_uuid ||
+      stay.health_state != visit->health_state ||
+      stay.susceptibility != visit->susceptibility ||
+      stay.infectivity != visit->infectivity ||
+      stay.symptom_factor != visit->symptom_factor ||
+      stay.location_dynamics.random_location_edges !=
+          visit->location_dynamics.random_location_edges ||
+      stay.weight != visit->weight || stay.start_time < visit->end_time) {
+    return false;
+  }
+  if (stay.start_time == visit->end_time) {
+    visit->end_time = stay.end_time;
+    return true;
+  }
+  // The absence is rounded to whole minutes, which must leave both stays and
+  // the absence itself non-empty.
+  VisitAbsence absence;
+  if (NumVisitStays(*visit) > 1 ||
+      !ToNearestMinutes(visit->end_time - visit->start_time,
+                        &absence.start_minutes) ||
+      !ToNearestMinutes(stay.start_time - visit->start_time,
+                        &absence.end_minutes) ||
+      absence.start_minutes == 0 ||
+      absence.end_minutes <= absence.start_minutes ||
+      visit->start_time + absl::Minutes(absence.end_minutes) >=
+          stay.end_time) {
+    return false;
+  }
+  visit->end_time = stay.end_time;
+  visit->absence = absence;
+  return true;
+}
+
+void CoalesceVisits(std::vector<Visit>* visits) {
+  std::sort(visits->begin(), visits->end(),
+            [](const Visit& a, const Visit& b) {
+              if (a.location_uuid != b.location_uuid) {
+                return a.location_uuid < b.location_uuid;
+              }
+              return a.start_time < b.start_time;
+            });
+  int last = -1;
+  for (const Visit& visit : *visits) {
+    if (last >= 0 && AppendVisitStay(visit, &(*visits)[last])) continue;
+    (*visits)[++last] = visit;
+  }
+  visits->resize(last + 1);
+}
+
+void ExpandVisitStays(const absl::Span<const Visit> visits,
+                      std::vector<Visit>* stays) {
+  for (const Visit& visit : visits) {
+    for (int i = 0; i < NumVisitStays(visit); ++i) {
+      stays->push_back(GetVisitStay(visit, i));
+    }
+  }
+}
+
+}  // namespace abesim
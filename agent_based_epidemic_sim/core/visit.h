@@ -17,8 +17,12 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_CORE_VISIT_H_
 #define AGENT_BASED_EPIDEMIC_SIM_CORE_VISIT_H_
 
+#include <ostream>
+#include <vector>
+
 #include "absl/meta/type_traits.h"
 #include "absl/time/time.h"
+#include "absl/types/span.h"
 #include "agent_based_epidemic_sim/core/constants.h"
 #include "agent_based_epidemic_sim/core/integral_types.h"
 #include "agent_based_epidemic_sim/core/pandemic.pb.h"
@@ -51,13 +55,40 @@ struct HealthInterval {
 static_assert(absl::is_trivially_copy_constructible<HealthInterval>::value,
               "Event must be trivially copyable.");
 
+// The largest number of random location edges a visit can ask for.
+inline constexpr int kMaxRandomLocationEdges = kint16max;
+
 // Parameters of an agent's behavior during a visit.
 struct VisitLocationDynamics {
-  // Number of edges to other agents at a random location.
-  int random_location_edges = 0;
+  // Number of edges to other agents at a random location, at most
+  // kMaxRandomLocationEdges.
+  int16 random_location_edges = 0;
 };
 
+// A time during a visit that the agent spends elsewhere, in whole minutes from
+// the start of the visit.  There is none if end_minutes <= start_minutes.
+struct VisitAbsence {
+  uint16 start_minutes = 0;
+  uint16 end_minutes = 0;
+};
+
+// The largest number of people a single visit can stand for.
+inline constexpr int kMaxVisitWeight = kint16max;
+
 // A visit to a given location in time of an agent.
+//
+// An agent that leaves a location and comes back in the same timestep sends a
+// single visit with an absence, so the visit carries two stays: a typical
+// home -> work -> home day is two visits.  A third stay, or a change of health
+// while the agent is there, starts another visit.  Locations treat the stays
+// of an agent as its presence at the location, so its own stays are never in
+// contact with each other.
+//
+// A visit of weight k stands for the identical visits of k people of a
+// cohort.  Cohort people are SUSCEPTIBLE, since infected ones split off, so
+// locations expose the visit as one agent and the cohort works out how many of
+// its people are infected.  Graph locations, whose edges connect individual
+// people, expose the cohort to the edges of each of its people.
 struct Visit {
   int64 location_uuid;
   int64 agent_uuid;
@@ -68,25 +99,61 @@ struct Visit {
   float infectivity;
   float symptom_factor;
   VisitLocationDynamics location_dynamics;
+  int16 weight = 1;
+  VisitAbsence absence;
 
   friend bool operator==(const Visit& a, const Visit& b) {
     return (a.location_uuid == b.location_uuid &&
             a.agent_uuid == b.agent_uuid && a.start_time == b.start_time &&
             a.end_time == b.end_time && a.health_state == b.health_state &&
-            a.infectivity == b.infectivity);
+            a.infectivity == b.infectivity && a.weight == b.weight &&
+            a.absence.start_minutes == b.absence.start_minutes &&
+            a.absence.end_minutes == b.absence.end_minutes);
   }
 
   friend bool operator!=(const Visit& a, const Visit& b) { return !(a == b); }
 
   friend std::ostream& operator<<(std::ostream& strm, const Visit& visit) {
-    return strm << "{" << visit.location_uuid << ", " << visit.agent_uuid
-                << ", " << visit.start_time << ", " << visit.end_time << ", "
-                << visit.health_state << ", " << visit.infectivity << "}";
+    strm << "{" << visit.location_uuid << ", " << visit.agent_uuid << ", "
+         << visit.start_time << ", " << visit.end_time << ", "
+         << visit.health_state << ", " << visit.infectivity;
+    if (visit.weight != 1) strm << ", x" << visit.weight;
+    if (visit.absence.end_minutes > visit.absence.start_minutes) {
+      strm << ", away " << visit.absence.start_minutes << "-"
+           << visit.absence.end_minutes << "m";
+    }
+    return strm << "}";
   }
 };
 
 static_assert(absl::is_trivially_copy_constructible<Visit>::value,
               "Event must be trivially copyable.");
+// Visits are the most numerous messages, and every broker copies them.
+static_assert(sizeof(Visit) <= 72, "Visit must stay small.");
+
+// Returns the number of stays that visit carries, 1 or 2.
+inline int NumVisitStays(const Visit& visit) {
+  return visit.absence.end_minutes > visit.absence.start_minutes ? 2 : 1;
+}
+
+// Returns the ith stay of visit as a visit of its own.
+Visit GetVisitStay(const Visit& visit, int i);
+
+// Adds stay to the end of visit if it is a later stay of the same agent at the
+// same location with the same health and behavior, and visit has room for it.
+// Returns whether stay was added.  The absence between the stays is rounded to
+// the nearest minute, which moves the end of the first stay and the start of
+// the second by at most 30 seconds.  Stays are not appended if the rounding
+// would leave either stay or the absence empty.
+bool AppendVisitStay(const Visit& stay, Visit* visit);
+
+// Merges the visits of an agent to the same location into as few visits as
+// possible.  Reorders visits by location.
+void CoalesceVisits(std::vector<Visit>* visits);
+
+// Appends the stays of visits to stays.
+void ExpandVisitStays(absl::Span<const Visit> visits,
+                      std::vector<Visit>* stays);
 
 }  // namespace abesim
 
@@ -0,0 +1,116 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/core/visit.h"
+
+#include <vector>
+
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+using testing::ElementsAre;
+
+absl::Time Hour(float hour) { return absl::UnixEpoch() + absl::Hours(hour); }
+
+Visit Stay(int64 location_uuid, float start_hour, float end_hour,
+           HealthState::State health_state = HealthState::SUSCEPTIBLE,
+           float infectivity = 0.0f) {
+  return {.location_uuid = location_uuid,
+          .agent_uuid = 7,
+          .start_time = Hour(start_hour),
+          .end_time = Hour(end_hour),
+          .health_state = health_state,
+          .infectivity = infectivity};
+}
+
+TEST(VisitTest, CoalescesReturnsToALocation) {
+  std::vector<Visit> visits = {Stay(1, 0, 8), Stay(2, 8, 18), Stay(1, 18, 24)};
+  CoalesceVisits(&visits);
+  ASSERT_EQ(visits.size(), 2);
+  EXPECT_EQ(NumVisitStays(visits[0]), 2);
+  EXPECT_EQ(visits[0].start_time, Hour(0));
+  EXPECT_EQ(visits[0].end_time, Hour(24));
+  EXPECT_EQ(GetVisitStay(visits[0], 0), Stay(1, 0, 8));
+  EXPECT_EQ(GetVisitStay(visits[0], 1), Stay(1, 18, 24));
+  EXPECT_EQ(visits[1], Stay(2, 8, 18));
+}
+
+TEST(VisitTest, KeepsHealthChangesInSeparateVisits) {
+  std::vector<Visit> visits = {
+      Stay(1, 0, 8),
+      Stay(1, 20, 24, HealthState::INFECTIOUS, 0.5f),
+      Stay(1, 18, 20),
+  };
+  CoalesceVisits(&visits);
+  ASSERT_EQ(visits.size(), 2);
+  std::vector<Visit> stays;
+  ExpandVisitStays(visits, &stays);
+  EXPECT_THAT(stays,
+              ElementsAre(Stay(1, 0, 8), Stay(1, 18, 20),
+                          Stay(1, 20, 24, HealthState::INFECTIOUS, 0.5f)));
+}
+
+TEST(VisitTest, StartsAnotherVisitWhenFull) {
+  std::vector<Visit> visits = {Stay(1, 0, 1), Stay(1, 2, 3), Stay(1, 3, 4),
+                               Stay(1, 5, 6)};
+  CoalesceVisits(&visits);
+  std::vector<Visit> stays;
+  ExpandVisitStays(visits, &stays);
+  EXPECT_THAT(stays, ElementsAre(Stay(1, 0, 1), Stay(1, 2, 4), Stay(1, 5, 6)));
+}
+
+TEST(VisitTest, DoesNotAppendOverlappingStays) {
+  Visit visit = Stay(1, 0, 8);
+  EXPECT_FALSE(AppendVisitStay(Stay(1, 7, 9), &visit));
+  EXPECT_FALSE(AppendVisitStay(Stay(2, 9, 10), &visit));
+  EXPECT_EQ(visit, Stay(1, 0, 8));
+  EXPECT_TRUE(AppendVisitStay(Stay(1, 9, 10), &visit));
+  EXPECT_EQ(NumVisitStays(visit), 2);
+  EXPECT_EQ(GetVisitStay(visit, 1), Stay(1, 9, 10));
+}
+
+TEST(VisitTest, RoundsAbsencesToTheNearestMinute) {
+  const absl::Time start = Hour(0);
+  Visit visit = Stay(1, 0, 0);
+  visit.end_time = start + absl::Minutes(100) + absl::Seconds(20);
+  Visit stay = Stay(1, 0, 0);
+  stay.start_time = start + absl::Minutes(200) + absl::Seconds(40);
+  stay.end_time = start + absl::Minutes(300) + absl::Seconds(10);
+  ASSERT_TRUE(AppendVisitStay(stay, &visit));
+  EXPECT_EQ(visit.start_time, start);
+  EXPECT_EQ(visit.end_time, stay.end_time);
+  EXPECT_EQ(GetVisitStay(visit, 0).end_time, start + absl::Minutes(100));
+  EXPECT_EQ(GetVisitStay(visit, 1).start_time, start + absl::Minutes(201));
+  EXPECT_EQ(GetVisitStay(visit, 1).end_time, stay.end_time);
+}
+
+TEST(VisitTest, DoesNotAppendStaysThatRoundingWouldEmpty) {
+  // The absence would round away.
+  Visit visit = Stay(1, 0, 1);
+  EXPECT_FALSE(AppendVisitStay(Stay(1, 1 + 0.4f / 60, 2), &visit));
+  // The first stay would round away.
+  visit = Stay(1, 0, 0.4f / 60);
+  EXPECT_FALSE(AppendVisitStay(Stay(1, 1, 2), &visit));
+  // The second stay would round away.
+  visit = Stay(1, 0, 1);
+  EXPECT_FALSE(AppendVisitStay(Stay(1, 2 - 0.4f / 60, 2), &visit));
+  EXPECT_EQ(visit, Stay(1, 0, 1));
+}
+
+}  // namespace
+}  // namespace abesim
@@ -14,40 +14,157 @@
 
 #include "agent_based_epidemic_sim/port/file_utils.h"
 
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
+#include <string>
+#include <thread>  // NOLINT: Open source only.
+#include <vector>
 
+#include "absl/memory/memory.h"
 #include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
 #include "agent_based_epidemic_sim/port/logging.h"
 
 namespace abesim {
 namespace file {
 namespace {
+
+// Writes the buffers filled by WriteString to the file on a background thread.
 class FileWriterImpl : public FileWriter {
  public:
-  explicit FileWriterImpl(std::ofstream ofstream)
-      : ofstream_(std::move(ofstream)) {}
+  FileWriterImpl(std::ofstream ofstream, const WriterOptions& options)
+      : ofstream_(std::move(ofstream)),
+        is_open_(ofstream_.is_open()),
+        options_(options) {
+    buffer_.reserve(options_.buffer_size);
+    flusher_ = std::thread([this]() { FlushBuffers(); });
+  }
+
+  ~FileWriterImpl() override {
+    absl::Status status = Close();
+    if (!status.ok()) LOG(ERROR) << status;
+  }
 
   absl::Status WriteString(absl::string_view content) override {
-    if (ofstream_.is_open()) {
-      ofstream_ << content;
-      return absl::OkStatus();
+    if (!is_open_ || closed_) {
+      return absl::Status(absl::StatusCode::kUnavailable, "Failed to write.");
     }
-    return absl::Status(absl::StatusCode::kUnavailable, "Failed to write.");
+    buffer_.append(content.data(), content.size());
+    if (buffer_.size() < options_.buffer_size) return absl::OkStatus();
+    return SubmitBuffer();
+  }
+
+  absl::Status Flush() override {
+    if (!is_open_ || closed_) {
+      return absl::Status(absl::StatusCode::kUnavailable, "Failed to flush.");
+    }
+    if (buffer_.empty()) {
+      absl::MutexLock l(&mu_);
+      return status_;
+    }
+    {
+      absl::MutexLock l(&mu_);
+      if (!CanSubmit()) return status_;
+    }
+    return SubmitBuffer(/*flush=*/true);
   }
 
   absl::Status Close() override {
+    if (closed_) return absl::OkStatus();
+    closed_ = true;
+    SubmitBuffer().IgnoreError();
+    {
+      absl::MutexLock l(&mu_);
+      done_ = true;
+    }
+    flusher_.join();
     ofstream_.close();
-    if (ofstream_.is_open()) {
+    absl::MutexLock l(&mu_);
+    if (!status_.ok()) return status_;
+    if (is_open_ && ofstream_.fail()) {
       return absl::Status(absl::StatusCode::kUnknown, "Failed to close.");
     }
     return absl::OkStatus();
   }
 
  private:
+  // A buffer waiting to be written, and whether to flush the ofstream after it.
+  struct PendingBuffer {
+    std::string buffer;
+    bool flush;
+  };
+
+  // Hands buffer_ to the background thread, blocking while
+  // max_pending_buffers buffers are already waiting.
+  absl::Status SubmitBuffer(bool flush = false) {
+    if (buffer_.empty()) return absl::OkStatus();
+    mu_.LockWhen(absl::Condition(this, &FileWriterImpl::CanSubmit));
+    pending_.push_back({std::move(buffer_), flush});
+    buffer_.clear();
+    if (!free_.empty()) {
+      buffer_ = std::move(free_.back());
+      free_.pop_back();
+    }
+    absl::Status status = status_;
+    mu_.Unlock();
+    buffer_.reserve(options_.buffer_size);
+    return status;
+  }
+
+  bool CanSubmit() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return pending_.size() < options_.max_pending_buffers;
+  }
+
+  bool HasWork() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    return done_ || !pending_.empty();
+  }
+
+  // Runs on flusher_ until Close, writing pending buffers in order and
+  // recycling them for WriteString.  The ofstream is only flushed after buffers
+  // handed over by Flush, so that full buffers reach the file in large writes.
+  void FlushBuffers() {
+    while (true) {
+      mu_.LockWhen(absl::Condition(this, &FileWriterImpl::HasWork));
+      if (pending_.empty()) {
+        mu_.Unlock();
+        return;
+      }
+      std::string buffer = std::move(pending_.front().buffer);
+      const bool flush = pending_.front().flush;
+      pending_.pop_front();
+      mu_.Unlock();
+      ofstream_.write(buffer.data(), buffer.size());
+      if (flush) ofstream_.flush();
+      buffer.clear();
+      absl::MutexLock l(&mu_);
+      if (ofstream_.fail() && status_.ok()) {
+        status_ = absl::Status(absl::StatusCode::kUnavailable,
+                               "Failed to write.");
+      }
+      free_.push_back(std::move(buffer));
+    }
+  }
+
+  // Only written by flusher_ until it is joined.
   std::ofstream ofstream_;
+  const bool is_open_;
+  const WriterOptions options_;
+  // The buffer being filled by WriteString.
+  std::string buffer_;
+  bool closed_ = false;
+
+  absl::Mutex mu_;
+  // Full buffers waiting to be written, oldest first.
+  std::deque<PendingBuffer> pending_ ABSL_GUARDED_BY(mu_);
+  // Written buffers that can be filled again.
+  std::vector<std::string> free_ ABSL_GUARDED_BY(mu_);
+  absl::Status status_ ABSL_GUARDED_BY(mu_);
+  bool done_ ABSL_GUARDED_BY(mu_) = false;
+  std::thread flusher_;
 };
+
 }  // namespace
 
 std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name) {
@@ -56,12 +173,20 @@ std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name) {
 
 std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name,
                                       const bool fail_if_file_exists) {
+  return OpenOrDie(file_name, fail_if_file_exists, WriterOptions());
+}
+
+std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name,
+                                      const bool fail_if_file_exists,
+                                      const WriterOptions& options) {
+  CHECK_GT(options.buffer_size, 0);
+  CHECK_GT(options.max_pending_buffers, 0);
   if (fail_if_file_exists) {
     CHECK(!std::filesystem::exists(file_name))
         << "File already exists: " << file_name;
   }
   std::ofstream ofstream((std::string(file_name)));
-  return absl::make_unique<FileWriterImpl>(std::move(ofstream));
+  return absl::make_unique<FileWriterImpl>(std::move(ofstream), options);
 }
 
 absl::Status GetContents(absl::string_view file_name, std::string* output) {
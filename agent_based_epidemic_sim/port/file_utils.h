@@ -17,6 +17,9 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_PORT_FILE_UTILS_H_
 #define AGENT_BASED_EPIDEMIC_SIM_PORT_FILE_UTILS_H_
 
+#include <memory>
+#include <string>
+
 #include "absl/status/status.h"
 #include "absl/strings/match.h"
 #include "absl/strings/string_view.h"
@@ -30,10 +33,26 @@ class FileWriter {
   virtual ~FileWriter() = default;
   // Writes a string to file.
   virtual absl::Status WriteString(absl::string_view content) = 0;
+  // Hands everything written so far to be written to the file without waiting
+  // for the write.  When max_pending_buffers buffers are already waiting, the
+  // content instead goes out with the next buffer.  Only Close waits until
+  // everything is in the file.
+  virtual absl::Status Flush() = 0;
   // Must be called before destroying the object.
   virtual absl::Status Close() = 0;
 };
 
+// Options of the writers returned by OpenOrDie.  Content is collected in
+// buffers that a background thread writes to the file, so that callers do not
+// wait on the disk.  WriteString blocks once max_pending_buffers full buffers
+// are waiting to be written, which bounds memory use when the disk is slower
+// than the caller.  Write errors of the background thread are returned by a
+// later WriteString, Flush or Close.
+struct WriterOptions {
+  int buffer_size = 1 << 20;
+  int max_pending_buffers = 8;
+};
+
 // Opens a file for writing. Crashes if the file already exists.
 std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name);
 
@@ -41,6 +60,11 @@ std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name);
 std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name,
                                       const bool fail_if_file_exists);
 
+// Opens a file for writing with the given options.
+std::unique_ptr<FileWriter> OpenOrDie(absl::string_view file_name,
+                                      bool fail_if_file_exists,
+                                      const WriterOptions& options);
+
 // Gets the contents of a file.
 absl::Status GetContents(absl::string_view file_name, std::string* output);
 
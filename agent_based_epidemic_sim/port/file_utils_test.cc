@@ -0,0 +1,145 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/port/file_utils.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>  // NOLINT: Open source only.
+
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+std::string TempFile(const std::string& name) {
+  return absl::StrCat(getenv("TEST_TMPDIR"), "/", name);
+}
+
+TEST(FileUtilsTest, WritesThroughSmallBuffersInOrder) {
+  const std::string file_name = TempFile("small_buffers");
+  file::WriterOptions options;
+  options.buffer_size = 16;
+  options.max_pending_buffers = 1;
+  auto writer =
+      file::OpenOrDie(file_name, /*fail_if_file_exists=*/false, options);
+  std::string expected;
+  for (int i = 0; i < 10000; ++i) {
+    const std::string line = absl::StrCat(i, ",", i * i, "\n");
+    EXPECT_TRUE(writer->WriteString(line).ok());
+    expected += line;
+  }
+  EXPECT_TRUE(writer->Close().ok());
+  std::string contents;
+  EXPECT_TRUE(file::GetContents(file_name, &contents).ok());
+  EXPECT_EQ(contents, expected);
+}
+
+TEST(FileUtilsTest, FlushesOnDestruction) {
+  const std::string file_name = TempFile("destruction");
+  file::OpenOrDie(file_name, /*fail_if_file_exists=*/false)
+      ->WriteString("a,b\n")
+      .IgnoreError();
+  std::string contents;
+  EXPECT_TRUE(file::GetContents(file_name, &contents).ok());
+  EXPECT_EQ(contents, "a,b\n");
+}
+
+TEST(FileUtilsTest, FlushesPartialBuffers) {
+  const std::string file_name = TempFile("flush");
+  auto writer = file::OpenOrDie(file_name, /*fail_if_file_exists=*/false);
+  std::string contents;
+  for (const std::string& expected : {"a,b\n", "a,b\nc,d\n"}) {
+    EXPECT_TRUE(writer->WriteString(expected.substr(contents.size())).ok());
+    EXPECT_TRUE(writer->Flush().ok());
+    // Flush does not wait for the write, so wait for the file to catch up.
+    const absl::Time deadline = absl::Now() + absl::Seconds(30);
+    while (absl::Now() < deadline &&
+           (!file::GetContents(file_name, &contents).ok() ||
+            contents != expected)) {
+      absl::SleepFor(absl::Milliseconds(1));
+    }
+    EXPECT_EQ(contents, expected);
+  }
+  EXPECT_TRUE(writer->Close().ok());
+  EXPECT_FALSE(writer->Flush().ok());
+}
+
+TEST(FileUtilsTest, DoesNotWaitOnSlowFile) {
+  // Nothing reads the pipe until the writes below are done, so the background
+  // thread blocks once the pipe is full.
+  const std::string file_name = TempFile("pipe");
+  ASSERT_EQ(mkfifo(file_name.c_str(), 0600), 0);
+  const int reader = open(file_name.c_str(), O_RDONLY | O_NONBLOCK);
+  ASSERT_GE(reader, 0);
+  file::WriterOptions options;
+  options.buffer_size = 1 << 20;
+  options.max_pending_buffers = 2;
+  auto writer =
+      file::OpenOrDie(file_name, /*fail_if_file_exists=*/false, options);
+  absl::Notification written;
+  int64_t read_bytes = 0;
+  bool timed_out = false;
+  std::thread drain([&]() {
+    timed_out = !written.WaitForNotificationWithTimeout(absl::Seconds(30));
+    fcntl(reader, F_SETFL, 0);
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(reader, buffer, sizeof(buffer))) > 0) read_bytes += n;
+  });
+
+  int64_t written_bytes = 0;
+  const std::string block(options.buffer_size, 'a');
+  EXPECT_TRUE(writer->WriteString(block).ok());
+  written_bytes += block.size();
+  for (int step = 0; step < 100; ++step) {
+    const std::string line = absl::StrCat(step, "\n");
+    EXPECT_TRUE(writer->WriteString(line).ok());
+    EXPECT_TRUE(writer->Flush().ok());
+    written_bytes += line.size();
+  }
+  written.Notify();
+
+  EXPECT_TRUE(writer->Close().ok());
+  drain.join();
+  close(reader);
+  EXPECT_FALSE(timed_out);
+  EXPECT_EQ(read_bytes, written_bytes);
+}
+
+TEST(FileUtilsTest, FailsToWriteAfterClose) {
+  auto writer = file::OpenOrDie(TempFile("closed"),
+                                /*fail_if_file_exists=*/false);
+  EXPECT_TRUE(writer->Close().ok());
+  EXPECT_FALSE(writer->WriteString("a").ok());
+  EXPECT_TRUE(writer->Close().ok());
+}
+
+TEST(FileUtilsTest, FailsToWriteUnopenedFile) {
+  auto writer = file::OpenOrDie(TempFile("missing/file"),
+                                /*fail_if_file_exists=*/false);
+  EXPECT_FALSE(writer->WriteString("a").ok());
+  EXPECT_TRUE(writer->Close().ok());
+}
+
+}  // namespace
+}  // namespace abesim
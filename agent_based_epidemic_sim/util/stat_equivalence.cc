@@ -0,0 +1,336 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/util/stat_equivalence.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/random/bit_gen_ref.h"
+#include "absl/random/distributions.h"
+#include "absl/strings/str_cat.h"
+#include "agent_based_epidemic_sim/core/aggregated_transmission_model.h"
+#include "agent_based_epidemic_sim/core/constants.h"
+#include "agent_based_epidemic_sim/core/duration_specified_visit_generator.h"
+#include "agent_based_epidemic_sim/core/location_discrete_event_simulator.h"
+#include "agent_based_epidemic_sim/core/micro_exposure_generator_builder.h"
+#include "agent_based_epidemic_sim/core/observer.h"
+#include "agent_based_epidemic_sim/core/pandemic.pb.h"
+#include "agent_based_epidemic_sim/core/parse_text_proto.h"
+#include "agent_based_epidemic_sim/core/ptts_transition_model.h"
+#include "agent_based_epidemic_sim/core/random.h"
+#include "agent_based_epidemic_sim/core/risk_score.h"
+#include "agent_based_epidemic_sim/core/seir_agent.h"
+#include "agent_based_epidemic_sim/port/logging.h"
+
+namespace abesim {
+namespace {
+
+// Returns the probability that the Kolmogorov distribution exceeds lambda.
+double KolmogorovSurvival(const double lambda) {
+  const double a = -2 * lambda * lambda;
+  double sign = 2;
+  double sum = 0;
+  double previous_term = 0;
+  for (int j = 1; j <= 100; ++j) {
+    const double term = sign * std::exp(a * j * j);
+    sum += term;
+    if (std::abs(term) <= 1e-3 * previous_term ||
+        std::abs(term) <= 1e-8 * sum) {
+      return std::clamp(sum, 0.0, 1.0);
+    }
+    sign = -sign;
+    previous_term = std::abs(term);
+  }
+  // The series only fails to converge for lambda near 0.
+  return 1;
+}
+
+// Fills in the defaults of the unset fields of options.
+SyntheticPopulationOptions WithDefaults(SyntheticPopulationOptions options) {
+  if (options.transition_model.state_transition_diagram().empty()) {
+    options.transition_model = ParseTextProtoOrDie<PTTSTransitionModelProto>(R"(
+      state_transition_diagram {
+        health_state: EXPOSED
+        transition_probability {
+          health_state: INFECTIOUS
+          transition_probability: 1
+          mean_days_to_transition: 3
+          sd_days_to_transition: 1
+        }
+      }
+      state_transition_diagram {
+        health_state: INFECTIOUS
+        transition_probability {
+          health_state: RECOVERED
+          transition_probability: 1
+          mean_days_to_transition: 10
+          sd_days_to_transition: 3
+        }
+      }
+    )");
+  }
+  if (options.make_location == nullptr) {
+    options.make_location = [](const int64 uuid) {
+      return absl::make_unique<LocationDiscreteEventSimulator>(
+          uuid,
+          MicroExposureGeneratorBuilder(kNonParametricTraceDistribution)
+              .Build());
+    };
+  }
+  return options;
+}
+
+// Records the outcomes of one step of one run.
+class OutcomeObserver : public AgentInfectionObserver {
+ public:
+  explicit OutcomeObserver(const EquivalenceOptions& options)
+      : options_(options),
+        contact_duration_histogram_(options.num_contact_duration_buckets) {}
+
+  void Observe(const Agent& agent,
+               absl::Span<const InfectionOutcome> outcomes) override {
+    if (agent.CurrentHealthState() != HealthState::SUSCEPTIBLE) ++num_infected_;
+    num_exposures_ += outcomes.size();
+    for (const InfectionOutcome& outcome : outcomes) {
+      const int bucket = std::min<double>(
+          absl::FDivDuration(outcome.exposure.duration,
+                             options_.contact_duration_bucket),
+          contact_duration_histogram_.size() - 1);
+      ++contact_duration_histogram_[bucket];
+    }
+  }
+
+ private:
+  friend class OutcomeObserverFactory;
+  const EquivalenceOptions& options_;
+  int64 num_infected_ = 0;
+  int64 num_exposures_ = 0;
+  std::vector<int64> contact_duration_histogram_;
+};
+
+// Adds the outcomes of each step of one run to samples.
+class OutcomeObserverFactory : public ObserverFactory<OutcomeObserver> {
+ public:
+  OutcomeObserverFactory(const EquivalenceOptions& options,
+                         EngineSamples* samples)
+      : options_(options),
+        samples_(samples),
+        contact_duration_histogram_(options.num_contact_duration_buckets) {}
+
+  std::unique_ptr<OutcomeObserver> MakeObserver(
+      const Timestep& timestep) const override {
+    return absl::make_unique<OutcomeObserver>(options_);
+  }
+
+  void Aggregate(const Timestep& timestep,
+                 absl::Span<std::unique_ptr<OutcomeObserver> const> observers)
+      override {
+    int64 num_infected = 0;
+    for (const auto& observer : observers) {
+      num_infected += observer->num_infected_;
+      num_exposures_ += observer->num_exposures_;
+      for (int i = 0; i < observer->contact_duration_histogram_.size(); ++i) {
+        contact_duration_histogram_[i] +=
+            observer->contact_duration_histogram_[i];
+      }
+    }
+    CHECK_LT(step_, samples_->epidemic_curves.size());
+    samples_->epidemic_curves[step_++].push_back(num_infected);
+  }
+
+  // Adds the fraction of the run's exposures in each duration bucket to
+  // samples, once the run is over.
+  void AddContactDurationFractions() const {
+    if (num_exposures_ == 0) return;
+    for (int i = 0; i < contact_duration_histogram_.size(); ++i) {
+      samples_->contact_duration_fractions[i].push_back(
+          static_cast<double>(contact_duration_histogram_[i]) /
+          num_exposures_);
+    }
+  }
+
+  int64 num_exposures() const { return num_exposures_; }
+
+ private:
+  const EquivalenceOptions& options_;
+  EngineSamples* const samples_;
+  int step_ = 0;
+  int64 num_exposures_ = 0;
+  std::vector<int64> contact_duration_histogram_;
+};
+
+}  // namespace
+
+double KolmogorovSmirnovPValue(absl::Span<const double> a,
+                               absl::Span<const double> b) {
+  if (a.empty() || b.empty()) return 1;
+  std::vector<double> sorted_a(a.begin(), a.end());
+  std::vector<double> sorted_b(b.begin(), b.end());
+  std::sort(sorted_a.begin(), sorted_a.end());
+  std::sort(sorted_b.begin(), sorted_b.end());
+  const double n = sorted_a.size();
+  const double m = sorted_b.size();
+  // The largest difference between the empirical distribution functions,
+  // which only change at sample values.  Tied values are passed together.
+  double statistic = 0;
+  for (int i = 0, j = 0; i < n && j < m;) {
+    const double x = std::min(sorted_a[i], sorted_b[j]);
+    while (i < n && sorted_a[i] <= x) ++i;
+    while (j < m && sorted_b[j] <= x) ++j;
+    statistic = std::max(statistic, std::abs(i / n - j / m));
+  }
+  const double effective_n = std::sqrt(n * m / (n + m));
+  return KolmogorovSurvival((effective_n + 0.12 + 0.11 / effective_n) *
+                            statistic);
+}
+
+SyntheticPopulation::SyntheticPopulation(SyntheticPopulationOptions options)
+    : options_(WithDefaults(std::move(options))),
+      transmission_model_(absl::make_unique<AggregatedTransmissionModel>(
+          options_.transmissibility)) {
+  CHECK_GT(options_.num_households, 0);
+  CHECK_GT(options_.household_size, 0);
+  CHECK_GT(options_.num_businesses, 0);
+  const int num_agents = options_.num_households * options_.household_size;
+  // Agents spend a random part of the day at work between two stays at home.
+  auto sample_duration = [](const float adjustment) {
+    absl::BitGenRef gen = GetBitGen();
+    return adjustment * absl::Uniform<float>(gen, 0.5f, 1.5f);
+  };
+  for (int i = 0; i < num_agents; ++i) {
+    const int64 household_uuid = num_agents + i / options_.household_size;
+    const int64 business_uuid =
+        num_agents + options_.num_households + i % options_.num_businesses;
+    visit_generators_.push_back(
+        absl::make_unique<DurationSpecifiedVisitGenerator>(
+            std::vector<LocationDuration>{{household_uuid, sample_duration},
+                                          {business_uuid, sample_duration},
+                                          {household_uuid, sample_duration}}));
+  }
+}
+
+std::vector<std::unique_ptr<Agent>> SyntheticPopulation::MakeAgents() const {
+  std::vector<std::unique_ptr<Agent>> agents;
+  agents.reserve(visit_generators_.size());
+  for (int i = 0; i < visit_generators_.size(); ++i) {
+    auto transition_model =
+        PTTSTransitionModel::CreateFromProto(options_.transition_model);
+    if (i < options_.num_initially_infectious) {
+      agents.push_back(SEIRAgent::Create(
+          i, {.time = options_.start_time,
+              .health_state = HealthState::INFECTIOUS},
+          transmission_model_.get(), SEIRAgent::default_infectivity_model(),
+          std::move(transition_model), *visit_generators_[i],
+          NewNullRiskScore()));
+    } else {
+      agents.push_back(SEIRAgent::CreateSusceptible(
+          i, transmission_model_.get(), SEIRAgent::default_infectivity_model(),
+          std::move(transition_model), *visit_generators_[i],
+          NewNullRiskScore()));
+    }
+  }
+  return agents;
+}
+
+std::vector<std::unique_ptr<Location>> SyntheticPopulation::MakeLocations()
+    const {
+  const int64 first_uuid = visit_generators_.size();
+  const int num_locations = options_.num_households + options_.num_businesses;
+  std::vector<std::unique_ptr<Location>> locations;
+  locations.reserve(num_locations);
+  for (int i = 0; i < num_locations; ++i) {
+    locations.push_back(options_.make_location(first_uuid + i));
+  }
+  return locations;
+}
+
+EngineSamples SampleEngine(const SimulationFactory& factory,
+                           const EquivalenceOptions& options) {
+  EngineSamples samples;
+  samples.epidemic_curves.resize(options.num_steps);
+  samples.contact_duration_fractions.resize(
+      options.num_contact_duration_buckets);
+  for (int run = 0; run < options.num_runs; ++run) {
+    OutcomeObserverFactory observer_factory(options, &samples);
+    std::unique_ptr<Simulation> simulation = factory();
+    simulation->AddObserverFactory(&observer_factory);
+    simulation->Step(options.num_steps, options.step_duration);
+    simulation->RemoveObserverFactory(&observer_factory);
+    samples.exposure_counts.push_back(observer_factory.num_exposures());
+    observer_factory.AddContactDurationFractions();
+  }
+  return samples;
+}
+
+absl::Status CheckStatisticalEquivalence(const EngineSamples& a,
+                                         const EngineSamples& b,
+                                         const EquivalenceOptions& options) {
+  if (a.epidemic_curves.size() != options.num_steps ||
+      b.epidemic_curves.size() != options.num_steps) {
+    return absl::InvalidArgumentError(
+        "Samples do not have an epidemic curve for each step.");
+  }
+  if (a.contact_duration_fractions.size() !=
+          options.num_contact_duration_buckets ||
+      b.contact_duration_fractions.size() !=
+          options.num_contact_duration_buckets) {
+    return absl::InvalidArgumentError(
+        "Samples do not have contact durations for each bucket.");
+  }
+  // Bonferroni correction for the curve at each step, the exposure counts,
+  // and each contact duration bucket.
+  const double significance =
+      options.significance /
+      (options.num_steps + 1 + options.num_contact_duration_buckets);
+  for (int step = 0; step < options.num_steps; ++step) {
+    const double p_value = KolmogorovSmirnovPValue(a.epidemic_curves[step],
+                                                   b.epidemic_curves[step]);
+    if (p_value < significance) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Epidemic curves differ at step ", step,
+                       ": p-value ", p_value, " < ", significance));
+    }
+  }
+  const double exposures_p_value =
+      KolmogorovSmirnovPValue(a.exposure_counts, b.exposure_counts);
+  if (exposures_p_value < significance) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Exposure counts differ: p-value ", exposures_p_value,
+                     " < ", significance));
+  }
+  for (int bucket = 0; bucket < options.num_contact_duration_buckets;
+       ++bucket) {
+    const double p_value =
+        KolmogorovSmirnovPValue(a.contact_duration_fractions[bucket],
+                                b.contact_duration_fractions[bucket]);
+    if (p_value < significance) {
+      return absl::FailedPreconditionError(
+          absl::StrCat("Contact durations differ in bucket ", bucket,
+                       ": p-value ", p_value, " < ", significance));
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::Status CheckStatisticalEquivalence(const SimulationFactory& a,
+                                         const SimulationFactory& b,
+                                         const EquivalenceOptions& options) {
+  return CheckStatisticalEquivalence(SampleEngine(a, options),
+                                     SampleEngine(b, options), options);
+}
+
+}  // namespace abesim
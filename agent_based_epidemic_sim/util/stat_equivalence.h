@@ -0,0 +1,149 @@
+/*
+ * Copyright 2020 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AGENT_BASED_EPIDEMIC_SIM_UTIL_STAT_EQUIVALENCE_H_
+#define AGENT_BASED_EPIDEMIC_SIM_UTIL_STAT_EQUIVALENCE_H_
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/time/time.h"
+#include "absl/types/span.h"
+#include "agent_based_epidemic_sim/core/agent.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/location.h"
+#include "agent_based_epidemic_sim/core/ptts_transition_model.pb.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/core/transmission_model.h"
+#include "agent_based_epidemic_sim/core/visit_generator.h"
+
+// Tests that two simulation engines, e.g. SerialSimulation and
+// ParallelSimulation, or one location implementation and a faster one, produce
+// the same distribution of outcomes.  Engines draw from GetBitGen(), which is
+// not seeded, and optimizations often change the order of random draws, so
+// runs cannot be compared exactly.  Instead both engines are run many times
+// and two-sample tests check that the samples could come from the same
+// distribution:
+//
+//   SyntheticPopulation population(SyntheticPopulationOptions{});
+//   PANDEMIC_EXPECT_OK(CheckStatisticalEquivalence(
+//       [&population]() {
+//         return SerialSimulation(absl::UnixEpoch(), population.MakeAgents(),
+//                                 population.MakeLocations());
+//       },
+//       [&population]() {
+//         return ParallelSimulation(absl::UnixEpoch(), population.MakeAgents(),
+//                                   population.MakeLocations(),
+//                                   /*num_workers=*/4);
+//       },
+//       EquivalenceOptions{}));
+
+namespace abesim {
+
+// Returns the p-value of the two-sample Kolmogorov-Smirnov test of the
+// hypothesis that a and b are drawn from the same distribution, using the
+// asymptotic distribution of the statistic.  The test is conservative for
+// discrete distributions.  Returns 1 if either sample is empty.
+double KolmogorovSmirnovPValue(absl::Span<const double> a,
+                               absl::Span<const double> b);
+
+struct SyntheticPopulationOptions {
+  int num_households = 50;
+  int household_size = 4;
+  // Every agent also visits one of the businesses each day.
+  int num_businesses = 5;
+  // The first agents become INFECTIOUS at start_time and the rest are
+  // SUSCEPTIBLE.
+  int num_initially_infectious = 5;
+  absl::Time start_time = absl::UnixEpoch();
+  // With the defaults, about a quarter of the agents are infected in 20 days.
+  float transmissibility = 20.0f;
+  // Leaving EXPOSED and INFECTIOUS.  Defaults to an SEIR model with 3 days
+  // EXPOSED and 10 days INFECTIOUS on average.
+  PTTSTransitionModelProto transition_model;
+  // Builds the location with the given uuid.  Defaults to a
+  // LocationDiscreteEventSimulator with micro exposures.
+  std::function<std::unique_ptr<Location>(int64 uuid)> make_location;
+};
+
+// A small synthetic population of households and businesses.  It owns the
+// models its agents share, so it must outlive the simulations built from it.
+class SyntheticPopulation {
+ public:
+  explicit SyntheticPopulation(SyntheticPopulationOptions options);
+
+  // Each call returns new agents and locations in their initial states.
+  std::vector<std::unique_ptr<Agent>> MakeAgents() const;
+  std::vector<std::unique_ptr<Location>> MakeLocations() const;
+
+ private:
+  const SyntheticPopulationOptions options_;
+  const std::unique_ptr<TransmissionModel> transmission_model_;
+  std::vector<std::unique_ptr<VisitGenerator>> visit_generators_;
+};
+
+struct EquivalenceOptions {
+  int num_runs = 100;
+  int num_steps = 20;
+  absl::Duration step_duration = absl::Hours(24);
+  // Contact durations are counted in buckets of this width; the last bucket
+  // also counts all longer contacts.
+  absl::Duration contact_duration_bucket = absl::Minutes(5);
+  int num_contact_duration_buckets = 24;
+  // The probability of rejecting equivalent engines.  It is divided between
+  // the tests that are run.
+  double significance = 0.001;
+};
+
+// The outcomes of running one engine num_runs times.
+struct EngineSamples {
+  // epidemic_curves[step][run] is the number of agents that are no longer
+  // SUSCEPTIBLE at the end of step.
+  std::vector<std::vector<double>> epidemic_curves;
+  // The number of InfectionOutcomes sent to agents in each run.
+  std::vector<double> exposure_counts;
+  // contact_duration_fractions[bucket][run] is the fraction of the exposures
+  // of run whose duration falls in bucket.  Runs without exposures are left
+  // out.
+  std::vector<std::vector<double>> contact_duration_fractions;
+};
+
+// Builds a new simulation whose runs all start from the same initial state.
+using SimulationFactory = std::function<std::unique_ptr<Simulation>()>;
+
+// Runs simulations built by factory options.num_runs times.
+EngineSamples SampleEngine(const SimulationFactory& factory,
+                           const EquivalenceOptions& options);
+
+// Returns an error naming the first outcome whose distribution differs
+// significantly between a and b: the epidemic curve at any step, the exposure
+// counts, or the fraction of contacts in any duration bucket.  Each is compared
+// with a Kolmogorov-Smirnov test over runs, since only runs are independent:
+// the contacts of a run share its visits and the size of its epidemic.
+absl::Status CheckStatisticalEquivalence(const EngineSamples& a,
+                                         const EngineSamples& b,
+                                         const EquivalenceOptions& options);
+
+// Samples both engines and compares them.
+absl::Status CheckStatisticalEquivalence(const SimulationFactory& a,
+                                         const SimulationFactory& b,
+                                         const EquivalenceOptions& options);
+
+}  // namespace abesim
+
+#endif  // AGENT_BASED_EPIDEMIC_SIM_UTIL_STAT_EQUIVALENCE_H_
@@ -0,0 +1,94 @@
+// Copyright 2020 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "agent_based_epidemic_sim/util/stat_equivalence.h"
+
+#include <vector>
+
+#include "absl/time/time.h"
+#include "agent_based_epidemic_sim/core/integral_types.h"
+#include "agent_based_epidemic_sim/core/simulation.h"
+#include "agent_based_epidemic_sim/port/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace abesim {
+namespace {
+
+TEST(StatEquivalenceTest, KolmogorovSmirnovPValue) {
+  const std::vector<double> a = {1, 2, 3, 4};
+  const std::vector<double> b = {5, 6, 7, 8};
+  EXPECT_NEAR(KolmogorovSmirnovPValue(a, b), 0.011066, 1e-6);
+  EXPECT_EQ(KolmogorovSmirnovPValue(a, a), 1);
+  // Ties are passed together.
+  EXPECT_EQ(KolmogorovSmirnovPValue({1, 1, 2, 2}, {1, 2}), 1);
+  EXPECT_EQ(KolmogorovSmirnovPValue(a, {}), 1);
+}
+
+SimulationFactory Serial(const SyntheticPopulation& population) {
+  return [&population]() {
+    return SerialSimulation(absl::UnixEpoch(), population.MakeAgents(),
+                            population.MakeLocations());
+  };
+}
+
+SimulationFactory Parallel(const SyntheticPopulation& population) {
+  return [&population]() {
+    return ParallelSimulation(absl::UnixEpoch(), population.MakeAgents(),
+                              population.MakeLocations(), /*num_workers=*/4);
+  };
+}
+
+TEST(StatEquivalenceTest, SamplesEngine) {
+  SyntheticPopulation population((SyntheticPopulationOptions()));
+  EquivalenceOptions options;
+  options.num_runs = 3;
+  options.num_steps = 5;
+  const EngineSamples samples = SampleEngine(Serial(population), options);
+  ASSERT_EQ(samples.epidemic_curves.size(), 5);
+  for (const auto& curve : samples.epidemic_curves) {
+    ASSERT_EQ(curve.size(), 3);
+  }
+  EXPECT_THAT(samples.epidemic_curves[0], testing::Each(testing::Ge(5)));
+  EXPECT_EQ(samples.exposure_counts.size(), 3);
+  ASSERT_EQ(samples.contact_duration_fractions.size(),
+            options.num_contact_duration_buckets);
+  for (int run = 0; run < 3; ++run) {
+    double total = 0;
+    for (const auto& fractions : samples.contact_duration_fractions) {
+      ASSERT_EQ(fractions.size(), 3);
+      total += fractions[run];
+    }
+    EXPECT_NEAR(total, 1, 1e-9);
+  }
+}
+
+TEST(StatEquivalenceTest, SerialAndParallelSimulationsAreEquivalent) {
+  SyntheticPopulation population((SyntheticPopulationOptions()));
+  PANDEMIC_EXPECT_OK(CheckStatisticalEquivalence(
+      Serial(population), Parallel(population), EquivalenceOptions()));
+}
+
+TEST(StatEquivalenceTest, DetectsDifferentTransmissibility) {
+  SyntheticPopulation population((SyntheticPopulationOptions()));
+  SyntheticPopulationOptions slower_options;
+  slower_options.transmissibility /= 2;
+  SyntheticPopulation slower(slower_options);
+  EXPECT_FALSE(CheckStatisticalEquivalence(Serial(population), Serial(slower),
+                                           EquivalenceOptions())
+                   .ok());
+}
+
+}  // namespace
+}  // namespace abesim
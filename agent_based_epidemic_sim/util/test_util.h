@@ -1,6 +1,9 @@
 #ifndef AGENT_BASED_EPIDEMIC_SIM_UTIL_TEST_UTIL_H_
 #define AGENT_BASED_EPIDEMIC_SIM_UTIL_TEST_UTIL_H_
 
+#include <memory>
+#include <vector>
+
 #include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "agent_based_epidemic_sim/core/agent.h"
@@ -40,6 +43,10 @@ class MockTransmissionModel : public TransmissionModel {
   MockTransmissionModel() = default;
   MOCK_METHOD(HealthTransition, GetInfectionOutcome,
               (absl::Span<const Exposure* const> exposures), (override));
+  MOCK_METHOD(int, GetWeightedInfectionOutcome,
+              (int slot, absl::Span<const Exposure* const> exposures,
+               int weight, HealthTransition* infection),
+              (override));
 };
 
 class MockVisitGenerator : public VisitGenerator {
@@ -97,6 +104,13 @@ class MockAgent : public Agent {
               (const Timestep& timestep,
                absl::Span<const InfectionOutcome> infection_outcomes),
               (override));
+  MOCK_METHOD(TransmissionModel*, PendingTransmissionModel, (),
+              (const, override));
+  MOCK_METHOD(void, ProcessResolvedInfectionOutcomes,
+              (const Timestep& timestep,
+               absl::Span<const InfectionOutcome> infection_outcomes,
+               const HealthTransition& transmission_outcome),
+              (override));
   MOCK_METHOD(void, UpdateContactReports,
               (const Timestep& timestep,
                absl::Span<const ContactReport> symptom_reports,
@@ -111,6 +125,9 @@ class MockAgent : public Agent {
   MOCK_METHOD(std::optional<absl::Time>, infection_onset, (),
               (const, override));
   MOCK_METHOD(const ExposureStore*, exposure_store, (), (const, override));
+  MOCK_METHOD(void, TakeSplitAgents,
+              (std::vector<std::unique_ptr<Agent>> * agents), (override));
+  MOCK_METHOD(bool, SeedInfection, (absl::Time time), (override));
 };
 
 class MockLocation : public Location {